@@ -0,0 +1,229 @@
+/**
+ * @file arena.c
+ * @author Daniel Starke
+ * @see arena.h
+ * @date 2026-10-16
+ * @version 2026-10-16
+ * 
+ * DISCLAIMER
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * All contributions are also assumed to be in the Public Domain.
+ * Other contributions are not permitted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "target.h"
+#include "arena.h"
+
+
+/**
+ * @internal
+ * Rounds the given size up to the next multiple of the given (power of two) alignment.
+ */
+#define AR_ALIGN(x, align) (((x) + ((align) - 1)) & ~((size_t)((align) - 1)))
+
+
+/**
+ * @internal
+ * Returns the pointer to the usable memory of the given block.
+ */
+#define AR_DATA(block) (((char *)(block)) + AR_ALIGN(sizeof(tArenaBlock), AR_ALIGNMENT))
+
+
+/**
+ * The function initializes the given arena with the passed minimal block size. No memory is
+ * allocated until the first allocation.
+ * 
+ * @param[out] arena - arena to initialize
+ * @param[in] blockSize - minimal block size in bytes or 0 for AR_BLOCK_SIZE
+ */
+void ar_init(tArena * arena, const size_t blockSize) {
+	if (arena == NULL) return;
+	arena->block = NULL;
+	arena->blockSize = blockSize;
+	arena->last = NULL;
+}
+
+
+/**
+ * @internal
+ * Allocates the given number of bytes with the given alignment from the arena. A new block is
+ * created if the current one has not enough space left. Allocations larger than the block size
+ * get a dedicated block which is inserted after the current one to keep its free space usable.
+ * 
+ * @param[in,out] arena - allocate from this arena
+ * @param[in] size - number of bytes to allocate
+ * @param[in] align - alignment in bytes (power of two)
+ * @return pointer to the allocated memory or NULL on error
+ */
+static void * ar_allocAligned(tArena * arena, const size_t size, const size_t align) {
+	tArenaBlock * block = arena->block;
+	const size_t blockSize = (arena->blockSize > 0) ? arena->blockSize : AR_BLOCK_SIZE;
+	const size_t header = AR_ALIGN(sizeof(tArenaBlock), AR_ALIGNMENT);
+	size_t offset;
+	if (block != NULL) {
+		offset = AR_ALIGN(block->used, align);
+		if (offset <= block->size && size <= (block->size - offset)) {
+			block->used = offset + size;
+			arena->last = AR_DATA(block) + offset;
+			return arena->last;
+		}
+	}
+	if (size > (((size_t)-1) - header)) return NULL;
+	if (size > (blockSize / 4) && block != NULL) {
+		/* dedicated block */
+		tArenaBlock * item = (tArenaBlock *)malloc(header + size);
+		if (item == NULL) return NULL;
+		item->size = size;
+		item->used = size;
+		item->next = block->next;
+		block->next = item;
+		return AR_DATA(item);
+	}
+	block = (tArenaBlock *)malloc(header + PCF_MAX(size, blockSize));
+	if (block == NULL) return NULL;
+	block->size = PCF_MAX(size, blockSize);
+	block->used = size;
+	block->next = arena->block;
+	arena->block = block;
+	arena->last = AR_DATA(block);
+	return arena->last;
+}
+
+
+/**
+ * The function allocates the given number of bytes from the arena. The returned memory is aligned
+ * to AR_ALIGNMENT and is released with ar_reset() or ar_free().
+ * 
+ * @param[in,out] arena - allocate from this arena
+ * @param[in] size - number of bytes to allocate
+ * @return pointer to the allocated memory or NULL on error
+ */
+void * ar_alloc(tArena * arena, const size_t size) {
+	if (arena == NULL) return NULL;
+	return ar_allocAligned(arena, size, AR_ALIGNMENT);
+}
+
+
+/**
+ * The function allocates a zero initialized array from the arena.
+ * 
+ * @param[in,out] arena - allocate from this arena
+ * @param[in] count - number of elements
+ * @param[in] size - size of a single element in bytes
+ * @return pointer to the allocated memory or NULL on error
+ */
+void * ar_calloc(tArena * arena, const size_t count, const size_t size) {
+	if (arena == NULL || (size > 0 && count > (((size_t)-1) / size))) return NULL;
+	void * res = ar_allocAligned(arena, count * size, AR_ALIGNMENT);
+	if (res != NULL) memset(res, 0, count * size);
+	return res;
+}
+
+
+/**
+ * The function resizes the given allocation. The last allocation of the current block is grown in
+ * place if possible. Otherwise, new memory is allocated and the content is copied. The old memory
+ * is not reused until the arena is reset.
+ * 
+ * @param[in,out] arena - allocate from this arena
+ * @param[in] ptr - previous allocation from this arena or NULL
+ * @param[in] oldSize - size of the previous allocation in bytes
+ * @param[in] newSize - requested size in bytes
+ * @return pointer to the resized memory or NULL on error (ptr remains valid)
+ */
+void * ar_realloc(tArena * arena, void * ptr, const size_t oldSize, const size_t newSize) {
+	if (arena == NULL) return NULL;
+	if (ptr == NULL) return ar_allocAligned(arena, newSize, AR_ALIGNMENT);
+	if (ptr == arena->last && arena->block != NULL) {
+		tArenaBlock * block = arena->block;
+		const size_t offset = (size_t)(((char *)ptr) - AR_DATA(block));
+		if (newSize <= (block->size - offset)) {
+			block->used = offset + newSize;
+			return ptr;
+		}
+	}
+	void * res = ar_allocAligned(arena, newSize, AR_ALIGNMENT);
+	if (res != NULL) memcpy(res, ptr, PCF_MIN(oldSize, newSize));
+	return res;
+}
+
+
+/**
+ * The function duplicates the given string within the arena.
+ * 
+ * @param[in,out] arena - allocate from this arena
+ * @param[in] str - null-terminated string to duplicate
+ * @return duplicated string or NULL on error
+ */
+char * ar_strdup(tArena * arena, const char * str) {
+	if (str == NULL) return NULL;
+	return ar_strndup(arena, str, strlen(str));
+}
+
+
+/**
+ * The function duplicates up to n characters of the given string within the arena. The result is
+ * always null-terminated.
+ * 
+ * @param[in,out] arena - allocate from this arena
+ * @param[in] str - string to duplicate
+ * @param[in] n - maximum number of characters to copy
+ * @return duplicated string or NULL on error
+ */
+char * ar_strndup(tArena * arena, const char * str, const size_t n) {
+	if (arena == NULL || str == NULL) return NULL;
+	size_t len = 0;
+	while (len < n && str[len] != 0) len++;
+	char * res = (char *)ar_allocAligned(arena, len + 1, 1);
+	if (res == NULL) return NULL;
+	memcpy(res, str, len);
+	res[len] = 0;
+	return res;
+}
+
+
+/**
+ * The function releases all allocations of the arena at once. The current block is kept for
+ * further allocations and all other blocks are freed.
+ * 
+ * @param[in,out] arena - arena to reset
+ */
+void ar_reset(tArena * arena) {
+	if (arena == NULL || arena->block == NULL) return;
+	tArenaBlock * block = arena->block->next;
+	while (block != NULL) {
+		tArenaBlock * next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->block->next = NULL;
+	arena->block->used = 0;
+	arena->last = NULL;
+}
+
+
+/**
+ * The function frees all memory of the arena. The arena can be used again afterwards.
+ * 
+ * @param[in,out] arena - arena to free
+ */
+void ar_free(tArena * arena) {
+	if (arena == NULL) return;
+	tArenaBlock * block = arena->block;
+	while (block != NULL) {
+		tArenaBlock * next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->block = NULL;
+	arena->last = NULL;
+}
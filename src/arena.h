@@ -0,0 +1,77 @@
+/**
+ * @file arena.h
+ * @author Daniel Starke
+ * @see arena.c
+ * @date 2026-10-16
+ * @version 2026-10-16
+ * 
+ * DISCLAIMER
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * All contributions are also assumed to be in the Public Domain.
+ * Other contributions are not permitted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __LIBPCF_ARENA_H__
+#define __LIBPCF_ARENA_H__
+
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Default arena block size in bytes. */
+#define AR_BLOCK_SIZE 0x4000
+
+
+/** Alignment of memory returned by ar_alloc() in bytes. */
+#define AR_ALIGNMENT 16
+
+
+/**
+ * The defined structure is for internal usage only.
+ * It defines a single memory block of an arena. The usable memory follows the aligned header.
+ */
+typedef struct tArenaBlock {
+	struct tArenaBlock * next; /**< next (older) block */
+	size_t size; /**< usable size in bytes */
+	size_t used; /**< used size in bytes */
+} tArenaBlock;
+
+
+/**
+ * Bump allocator context. All allocations are released at once with ar_reset() or ar_free().
+ * A zero initialized context is valid and uses AR_BLOCK_SIZE.
+ */
+typedef struct tArena {
+	tArenaBlock * block; /**< current block */
+	size_t blockSize; /**< minimal block size in bytes or 0 for AR_BLOCK_SIZE */
+	void * last; /**< last allocation within the current block (can be grown in place) */
+} tArena;
+
+
+void   ar_init(tArena * arena, const size_t blockSize);
+void * ar_alloc(tArena * arena, const size_t size);
+void * ar_calloc(tArena * arena, const size_t count, const size_t size);
+void * ar_realloc(tArena * arena, void * ptr, const size_t oldSize, const size_t newSize);
+char * ar_strdup(tArena * arena, const char * str);
+char * ar_strndup(tArena * arena, const char * str, const size_t n);
+void   ar_reset(tArena * arena);
+void   ar_free(tArena * arena);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* __LIBPCF_ARENA_H__ */
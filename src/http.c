@@ -3,7 +3,7 @@
  * @author Daniel Starke
  * @see parser.h
  * @date 2018-07-05
- * @version 2018-08-09
+ * @version 2026-10-16
  * 
  * DISCLAIMER
  * This file has no copyright assigned and is placed in the Public Domain.
@@ -35,6 +35,32 @@
 #endif
 
 
+/**
+ * Internal states of the HTTP parser.
+ */
+typedef enum {
+	HTTP_START,                 /* start of the HTTP message; all other flags are unset */
+	HTTP_WITHIN_METHOD,         /* within the method field of a request line */
+	HTTP_WITHIN_TARGET,         /* within the target field of a request line */
+	HTTP_WITHIN_VERSION,        /* within the version field of a request or status line */
+	HTTP_WITHIN_STATUS,         /* within the status field of a status line */
+	HTTP_WITHIN_REASON,         /* within the reason field of a status line */
+	HTTP_WITHIN_FIELD,          /* within a parameter field name */
+	HTTP_WITHIN_VALUE,          /* within a parameter value */
+	HTTP_WITHIN_CONTENT_LENGTH, /* within the Content-Length parameter value */
+	HTTP_WITHIN_BODY,           /* within the body; the header has been parsed completely */
+	HTTP_WITHIN_CHUNK_SIZE,     /* within the size line of a chunked body */
+	HTTP_WITHIN_CHUNK_EXT,      /* within the chunk extensions of a size line */
+	HTTP_WITHIN_CHUNK_SIZE_LF,  /* expecting the line feed of a size line */
+	HTTP_WITHIN_CHUNK_DATA,     /* within the chunk data */
+	HTTP_WITHIN_CHUNK_DATA_CR,  /* expecting the carriage return after the chunk data */
+	HTTP_WITHIN_CHUNK_DATA_LF,  /* expecting the line feed after the chunk data */
+	HTTP_WITHIN_TRAILER,        /* at the start of a trailer line after the last chunk */
+	HTTP_WITHIN_TRAILER_FIELD,  /* within a trailer field line */
+	HTTP_WITHIN_TRAILER_LF      /* expecting the line feed which ends the chunked body */
+} tHttpStates;
+
+
 /**
  * UTF-8 based HTTP parser. The input HTTP header and body is tokenized and each token is passed to
  * the given callback function. The string tokens passed to the callback point into the HTTP string
@@ -49,26 +75,67 @@
  * @see https://tools.ietf.org/html/rfc7230
  * @see http://www.iana.org/assignments/message-headers/message-headers.xhtml
  * @remarks The input HTTP is not a string but a char buffer with a defined size.
+ * @remarks A chunked body is passed as is, including the chunk framing. Use p_httpResume() to decode it.
  */
 tPHttpReturnType p_http(const char * http, const size_t length, const char ** errorPos, const PHttpTokenVisitor visitor, void * param) {
-	if (http == NULL || visitor == NULL) return PHRT_INVALID_ARGUMENT;
-	typedef enum {
-		HTTP_START,                 /* start of the HTTP message; all other flags are unset */
-		HTTP_WITHIN_METHOD,         /* within the method field of a request line */
-		HTTP_WITHIN_TARGET,         /* within the target field of a request line */
-		HTTP_WITHIN_VERSION,        /* within the version field of a request or status line */
-		HTTP_WITHIN_STATUS,         /* within the status field of a status line */
-		HTTP_WITHIN_REASON,         /* within the reason field of a status line */
-		HTTP_WITHIN_FIELD,          /* within a parameter field name */
-		HTTP_WITHIN_VALUE,          /* within a parameter value */
-		HTTP_WITHIN_CONTENT_LENGTH  /* within the Content-Length parameter value */
-	} tHttpStates;
-	const char * ptr = http;
-	const char * lastNonSpace = NULL;
-	tPToken tokens[3] = { 0 };
-	tHttpStates state = HTTP_START;
-	long contentLength = -1;
+	tPHttpState state;
+	p_httpInit(&state);
+	state.readOnly = 1; /* the input is never modified */
+	return p_httpResume((char *)http, length, &state, errorPos, visitor, param);
+}
+
+
+/**
+ * Initializes the given HTTP parser state for p_httpResume().
+ * 
+ * @param[out] state - parser state to initialize
+ */
+void p_httpInit(tPHttpState * state) {
+	if (state == NULL) return;
+	memset(state, 0, sizeof(*state));
+	state->state = (int)HTTP_START;
+	for (size_t i = 0; i < 3; i++) state->start[i] = (size_t)-1;
+	state->lastNonSpace = (size_t)-1;
+	state->contentLength = -1;
+}
+
+
+/**
+ * Resumable variant of p_http(). The parser continues at the position given by the passed state
+ * and only consumes the bytes which were appended since the last call. The state is updated if
+ * the input ends unexpectedly to continue parsing once more data is available. The input buffer
+ * may be moved between calls as long as the already parsed data remains unchanged. Note that the
+ * tokens passed to the callback function only remain valid until the buffer is moved.
+ * A body with chunked transfer encoding is decoded in-place to pass it as single contiguous token.
+ * The data between the decoded body and the end of the message is undefined in this case. The
+ * length of the complete message is returned in st->offset on success. Any following data, like a
+ * pipelined response, remains unchanged.
+ * 
+ * @param[in,out] http - input HTTP
+ * @param[in] length - length of HTTP in bytes
+ * @param[in,out] st - parser state (see p_httpInit())
+ * @param[out] errorPos - error position (optional)
+ * @param[in] visitor - user defined callback function
+ * @param[in] param - user defined parameter (passed to callback function)
+ * @return see tPHttpReturnType
+ * @see p_http()
+ */
+tPHttpReturnType p_httpResume(char * http, const size_t length, tPHttpState * st, const char ** errorPos, const PHttpTokenVisitor visitor, void * param) {
+	if (http == NULL || st == NULL || visitor == NULL) return PHRT_INVALID_ARGUMENT;
+	const char * ptr = http + st->offset;
+	char * out = http + st->write;
+	const char * lastNonSpace = (st->lastNonSpace != (size_t)-1) ? http + st->lastNonSpace : NULL;
+	tPToken tokens[3];
+	tHttpStates state = (tHttpStates)(st->state);
+	long contentLength = st->contentLength;
+	size_t chunkLength = st->chunkLength;
+	int chunked = st->chunked;
 	tPHttpReturnType error = PHRT_UNEXPECTED_END;
+	size_t n = st->offset;
+	for (size_t i = 0; i < 3; i++) {
+		tokens[i].start = (st->start[i] != (size_t)-1) ? http + st->start[i] : NULL;
+		tokens[i].length = st->length[i];
+	}
 #define VISIT(x) \
 	do { \
 		if (visitor(PHTT_##x, tokens, param) == 0) { \
@@ -77,9 +144,10 @@ tPHttpReturnType p_http(const char * http, const size_t length, const char ** er
 		} \
 	} while (0)
 #define ONERROR(x) do {error = PHRT_##x; goto onError;} while ( 0 )
-	for (size_t n = 0; n < length && *ptr != 0; n++, ptr++) {
+	if (state >= HTTP_WITHIN_BODY) goto onBody;
+	for (; n < length && *ptr != 0; n++, ptr++) {
 #ifdef PCF_P_HTTP_DEBUG
-		const char * stateStr[] = {"START", "METHOD", "TARGET", "VERSION", "STATUS", "REASON", "FIELD", "VALUE", "CONTENT_LENGTH"};
+		const char * stateStr[] = {"START", "METHOD", "TARGET", "VERSION", "STATUS", "REASON", "FIELD", "VALUE", "CONTENT_LENGTH", "BODY", "CHUNK_SIZE", "CHUNK_EXT", "CHUNK_SIZE_LF", "CHUNK_DATA", "CHUNK_DATA_CR", "CHUNK_DATA_LF", "TRAILER", "TRAILER_FIELD", "TRAILER_LF"};
 		fprintf(stderr, "char =");
 		if (isprint(*ptr) != 0) {
 			fprintf(stderr, " '%c'", *ptr);
@@ -94,6 +162,7 @@ tPHttpReturnType p_http(const char * http, const size_t length, const char ** er
 		fflush(stderr);
 #endif /* PCF_P_HTTP_DEBUG */
 		if (isspace(*ptr) == 0 && *ptr < 0x20) ONERROR(UNEXPECTED_CHARACTER); /* this excludes also negative values */
+		if (*ptr == '\r' && (n + 1) >= length) break; /* wait for the following line feed */
 		switch (state) {
 		case HTTP_START:
 			if (p_isHttpTChar(*ptr) != 0) {
@@ -220,26 +289,20 @@ tPHttpReturnType p_http(const char * http, const size_t length, const char ** er
 				tokens[1].length = 0;
 			} else if (tokens[0].length == 0 && *ptr == '\r' && (n + 1) < length && ptr[1] == '\n') {
 				/* start of body */
-				if (contentLength >= 0) {
+				if (contentLength >= 0 && chunked == 0) {
+					/* Transfer-Encoding overrides Content-Length (RFC 7230 section 3.3.3) */
 					tokens[0].start = http;
 					tokens[0].length = (size_t)contentLength + n + 2;
 					VISIT(EXPECTED);
 				}
-				tokens[0].start = ptr + 2;
-				tokens[0].length = (size_t)(length - (n + 2));
-				if (contentLength > 0) {
-					if (tokens[0].length < (size_t)contentLength) {
-						if (errorPos != NULL) *errorPos = tokens[0].start + tokens[0].length;
-						return PHRT_UNEXPECTED_END;
-					}
-					tokens[0].length = (size_t)contentLength;
-					/* body complete */
-					VISIT(BODY);
-				} else if (tokens[0].length > 0) {
-					/* body complete */
-					VISIT(BODY);
-				}
-				return PHRT_SUCCESS;
+				ptr += 2;
+				n += 2;
+				tokens[0].start = ptr;
+				tokens[1].start = NULL;
+				tokens[1].length = 0;
+				out = http + n;
+				state = (chunked != 0) ? HTTP_WITHIN_CHUNK_SIZE : HTTP_WITHIN_BODY;
+				goto onBody;
 			} else {
 				ONERROR(UNEXPECTED_CHARACTER);
 			}
@@ -256,6 +319,7 @@ onParameterSetComplete:
 				/* parameter set complete */
 				state = HTTP_WITHIN_FIELD;
 				tokens[1].length = (size_t)(lastNonSpace - tokens[1].start);
+				if (p_cmpTokenI(tokens, "Transfer-Encoding") == 0) chunked = p_isHttpChunked(tokens + 1);
 				VISIT(PARAMETER);
 				tokens[0].start = ptr + 2;
 				tokens[0].length = 0;
@@ -303,11 +367,174 @@ onParameterSetComplete:
 				}
 			}
 			break;
+		default:
+			/* body states are handled outside of the header parsing loop */
+			break;
+		}
+	}
+onIncomplete:
+	/* store state to resume once more data is available */
+	st->state = (int)state;
+	st->offset = n;
+	for (size_t i = 0; i < 3; i++) {
+		st->start[i] = (tokens[i].start != NULL) ? (size_t)(tokens[i].start - http) : (size_t)-1;
+		st->length[i] = tokens[i].length;
+	}
+	st->lastNonSpace = (lastNonSpace != NULL) ? (size_t)(lastNonSpace - http) : (size_t)-1;
+	st->contentLength = contentLength;
+	st->chunkLength = chunkLength;
+	st->chunked = chunked;
+	st->write = (size_t)(out - http);
+	goto onError;
+onBody:
+	if (state != HTTP_WITHIN_BODY) goto onChunk;
+	tokens[0].length = (size_t)(length - (size_t)(tokens[0].start - http));
+	if (contentLength > 0) {
+		if (tokens[0].length < (size_t)contentLength) {
+			st->state = (int)state;
+			st->start[0] = (size_t)(tokens[0].start - http);
+			st->contentLength = contentLength;
+			if (errorPos != NULL) *errorPos = tokens[0].start + tokens[0].length;
+			return PHRT_UNEXPECTED_END;
+		}
+		tokens[0].length = (size_t)contentLength;
+		/* body complete */
+		VISIT(BODY);
+	} else if (contentLength < 0 && tokens[0].length > 0) {
+		/* body complete */
+		VISIT(BODY);
+	}
+	/* any data following the message belongs to the next one */
+	st->offset = (size_t)(tokens[0].start - http) + ((contentLength >= 0) ? (size_t)contentLength : tokens[0].length);
+	return PHRT_SUCCESS;
+onChunk:
+	/* decode chunked body; tokens[0].start points to the body start, out to the decoded end */
+	for (; n < length; n++, ptr++) {
+		switch (state) {
+		case HTTP_WITHIN_CHUNK_SIZE:
+			if (isxdigit(*ptr) != 0) {
+				if (chunkLength > (((size_t)-1) >> 4)) ONERROR(INVALID_CHUNK); /* number overflow */
+				chunkLength = (chunkLength << 4) | (size_t)((isdigit(*ptr) != 0) ? (*ptr - '0') : (tolower(*ptr) - 'a' + 10));
+				tokens[1].start = ptr;
+			} else if (tokens[1].start == NULL) {
+				ONERROR(INVALID_CHUNK);
+			} else if (*ptr == '\r') {
+				state = HTTP_WITHIN_CHUNK_SIZE_LF;
+			} else if (*ptr == ';' || isblank(*ptr) != 0) {
+				state = HTTP_WITHIN_CHUNK_EXT;
+			} else {
+				ONERROR(INVALID_CHUNK);
+			}
+			break;
+		case HTTP_WITHIN_CHUNK_EXT:
+			/* chunk extensions are ignored */
+			if (*ptr == '\r') {
+				state = HTTP_WITHIN_CHUNK_SIZE_LF;
+			} else if (*ptr == '\n') {
+				ONERROR(UNEXPECTED_CHARACTER);
+			}
+			break;
+		case HTTP_WITHIN_CHUNK_SIZE_LF:
+			if (*ptr != '\n') ONERROR(UNEXPECTED_CHARACTER);
+			tokens[1].start = NULL;
+			state = (chunkLength > 0) ? HTTP_WITHIN_CHUNK_DATA : HTTP_WITHIN_TRAILER;
+			break;
+		case HTTP_WITHIN_CHUNK_DATA:
+			{
+				/* move the available chunk data next to the already decoded data */
+				size_t avail = length - n;
+				if (avail > chunkLength) avail = chunkLength;
+				if (st->readOnly == 0 && out != ptr) memmove(out, ptr, avail);
+				out += avail;
+				chunkLength -= avail;
+				ptr += avail - 1;
+				n += avail - 1;
+				if (chunkLength == 0) state = HTTP_WITHIN_CHUNK_DATA_CR;
+			}
+			break;
+		case HTTP_WITHIN_CHUNK_DATA_CR:
+			if (*ptr != '\r') ONERROR(INVALID_CHUNK);
+			state = HTTP_WITHIN_CHUNK_DATA_LF;
+			break;
+		case HTTP_WITHIN_CHUNK_DATA_LF:
+			if (*ptr != '\n') ONERROR(INVALID_CHUNK);
+			state = HTTP_WITHIN_CHUNK_SIZE;
+			break;
+		case HTTP_WITHIN_TRAILER:
+			/* trailer fields are ignored */
+			state = (*ptr == '\r') ? HTTP_WITHIN_TRAILER_LF : HTTP_WITHIN_TRAILER_FIELD;
+			break;
+		case HTTP_WITHIN_TRAILER_FIELD:
+			if (*ptr == '\n') state = HTTP_WITHIN_TRAILER;
+			break;
+		case HTTP_WITHIN_TRAILER_LF:
+			if (*ptr != '\n') ONERROR(UNEXPECTED_CHARACTER);
+			/* body complete */
+			if (st->readOnly != 0) {
+				tokens[0].length = (size_t)(ptr + 1 - tokens[0].start);
+			} else {
+				tokens[0].length = (size_t)(out - tokens[0].start);
+			}
+			if (tokens[0].length > 0) VISIT(BODY);
+			st->offset = n + 1;
+			return PHRT_SUCCESS;
+		default:
+			ONERROR(INVALID_ARGUMENT);
+			break;
 		}
 	}
+	goto onIncomplete;
 #undef VISIT
 #undef ONERROR
 onError:
 	if (errorPos != NULL) *errorPos = ptr;
 	return error;
 }
+
+
+/**
+ * Passes the part of the body which was received so far to the given callback function and removes
+ * it from the input of p_httpResume(). This allows processing large messages piecewise with an
+ * input buffer of constant size. Call it after p_httpResume() returned PHRT_UNEXPECTED_END. The
+ * remaining part of the body is passed by p_httpResume() once the message is complete. Nothing is
+ * done while the header is incomplete or if the chunked body is not decoded in-place.
+ * 
+ * @param[in,out] http - input HTTP
+ * @param[in] length - length of HTTP in bytes
+ * @param[in,out] st - parser state (see p_httpInit())
+ * @param[in] visitor - user defined callback function (called with PHTT_BODY)
+ * @param[in] param - user defined parameter (passed to callback function)
+ * @return new length of the input HTTP in bytes or (size_t)-1 if the callback function aborted
+ * @see p_httpResume()
+ */
+size_t p_httpDrain(char * http, const size_t length, tPHttpState * st, const PHttpTokenVisitor visitor, void * param) {
+	if (http == NULL || st == NULL || visitor == NULL || st->readOnly != 0) return length;
+	if (st->state < (int)HTTP_WITHIN_BODY || st->start[0] == (size_t)-1) return length;
+	const size_t start = st->start[0];
+	size_t end;
+	tPToken token;
+	if (st->state == (int)HTTP_WITHIN_BODY) {
+		if (st->contentLength <= 0) return length;
+		end = length;
+		if ((end - start) > (size_t)(st->contentLength)) end = start + (size_t)(st->contentLength);
+	} else {
+		end = st->write;
+	}
+	if (end <= start) return length;
+	token.start = http + start;
+	token.length = end - start;
+	if (visitor(PHTT_BODY, &token, param) == 0) return (size_t)-1;
+	if (st->state == (int)HTTP_WITHIN_BODY) {
+		/* only the remaining content length is expected */
+		st->contentLength -= (long)(token.length);
+		memmove(http + start, http + end, length - end);
+		return length - token.length;
+	}
+	/* keep the input which was not decoded yet */
+	memmove(http + start, http + st->offset, length - st->offset);
+	if (st->start[1] != (size_t)-1) st->start[1] = start;
+	const size_t newLength = start + (length - st->offset);
+	st->offset = start;
+	st->write = start;
+	return newLength;
+}
@@ -3,7 +3,7 @@
  * @author Daniel Starke
  * @see parser.h
  * @date 2018-06-23
- * @version 2018-08-11
+ * @version 2026-10-16
  * 
  * DISCLAIMER
  * This file has no copyright assigned and is placed in the Public Domain.
@@ -28,6 +28,10 @@
 #include "parser.h"
 #include "target.h"
 #include "utf8.h"
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define P_USE_SSE2 1
+#endif
 
 
 /**
@@ -593,6 +597,143 @@ int p_isHttpDelimiter(const int value) {
 }
 
 
+/**
+ * Returns whether the given Transfer-Encoding field value ends with the chunked transfer coding
+ * as defined in https://tools.ietf.org/html/rfc7230#section-3.3.1.
+ * 
+ * @param[in] token - test this field value
+ * @return 1 if true, else 0
+ */
+int p_isHttpChunked(const tPToken * token) {
+	static const char chunked[] = "chunked";
+	const size_t len = sizeof(chunked) - 1;
+	tPToken last;
+	if (token == NULL || token->start == NULL || token->length < len) return 0;
+	last.start = token->start + token->length - len;
+	last.length = len;
+	if (token->length > len && last.start[-1] != ',' && last.start[-1] != ' ' && last.start[-1] != '\t') return 0;
+	return (p_cmpTokenI(&last, chunked) == 0) ? 1 : 0;
+}
+
+
+/**
+ * Returns whether the given value is part of the passed character set.
+ * 
+ * @param[in] value - test this value
+ * @param[in] set - character set
+ * @return 1 if true, else 0
+ * @see p_findEscape()
+ */
+static int p_isInEscapeSet(const unsigned char value, const tPEscapeSet set) {
+	switch (set) {
+	case PES_CSV:        return (value == '"') ? 1 : 0;
+	case PES_JSON:       return (value == '"' || value == '\\' || value == '/' || value < 0x20) ? 1 : 0;
+	case PES_XML:        return p_isXmlNeedEscape(value);
+	case PES_URL:        return (value < 0x20 || p_isUrlNeedEscape(value) != 0) ? 1 : 0;
+	case PES_URL_ESCAPE: return (value == '%' || value < 0x20) ? 1 : 0;
+	}
+	return 0;
+}
+
+
+/**
+ * Returns the number of bytes in the given string up to the null-terminator or length.
+ * 
+ * @param[in] str - string to measure
+ * @param[in] length - maximum length of the input string in bytes or (size_t)-1
+ * @return string length in bytes
+ */
+size_t p_strnlen(const char * str, const size_t length) {
+	if (length == (size_t)-1) return strlen(str);
+	const char * end = (const char *)memchr(str, 0, length);
+	return (end != NULL) ? (size_t)(end - str) : length;
+}
+
+
+/**
+ * Returns the offset of the first character of the given set within the passed string. 16 bytes
+ * are checked at once if SSE2 is available. Null-terminators are not handled specially.
+ * 
+ * @param[in] str - string to search
+ * @param[in] length - length of the input string in bytes
+ * @param[in] set - character set to search for
+ * @return offset of the first found character or length if none was found
+ */
+size_t p_findEscape(const char * str, const size_t length, const tPEscapeSet set) {
+	size_t i = 0;
+	if (str == NULL) return 0;
+#ifdef P_USE_SSE2
+	{
+		const __m128i quot  = _mm_set1_epi8('"');
+		const __m128i ctrl  = _mm_set1_epi8(0x1F);
+		const __m128i bs    = _mm_set1_epi8('\\');
+		const __m128i slash = _mm_set1_epi8('/');
+		const __m128i apos  = _mm_set1_epi8('\'');
+		const __m128i lt    = _mm_set1_epi8('<');
+		const __m128i gt    = _mm_set1_epi8('>');
+		const __m128i amp   = _mm_set1_epi8('&');
+		const __m128i pct   = _mm_set1_epi8('%');
+		const __m128i hyph  = _mm_set1_epi8('-');
+		const __m128i dot   = _mm_set1_epi8('.');
+		const __m128i digit = _mm_set1_epi8('0');
+		const __m128i nine  = _mm_set1_epi8(9);
+		const __m128i lsqb  = _mm_set1_epi8('[');
+		const __m128i rsqb  = _mm_set1_epi8(']');
+		const __m128i high  = _mm_set1_epi8((char)0x7F);
+/* unsigned a <= b per byte */
+#define P_LE(a, b) _mm_cmpeq_epi8(_mm_min_epu8((a), (b)), (a))
+		for (; (i + 16) <= length; i += 16) {
+			const __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+			__m128i m;
+			switch (set) {
+			case PES_CSV:
+				m = _mm_cmpeq_epi8(v, quot);
+				break;
+			case PES_JSON:
+				m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quot), _mm_cmpeq_epi8(v, bs)), _mm_or_si128(_mm_cmpeq_epi8(v, slash), P_LE(v, ctrl)));
+				break;
+			case PES_XML:
+				m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quot), _mm_cmpeq_epi8(v, apos)), _mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)));
+				m = _mm_or_si128(m, _mm_cmpeq_epi8(v, amp));
+				break;
+			case PES_URL:
+				/* candidates: below '0' except '-' and '.', ':' to '@', '[', ']' and non-ASCII */
+				m = _mm_andnot_si128(P_LE(_mm_sub_epi8(v, digit), nine), P_LE(v, _mm_set1_epi8('@')));
+				m = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(v, hyph), _mm_cmpeq_epi8(v, dot)), m);
+				m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, lsqb), _mm_cmpeq_epi8(v, rsqb)));
+				m = _mm_or_si128(m, _mm_xor_si128(P_LE(v, high), _mm_set1_epi8((char)0xFF)));
+				{
+					/* verify candidates as the vector test is not exact */
+					int bits = _mm_movemask_epi8(m);
+					while (bits != 0) {
+						const int bit = __builtin_ctz((unsigned)bits);
+						if (p_isInEscapeSet((unsigned char)(str[i + (size_t)bit]), set) != 0) return i + (size_t)bit;
+						bits &= bits - 1;
+					}
+				}
+				continue;
+			case PES_URL_ESCAPE:
+				m = _mm_or_si128(_mm_cmpeq_epi8(v, pct), P_LE(v, ctrl));
+				break;
+			default:
+				m = _mm_setzero_si128();
+				break;
+			}
+			{
+				const int bits = _mm_movemask_epi8(m);
+				if (bits != 0) return i + (size_t)__builtin_ctz((unsigned)bits);
+			}
+		}
+#undef P_LE
+	}
+#endif /* P_USE_SSE2 */
+	for (; i < length; i++) {
+		if (p_isInEscapeSet((unsigned char)(str[i]), set) != 0) break;
+	}
+	return i;
+}
+
+
 /**
  * The function escapes all needed XML control characters with their escape code.
  * 
@@ -604,39 +745,36 @@ int p_isHttpDelimiter(const int value) {
  */
 char * p_escapeXml(const char * str, const size_t length) {
 	if (str == NULL) return NULL;
-	/* calculate the result string size in bytes */
-	size_t resSize = 1;
-	size_t i = 0;
-	for (const char * in = str; *in != 0 && i < length; in++, i++) {
-		switch (*in) {
-		case '"':  resSize += 6; break;
-		case '\'': resSize += 6; break;
-		case '<':  resSize += 4; break;
-		case '>':  resSize += 4; break;
-		case '&':  resSize += 5; break;
-		default:   resSize++; break;
-		}
-	}
-	if ((i + 1) == resSize) return (char *)str;
-	/* create the result string */
-	char * res = (char *)malloc(sizeof(char) * resSize);
+	const size_t len = p_strnlen(str, length);
+	size_t i = p_findEscape(str, len, PES_XML);
+	if (i >= len) return (char *)str;
+	/* create the result string with enough space for the worst case */
+	char * res = (char *)malloc(sizeof(char) * ((len * 6) + 1));
 	if (res == NULL) return NULL;
 #define CASE_APPEND(a, b) case a: memcpy(out, b, sizeof(b) - 1); out += (size_t)(sizeof(b) - 1); break;
-	i = 0;
-	char * out = res;
-	for (const char * in = str; *in != 0 && i < length; in++, i++) {
-		switch (*in) {
+	memcpy(res, str, i);
+	char * out = res + i;
+	while (i < len) {
+		switch (str[i]) {
 		CASE_APPEND('"',  "&quot;")
 		CASE_APPEND('\'', "&apos;")
 		CASE_APPEND('<',  "&lt;"  )
 		CASE_APPEND('>',  "&gt;"  )
 		CASE_APPEND('&',  "&amp;" )
-		default: *out = *in; out++; break;
+		default: *out = str[i]; out++; break;
 		}
+		i++;
+		/* copy the following run of plain characters at once */
+		const size_t run = p_findEscape(str + i, len - i, PES_XML);
+		memcpy(out, str + i, run);
+		out += run;
+		i += run;
 	}
 	*out = 0;
 #undef CASE_APPEND
-	return res;
+	/* shrink to the actual size */
+	char * shrunk = (char *)realloc(res, (size_t)(out - res) + 1);
+	return (shrunk != NULL) ? shrunk : res;
 }
 
 
@@ -686,112 +824,81 @@ char * p_unescapeXml(const char * str, const size_t length, const tPXmlUnEscMapE
 	const tPXmlUnEscMapEntity * usedMap = (map != NULL) ? map : defMap;
 	const size_t usedMapSize = (map != NULL) ? mapSize : defMapSize;
 	if (str == NULL) return NULL;
-	/* calculate the result string size in bytes (this also validates the input string) */
-	size_t resSize = 1;
-	size_t i = 0;
-	int oldErrno = errno;
-	tPXmlUnEscMapEntity refItem = {0};
-	for (const char * in = str; *in != 0 && i < length; in++, i++) {
-		switch (*in) {
-		case '&':
-			refItem.str = in + 1;
-			break;
-		case ';':
-			if (refItem.str != NULL) {
-				refItem.strSize = (size_t)(in - refItem.str);
-				if (refItem.str[0] == '#') {
-					char * endPtr = NULL;
-					unsigned long cp = 0;
-					errno = 0;
-					if (refItem.strSize > 1 && refItem.str[1] == 'x') {
-						/* Unicode code point in hex */
-						cp = strtoul(refItem.str + 2, &endPtr, 16);
-					} else {
-						/* Unicode code point in decimal */
-						cp = strtoul(refItem.str + 1, &endPtr, 10);
-					}
-					if (errno == ERANGE || *endPtr != ';' || cp == 0) {
-						errno = EINVAL;
-						return NULL; /* number overflow or not a number */
-					}
-					resSize += utf8_codePointeSize((tUChar)cp, UTF8M_REPLACE); /* invalid Unicode code points are replaced */
-				} else {
-					/* named sequence */
-					const tPXmlUnEscMapEntity * item = (const tPXmlUnEscMapEntity *)bs_array(
-						&refItem, usedMap, sizeof(tPXmlUnEscMapEntity), usedMapSize, p_cmpXmlUnEscMapEntities
-					);
-					if (item == NULL) {
-						errno = EINVAL;
-						return NULL; /* unknown escape sequence */
-					}
-					resSize += item->replSize;
-				}
-			} else {
-				resSize++;
+	const size_t len = p_strnlen(str, length);
+	const char * amp = (const char *)memchr(str, '&', len);
+	if (amp == NULL) return (char *)str;
+	/* Numeric and predefined entities never grow. Custom ones may grow up to the maximum given. */
+	size_t resSize = len + 1;
+	if (map != NULL) {
+		size_t growth = 0;
+		for (size_t m = 0; m < usedMapSize; m++) {
+			if (usedMap[m].replSize > (usedMap[m].strSize + 2) && (usedMap[m].replSize - usedMap[m].strSize - 2) > growth) {
+				growth = usedMap[m].replSize - usedMap[m].strSize - 2;
+			}
+		}
+		if (growth > 0) {
+			for (const char * in = amp; in != NULL; in = (const char *)memchr(in + 1, '&', len - (size_t)(in + 1 - str))) {
+				resSize += growth;
 			}
-			refItem.str = NULL;
-			break;
-		default:
-			resSize++;
-			break;
 		}
 	}
-	if (refItem.str != NULL) {
-		errno = EINVAL;
-		return NULL; /* unknown escape sequence */
-	}
-	if ((i + 1) == resSize) return (char *)str;
 	/* create the result string */
 	char * res = (char *)malloc(sizeof(char) * resSize);
 	if (res == NULL) return NULL;
-	i = 0;
+	int oldErrno = errno;
+	tPXmlUnEscMapEntity refItem = {0};
+	const char * in = str;
+	const char * end = str + len;
 	char * out = res;
-	for (const char * in = str; *in != 0 && i < length; in++, i++) {
-		switch (*in) {
-		case '&':
-			refItem.str = in + 1;
-			break;
-		case ';':
-			if (refItem.str != NULL) {
-				refItem.strSize = (size_t)(in - refItem.str);
-				if (refItem.str[0] == '#') {
-					char * endPtr = NULL;
-					unsigned long cp = 0;
-					errno = 0;
-					if (refItem.strSize > 1 && refItem.str[1] == 'x') {
-						/* Unicode code point in hex */
-						cp = strtoul(refItem.str + 2, &endPtr, 16);
-					} else {
-						/* Unicode code point in decimal */
-						cp = strtoul(refItem.str + 1, &endPtr, 10);
-					}
-					/* invalid Unicode code points are replaced */
-					out += utf8_fromCodePoint(out, (size_t)-1, (tUChar)cp, UTF8M_REPLACE);
-				} else {
-					/* named sequence */
-					const tPXmlUnEscMapEntity * item = (const tPXmlUnEscMapEntity *)bs_array(
-						&refItem, usedMap, sizeof(tPXmlUnEscMapEntity), usedMapSize, p_cmpXmlUnEscMapEntities
-					);
-					memcpy(out, item->repl, item->replSize);
-					out += item->replSize;
-				}
+	while (amp != NULL) {
+		/* copy the plain characters in front of the entity at once */
+		memcpy(out, in, (size_t)(amp - in));
+		out += (size_t)(amp - in);
+		const char * semi = (const char *)memchr(amp + 1, ';', (size_t)(end - amp - 1));
+		if (semi == NULL) goto onEinval; /* unknown escape sequence */
+		/* the last ampersand before the semicolon starts the entity */
+		for (const char * next = amp + 1; next < semi; next++) {
+			if (*next == '&') amp = next;
+		}
+		refItem.str = amp + 1;
+		refItem.strSize = (size_t)(semi - refItem.str);
+		if (refItem.str[0] == '#') {
+			char * endPtr = NULL;
+			unsigned long cp = 0;
+			errno = 0;
+			if (refItem.strSize > 1 && refItem.str[1] == 'x') {
+				/* Unicode code point in hex */
+				cp = strtoul(refItem.str + 2, &endPtr, 16);
 			} else {
-				*out = *in;
-				out++;
-			}
-			refItem.str = NULL;
-			break;
-		default:
-			if (refItem.str == NULL) {
-				*out = *in;
-				out++;
+				/* Unicode code point in decimal */
+				cp = strtoul(refItem.str + 1, &endPtr, 10);
 			}
-			break;
+			if (errno == ERANGE || endPtr != semi || cp == 0) goto onEinval; /* number overflow or not a number */
+			/* invalid Unicode code points are replaced */
+			out += utf8_fromCodePoint(out, (size_t)-1, (tUChar)cp, UTF8M_REPLACE);
+		} else {
+			/* named sequence */
+			const tPXmlUnEscMapEntity * item = (const tPXmlUnEscMapEntity *)bs_array(
+				&refItem, usedMap, sizeof(tPXmlUnEscMapEntity), usedMapSize, p_cmpXmlUnEscMapEntities
+			);
+			if (item == NULL) goto onEinval; /* unknown escape sequence */
+			memcpy(out, item->repl, item->replSize);
+			out += item->replSize;
 		}
+		in = semi + 1;
+		amp = (const char *)memchr(in, '&', (size_t)(end - in));
 	}
+	memcpy(out, in, (size_t)(end - in));
+	out += (size_t)(end - in);
 	*out = 0;
 	errno = oldErrno;
-	return res;
+	/* shrink to the actual size */
+	char * shrunk = (char *)realloc(res, (size_t)(out - res) + 1);
+	return (shrunk != NULL) ? shrunk : res;
+onEinval:
+	free(res);
+	errno = EINVAL;
+	return NULL;
 }
 
 
@@ -848,38 +955,40 @@ int p_xmlGetFullName(tPToken * out, const tPToken * parts) {
 char * p_escapeUrl(const char * str, const size_t length) {
 	static const char * hexStr = "0123456789ABCDEF";
 	if (str == NULL) return NULL;
-	/* calculate the result string size in bytes */
-	size_t resSize = 1;
-	size_t i = 0;
-	for (const unsigned char * in = (const unsigned char *)str; *in != 0 && i < length; in++, i++) {
-		if (*in < 0x20) {
-			errno = EINVAL;
-			return NULL;
-		} else if (p_isUrlNeedEscape(*in) != 0) {
-			resSize += 3;
-		} else {
-			resSize++;
-		}
+	const size_t len = p_strnlen(str, length);
+	size_t i = p_findEscape(str, len, PES_URL);
+	if (i >= len) return (char *)str;
+	if ((unsigned char)(str[i]) < 0x20) {
+		errno = EINVAL;
+		return NULL;
 	}
-	if ((i + 1) == resSize) return (char *)str;
-	/* create the result string */
-	char * res = (char *)malloc(sizeof(char) * resSize);
+	/* create the result string with enough space for the worst case */
+	char * res = (char *)malloc(sizeof(char) * ((len * 3) + 1));
 	if (res == NULL) return NULL;
-	i = 0;
-	char * out = res;
-	for (const unsigned char * in = (const unsigned char *)str; *in != 0 && i < length; in++, i++) {
-		if (p_isUrlNeedEscape(*in) != 0) {
-			out[0] = '%';
-			out[1] = hexStr[(*in >> 4) & 0x0F];
-			out[2] = hexStr[*in & 0x0F];
-			out += 3;
-		} else {
-			*out = (char)(*in);
-			out++;
+	memcpy(res, str, i);
+	char * out = res + i;
+	while (i < len) {
+		const unsigned char c = (unsigned char)(str[i]);
+		if (c < 0x20) {
+			free(res);
+			errno = EINVAL;
+			return NULL;
 		}
+		out[0] = '%';
+		out[1] = hexStr[(c >> 4) & 0x0F];
+		out[2] = hexStr[c & 0x0F];
+		out += 3;
+		i++;
+		/* copy the following run of plain characters at once */
+		const size_t run = p_findEscape(str + i, len - i, PES_URL);
+		memcpy(out, str + i, run);
+		out += run;
+		i += run;
 	}
 	*out = 0;
-	return res;
+	/* shrink to the actual size */
+	char * shrunk = (char *)realloc(res, (size_t)(out - res) + 1);
+	return (shrunk != NULL) ? shrunk : res;
 }
 
 
@@ -915,46 +1024,50 @@ int p_escapeUrlVar(char ** var) {
  */
 char * p_unescapeUrl(const char * str, const size_t length) {
 	if (str == NULL) return NULL;
-	/* calculate the result string size in bytes */
-	size_t resSize = 1;
-	size_t i = 0;
-	for (const unsigned char * in = (const unsigned char *)str; *in != 0 && i < length; in++, i++) {
-		if (*in < 0x20) {
-			errno = EINVAL;
-			return NULL;
-		} else if (*in == '%' && (i + 2) < length && isxdigit(in[1]) != 0 && isxdigit(in[2]) != 0) {
-			in += 2;
-			i += 2;
-		}
-		resSize++;
-	}
-	if ((i + 1) == resSize) return (char *)str;
-	/* create the result string */
-	char * res = (char *)malloc(sizeof(char) * resSize);
+	const size_t len = p_strnlen(str, length);
+	size_t i = p_findEscape(str, len, PES_URL_ESCAPE);
+	if (i >= len) return (char *)str;
+	/* the result never exceeds the input string size */
+	char * res = (char *)malloc(sizeof(char) * (len + 1));
 	if (res == NULL) return NULL;
-	i = 0;
-	char * out = res;
-	for (const unsigned char * in = (const unsigned char *)str; *in != 0 && i < length; in++, i++) {
-		if (*in == '%' && (i + 2) < length && isxdigit(in[1]) != 0 && isxdigit(in[2]) != 0) {
+	memcpy(res, str, i);
+	char * out = res + i;
+	while (i < len) {
+		const unsigned char * in = (const unsigned char *)(str + i);
+		if (*in < 0x20) {
+			goto onEinval;
+		} else if ((i + 2) < len && isxdigit(in[1]) != 0 && isxdigit(in[2]) != 0) {
 			const int b1 = toupper(in[1]) - '0';
 			const int b2 = toupper(in[2]) - '0';
 			const int b = (((b1 > 16) ? (b1 - 7) : b1) << 4) | ((b2 > 16) ? (b2 - 7) : b2);
-			if (b < 0x20) {
-				free(res);
-				errno = EINVAL;
-				return NULL;
-			}
+			if (b < 0x20) goto onEinval;
 			*out = (char)b;
-			out++;
-			in += 2;
-			i += 2;
+			i += 3;
 		} else {
+			/* percent sign without valid hex digits */
 			*out = (char)(*in);
-			out++;
+			i++;
 		}
+		out++;
+		/* copy the following run of plain characters at once */
+		const size_t run = p_findEscape(str + i, len - i, PES_URL_ESCAPE);
+		memcpy(out, str + i, run);
+		out += run;
+		i += run;
+	}
+	if ((size_t)(out - res) == len) {
+		/* nothing was decoded */
+		free(res);
+		return (char *)str;
 	}
 	*out = 0;
-	return res;
+	/* shrink to the actual size */
+	char * shrunk = (char *)realloc(res, (size_t)(out - res) + 1);
+	return (shrunk != NULL) ? shrunk : res;
+onEinval:
+	free(res);
+	errno = EINVAL;
+	return NULL;
 }
 
 
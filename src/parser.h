@@ -4,7 +4,7 @@
  * @see parser.c
  * @see sax.c
  * @date 2018-06-23
- * @version 2018-07-30
+ * @version 2026-10-16
  * 
  * DISCLAIMER
  * This file has no copyright assigned and is placed in the Public Domain.
@@ -47,7 +47,7 @@ typedef enum {
 
 
 /**
- * Possible return values generated by p_sax().
+ * Possible return values generated by p_sax() and p_saxResume().
  */
 typedef enum {
 	PSRT_SUCCESS,              /**< input XML was parsed successfully */
@@ -61,7 +61,8 @@ typedef enum {
 	PSRT_EXPECTED_ATTR_NAME,   /**< expected a attribute name or tag end here */
 	PSRT_EXPECTED_ATTR_EQUAL,  /**< expected attribute value assigning equal sign here */
 	PSRT_EXPECTED_ATTR_VALUE,  /**< expected the attribute value here */
-	PSRT_EXPECTED_PI_END       /**< expected the end of the processing instruction here */
+	PSRT_EXPECTED_PI_END,      /**< expected the end of the processing instruction here */
+	PSRT_NO_MEMORY             /**< failed to allocate the carry-over buffer of p_saxResume() or a token exceeds its limit */
 } tPSaxReturnType;
 
 
@@ -114,11 +115,24 @@ typedef enum {
 	PHRT_ABORT,                  /**< callback function aborted the parsing operation */
 	PHRT_INVALID_ARGUMENT,       /**< an invalid argument was passed to p_http() */
 	PHRT_INVALID_CONTENT_LENGTH, /**< the HTTP Content-Length field is invalid */
+	PHRT_INVALID_CHUNK,          /**< the HTTP chunked body framing is invalid */
 	PHRT_UNEXPECTED_CHARACTER,   /**< unexpected character at the error position */
 	PHRT_UNEXPECTED_END          /**< the HTTP request ends unexpected */
 } tPHttpReturnType;
 
 
+/**
+ * Possible character sets searched for by p_findEscape().
+ */
+typedef enum {
+	PES_CSV,       /**< double quotes */
+	PES_JSON,      /**< double quotes, backslash, slash and ASCII control characters */
+	PES_XML,       /**< characters which need to be escaped in XML */
+	PES_URL,       /**< characters which need to be escaped in a URL and ASCII control characters */
+	PES_URL_ESCAPE /**< percent sign and ASCII control characters */
+} tPEscapeSet;
+
+
 /**
  * A single text parser token.
  */
@@ -128,6 +142,46 @@ typedef struct {
 } tPToken;
 
 
+/**
+ * State of the resumable HTTP parser p_httpResume(). Initialize it with p_httpInit().
+ */
+typedef struct {
+	int state;                 /**< internal parser state */
+	int readOnly;              /**< set to pass a chunked body as is instead of decoding it in-place */
+	int chunked;               /**< set if the body uses the chunked transfer coding */
+	size_t offset;             /**< number of input bytes consumed (message length on success) */
+	size_t start[3];           /**< start offsets of the pending tokens or (size_t)-1 if unset */
+	size_t length[3];          /**< lengths of the pending tokens in bytes */
+	size_t lastNonSpace;       /**< offset of the last non-space character or (size_t)-1 if unset */
+	long contentLength;        /**< value of the Content-Length field or -1 if unset */
+	size_t chunkLength;        /**< remaining bytes of the current chunk */
+	size_t write;              /**< end offset of the decoded chunked body */
+} tPHttpState;
+
+
+/**
+ * State of the resumable XML parser p_saxResume(). Initialize it with p_saxInit() and release it
+ * with p_saxFree().
+ */
+typedef struct {
+	int flags;                 /**< internal parser state */
+	size_t level;              /**< current token level */
+	char attrValueSep;         /**< quote character of the pending attribute value */
+	size_t next;               /**< offset of the next character to parse within the pending input */
+	size_t start[3];           /**< start offsets of the pending tokens or (size_t)-1 if unset */
+	size_t length[3];          /**< lengths of the pending tokens in bytes */
+	size_t startTag[2];        /**< start offsets of the pending start tag tokens or (size_t)-1 if unset */
+	size_t startTagLength[2];  /**< lengths of the pending start tag tokens in bytes */
+	size_t lastNonSpace;       /**< offset of the last non-space character or (size_t)-1 if unset */
+	size_t nsSep;              /**< offset of the namespace separator or (size_t)-1 if unset */
+	char * carry;              /**< carry-over buffer with the pending input (allocated) */
+	size_t carryCapacity;      /**< total capacity of carry in bytes */
+	size_t carryLength;        /**< number of bytes in carry */
+	size_t carryOffset;        /**< document offset of the first byte in carry */
+	size_t inputOffset;        /**< document offset of the next input */
+} tPSaxState;
+
+
 /**
  * A text parser position.
  */
@@ -195,6 +249,8 @@ int p_cmpTokens(const tPToken * lhs, const tPToken * rhs);
 int p_cmpTokensI(const tPToken * lhs, const tPToken * rhs);
 char * p_copyToken(const tPToken * token);
 int p_getPos(const char * str, const size_t length, const char * pos, const size_t tabLen, tParserPos * output);
+size_t p_strnlen(const char * str, const size_t length);
+size_t p_findEscape(const char * str, const size_t length, const tPEscapeSet set);
 
 int p_cmpXmlUnEscMapEntities(const void * lhs, const void * rhs);
 int p_isXmlNameChar(const int value);
@@ -207,6 +263,9 @@ char * p_unescapeXml(const char * str, const size_t length, const tPXmlUnEscMapE
 int p_unescapeXmlVar(char ** var, const tPXmlUnEscMapEntity * map, const size_t mapSize);
 int p_xmlGetFullName(tPToken * out, const tPToken * parts);
 tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** errorPos, const PSaxTokenVisitor visitor, void * param);
+void p_saxInit(tPSaxState * state);
+tPSaxReturnType p_saxResume(const char * xml, const size_t length, tPSaxState * st, size_t * errorOffset, const PSaxTokenVisitor visitor, void * param);
+void p_saxFree(tPSaxState * state);
 
 int p_isUrlNeedEscape(const int value);
 char * p_escapeUrl(const char * str, const size_t length);
@@ -218,7 +277,11 @@ tPUrlReturnType p_urlTokens(const char * str, const size_t length, tPToken * out
 
 int p_isHttpTChar(const int value);
 int p_isHttpDelimiter(const int value);
+int p_isHttpChunked(const tPToken * token);
 tPHttpReturnType p_http(const char * http, const size_t length, const char ** errorPos, const PHttpTokenVisitor visitor, void * param);
+void p_httpInit(tPHttpState * state);
+tPHttpReturnType p_httpResume(char * http, const size_t length, tPHttpState * st, const char ** errorPos, const PHttpTokenVisitor visitor, void * param);
+size_t p_httpDrain(char * http, const size_t length, tPHttpState * st, const PHttpTokenVisitor visitor, void * param);
 
 
 #ifdef __cplusplus
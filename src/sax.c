@@ -3,7 +3,7 @@
  * @author Daniel Starke
  * @see parser.h
  * @date 2018-06-23
- * @version 2018-07-25
+ * @version 2026-10-16
  * 
  * DISCLAIMER
  * This file has no copyright assigned and is placed in the Public Domain.
@@ -20,59 +20,95 @@
  */
 #include <ctype.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include "parser.h"
 
 
 #ifdef PCF_P_SAX_DEBUG
 #include <stdio.h>
-#include <stdlib.h>
 #endif /* PCF_P_SAX_DEBUG */
 
 
 /**
- * UTF-8 based Simple API for XML parser. The input XML is tokenized and each token is passed to the
- * given callback function. The string tokens passed to the callback point into the XML string passed
- * to this function. Leading and trailing spaces are stripped from the tag contents. Attribute
- * values are passed without quoting. The function does not check if the XML document is well-formed
- * but it expects it to be so. Only XML documents are supported (see XML technical report chapter 2).
- * Escaping is preserved.
+ * Internal parser states of p_sax() and p_saxResume().
+ */
+typedef enum {
+	SAX_START                  = 0x0000, /* start of the XML document; all other flags are unset */
+	SAX_WITHIN_XML             = 0x0001, /* XML specific processing instruction */
+	SAX_WITHIN_INSTRUCTION     = 0x0002, /* processing instruction */
+	SAX_WITHIN_COMMENT         = 0x0004, /* within a comment */
+	SAX_WITHIN_START_TAG       = 0x0008, /* within an start tag */
+	SAX_WITHIN_END_TAG         = 0x0010, /* within an end tag */
+	SAX_WITHIN_TAG             = SAX_WITHIN_START_TAG | SAX_WITHIN_END_TAG, /* within a tag */
+	SAX_WITHIN_TAG_NAME        = 0x0020, /* within the name of a tag */
+	SAX_WITHIN_ATTRIBUTE_LIST  = 0x0040, /* within a list of attributes */
+	SAX_WITHIN_ATTRIBUTE_NAME  = 0x0080, /* within the name of an attribute */
+	SAX_WITHIN_ATTRIBUTE_EQUAL = 0x0100, /* within the name of an attribute */
+	SAX_WITHIN_ATTRIBUTE_VALUE = 0x0200, /* within the value of an attribute */
+	SAX_WITHIN_CONTENT         = 0x0400, /* within the content of a tag */
+	SAX_WITHIN_CDATA           = 0x0800, /* within a CDATA part */
+	SAX_END                    = 0x1000  /* end of the XML document (null character) was reached; all other flags are unset */
+} tSaxFlags;
+
+
+/**
+ * Minimum number of bytes which need to follow a character that starts a multi-character sequence
+ * (e.g. "<![CDATA[") to evaluate it without suspending.
+ */
+#define SAX_LOOKAHEAD 9
+
+
+/**
+ * Minimum number of input bytes appended to the carry-over buffer at once.
+ */
+#define SAX_CARRY_STEP 256
+
+
+/**
+ * Maximum size of the carry-over buffer in bytes. This limits the length of a single token which
+ * straddles the input boundaries of p_saxResume().
+ */
+#define SAX_MAX_CARRY 0x100000
+
+
+/**
+ * Parses the given XML input starting at the position stored in the passed state. The state holds
+ * all pending tokens as offsets relative to the input start. If the input is not final, parsing
+ * is suspended before a character which cannot be evaluated without the following input. The
+ * state is updated in this case relative to the returned keep offset.
  * 
  * @param[in] xml - input XML
  * @param[in] length - length of XML in bytes
+ * @param[in,out] st - parser state
+ * @param[in] final - set if the input ends with the XML document
+ * @param[out] keep - receives the offset of the first input byte needed to resume if suspended
  * @param[out] errorPos - error position (optional)
  * @param[in] visitor - user defined callback function
  * @param[in] param - user defined parameter (passed to callback function)
- * @return see tPSaxReturnType
- * @see https://www.w3.org/TR/xml/
+ * @return see tPSaxReturnType; PSRT_UNEXPECTED_END with keep set if suspended
  */
-tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** errorPos, const PSaxTokenVisitor visitor, void * param) {
-	typedef enum {
-		SAX_START                  = 0x0000, /* start of the XML document; all other flags are unset */
-		SAX_WITHIN_XML             = 0x0001, /* XML specific processing instruction */
-		SAX_WITHIN_INSTRUCTION     = 0x0002, /* processing instruction */
-		SAX_WITHIN_COMMENT         = 0x0004, /* within a comment */
-		SAX_WITHIN_START_TAG       = 0x0008, /* within an start tag */
-		SAX_WITHIN_END_TAG         = 0x0010, /* within an end tag */
-		SAX_WITHIN_TAG             = SAX_WITHIN_START_TAG | SAX_WITHIN_END_TAG, /* within a tag */
-		SAX_WITHIN_TAG_NAME        = 0x0020, /* within the name of a tag */
-		SAX_WITHIN_ATTRIBUTE_LIST  = 0x0040, /* within a list of attributes */
-		SAX_WITHIN_ATTRIBUTE_NAME  = 0x0080, /* within the name of an attribute */
-		SAX_WITHIN_ATTRIBUTE_EQUAL = 0x0100, /* within the name of an attribute */
-		SAX_WITHIN_ATTRIBUTE_VALUE = 0x0200, /* within the value of an attribute */
-		SAX_WITHIN_CONTENT         = 0x0400, /* within the content of a tag */
-		SAX_WITHIN_CDATA           = 0x0800, /* within a CDATA part */
-	} tSaxFlags;
-	if (xml == NULL || visitor == NULL) return PSRT_INVALID_ARGUMENT;
-	const char * ptr = xml;
-	const char * lastNonSpace = NULL;
-	const char * nsSep = NULL;
-	char attrValueSep = 0;
-	tPToken tokens[3] = { 0 };
-	tPToken startTag[2] = { 0 };
-	tSaxFlags flags = SAX_START;
-	size_t level = 0;
+static tPSaxReturnType saxParse(const char * xml, const size_t length, tPSaxState * st, const int final, size_t * keep, const char ** errorPos, const PSaxTokenVisitor visitor, void * param) {
+#define LOAD_PTR(x) (((x) != (size_t)-1) ? xml + (x) : NULL)
+	const char * ptr = xml + st->next;
+	const char * lastNonSpace = LOAD_PTR(st->lastNonSpace);
+	const char * nsSep = LOAD_PTR(st->nsSep);
+	char attrValueSep = st->attrValueSep;
+	tPToken tokens[3];
+	tPToken startTag[2];
+	tSaxFlags flags = (tSaxFlags)(st->flags);
+	size_t level = st->level;
 	tPSaxReturnType error = PSRT_UNEXPECTED_CHARACTER;
+	size_t n = st->next;
+	for (size_t i = 0; i < 3; i++) {
+		tokens[i].start = LOAD_PTR(st->start[i]);
+		tokens[i].length = st->length[i];
+	}
+	for (size_t i = 0; i < 2; i++) {
+		startTag[i].start = LOAD_PTR(st->startTag[i]);
+		startTag[i].length = st->startTagLength[i];
+	}
+#undef LOAD_PTR
 #define WITHIN(x)  ((flags & SAX_WITHIN_##x) != 0)
 #define VISIT(x) \
 	do { \
@@ -82,7 +118,19 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 		} \
 	} while (0)
 #define ONERROR(x) do {error = PSRT_##x; goto onError;} while ( 0 )
-	for (size_t n = 0; n < length && *ptr != 0; ) {
+	/* all pending token pointers are reset when entering the tag content */
+#define ENTER_CONTENT() \
+	do { \
+		flags = SAX_WITHIN_CONTENT; \
+		lastNonSpace = NULL; \
+		nsSep = NULL; \
+		memset(tokens, 0, sizeof(tokens)); \
+		memset(startTag, 0, sizeof(startTag)); \
+	} while (0)
+	while (n < length && *ptr != 0) {
+		if (final == 0 && (length - n) < SAX_LOOKAHEAD && (*ptr == '<' || *ptr == '?' || *ptr == '-' || *ptr == ']')) {
+			break; /* suspend until the following input is available */
+		}
 #ifdef PCF_P_SAX_DEBUG
 		const char * flagStr[] = {"XML", "INSTRUCTION", "COMMENT", "START_TAG", "END_TAG", "TAG_NAME", "ATTRIBUTE_LIST", "ATTRIBUTE_NAME", "ATTRIBUTE_EQUAL", "ATTRIBUTE_VALUE", "CONTENT", "CDATA"};
 		fprintf(stderr, "char =");
@@ -118,6 +166,9 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 					tokens[0].length = (size_t)((lastNonSpace + 1) - tokens[0].start);
 					VISIT(CONTENT);
 				}
+				tokens[0].start = NULL;
+				tokens[0].length = 0;
+				lastNonSpace = NULL;
 				if ((n + 1) < length && ptr[1] == '?') {
 					flags = SAX_WITHIN_INSTRUCTION;
 					lastNonSpace = NULL;
@@ -179,10 +230,8 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 			} else if (attrValueSep == '=' && (*ptr == '\'' || *ptr == '"')) {
 				flags = (tSaxFlags)((flags & ((tSaxFlags)~SAX_WITHIN_ATTRIBUTE_EQUAL)) | SAX_WITHIN_ATTRIBUTE_VALUE);
 				attrValueSep = *ptr;
-				if ((n + 1) < length) {
-					tokens[2].start = ptr + 1;
-					tokens[2].length = 0;
-				}
+				tokens[2].start = ptr + 1;
+				tokens[2].length = 0;
 			} else if (p_isXmlWhiteSpace(*ptr) == 0) {
 				ONERROR(EXPECTED_ATTR_VALUE);
 			}
@@ -202,10 +251,7 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 			}
 		} else if ( WITHIN(ATTRIBUTE_LIST) ) {
 			if (WITHIN(INSTRUCTION) && (n + 1) < length && *ptr == '?' && ptr[1] == '>') {
-				flags = SAX_WITHIN_CONTENT;
-				lastNonSpace = NULL;
-				tokens[0].start = NULL;
-				tokens[1].start = NULL;
+				ENTER_CONTENT();
 				n += 2;
 				ptr += 2;
 			} else if (*ptr == '>' && !WITHIN(INSTRUCTION)) {
@@ -221,10 +267,7 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 				} else if ( WITHIN(START_TAG) ) {
 					level++;
 				}
-				flags = SAX_WITHIN_CONTENT;
-				lastNonSpace = NULL;
-				tokens[0].start = NULL;
-				tokens[1].start = NULL;
+				ENTER_CONTENT();
 			} else if (p_isXmlNameStartChar(*ptr) != 0 && !WITHIN(END_TAG)) {
 				flags = (tSaxFlags)(flags | SAX_WITHIN_ATTRIBUTE_NAME);
 				tokens[0].start = NULL;
@@ -261,10 +304,7 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 						VISIT(INSTRUCTION);
 					}
 				}
-				flags = SAX_WITHIN_CONTENT;
-				lastNonSpace = NULL;
-				tokens[0].start = NULL;
-				tokens[1].start = NULL;
+				ENTER_CONTENT();
 				n += 2;
 				ptr += 2;
 			} else if ( WITHIN(TAG_NAME) ) {
@@ -344,15 +384,9 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 				} else {
 					ONERROR(UNEXPECTED_CHARACTER);
 				}
-				flags = SAX_WITHIN_CONTENT;
-				lastNonSpace = NULL;
-				tokens[0].start = NULL;
-				tokens[1].start = NULL;
+				ENTER_CONTENT();
 			} else if ((n + 1) < length && *ptr == '?' && ptr[1] == '>') {
-				flags = SAX_WITHIN_CONTENT;
-				lastNonSpace = NULL;
-				tokens[0].start = NULL;
-				tokens[1].start = NULL;
+				ENTER_CONTENT();
 				n++;
 				ptr++;
 			} else if (*ptr == '/' && !WITHIN(END_TAG)) {
@@ -404,19 +438,13 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 				tokens[1].length = 1;
 				nsSep = (*ptr == ':') ? ptr : NULL;
 			} else if (*ptr == '>') {
-				flags = SAX_WITHIN_CONTENT;
-				lastNonSpace = NULL;
-				tokens[0].start = NULL;
-				tokens[1].start = NULL;
+				ENTER_CONTENT();
 			} else if (p_isXmlWhiteSpace(*ptr) == 0) {
 				ONERROR(EXPECTED_TAG_NAME);
 			}
 		} else if ( WITHIN(COMMENT) ) {
 			if ((n + 2) < length && *ptr == '-' && ptr[1] == '-' && ptr[2] == '>') {
-				flags = SAX_WITHIN_CONTENT;
-				lastNonSpace = NULL;
-				tokens[0].start = NULL;
-				tokens[1].start = NULL;
+				ENTER_CONTENT();
 				n += 2;
 				ptr += 2;
 			}
@@ -425,10 +453,7 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 				if (tokens[0].length > 0) {
 					VISIT(CDATA);
 				}
-				flags = SAX_WITHIN_CONTENT;
-				lastNonSpace = NULL;
-				tokens[0].start = NULL;
-				tokens[1].start = NULL;
+				ENTER_CONTENT();
 				n += 2;
 				ptr += 2;
 			} else {
@@ -440,14 +465,204 @@ tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** error
 		n++;
 		ptr++;
 	}
+	if (final == 0 && (n >= length || *ptr != 0)) {
+		/* store state relative to the first pending input byte to resume with the following input */
+#define KEEP(x) if ((x) != NULL && (size_t)((x) - xml) < *keep) *keep = (size_t)((x) - xml)
+#define STORE_PTR(x) (((x) != NULL) ? (size_t)((x) - xml) - *keep : (size_t)-1)
+		*keep = n;
+		KEEP(lastNonSpace);
+		KEEP(nsSep);
+		for (size_t i = 0; i < 3; i++) KEEP(tokens[i].start);
+		for (size_t i = 0; i < 2; i++) KEEP(startTag[i].start);
+		st->flags = (int)flags;
+		st->level = level;
+		st->attrValueSep = attrValueSep;
+		st->next = n - *keep;
+		for (size_t i = 0; i < 3; i++) {
+			st->start[i] = STORE_PTR(tokens[i].start);
+			st->length[i] = tokens[i].length;
+		}
+		for (size_t i = 0; i < 2; i++) {
+			st->startTag[i] = STORE_PTR(startTag[i].start);
+			st->startTagLength[i] = startTag[i].length;
+		}
+		st->lastNonSpace = STORE_PTR(lastNonSpace);
+		st->nsSep = STORE_PTR(nsSep);
+#undef KEEP
+#undef STORE_PTR
+		return PSRT_UNEXPECTED_END;
+	}
 	if (flags != SAX_START && !WITHIN(CONTENT)) {
+		if (final == 0) ONERROR(UNEXPECTED_CHARACTER); /* null character within a pending token */
 		ONERROR(UNEXPECTED_END);
 	}
+	/* any input after the end of the document is ignored */
+	st->flags = (int)SAX_END;
 #undef WITHIN
 #undef VISIT
 #undef ONERROR
+#undef ENTER_CONTENT
 	return PSRT_SUCCESS;
 onError:
 	if (errorPos != NULL) *errorPos = ptr;
 	return error;
 }
+
+
+/**
+ * UTF-8 based Simple API for XML parser. The input XML is tokenized and each token is passed to the
+ * given callback function. The string tokens passed to the callback point into the XML string passed
+ * to this function. Leading and trailing spaces are stripped from the tag contents. Attribute
+ * values are passed without quoting. The function does not check if the XML document is well-formed
+ * but it expects it to be so. Only XML documents are supported (see XML technical report chapter 2).
+ * Escaping is preserved.
+ * 
+ * @param[in] xml - input XML
+ * @param[in] length - length of XML in bytes
+ * @param[out] errorPos - error position (optional)
+ * @param[in] visitor - user defined callback function
+ * @param[in] param - user defined parameter (passed to callback function)
+ * @return see tPSaxReturnType
+ * @see https://www.w3.org/TR/xml/
+ */
+tPSaxReturnType p_sax(const char * xml, const size_t length, const char ** errorPos, const PSaxTokenVisitor visitor, void * param) {
+	if (xml == NULL || visitor == NULL) return PSRT_INVALID_ARGUMENT;
+	tPSaxState state;
+	size_t keep;
+	p_saxInit(&state);
+	return saxParse(xml, length, &state, 1, &keep, errorPos, visitor, param);
+}
+
+
+/**
+ * Initializes the given XML parser state for p_saxResume().
+ * 
+ * @param[out] state - parser state to initialize
+ */
+void p_saxInit(tPSaxState * state) {
+	if (state == NULL) return;
+	memset(state, 0, sizeof(*state));
+	state->flags = (int)SAX_START;
+	for (size_t i = 0; i < 3; i++) state->start[i] = (size_t)-1;
+	for (size_t i = 0; i < 2; i++) state->startTag[i] = (size_t)-1;
+	state->lastNonSpace = (size_t)-1;
+	state->nsSep = (size_t)-1;
+}
+
+
+/**
+ * Appends the given input to the carry-over buffer of the passed parser state. The buffer does not
+ * grow beyond SAX_MAX_CARRY bytes.
+ * 
+ * @param[in,out] st - parser state
+ * @param[in] xml - input to append
+ * @param[in] length - length of xml in bytes
+ * @return 1 on success, else 0
+ */
+static int saxCarry(tPSaxState * st, const char * xml, const size_t length) {
+	if (length < 1) return 1;
+	if (length > (SAX_MAX_CARRY - st->carryLength)) return 0; /* pending token exceeds our defined limits */
+	if ((st->carryLength + length) > st->carryCapacity) {
+		size_t newCapacity = (st->carryCapacity > 0) ? st->carryCapacity : SAX_CARRY_STEP;
+		while (newCapacity < (st->carryLength + length)) newCapacity *= 2;
+		if (newCapacity > SAX_MAX_CARRY) newCapacity = SAX_MAX_CARRY;
+		char * newCarry = (char *)realloc(st->carry, newCapacity);
+		if (newCarry == NULL) return 0;
+		st->carry = newCarry;
+		st->carryCapacity = newCapacity;
+	}
+	memcpy(st->carry + st->carryLength, xml, length);
+	st->carryLength += length;
+	return 1;
+}
+
+
+/**
+ * Resumable variant of p_sax() for XML documents which are received piecewise. Each call parses
+ * the passed part of the document in place and continues at the position given by the passed
+ * state. Tokens which straddle the end of the passed input are stored in a small carry-over buffer
+ * within the state and completed with the beginning of the following input. Pass an empty input
+ * to signal the end of the document. Note that the tokens passed to the callback function only
+ * remain valid until the callback function returns. A null character ends the document. The input
+ * following it is ignored and PSRT_UNEXPECTED_CHARACTER is returned if a token is still pending.
+ * 
+ * @param[in] xml - next part of the input XML (NULL if length is 0)
+ * @param[in] length - length of xml in bytes or 0 for the end of the document
+ * @param[in,out] st - parser state (see p_saxInit())
+ * @param[out] errorOffset - error position as byte offset within the whole document (optional)
+ * @param[in] visitor - user defined callback function
+ * @param[in] param - user defined parameter (passed to callback function)
+ * @return see tPSaxReturnType; PSRT_UNEXPECTED_END if more input is needed; PSRT_NO_MEMORY if a
+ * pending token exceeds SAX_MAX_CARRY bytes
+ * @see p_sax()
+ */
+tPSaxReturnType p_saxResume(const char * xml, const size_t length, tPSaxState * st, size_t * errorOffset, const PSaxTokenVisitor visitor, void * param) {
+	if ((xml == NULL && length > 0) || st == NULL || visitor == NULL) return PSRT_INVALID_ARGUMENT;
+	const int final = (length < 1) ? 1 : 0;
+	const char * errorPos = NULL;
+	const char * input;
+	size_t used = 0;
+	size_t keep;
+	tPSaxReturnType res;
+	if (st->flags == (int)SAX_END) return PSRT_SUCCESS;
+	/* complete the pending tokens in the carry-over buffer with the beginning of the input */
+	while (st->carryLength > 0) {
+		const size_t carried = st->carryLength;
+		size_t step = (carried > SAX_CARRY_STEP) ? carried : SAX_CARRY_STEP;
+		if (step > (length - used)) step = length - used;
+		if (step > (SAX_MAX_CARRY - carried)) step = SAX_MAX_CARRY - carried;
+		if (step < 1 && used < length) return PSRT_NO_MEMORY; /* pending token exceeds our defined limits */
+		if (saxCarry(st, xml + used, step) != 1) return PSRT_NO_MEMORY;
+		used += step;
+		keep = (size_t)-1;
+		res = saxParse(st->carry, st->carryLength, st, final, &keep, &errorPos, visitor, param);
+		if (keep == (size_t)-1) {
+			if (res != PSRT_SUCCESS && errorOffset != NULL && errorPos != NULL) {
+				*errorOffset = st->carryOffset + (size_t)(errorPos - st->carry);
+			}
+			st->inputOffset += length;
+			return res;
+		}
+		if (keep >= carried) {
+			/* the remaining pending tokens start within the input */
+			used -= st->carryLength - keep;
+			st->carryLength = 0;
+			break;
+		}
+		memmove(st->carry, st->carry + keep, st->carryLength - keep);
+		st->carryLength -= keep;
+		st->carryOffset += keep;
+		if (used >= length) {
+			st->inputOffset += length;
+			return PSRT_UNEXPECTED_END;
+		}
+	}
+	/* parse the input in place */
+	input = (xml != NULL) ? xml + used : "";
+	keep = (size_t)-1;
+	res = saxParse(input, length - used, st, final, &keep, &errorPos, visitor, param);
+	if (keep != (size_t)-1) {
+		/* keep the pending tokens for the following input */
+		if (saxCarry(st, input + keep, length - used - keep) != 1) return PSRT_NO_MEMORY;
+		st->carryOffset = st->inputOffset + used + keep;
+	} else if (res != PSRT_SUCCESS && errorOffset != NULL && errorPos != NULL) {
+		*errorOffset = st->inputOffset + used + (size_t)(errorPos - input);
+	}
+	st->inputOffset += length;
+	return res;
+}
+
+
+/**
+ * Releases the carry-over buffer of the given XML parser state. The state needs to be initialized
+ * again with p_saxInit() before it can be reused.
+ * 
+ * @param[in,out] state - parser state to release
+ */
+void p_saxFree(tPSaxState * state) {
+	if (state == NULL) return;
+	if (state->carry != NULL) free(state->carry);
+	state->carry = NULL;
+	state->carryCapacity = 0;
+	state->carryLength = 0;
+}
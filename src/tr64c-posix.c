@@ -2,7 +2,7 @@
  * @file tr64c_posix.c
  * @author Daniel Starke
  * @date 2018-06-21
- * @version 2018-08-17
+ * @version 2026-10-16
  * 
  * DISCLAIMER
  * This file has no copyright assigned and is placed in the Public Domain.
@@ -27,12 +27,17 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/types.h>
+#include "tr64c.h"
 
 
 /**
@@ -40,20 +45,90 @@
  */
 struct sIpAddress {
 	struct addrinfo * list;
-	struct addrinfo * entry;
+	const struct addrinfo ** order; /* list entries with interleaved address families */
+	size_t count; /* number of entries in order */
+	size_t refCount; /* number of request contexts sharing this list */
 };
 
 
+/**
+ * States of a non-blocking request.
+ */
+typedef enum {
+	NS_IDLE = 0,
+	NS_CONNECT,
+	NS_SEND,
+	NS_RECEIVE
+} tNetState;
+
+
+/** Maximum number of concurrent connection attempts per request. */
+#define CONNECT_ATTEMPTS 8
+
+
+/** Delay in milliseconds before the next connection attempt is started in parallel (RFC 8305). */
+#define CONNECT_ATTEMPT_DELAY 250
+
+
+/** Maximum number of request fragments passed per sendmsg() call. */
+#define SEND_FRAGMENTS 64
+
+
+/**
+ * Single non-blocking connection attempt.
+ */
+typedef struct {
+	int socket;
+	uint32_t events; /* socket events registered at the engine */
+} tConnAttempt;
+
+
 /**
  * Internal network handles.
  */
 struct sNetHandle {
 	struct addrinfo * list;
 	int socket;
+	tNetState state; /* state of the pending request */
+	tConnAttempt attempt[CONNECT_ATTEMPTS]; /* concurrent connection attempts */
+	size_t attempts; /* number of elements in attempt */
+	size_t nextEntry; /* index of the next address to connect to within the ordered address list */
+	uint64_t attemptTime; /* start time of the last connection attempt */
+	size_t sent; /* number of request bytes sent */
+	size_t requestLength; /* request size in bytes (kept to send the request again) */
+	int reused; /* set if the request is sent over a re-used connection */
+	int pipelined; /* set if further requests were sent over the connection (see requestPipelined()) */
+	const size_t * pipelineEnd; /* end offset of each pipelined request within the sent data */
+	uint64_t idleTime; /* time point at which the connection became idle */
+	size_t expected; /* expected response size in bytes or 0 if unknown */
+	size_t received; /* received bytes once the response is complete (may include the next pipelined response), else 0 */
+	tTr64Response response; /* response fields parsed so far */
+	tPHttpState parser; /* state of the incremental response parser */
+	int auth; /* set if performing authentication of the previous request */
+	uint64_t startTime; /* start time of the current request state */
+	uint64_t durationStart; /* start time of the request */
+	struct sEngine * engine; /* engine processing the pending request */
+	size_t index; /* index within the pending requests of the engine */
+	uint32_t events; /* socket events registered at the engine */
+	int (* visitor)(tTr64RequestCtx *, const int, void *); /* callback for the completed request */
+	void * param; /* user defined callback function parameter */
 };
 
 
-#include "tr64c.h"
+/**
+ * Internal request engine.
+ */
+struct sEngine {
+	int fd; /* epoll handle */
+	tTr64RequestCtx ** ctx; /* pending requests */
+	size_t capacity; /* total capacity of ctx in number of elements */
+	size_t length; /* number of elements in ctx */
+	int verbose; /* verbosity level */
+};
+
+
+/** Maximum number of socket events processed per engine poll. */
+#define ENGINE_EVENTS 64
 
 
 #ifdef UNICODE
@@ -74,6 +149,19 @@ int isFile(const TCHAR * src) {
 }
 
 
+/**
+ * Checks if the given path exists and is a directory.
+ * 
+ * @param[in] src - check this path
+ * @return 1 if src exists and is a directory, else 0
+ */
+int isDir(const TCHAR * src) {
+	struct stat stats;
+	if (src != NULL && stat(src, &stats) == 0 && S_ISDIR(stats.st_mode)) return 1;
+	return 0;
+}
+
+
 /**
  * Reads the given file as a single null-terminated allocated UTF-8 string.
  * 
@@ -112,38 +200,171 @@ onError:
 
 
 /**
- * Write a null-terminated UTF-8 string to the given file. Existing files will be overwritten.
+ * Maps the given file read-only into memory.
  * 
- * @param[in] dst - output file path
- * @param[in] str - null-terminated input string
+ * @param[in] src - input file path
+ * @param[out] len - pointer for the resulting length
+ * @return pointer to the mapped file content on success, else NULL
+ * @see unmapFile()
+ */
+const char * mapFile(const TCHAR * src, size_t * len) {
+	if (src == NULL || len == NULL) return NULL;
+	struct stat stats;
+	void * res = MAP_FAILED;
+	int fd;
+	
+	*len = 0;
+	fd = open(src, O_RDONLY);
+	if (fd < 0) return NULL;
+	if (fstat(fd, &stats) == 0 && stats.st_size > 0) {
+		res = mmap(NULL, (size_t)(stats.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (res != MAP_FAILED) *len = (size_t)(stats.st_size);
+	}
+	close(fd);
+	return (res != MAP_FAILED) ? (const char *)res : NULL;
+}
+
+
+/**
+ * Releases the file mapping created by mapFile().
+ * 
+ * @param[in] ptr - pointer to the mapped file content
+ * @param[in] len - length of the mapped file content
+ */
+void unmapFile(const char * ptr, const size_t len) {
+	if (ptr == NULL) return;
+	munmap((void *)ptr, len);
+}
+
+
+/**
+ * Writes the given data completely to the passed file descriptor.
+ * 
+ * @param[in] fd - output file descriptor
+ * @param[in] str - input string
+ * @param[in] len - length of the input string in bytes
  * @return 1 on success, else 0
  */
-int writeStringToFile(const TCHAR * dst, const char * str) {
-	return writeStringNToFile(dst, str, strlen(str));
+static int writeAll(const int fd, const char * str, const size_t len) {
+	size_t written = 0;
+	while (written < len) {
+		const ssize_t n = write(fd, str + written, len - written);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return 0;
+		}
+		written += (size_t)n;
+	}
+	return 1;
 }
 
 
 /**
- * Write a UTF-8 string to the given file. Existing files will be overwritten.
+ * Replaces the given file atomically with a UTF-8 string. The string is written to a temporary
+ * file next to the destination which is then renamed. Concurrent readers therefore either see the
+ * previous or the new file content, and existing mappings of the previous file stay valid.
  * 
  * @param[in] dst - output file path
  * @param[in] str - input string
  * @param[in] len - length of the input string in bytes
+ * @param[in] mode - access permissions of the new file
  * @return 1 on success, else 0
  */
-int writeStringNToFile(const TCHAR * dst, const char * str, const size_t len) {
+static int replaceFile(const TCHAR * dst, const char * str, const size_t len, const mode_t mode) {
 	if (dst == NULL || str == NULL) return 0;
-	FILE * fd = NULL;
+	const size_t dstLen = strlen(dst);
+	char * tmp = NULL;
+	int fd = -1;
 	int res = 0;
 	
-	fd = fopen(dst, "w");
-	if (fd == NULL) goto onError;
+	/* the process ID makes the temporary file unique among concurrent writers */
+	tmp = (char *)malloc(dstLen + 32);
+	if (tmp == NULL) goto onError;
+	snprintf(tmp, dstLen + 32, "%s.%lu.tmp", dst, (unsigned long)getpid());
+	
+	/* the creation mode only applies to new files (a previous process may have left one behind) */
+	unlink(tmp);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, mode);
+	if (fd < 0) goto onError;
 	
-	if (fwrite(str, len, 1, fd) < 1) goto onError;
+	if (writeAll(fd, str, len) != 1) goto onError;
+	if (close(fd) != 0) {
+		fd = -1;
+		goto onError;
+	}
+	fd = -1;
+	
+	if (rename(tmp, dst) != 0) goto onError;
 	
 	res = 1;
 onError:
-	if (fd != NULL) fclose(fd);
+	if (fd >= 0) close(fd);
+	if (tmp != NULL) {
+		if (res != 1) unlink(tmp);
+		free(tmp);
+	}
+	return res;
+}
+
+
+/**
+ * Write a null-terminated UTF-8 string to the given file. Existing files will be replaced
+ * atomically.
+ * 
+ * @param[in] dst - output file path
+ * @param[in] str - null-terminated input string
+ * @return 1 on success, else 0
+ */
+int writeStringToFile(const TCHAR * dst, const char * str) {
+	return writeStringNToFile(dst, str, strlen(str));
+}
+
+
+/**
+ * Write a UTF-8 string to the given file. Existing files will be replaced atomically.
+ * 
+ * @param[in] dst - output file path
+ * @param[in] str - input string
+ * @param[in] len - length of the input string in bytes
+ * @return 1 on success, else 0
+ */
+int writeStringNToFile(const TCHAR * dst, const char * str, const size_t len) {
+	return replaceFile(dst, str, len, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+}
+
+
+/**
+ * Write a UTF-8 string to the given file which is only accessible by the current user. Existing
+ * files will be replaced atomically.
+ * 
+ * @param[in] dst - output file path
+ * @param[in] str - input string
+ * @param[in] len - length of the input string in bytes
+ * @return 1 on success, else 0
+ */
+int writePrivateStringNToFile(const TCHAR * dst, const char * str, const size_t len) {
+	return replaceFile(dst, str, len, S_IRUSR | S_IWUSR);
+}
+
+
+/**
+ * Appends a UTF-8 string to the given file. The file is created if it does not exist. The string
+ * is written with a single call to allow concurrent writers to append whole lines.
+ * 
+ * @param[in] dst - output file path
+ * @param[in] str - input string
+ * @param[in] len - length of the input string in bytes
+ * @return 1 on success, else 0
+ */
+int appendStringNToFile(const TCHAR * dst, const char * str, const size_t len) {
+	if (dst == NULL || str == NULL) return 0;
+	int fd;
+	int res;
+	
+	fd = open(dst, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+	if (fd < 0) return 0;
+	res = writeAll(fd, str, len);
+	if (close(fd) != 0) res = 0;
 	return res;
 }
 
@@ -479,293 +700,1111 @@ onError:
 
 
 /**
- * Performs a HTTP request for the parameters in the given context. The internal buffer is used to
- * provide data which shall be sent to the host (with HTTP header). The result is stored in the
- * same buffer (with HTTP header). The internal socket will be left open.
- * The function sets ctx->auth to the needed authentication response if the request failed due to a
- * 401 status code. Re-sending the request with the proper authentication response will clear the
- * ctx->auth field to avoid an infinite loop if the credentials are wrong.
+ * Closes the socket of the given network handle if open.
  * 
- * @param[in,out] ctx - context to use
- * @return 1 on success, 0 on error
- * @remarks The calling function should check if ctx->auth is set and ctx->status == 401 to perform
- * a second request with the authentication response provided by ctx->auth.
+ * @param[in,out] net - network handle to use
  */
-static int request(tTr64RequestCtx * ctx) {
-	if (ctx == NULL || ctx->length < 1) return 0;
-	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_REQUEST));
-	const struct addrinfo * addr = NULL;
-	struct timeval timeoutBase = {
-		.tv_sec = TIMEOUT_RESOLUTION / 1000,
-		.tv_usec = (TIMEOUT_RESOLUTION % 1000) * 1000
-	};
-	struct timeval timeout;
-	fd_set event;
-	ssize_t size;
-	int sRes, res = 0, auth = 0;
-	tTr64Response response = {0};
-	uint64_t startTime, durationStart;
-	
-	ctx->status = 400;
-	ctx->duration = (size_t)-1;
-	durationStart = getTimePoint();
-	
-	if (ctx->auth != NULL) {
-		auth = 1; /* performing authentication of the previous request */
-		free(ctx->auth);
-		ctx->auth = NULL;
-	}
-	
-	ctx->content = NULL;
-	
-	if (ctx->net->socket != -1 && ctx->net->list != ctx->address->list) {
-		shutdown(ctx->net->socket, SHUT_RDWR);
-		close(ctx->net->socket);
-		ctx->net->socket = -1;
-		ctx->net->list = NULL;
-	}
-	
-	if (ctx->address == NULL || ctx->address->list == NULL) {
-		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_OPT_NO_ADDR));
-		goto onError;
+static void closeSocket(tNetHandle * net) {
+	if (net->socket != -1) {
+		shutdown(net->socket, SHUT_RDWR);
+		close(net->socket);
+		net->socket = -1;
+		net->events = 0;
 	}
-	ctx->net->list = ctx->address->list;
+	/* abort pending connection attempts */
+	for (size_t i = 0; i < net->attempts; i++) close(net->attempt[i].socket);
+	net->attempts = 0;
+}
+
+
+/**
+ * Closes the connection attempt at the given index. The last attempt takes its place.
+ * 
+ * @param[in,out] net - network handle to use
+ * @param[in] index - index of the connection attempt
+ */
+static void closeAttempt(tNetHandle * net, const size_t index) {
+	close(net->attempt[index].socket);
+	net->attempts--;
+	net->attempt[index] = net->attempt[net->attempts];
+}
+
+
+/**
+ * Uses the connection attempt at the given index as connected socket and closes all others.
+ * 
+ * @param[in,out] net - network handle to use
+ * @param[in] index - index of the connection attempt
+ */
+static void useAttempt(tNetHandle * net, const size_t index) {
+	net->socket = net->attempt[index].socket;
+	net->events = net->attempt[index].events;
+	net->attempts--;
+	net->attempt[index] = net->attempt[net->attempts];
+	while (net->attempts > 0) closeAttempt(net, net->attempts - 1);
+	net->state = NS_SEND;
+	net->startTime = getTimePoint();
+}
+
+
+/**
+ * Creates a new non-blocking socket and starts a connection attempt to the given address. The
+ * attempt becomes the connected socket if the connection was established immediately.
+ * 
+ * @param[in,out] ctx - context to use
+ * @param[in] addr - connect to this address
+ * @return 1 on success, 0 if the connection was refused, -1 on error
+ */
+static int connectSocket(tTr64RequestCtx * ctx, const struct addrinfo * addr) {
+	tNetHandle * net = ctx->net;
+	int sock, sRes, err;
 	
-	if (ctx->address->entry == NULL) {
-		/* restart iteration over resolved addresses */
-		ctx->address->entry = ctx->address->list;
+	/* create socket */
+	sock = socket(addr->ai_family, SOCK_STREAM, IPPROTO_TCP);
+	if (sock == -1) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_NEW));
+		if (ctx->verbose > 1) printLastError(ferr);
+		return -1;
 	}
 	
-onTryNext:
-	/* try to connect to one of the given addresses */
-	addr = ctx->address->entry;
-	if (ctx->net->socket == -1) {
-		/* create socket */
-		ctx->net->socket = socket(addr->ai_family, SOCK_STREAM, IPPROTO_TCP);
-		if (ctx->net->socket == -1) {
-			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_NEW));
+	/* configure the socket */
+	{
+		/* keep-alive */
+		int val = 1;
+		sRes = setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (const char *)(&val), sizeof(val));
+		if (sRes != 0) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_SET_ALIVE));
 			if (ctx->verbose > 1) printLastError(ferr);
 			goto onError;
 		}
-		
-		/* configure the socket */
-		{
-			/* keep-alive */
-			int val = 1;
-			sRes = setsockopt(ctx->net->socket, SOL_SOCKET, SO_KEEPALIVE, (const char *)(&val), sizeof(val));
-			if (sRes != 0) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_SET_ALIVE));
-				if (ctx->verbose > 1) printLastError(ferr);
-				goto onError;
-			}
-			/* disable Nagle algorithm */
-			sRes = setsockopt(ctx->net->socket, IPPROTO_TCP, TCP_NODELAY, (const char *)(&val), sizeof(val));
-			if (sRes != 0) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_OFF_NAGLE));
-				if (ctx->verbose > 1) printLastError(ferr);
-				goto onError;
-			}
-		}
-		{
-			/* send timeout */
-			struct timeval val = {
-				.tv_sec = ctx->timeout / 1000,
-				.tv_usec = (ctx->timeout % 1000) * 1000
-			};
-			sRes = setsockopt(ctx->net->socket, SOL_SOCKET, SO_SNDTIMEO, (const char *)(&val), sizeof(val));
-			if (sRes != 0) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_SET_SEND_TOUT));
-				if (ctx->verbose > 1) printLastError(ferr);
-				goto onError;
-			}
-		}
-	
-		/* connect */
-		sRes = connect(ctx->net->socket, (const struct sockaddr *)(addr->ai_addr), (socklen_t)(addr->ai_addrlen));
+		/* disable Nagle algorithm */
+		sRes = setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)(&val), sizeof(val));
 		if (sRes != 0) {
-			if (addr->ai_next == NULL) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_CONNECT));
-				if (ctx->verbose > 1) printLastError(ferr);
-				goto onError;
-			}
-			if (addr->ai_family != addr->ai_next->ai_family) {
-				shutdown(ctx->net->socket, SHUT_RDWR);
-				close(ctx->net->socket);
-				ctx->net->socket = -1;
-			}
-			ctx->address->entry = addr->ai_next;
-			goto onTryNext;
-		}
-	}
-	if (signalReceived != 0) goto onError;
-	
-	/* send HTTP request */
-	size = 0;
-	for (size_t i = 0; i < ctx->length; i += (size_t)size) {
-		size = send(ctx->net->socket, ctx->buffer + i, ctx->length - i, 0);
-		if (size < 0) {
-			switch (errno) {
-			case EINTR:
-				if (signalReceived != 0) goto onError;
-				/* try again */
-				size = 0;
-				break;
-			case EAGAIN:
-#if EAGAIN != EWOULDBLOCK
-			case EWOULDBLOCK:
-#endif
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_SEND_TOUT));
-				if (ctx->verbose > 1) printLastError(ferr);
-				ctx->status = 408;
-				goto onError;
-				break;
-			default:
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_HTTP_SEND_REQ));
-				if (ctx->verbose > 1) printLastError(ferr);
-				goto onError;
-				break;
-			}
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_OFF_NAGLE));
+			if (ctx->verbose > 1) printLastError(ferr);
+			goto onError;
 		}
 	}
-	if (signalReceived != 0) goto onError;
-	
 	{
 		/* configure socket non-blocking */
-		int flags = fcntl(ctx->net->socket, F_GETFL, 0);
-		if (flags == -1) {
-			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_NON_BLOCK));
-			if (ctx->verbose > 1) printLastError(ferr);
-			goto onError;
-		}
-		if (fcntl(ctx->net->socket, F_SETFL, flags | O_NONBLOCK) != 0) {
+		int flags = fcntl(sock, F_GETFL, 0);
+		if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) != 0) {
 			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_NON_BLOCK));
 			if (ctx->verbose > 1) printLastError(ferr);
 			goto onError;
 		}
 	}
 	
-	/* receive HTTP response */
-	size = 0;
-	startTime = getTimePoint();
-	for (ctx->length = 0; ctx->length < ctx->capacity; ) {
-		FD_ZERO(&event);
-		FD_SET(ctx->net->socket, &event);
-		/* wait for data or timeout */
-		timeout = timeoutBase;
-		sRes = select(ctx->net->socket + 1, &event, NULL, NULL, &timeout);
-		if (sRes < 0) {
-			goto onError;
-		} else if (sRes == 0) {
-			goto onReceiveTimeout;
-		}
-		/* get received data */
-		if (response.content.start != NULL && response.content.length > 0) {
-			size = recv(ctx->net->socket, ctx->buffer + ctx->length, response.content.start + response.content.length - ctx->buffer - ctx->length, 0);
-		} else {
-			size = recv(ctx->net->socket, ctx->buffer + ctx->length, ctx->capacity - ctx->length, 0);
-		}
-		if (size < 0) {
-			switch (errno) {
-			case EINTR:
-				if (signalReceived != 0) goto onError;
-				/* try again */
-				continue;
-				break;
-			case EAGAIN:
-#if EAGAIN != EWOULDBLOCK
-			case EWOULDBLOCK:
-#endif
-				goto onReceiveTimeout;
-				break;
-			default:
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_HTTP_RECV_RESP));
-				if (ctx->verbose > 1) printLastError(ferr);
-				goto onError;
-				break;
-			}
-			break; /* timeout -> assume successful completion */
-		} else if (size == 0) {
-			/* peer closed the connection */
+	/* connect */
+	net->attemptTime = getTimePoint();
+	sRes = connect(sock, (const struct sockaddr *)(addr->ai_addr), (socklen_t)(addr->ai_addrlen));
+	if (sRes != 0 && errno != EINPROGRESS) {
+		/* keep errno for the caller */
+		err = errno;
+		close(sock);
+		errno = err;
+		return 0;
+	}
+	net->attempt[net->attempts].socket = sock;
+	net->attempt[net->attempts].events = 0;
+	net->attempts++;
+	/* the new attempt needs to be registered at the engine */
+	net->events = 0;
+	if (sRes == 0) useAttempt(net, net->attempts - 1);
+	return 1;
+onError:
+	close(sock);
+	return -1;
+}
+
+
+/**
+ * Starts a connection attempt to the next reachable address of the ordered address list. Pending
+ * attempts are kept.
+ * 
+ * @param[in,out] ctx - context to use
+ * @return 1 if a connection attempt is pending or succeeded, else 0
+ */
+static int connectNext(tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	const tIpAddress * address = ctx->address;
+	while (net->nextEntry < address->count && net->attempts < CONNECT_ATTEMPTS) {
+		switch (connectSocket(ctx, address->order[net->nextEntry++])) {
+		case 1:
+			return 1;
+		case 0:
 			break;
+		default:
+			return 0;
 		}
-		if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_SOCK_RECV), (unsigned)size);
-		if ((size_t)(ctx->length + size) > MAX_RESPONSE_SIZE) goto onError; /* received response exceeds our defined limits */
-		ctx->length += (size_t)size;
-		/* increase input buffer if needed */
-		if (ctx->length >= ctx->capacity) {
-			const size_t newCapacity = ctx->capacity << 1;
-			if (newCapacity == 0) goto onError; /* overflow */
-			if (arrayFieldResize(ctx, buffer, newCapacity) != 1) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-				goto onError;
-			}
-		}
-		/* check if we have already received the whole response */
-		memset(&response, 0, sizeof(response));
-		switch (p_http(ctx->buffer, ctx->length, NULL, httpResponseVisitor, &response)) {
-		case PHRT_SUCCESS:
-			ctx->status = response.status;
-			if (response.status == 401 && auth == 0) {
-				httpAuthentication(ctx, &response);
-				goto onError;
-			} else if (response.status != 200) {
-				if (ctx->verbose > 1) {
-					const tHttpStatusMsg * item = (const tHttpStatusMsg *)bs_staticArray(&(response.status), httpStatMsg, cmpHttpStatusMsg);
-					if (item != NULL) {
-						_ftprintf(ferr, MSGT(MSGT_ERR_HTTP_STATUS_STR), (unsigned)response.status, item->string);
-					} else  {
-						_ftprintf(ferr, MSGT(MSGT_ERR_HTTP_STATUS), (unsigned)response.status);
-					}
-				}
-				goto onError;
-			} else if (response.content.start != NULL && response.content.start != ctx->buffer && response.content.length > 0) {
-				ctx->content = (char *)response.content.start;
-				/* limit to actual content length */
-				ctx->length = (size_t)(response.content.start + response.content.length - ctx->buffer);
-			}
-			goto onSuccess;
+	}
+	if (net->attempts > 0) return 1;
+	if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_CONNECT));
+	if (ctx->verbose > 1) printLastError(ferr);
+	return 0;
+}
+
+
+/**
+ * Checks whether another connection attempt shall be started in parallel to the pending ones.
+ * 
+ * @param[in] ctx - context to use
+ * @return 1 if true, else 0
+ */
+static int hasNextAttempt(const tTr64RequestCtx * ctx) {
+	const tNetHandle * net = ctx->net;
+	return (net->state == NS_CONNECT && net->socket == -1 && net->attempts < CONNECT_ATTEMPTS && net->nextEntry < ctx->address->count) ? 1 : 0;
+}
+
+
+/**
+ * Checks the pending connection attempts and uses the first established connection. Failed
+ * attempts are replaced by an attempt to the next address.
+ * 
+ * @param[in,out] ctx - context to use
+ * @return 1 if connected, 0 if still pending, -1 on error
+ */
+static int checkAttempts(tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	struct pollfd fds[CONNECT_ATTEMPTS];
+	int failed = 0;
+	for (size_t i = 0; i < net->attempts; i++) {
+		fds[i].fd = net->attempt[i].socket;
+		fds[i].events = POLLOUT;
+		fds[i].revents = 0;
+	}
+	if (poll(fds, (nfds_t)(net->attempts), 0) < 0) {
+		if (errno == EINTR && signalReceived == 0) return 0;
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_CONNECT));
+		if (ctx->verbose > 1) printLastError(ferr);
+		return -1;
+	}
+	/* backwards as closed attempts are replaced by the last one */
+	for (size_t i = net->attempts; i-- > 0; ) {
+		if (fds[i].revents == 0) continue;
+		int err = 0;
+		socklen_t errLen = (socklen_t)sizeof(err);
+		if (getsockopt(net->attempt[i].socket, SOL_SOCKET, SO_ERROR, &err, &errLen) != 0) err = errno;
+		if (err == 0) {
+			useAttempt(net, i);
+			return 1;
+		}
+		closeAttempt(net, i);
+		errno = err;
+		failed = 1;
+	}
+	if (failed != 0) {
+		/* try next address */
+		if (connectNext(ctx) != 1) return -1;
+		if (net->state != NS_CONNECT) return 1;
+	}
+	return 0;
+}
+
+
+/**
+ * Checks whether the idle connection of the given context may be re-used. The connection is stale
+ * if it was idle for too long or if the peer closed it meanwhile. An idle connection has nothing to
+ * read unless it was closed by the peer.
+ * 
+ * @param[in] ctx - context to use
+ * @return 1 if stale, else 0
+ */
+static int isStale(const tTr64RequestCtx * ctx) {
+	const tNetHandle * net = ctx->net;
+	char chr;
+	if (UINT_OVERFLOW_OP(getTimePoint(), -, net->idleTime) > (uint64_t)IDLE_TIMEOUT) return 1;
+	if (recv(net->socket, &chr, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+	return 1;
+}
+
+
+/**
+ * Sends the request again over a new connection if the re-used connection failed before any
+ * response data was received. This happens if the peer closed the idle connection just before the
+ * request was sent. Only idempotent requests are repeated once the request was sent completely.
+ * 
+ * @param[in,out] ctx - context to use
+ * @return 1 if the request was restarted, else 0
+ */
+static int retryRequest(tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	if (net->reused == 0 || (net->state == NS_RECEIVE && ctx->length > 0)) return 0;
+	if (net->pipelined != 0 && net->sent >= net->pipelineEnd[0]) return 0; /* a pipelined request was sent completely */
+	if (net->state == NS_RECEIVE && (ctx->fragments.length > 0 || net->requestLength < 4 || memcmp(ctx->buffer, "GET ", 4) != 0)) return 0;
+	/* the request is still in the buffer or its fragments as nothing was received */
+	net->reused = 0;
+	closeSocket(net);
+	ctx->length = net->requestLength;
+	net->sent = 0;
+	net->state = NS_CONNECT;
+	net->nextEntry = 0;
+	net->startTime = getTimePoint();
+	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_SOCK_RETRY));
+	return connectNext(ctx);
+}
+
+
+/**
+ * Checks whether the failed connection broke off a pipeline before the current response was
+ * started. The caller of requestPipelined() sends the requests again which were not sent
+ * completely in this case.
+ * 
+ * @param[in] ctx - context to use
+ * @return 1 if true, else 0
+ */
+static int isPipelineBreak(const tTr64RequestCtx * ctx) {
+	if (ctx->net->pipelined == 0 || ctx->length > 0) return 0;
+	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_SOCK_PIPELINE));
+	return 1;
+}
+
+
+/**
+ * Checks whether the response in the context buffer is complete and evaluates its status. Only the
+ * data received since the last call is parsed. The buffer is enlarged to the expected response size
+ * if needed. The body of a successful response is passed to the receive callback of the context as
+ * it arrives instead if set. The buffer only holds the header and the undecoded input in this case.
+ * 
+ * @param[in,out] ctx - context to use
+ * @return 1 if the response is complete and successful, 0 if incomplete, -1 on error
+ */
+static int parseResponse(tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	tTr64Response * response = &(net->response);
+	/* only parse the data received since the last call */
+	switch (p_httpResume(ctx->buffer, ctx->length, &(net->parser), NULL, httpResponseVisitor, response)) {
+	case PHRT_SUCCESS:
+		net->received = ctx->length;
+		ctx->status = response->status;
+		if (response->status == 401 && net->auth == 0) {
+			httpAuthentication(ctx, response);
+			return -1;
+		} else if (response->status != 200 && response->status != 304) {
+			if (ctx->verbose > 1) {
+				const tHttpStatusMsg * item = (const tHttpStatusMsg *)bs_staticArray(&(response->status), httpStatMsg, cmpHttpStatusMsg);
+				if (item != NULL) {
+					_ftprintf(ferr, MSGT(MSGT_ERR_HTTP_STATUS_STR), (unsigned)response->status, item->string);
+				} else  {
+					_ftprintf(ferr, MSGT(MSGT_ERR_HTTP_STATUS), (unsigned)response->status);
+				}
+			}
+			return -1;
+		} else if (ctx->receive != NULL && response->status == 200) {
+			/* pass the rest of the streamed body */
+			if (response->content.start != NULL && response->content.start != ctx->buffer && response->content.length > 0) {
+				if (ctx->receive(ctx, response->content.start, response->content.length, ctx->receiveParam) != 1) return -1;
+			}
+		} else if (response->content.start != NULL && response->content.start != ctx->buffer && response->content.length > 0) {
+			ctx->content = (char *)response->content.start;
+			/* limit to actual content length */
+			ctx->length = (size_t)(response->content.start + response->content.length - ctx->buffer);
+		}
+		ctx->etag = response->etag;
+		ctx->modified = response->modified;
+		return 1;
+	case PHRT_UNEXPECTED_END:
+		/* incomplete response */
+		if (ctx->receive != NULL && response->status == 200) {
+			/* pass the body received so far instead of buffering the whole response */
+			const size_t length = p_httpDrain(ctx->buffer, ctx->length, &(net->parser), httpReceiveVisitor, ctx);
+			if (length == (size_t)-1) return -1;
+			ctx->length = length;
+			return 0;
+		}
+		if (net->expected == 0 && response->content.start != NULL && response->content.length > 0) {
+			net->expected = (size_t)(response->content.start + response->content.length - ctx->buffer);
+			if (net->expected > ctx->capacity) {
+				if (net->expected > MAX_RESPONSE_SIZE) return -1; /* received response exceeds our defined limits */
+				if (resizeResponseBuffer(ctx, response, net->expected) != 1) {
+					if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+					return -1;
+				}
+			}
+		}
+		return 0;
+	default:
+		break;
+	}
+	return -1;
+}
+
+
+/**
+ * Sends the next part of the request without blocking. A request given as fragments is sent from
+ * the referenced data at once via sendmsg() (scatter-gather). Otherwise, it is sent from the
+ * context buffer.
+ * 
+ * @param[in,out] ctx - context to use
+ * @return number of bytes sent or -1 on error (see errno)
+ */
+static ssize_t sendRequest(tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	const tTr64Fragments * list = &(ctx->fragments);
+	struct iovec iov[SEND_FRAGMENTS];
+	struct msghdr msg = {0};
+	size_t i = 0, count = 0, skip = net->sent;
+	if (list->length < 1) return send(net->socket, ctx->buffer + net->sent, ctx->length - net->sent, MSG_NOSIGNAL);
+	/* skip the fragments already sent */
+	for (; i < list->length && skip >= list->item[i].length; i++) skip -= list->item[i].length;
+	for (; i < list->length && count < SEND_FRAGMENTS; i++, count++) {
+		iov[count].iov_base = (void *)(list->item[i].start + skip);
+		iov[count].iov_len = list->item[i].length - skip;
+		skip = 0;
+	}
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	return sendmsg(net->socket, &msg, MSG_NOSIGNAL);
+}
+
+
+/**
+ * Starts the HTTP request prepared in the context buffer or fragments without blocking. The open
+ * connection is re-used if possible. The request is continued by processRequest().
+ * 
+ * @param[in,out] ctx - context to use
+ * @return 1 on success, else 0
+ */
+static int startRequest(tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	
+	ctx->status = 400;
+	ctx->duration = (size_t)-1;
+	net->durationStart = getTimePoint();
+	net->startTime = net->durationStart;
+	net->sent = 0;
+	net->requestLength = (ctx->fragments.length > 0) ? ctx->fragments.size : ctx->length;
+	net->expected = 0;
+	net->received = 0;
+	net->auth = 0;
+	
+	if (ctx->auth != NULL) {
+		/* performing authentication of the previous request (a preemptive one may get a new challenge) */
+		net->auth = (ctx->preAuth == 0) ? 1 : 0;
+		free(ctx->auth);
+		ctx->auth = NULL;
+	}
+	ctx->preAuth = 0;
+	
+	ctx->content = NULL;
+	memset(&(ctx->etag), 0, sizeof(ctx->etag));
+	memset(&(ctx->modified), 0, sizeof(ctx->modified));
+	
+	if (ctx->address == NULL || ctx->address->list == NULL) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_OPT_NO_ADDR));
+		return 0;
+	}
+	
+	if (net->socket != -1 && (net->list != ctx->address->list || isStale(ctx) == 1)) {
+		closeSocket(net);
+	}
+	net->list = ctx->address->list;
+	
+	if (net->socket != -1) {
+		/* re-use the open connection */
+		net->reused = 1;
+		net->state = NS_SEND;
+		return 1;
+	}
+	net->reused = 0;
+	/* race connection attempts to the resolved addresses (RFC 8305) */
+	net->state = NS_CONNECT;
+	net->nextEntry = 0;
+	return connectNext(ctx);
+}
+
+
+/**
+ * Continues the request started via startRequest() as far as possible without blocking.
+ * 
+ * @param[in,out] ctx - context to use
+ * @param[in] readable - set to 1 if the socket is ready for reading
+ * @param[in] writable - set to 1 if the socket is ready for writing
+ * @return 1 if completed successfully, 0 if still pending, -1 on error
+ */
+static int processRequest(tTr64RequestCtx * ctx, const int readable, const int writable) {
+	tNetHandle * net = ctx->net;
+	ssize_t size;
+	
+	switch (net->state) {
+	case NS_CONNECT:
+		if (writable == 0) return 0;
+		switch (checkAttempts(ctx)) {
+		case 1:
 			break;
-		case PHRT_UNEXPECTED_END:
-			/* incomplete response */
-			if (response.content.start != NULL && response.content.length > 0 && (response.content.start + response.content.length) > (ctx->buffer + ctx->capacity)) {
-				const size_t newCapacity = (size_t)(response.content.start + response.content.length - ctx->buffer);
-				if (newCapacity > MAX_RESPONSE_SIZE) goto onError; /* received response exceeds our defined limits */
-				if (arrayFieldResize(ctx, buffer, newCapacity) != 1) {
+		case 0:
+			return 0;
+		default:
+			return -1;
+		}
+		/* fall-through */
+	case NS_SEND:
+		while (net->sent < net->requestLength) {
+			size = sendRequest(ctx);
+			if (size < 0) {
+				switch (errno) {
+				case EINTR:
+					if (signalReceived != 0) return -1;
+					/* try again */
+					continue;
+				case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+				case EWOULDBLOCK:
+#endif
+					return 0; /* wait until writable */
+				default:
+					if (retryRequest(ctx) == 1) return 0;
+					if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_HTTP_SEND_REQ));
+					if (ctx->verbose > 1) printLastError(ferr);
+					return -1;
+				}
+			}
+			net->sent += (size_t)size;
+		}
+		/* the response is received in the same buffer */
+		net->state = NS_RECEIVE;
+		net->startTime = getTimePoint();
+		ctx->length = 0;
+		memset(&(net->response), 0, sizeof(net->response));
+		p_httpInit(&(net->parser));
+		return 0;
+	case NS_RECEIVE:
+		if (readable == 0) return 0;
+		for (;;) {
+			size_t avail = ctx->capacity - ctx->length;
+			if (net->expected > ctx->length && (net->expected - ctx->length) < avail) {
+				avail = net->expected - ctx->length;
+			}
+			size = recv(net->socket, ctx->buffer + ctx->length, avail, 0);
+			if (size < 0) {
+				switch (errno) {
+				case EINTR:
+					if (signalReceived != 0) return -1;
+					/* try again */
+					continue;
+				case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+				case EWOULDBLOCK:
+#endif
+					return 0; /* wait until readable */
+				default:
+					if (retryRequest(ctx) == 1) return 0;
+					if (isPipelineBreak(ctx) == 1) return -1;
+					if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_HTTP_RECV_RESP));
+					if (ctx->verbose > 1) printLastError(ferr);
+					return -1;
+				}
+			} else if (size == 0) {
+				/* peer closed the connection before the response was complete */
+				if (retryRequest(ctx) == 1) return 0;
+				if (isPipelineBreak(ctx) == 1) return -1;
+				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_HTTP_RECV_RESP));
+				return -1;
+			}
+			if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_SOCK_RECV), (unsigned)size);
+			if ((size_t)(ctx->length + size) > MAX_RESPONSE_SIZE) return -1; /* received response exceeds our defined limits */
+			ctx->length += (size_t)size;
+			/* check if we have already received the whole response */
+			switch (parseResponse(ctx)) {
+			case 0:
+				break;
+			case 1:
+				return 1;
+			default:
+				return -1;
+			}
+			/* increase input buffer if needed (a streamed body has already been passed on) */
+			if (ctx->length >= ctx->capacity) {
+				const size_t newCapacity = ctx->capacity << 1;
+				if (newCapacity == 0) return -1; /* overflow */
+				if (resizeResponseBuffer(ctx, &(net->response), newCapacity) != 1) {
 					if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-					goto onError;
+					return -1;
 				}
 			}
+		}
+		break;
+	default:
+		break;
+	}
+	return -1;
+}
+
+
+/**
+ * Returns the time point at which checkTimeout() needs to be called next for the given context.
+ * 
+ * @param[in] ctx - context to use
+ * @return time point in milliseconds
+ */
+static uint64_t getDeadline(const tTr64RequestCtx * ctx) {
+	const tNetHandle * net = ctx->net;
+	const uint64_t deadline = net->startTime + (uint64_t)(ctx->timeout) + 1;
+	if (hasNextAttempt(ctx) == 1 && (net->attemptTime + CONNECT_ATTEMPT_DELAY) < deadline) {
+		return net->attemptTime + CONNECT_ATTEMPT_DELAY;
+	}
+	return deadline;
+}
+
+
+/**
+ * Checks whether the pending request of the given context exceeded the configured timeout. The
+ * next connection attempt is started once the connection attempt delay passed.
+ * 
+ * @param[in,out] ctx - context to use
+ * @return 0 if the timeout was not reached yet, -1 on timeout
+ */
+static int checkTimeout(tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	const uint64_t now = getTimePoint();
+	if (hasNextAttempt(ctx) == 1 && UINT_OVERFLOW_OP(now, -, net->attemptTime) >= CONNECT_ATTEMPT_DELAY) {
+		/* start the next connection attempt in parallel */
+		if (connectNext(ctx) != 1) return -1;
+	}
+	const uint64_t val = UINT_OVERFLOW_OP(now, -, net->startTime);
+	if (val <= (uint64_t)(ctx->timeout)) return 0;
+	switch (net->state) {
+	case NS_CONNECT:
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_CONNECT_TOUT));
+		break;
+	case NS_SEND:
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_SEND_TOUT));
+		break;
+	default:
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_RECV_TOUT));
+		break;
+	}
+	ctx->status = 408;
+	return -1;
+}
+
+
+/**
+ * Finishes the request of the given context. The socket is closed on error.
+ * 
+ * @param[in,out] ctx - context to use
+ * @param[in] result - result of the request
+ * @return 1 if the request succeeded, else 0
+ */
+static int finishRequest(tTr64RequestCtx * ctx, const int result) {
+	tNetHandle * net = ctx->net;
+	ctx->duration = (size_t)(UINT_OVERFLOW_OP(getTimePoint(), -, net->durationStart));
+	net->state = NS_IDLE;
+	/* the referenced request data may be released from now on */
+	ctx->fragments.length = 0;
+	ctx->fragments.size = 0;
+	if (result != 1) {
+		/* reset socket on error */
+		closeSocket(net);
+		return 0;
+	}
+	net->idleTime = getTimePoint();
+	return 1;
+}
+
+
+/**
+ * Updates the socket events the engine waits for according to the request state of the given
+ * context.
+ * 
+ * @param[in,out] engine - engine to use
+ * @param[in,out] ctx - context to use
+ * @return 1 on success, else 0
+ */
+static int updateEvents(tTr64Engine * engine, tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	struct epoll_event event;
+	uint32_t events;
+	int op;
+	if (net->socket == -1 && net->state == NS_CONNECT) {
+		/* register new connection attempts (closed sockets are removed from the epoll set implicitly) */
+		for (size_t i = 0; i < net->attempts; i++) {
+			tConnAttempt * attempt = net->attempt + i;
+			if (attempt->events != 0) continue;
+			memset(&event, 0, sizeof(event));
+			event.events = EPOLLOUT;
+			event.data.ptr = ctx;
+			if (epoll_ctl(engine->fd, EPOLL_CTL_ADD, attempt->socket, &event) != 0) {
+				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_ENGINE_EVENT));
+				if (ctx->verbose > 1) printLastError(ferr);
+				return 0;
+			}
+			attempt->events = EPOLLOUT;
+		}
+		net->events = (net->attempts > 0) ? EPOLLOUT : 0;
+		return 1;
+	}
+	if (net->socket == -1) {
+		/* closed sockets are removed from the epoll set implicitly */
+		net->events = 0;
+		return 1;
+	}
+	switch (net->state) {
+	case NS_IDLE:
+		events = 0;
+		break;
+	case NS_RECEIVE:
+		events = EPOLLIN;
+		break;
+	default:
+		events = EPOLLOUT;
+		break;
+	}
+	if (events == net->events) return 1;
+	if (events == 0) {
+		op = EPOLL_CTL_DEL;
+	} else if (net->events == 0) {
+		op = EPOLL_CTL_ADD;
+	} else {
+		op = EPOLL_CTL_MOD;
+	}
+	memset(&event, 0, sizeof(event));
+	event.events = events;
+	event.data.ptr = ctx;
+	if (epoll_ctl(engine->fd, op, net->socket, &event) != 0) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_ENGINE_EVENT));
+		if (ctx->verbose > 1) printLastError(ferr);
+		return 0;
+	}
+	net->events = events;
+	return 1;
+}
+
+
+/**
+ * Adds the given context to the pending requests of the engine.
+ * 
+ * @param[in,out] engine - engine to use
+ * @param[in,out] ctx - context to add
+ * @return 1 on success, else 0
+ */
+static int addPending(tTr64Engine * engine, tTr64RequestCtx * ctx) {
+	if (engine->length >= engine->capacity) {
+		if (arrayFieldResize(engine, ctx, PCF_MAX(INIT_ARRAY_SIZE, engine->capacity * 2)) != 1) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+			return 0;
+		}
+	}
+	ctx->net->engine = engine;
+	ctx->net->index = engine->length;
+	engine->ctx[engine->length] = ctx;
+	engine->length++;
+	return 1;
+}
+
+
+/**
+ * Removes the given context from the pending requests of the engine.
+ * 
+ * @param[in,out] engine - engine to use
+ * @param[in,out] ctx - context to remove
+ */
+static void removePending(tTr64Engine * engine, tTr64RequestCtx * ctx) {
+	tTr64RequestCtx * last = engine->ctx[engine->length - 1];
+	engine->ctx[ctx->net->index] = last;
+	last->net->index = ctx->net->index;
+	engine->length--;
+	ctx->net->engine = NULL;
+}
+
+
+/**
+ * Starts the request prepared in the given context and adds it to the pending requests of the
+ * engine. The request is finished if it could not be started.
+ * 
+ * @param[in,out] engine - engine to use
+ * @param[in,out] ctx - context to use
+ * @return 1 on success, else 0
+ */
+static int startPending(tTr64Engine * engine, tTr64RequestCtx * ctx) {
+	if (startRequest(ctx) != 1) goto onError;
+	if (addPending(engine, ctx) != 1) goto onError;
+	if (updateEvents(engine, ctx) != 1) {
+		removePending(engine, ctx);
+		goto onError;
+	}
+	return 1;
+onError:
+	finishRequest(ctx, -1);
+	return 0;
+}
+
+
+/**
+ * Handles the result of processRequest() or checkTimeout() for the given pending context. Finished
+ * requests are passed to the associated visitor which may start the next request.
+ * 
+ * @param[in,out] engine - engine to use
+ * @param[in,out] ctx - context to use
+ * @param[in] result - 1 if the request succeeded, 0 if still pending, -1 on error
+ * @return 1 on success, 0 if the visitor requested to abort
+ */
+static int completePending(tTr64Engine * engine, tTr64RequestCtx * ctx, int result) {
+	tNetHandle * net = ctx->net;
+	if (result == 0) {
+		if (updateEvents(engine, ctx) == 1) return 1;
+		result = -1;
+	}
+	removePending(engine, ctx);
+	result = finishRequest(ctx, result);
+	updateEvents(engine, ctx);
+	for (;;) {
+		switch (net->visitor(ctx, result, net->param)) {
+		case 0:
+			return 0;
+		case 2:
 			break;
 		default:
+			return 1;
+		}
+		if (startPending(engine, ctx) == 1) return 1;
+		result = 0;
+	}
+}
+
+
+/**
+ * Creates a new request engine which performs multiple HTTP requests concurrently on a single
+ * thread. Requests are added via submitTr64Request() and processed by pollTr64Engine().
+ * 
+ * @param[in] verbose - verbosity level
+ * @return Handle on success, else NULL.
+ */
+tTr64Engine * newTr64Engine(const int verbose) {
+	tTr64Engine * res = (tTr64Engine *)calloc(1, sizeof(tTr64Engine));
+	if (res == NULL) {
+		if (verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		return NULL;
+	}
+	res->verbose = verbose;
+	res->fd = epoll_create1(EPOLL_CLOEXEC);
+	if (res->fd == -1) {
+		if (verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_ENGINE_NEW));
+		if (verbose > 1) printLastError(ferr);
+		free(res);
+		return NULL;
+	}
+	return res;
+}
+
+
+/**
+ * Submits the request prepared in the buffer of the given context to the engine. The passed
+ * visitor is called from pollTr64Engine() once the request completed with 1 on success, else 0. It
+ * returns 0 to abort pollTr64Engine(), 1 to leave the context idle or 2 if the next request was
+ * prepared in the context buffer. The semantic of each request is the same as for request().
+ * The context may not be submitted again or freed while the request is pending.
+ * 
+ * @param[in,out] engine - engine to use
+ * @param[in,out] ctx - context to use
+ * @param[in] visitor - callback function called for the completed request
+ * @param[in,out] param - user defined callback function parameter
+ * @return 1 on success, 0 if the request could not be started
+ */
+int submitTr64Request(tTr64Engine * engine, tTr64RequestCtx * ctx, int (* visitor)(tTr64RequestCtx *, const int, void *), void * param) {
+	if (engine == NULL || ctx == NULL || visitor == NULL || (ctx->length < 1 && ctx->fragments.length < 1) || ctx->net->engine != NULL) return 0;
+	ctx->net->visitor = visitor;
+	ctx->net->param = param;
+	return startPending(engine, ctx);
+}
+
+
+/**
+ * Waits up to the given timeout for network events and continues all pending requests of the
+ * engine accordingly. Completed requests are passed to their visitor. The function returns early
+ * if a request timed out.
+ * 
+ * @param[in,out] engine - engine to use
+ * @param[in] timeout - maximum time to wait in milliseconds
+ * @param[out] pending - optional pointer to the number of pending requests
+ * @return 1 on success, 0 if aborted or on error
+ */
+int pollTr64Engine(tTr64Engine * engine, const size_t timeout, size_t * pending) {
+	struct epoll_event events[ENGINE_EVENTS];
+	int res = 0;
+	if (engine == NULL) return 0;
+	if (engine->length > 0) {
+		/* wait until the next event or the nearest request timeout */
+		const uint64_t now = getTimePoint();
+		uint64_t wait = (uint64_t)PCF_MIN(timeout, (size_t)INT_MAX);
+		for (size_t i = 0; i < engine->length; i++) {
+			const uint64_t deadline = getDeadline(engine->ctx[i]);
+			const uint64_t remaining = (deadline > now) ? (deadline - now) : 0;
+			if (remaining < wait) wait = remaining;
+		}
+		const int count = epoll_wait(engine->fd, events, ENGINE_EVENTS, (int)wait);
+		if (count < 0 && errno != EINTR) {
+			if (engine->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_ENGINE_WAIT));
+			if (engine->verbose > 1) printLastError(ferr);
 			goto onError;
-			break;
 		}
-		/* check configured timeout */
-onReceiveTimeout:
-		{
-			const uint64_t val = UINT_OVERFLOW_OP(getTimePoint(), -, startTime);
-			if (val > (uint64_t)(ctx->timeout)) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_SOCK_RECV_TOUT));
-				if (ctx->verbose > 1) printLastError(ferr);
-				ctx->status = 408;
-				goto onError; /* incomplete */
+		if (signalReceived != 0) goto onError;
+		/* continue requests with pending events */
+		for (int i = 0; i < count; i++) {
+			tTr64RequestCtx * ctx = (tTr64RequestCtx *)(events[i].data.ptr);
+			const uint32_t flags = events[i].events;
+			const int failed = ((flags & (EPOLLERR | EPOLLHUP)) != 0) ? 1 : 0;
+			if (ctx->net->engine != engine) continue;
+			const int result = processRequest(ctx, ((flags & EPOLLIN) != 0 || failed != 0) ? 1 : 0, ((flags & EPOLLOUT) != 0 || failed != 0) ? 1 : 0);
+			if (completePending(engine, ctx, result) != 1) goto onError;
+		}
+		/* check request timeouts */
+		for (size_t i = 0; i < engine->length; ) {
+			tTr64RequestCtx * ctx = engine->ctx[i];
+			const int result = checkTimeout(ctx);
+			if (result != 0 || ctx->net->events == 0) {
+				if (completePending(engine, ctx, result) != 1) goto onError;
 			}
-			if (signalReceived != 0) goto onError;
+			if (i < engine->length && engine->ctx[i] == ctx) i++;
 		}
 	}
-onSuccess:
 	res = 1;
 onError:
-	ctx->duration = (size_t)(UINT_OVERFLOW_OP(getTimePoint(), -, durationStart));
-	if (ctx->address != NULL) ctx->address->entry = NULL;
-	if (res == 0) {
-		/* reset socket on error */
-		if (ctx->net->socket != -1) {
-			shutdown(ctx->net->socket, SHUT_RDWR);
-			close(ctx->net->socket);
-			ctx->net->socket = -1;
+	if (pending != NULL) *pending = engine->length;
+	return res;
+}
+
+
+/**
+ * Frees the given request engine. All pending requests are aborted. The engine is invalid after
+ * this call.
+ * 
+ * @param[in,out] engine - engine to free
+ */
+void freeTr64Engine(tTr64Engine * engine) {
+	if (engine == NULL) return;
+	while (engine->length > 0) {
+		tTr64RequestCtx * ctx = engine->ctx[engine->length - 1];
+		removePending(engine, ctx);
+		finishRequest(ctx, -1);
+	}
+	if (engine->ctx != NULL) free(engine->ctx);
+	if (engine->fd != -1) close(engine->fd);
+	free(engine);
+}
+
+
+/**
+ * Performs the HTTP requests prepared in the buffers of the given contexts concurrently. Each
+ * context uses its own connection (see cloneTr64Request()). Contexts with an empty buffer are
+ * skipped. The passed visitor is called for each completed request as described for
+ * submitTr64Request().
+ * 
+ * @param[in,out] ctxs - contexts to use
+ * @param[in] count - number of contexts in ctxs
+ * @param[in] visitor - callback function called for each completed request
+ * @param[in,out] param - user defined callback function parameter
+ * @return 1 on success, 0 if aborted or on error
+ */
+int requestParallel(tTr64RequestCtx ** ctxs, const size_t count, int (* visitor)(tTr64RequestCtx *, const int, void *), void * param) {
+	if (ctxs == NULL || count < 1 || visitor == NULL) return 0;
+	if (ctxs[0]->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_REQUESTPARALLEL));
+	tTr64Engine * engine = newTr64Engine(ctxs[0]->verbose);
+	size_t pending = 0;
+	int res = 0;
+	if (engine == NULL) return 0;
+	
+	/* submit all prepared requests */
+	for (size_t i = 0; i < count; i++) {
+		tTr64RequestCtx * ctx = ctxs[i];
+		if (ctx->length < 1 && ctx->fragments.length < 1) continue;
+		while (submitTr64Request(engine, ctx, visitor, param) != 1) {
+			const int next = visitor(ctx, 0, param);
+			if (next == 0) goto onError;
+			if (next != 2) break;
+		}
+	}
+	
+	/* process pending requests */
+	do {
+		if (pollTr64Engine(engine, (size_t)-1, &pending) != 1) goto onError;
+	} while (pending > 0);
+	
+	res = 1;
+onError:
+	freeTr64Engine(engine);
+	return res;
+}
+
+
+/**
+ * Callback function for requestParallel() to store the result of a single request.
+ * 
+ * @param[in,out] ctx - context of the completed request
+ * @param[in] result - 1 if the request succeeded, else 0
+ * @param[out] param - result storage (int)
+ * @return 1
+ */
+static int requestVisitor(tTr64RequestCtx * ctx, const int result, void * param) {
+	PCF_UNUSED(ctx)
+	*((int *)param) = result;
+	return 1;
+}
+
+
+/**
+ * Performs a HTTP request for the parameters in the given context. The request fragments or, if
+ * none are given, the internal buffer provide the data which shall be sent to the host (with HTTP
+ * header). The result is stored in the internal buffer (with HTTP header). The internal socket will
+ * be left open. The function sets ctx->auth to the needed authentication response if the request
+ * failed due to a 401 status code. Re-sending the request with the proper authentication response
+ * will clear the ctx->auth field to avoid an infinite loop if the credentials are wrong.
+ * 
+ * @param[in,out] ctx - context to use
+ * @return 1 on success, 0 on error
+ * @remarks The calling function should check if ctx->auth is set and ctx->status == 401 to perform
+ * a second request with the authentication response provided by ctx->auth.
+ */
+static int request(tTr64RequestCtx * ctx) {
+	if (ctx == NULL || (ctx->length < 1 && ctx->fragments.length < 1)) return 0;
+	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_REQUEST));
+	int res = 0;
+	if (requestParallel(&ctx, 1, requestVisitor, &res) != 1) return 0;
+	return res;
+}
+
+
+/**
+ * Continues the request started via startRequest() until it completed or failed. The calling
+ * thread is blocked in the meantime.
+ * 
+ * @param[in,out] ctx - context to use
+ * @return 1 if completed successfully, -1 on error
+ */
+static int waitRequest(tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	struct pollfd fds[CONNECT_ATTEMPTS];
+	nfds_t count;
+	int result;
+	for (;;) {
+		/* wait for the connected socket or the pending connection attempts */
+		if (net->socket != -1) {
+			fds[0].fd = net->socket;
+			fds[0].events = (net->state == NS_RECEIVE) ? POLLIN : POLLOUT;
+			fds[0].revents = 0;
+			count = 1;
+		} else {
+			for (size_t i = 0; i < net->attempts; i++) {
+				fds[i].fd = net->attempt[i].socket;
+				fds[i].events = POLLOUT;
+				fds[i].revents = 0;
+			}
+			count = (nfds_t)(net->attempts);
+		}
+		const uint64_t now = getTimePoint();
+		const uint64_t deadline = getDeadline(ctx);
+		const int wait = (deadline > now) ? (int)PCF_MIN(deadline - now, (uint64_t)INT_MAX) : 0;
+		const int events = poll(fds, count, wait);
+		if (events < 0 && errno != EINTR) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_ENGINE_WAIT));
+			if (ctx->verbose > 1) printLastError(ferr);
+			return -1;
 		}
+		if (signalReceived != 0) return -1;
+		if (events > 0) {
+			int readable = 0, writable = 0;
+			for (nfds_t i = 0; i < count; i++) {
+				if ((fds[i].revents & (POLLIN | POLLERR | POLLHUP)) != 0) readable = 1;
+				if ((fds[i].revents & (POLLOUT | POLLERR | POLLHUP)) != 0) writable = 1;
+			}
+			result = processRequest(ctx, readable, writable);
+			if (result != 0) return result;
+		}
+		result = checkTimeout(ctx);
+		if (result != 0) return result;
 	}
+}
+
+
+/**
+ * Prepares the context to receive the next pipelined response. Data received after the end of the
+ * current response belongs to the next one and is moved to the start of the buffer.
+ * 
+ * @param[in,out] ctx - context to use
+ */
+static void nextResponse(tTr64RequestCtx * ctx) {
+	tNetHandle * net = ctx->net;
+	const size_t end = net->parser.offset;
+	const size_t rest = (net->received > end) ? (net->received - end) : 0;
+	if (rest > 0) memmove(ctx->buffer, ctx->buffer + end, rest);
+	ctx->length = rest;
+	ctx->status = 400;
+	ctx->duration = (size_t)-1;
+	ctx->content = NULL;
+	memset(&(ctx->etag), 0, sizeof(ctx->etag));
+	memset(&(ctx->modified), 0, sizeof(ctx->modified));
+	/* the requests are no longer in the buffer to send them again */
+	net->reused = 0;
+	net->auth = 0;
+	net->expected = 0;
+	net->received = 0;
+	net->durationStart = getTimePoint();
+	net->startTime = net->durationStart;
+	memset(&(net->response), 0, sizeof(net->response));
+	p_httpInit(&(net->parser));
+}
+
+
+/**
+ * Performs the HTTP requests prepared back to back in the buffer or fragments of the given context
+ * over a single connection without waiting for each response (HTTP/1.1 pipelining). The responses
+ * are received in order into the context buffer and passed to the given visitor. It returns 0 to
+ * stop or 1 to continue with the next response. A response with status 401 also stops as the
+ * authentication challenge is evaluated within the buffer. The pipeline breaks off if the
+ * connection fails or gets closed by the peer. Requests which were sent completely at this point
+ * may have been performed by the peer. They are passed to the visitor as failed with status 0.
+ * Requests which were not sent completely are not passed to the visitor. The caller needs to send
+ * them again, one by one. The connection is closed unless all responses were received.
+ * 
+ * @param[in,out] ctx - context to use
+ * @param[in] count - number of requests in the context buffer or fragments
+ * @param[in] end - end offset of each request within the context buffer or fragments (count elements)
+ * @param[in] visitor - callback function called for each received response
+ * @param[in,out] param - user defined callback function parameter
+ * @return 1 if all responses were passed to the visitor, else 0
+ * @see request()
+ */
+int requestPipelined(tTr64RequestCtx * ctx, const size_t count, const size_t * end, int (* visitor)(tTr64RequestCtx *, const int, void *), void * param) {
+	if (ctx == NULL || (ctx->length < 1 && ctx->fragments.length < 1) || count < 1 || end == NULL || visitor == NULL) return 0;
+	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_REQUESTPIPELINED));
+	tNetHandle * net = ctx->net;
+	int result = -1;
+	int res = 0;
+	
+	/* send all requests and receive the first response */
+	net->pipelined = 1;
+	net->pipelineEnd = end;
+	if (startRequest(ctx) == 1) result = waitRequest(ctx);
+	for (size_t i = 0; ; ) {
+		ctx->duration = (size_t)(UINT_OVERFLOW_OP(getTimePoint(), -, net->durationStart));
+		if (net->received == 0) {
+			/* incomplete response; it failed if it was started or timed out */
+			int next = 1;
+			if ((net->state == NS_RECEIVE && ctx->length > 0) || ctx->status == 408) {
+				next = visitor(ctx, 0, param);
+				i++;
+			}
+			/* requests sent completely may have been performed and are not repeated */
+			for (; next != 0 && i < count && end[i] <= net->sent; i++) {
+				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_HTTP_PIPELINE_RESP));
+				ctx->status = 0;
+				ctx->duration = (size_t)-1;
+				next = visitor(ctx, 0, param);
+			}
+			break;
+		}
+		if (visitor(ctx, (result == 1) ? 1 : 0, param) == 0 || ctx->status == 401) break;
+		if (++i >= count) {
+			res = 1;
+			break;
+		}
+		nextResponse(ctx);
+		result = (ctx->length > 0) ? parseResponse(ctx) : 0;
+		if (result == 0) result = waitRequest(ctx);
+	}
+	net->pipelined = 0;
+	net->pipelineEnd = NULL;
+	finishRequest(ctx, res);
 	return res;
 }
 
@@ -792,9 +1831,36 @@ static int resolve(tTr64RequestCtx * ctx) {
 	
 	res = (tIpAddress *)malloc(sizeof(tIpAddress));
 	if (res == NULL) goto onError;
-	res->entry = NULL;
+	res->order = NULL;
+	res->count = 0;
+	res->refCount = 1;
 	
-	if (getaddrinfo(ctx->host, ctx->port, &hints, &(res->list)) != 0) goto onError;
+	if (getaddrinfo(ctx->host, ctx->port, &hints, &(res->list)) != 0) {
+		res->list = NULL;
+		goto onError;
+	}
+	
+	/* interleave the address families for the connection attempts (RFC 8305 section 4) */
+	for (const struct addrinfo * addr = res->list; addr != NULL; addr = addr->ai_next) res->count++;
+	if (res->count > 0) {
+		const int family = res->list->ai_family;
+		const struct addrinfo * first = res->list;
+		const struct addrinfo * other = res->list;
+		res->order = (const struct addrinfo **)malloc(sizeof(const struct addrinfo *) * res->count);
+		if (res->order == NULL) goto onError;
+		for (size_t i = 0; i < res->count; ) {
+			for (; first != NULL && first->ai_family != family; first = first->ai_next);
+			if (first != NULL) {
+				res->order[i++] = first;
+				first = first->ai_next;
+			}
+			for (; other != NULL && other->ai_family == family; other = other->ai_next);
+			if (other != NULL) {
+				res->order[i++] = other;
+				other = other->ai_next;
+			}
+		}
+	}
 	
 	ctx->address = res;
 	ctx->duration = (size_t)(UINT_OVERFLOW_OP(getTimePoint(), -, durationStart));
@@ -802,7 +1868,10 @@ static int resolve(tTr64RequestCtx * ctx) {
 	return 1;
 onError:
 	ctx->duration = (size_t)(UINT_OVERFLOW_OP(getTimePoint(), -, durationStart));
-	if (res != NULL) free(res);
+	if (res != NULL) {
+		if (res->list != NULL) freeaddrinfo(res->list);
+		free(res);
+	}
 	return 0;
 }
 
@@ -816,10 +1885,6 @@ onError:
 static int reset(tTr64RequestCtx * ctx) {
 	if (ctx == NULL) return 0;
 	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_RESET));
-	/* reset resolved address list iterator */
-	if (ctx->address != NULL) {
-		ctx->address->entry = NULL;
-	}
 	/* reset socket */
 	if (ctx->net != NULL && ctx->net->socket != -1) {
 		shutdown(ctx->net->socket, SHUT_RDWR);
@@ -909,8 +1974,10 @@ tTr64RequestCtx * newTr64Request(const char * url, const char * user, const char
 		if (verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
 		goto onError;
 	}
+	memset(res->net, 0, sizeof(*(res->net)));
 	res->net->list = NULL;
 	res->net->socket = -1;
+	res->net->state = NS_IDLE;
 	res->request = request;
 	res->reset = reset;
 	res->printAddress = printAddresses;
@@ -928,6 +1995,65 @@ onError:
 }
 
 
+/**
+ * Creates a new HTTP request context for the same host as the given one. The resolved addresses
+ * are shared with the given context but the new context uses its own connection and buffer.
+ * 
+ * @param[in] ctx - context to clone
+ * @return Handle on success, else NULL.
+ */
+tTr64RequestCtx * cloneTr64Request(const tTr64RequestCtx * ctx) {
+	if (ctx == NULL) return NULL;
+	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_CLONETR64REQUEST));
+	
+	tTr64RequestCtx * res = (tTr64RequestCtx *)malloc(sizeof(tTr64RequestCtx));
+	if (res == NULL) goto onOutOfMemory;
+	memset(res, 0, sizeof(*res));
+	
+#define CLONE_STR(field) \
+	if (ctx->field != NULL) { \
+		res->field = strdup(ctx->field); \
+		if (res->field == NULL) goto onOutOfMemory; \
+	}
+	CLONE_STR(protocol)
+	CLONE_STR(user)
+	CLONE_STR(pass)
+	CLONE_STR(host)
+	CLONE_STR(port)
+	CLONE_STR(path)
+#undef CLONE_STR
+	
+	res->format = ctx->format;
+	res->timeout = ctx->timeout;
+	
+	res->discover = ctx->discover;
+	res->resolve = ctx->resolve;
+	res->net = (tNetHandle *)malloc(sizeof(tNetHandle));
+	if (res->net == NULL) goto onOutOfMemory;
+	memset(res->net, 0, sizeof(*(res->net)));
+	res->net->list = NULL;
+	res->net->socket = -1;
+	res->net->state = NS_IDLE;
+	res->request = ctx->request;
+	res->reset = ctx->reset;
+	res->printAddress = ctx->printAddress;
+	res->verbose = ctx->verbose;
+	
+	if (ctx->address != NULL) {
+		res->address = ctx->address;
+		res->address->refCount++;
+	}
+	
+	if (arrayFieldInit(res, buffer, BUFFER_SIZE) != 1) goto onOutOfMemory;
+	
+	return res;
+onOutOfMemory:
+	if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+	freeTr64Request(res);
+	return NULL;
+}
+
+
 /**
  * Frees the given HTTP request context. The context is invalid after this call.
  * 
@@ -944,17 +2070,23 @@ void freeTr64Request(tTr64RequestCtx * ctx) {
 	if (ctx->path != NULL) free(ctx->path);
 	if (ctx->method != NULL) free(ctx->method);
 	if (ctx->auth != NULL) free(ctx->auth);
+	if (ctx->realm != NULL) free(ctx->realm);
+	if (ctx->nonce != NULL) free(ctx->nonce);
+	if (ctx->opaque != NULL) free(ctx->opaque);
 	if (ctx->address != NULL) {
-		if (ctx->address->list != NULL) freeaddrinfo(ctx->address->list);
-		free(ctx->address);
+		if (ctx->address->refCount > 1) {
+			ctx->address->refCount--;
+		} else {
+			if (ctx->address->list != NULL) freeaddrinfo(ctx->address->list);
+			if (ctx->address->order != NULL) free((void *)(ctx->address->order));
+			free(ctx->address);
+		}
 	}
 	if (ctx->net != NULL) {
-		if (ctx->net->socket != -1) {
-			shutdown(ctx->net->socket, SHUT_RDWR);
-			close(ctx->net->socket);
-		}
+		closeSocket(ctx->net);
 		free(ctx->net);
 	}
+	if (ctx->fragments.item != NULL) free(ctx->fragments.item);
 	if (ctx->buffer != NULL) free(ctx->buffer);
 	free(ctx);
 }
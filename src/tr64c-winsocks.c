@@ -2,7 +2,7 @@
  * @file tr64c_winsocks.c
  * @author Daniel Starke
  * @date 2018-06-21
- * @version 2018-08-17
+ * @version 2026-10-16
  * 
  * DISCLAIMER
  * This file has no copyright assigned and is placed in the Public Domain.
@@ -24,21 +24,31 @@
 #define WIN32_LEAN_AND_MEAN
 #endif
 #include <windows.h>
+#include <sddl.h>
 #include <winsock2.h>
 #include <ws2tcpip.h>
 
 
 #ifdef _MSC_VER
+#pragma comment(lib, "Advapi32.lib")
 #pragma comment(lib, "Ws2_32.lib")
 #endif
 
 
+struct tTr64RequestCtx;
+
+
+/** Maximum number of request fragments passed per WSASend() call. */
+#define SEND_FRAGMENTS 64
+
+
 /**
  * Internal list of IP addresses of a single host.
  */
 struct sIpAddress {
 	ADDRINFOT * list;
 	ADDRINFOT * entry;
+	size_t refCount; /* number of request contexts sharing this list */
 };
 
 
@@ -48,6 +58,21 @@ struct sIpAddress {
 struct sNetHandle {
 	ADDRINFOT * list;
 	SOCKET socket;
+	DWORD idleTime; /* time point at which the connection became idle */
+	struct sEngine * engine; /* engine processing the pending request */
+	int (* visitor)(struct tTr64RequestCtx *, const int, void *); /* callback for the completed request */
+	void * param; /* user defined callback function parameter */
+};
+
+
+/**
+ * Internal request engine.
+ */
+struct sEngine {
+	struct tTr64RequestCtx ** ctx; /* pending requests */
+	size_t capacity; /* total capacity of ctx in number of elements */
+	size_t length; /* number of elements in ctx */
+	int verbose; /* verbosity level */
 };
 
 
@@ -67,6 +92,19 @@ int isFile(const TCHAR * src) {
 }
 
 
+/**
+ * Checks if the given path exists and is a directory.
+ * 
+ * @param[in] src - check this path
+ * @return 1 if src exists and is a directory, else 0
+ */
+int isDir(const TCHAR * src) {
+	if (src == NULL) return 0;
+	DWORD dwAttrib = GetFileAttributes(src);
+	return (dwAttrib != INVALID_FILE_ATTRIBUTES && (dwAttrib & FILE_ATTRIBUTE_DIRECTORY) != 0) ? 1 : 0;
+}
+
+
 /**
  * Reads the given file as a single null-terminated allocated UTF-8 string.
  * 
@@ -82,7 +120,8 @@ char * readFileToString(const TCHAR * src, size_t * len) {
 	char * str = NULL;
 	char * res = NULL;
 	
-	hFile = CreateFile(src, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	/* allow concurrent writers to replace the file while it is read */
+	hFile = CreateFile(src, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 	if (hFile == INVALID_HANDLE_VALUE) goto onError;
 	
 	if (GetFileSizeEx(hFile, &lpFileSize) == 0) goto onError;
@@ -108,7 +147,101 @@ onError:
 
 
 /**
- * Write a null-terminated UTF-8 string to the given file. Existing files will be overwritten.
+ * Maps the given file read-only into memory.
+ * 
+ * @param[in] src - input file path
+ * @param[out] len - pointer for the resulting length
+ * @return pointer to the mapped file content on success, else NULL
+ * @see unmapFile()
+ */
+const char * mapFile(const TCHAR * src, size_t * len) {
+	if (src == NULL || len == NULL) return NULL;
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	HANDLE hMap = NULL;
+	LARGE_INTEGER lpFileSize;
+	void * res = NULL;
+	
+	*len = 0;
+	hFile = CreateFile(src, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) goto onError;
+	
+	if (GetFileSizeEx(hFile, &lpFileSize) == 0) goto onError;
+	if (lpFileSize.QuadPart < 1 || lpFileSize.QuadPart > 0xFFFFFFFE) goto onError; /* 32-bit limit */
+	
+	hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMap == NULL) goto onError;
+	
+	/* the view keeps the mapping alive after the handles are closed */
+	res = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	if (res != NULL) *len = (size_t)(lpFileSize.QuadPart);
+onError:
+	if (hMap != NULL) CloseHandle(hMap);
+	if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+	return (const char *)res;
+}
+
+
+/**
+ * Releases the file mapping created by mapFile().
+ * 
+ * @param[in] ptr - pointer to the mapped file content
+ * @param[in] len - length of the mapped file content
+ */
+void unmapFile(const char * ptr, const size_t len) {
+	PCF_UNUSED(len);
+	if (ptr == NULL) return;
+	UnmapViewOfFile(ptr);
+}
+
+
+/**
+ * Replaces the given file atomically with a UTF-8 string. The string is written to a temporary
+ * file next to the destination which is then moved over it. Concurrent readers therefore either
+ * see the previous or the new file content.
+ * 
+ * @param[in] dst - output file path
+ * @param[in] str - input string
+ * @param[in] len - length of the input string in bytes
+ * @param[in] sa - security attributes of the new file or NULL
+ * @return 1 on success, else 0
+ */
+static int replaceFile(const TCHAR * dst, const char * str, const size_t len, SECURITY_ATTRIBUTES * sa) {
+	if (dst == NULL || str == NULL) return 0;
+	const size_t tmpLen = _tcslen(dst) + 32;
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	DWORD lpNumberOfBytesWritten;
+	TCHAR * tmp = NULL;
+	int res = 0;
+	
+	/* the process ID makes the temporary file unique among concurrent writers */
+	tmp = (TCHAR *)malloc(tmpLen * sizeof(TCHAR));
+	if (tmp == NULL) goto onError;
+	_sntprintf(tmp, tmpLen, _T("%s.%lu.tmp"), dst, (unsigned long)GetCurrentProcessId());
+	
+	hFile = CreateFile(tmp, GENERIC_WRITE, 0, sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) goto onError;
+	
+	if (WriteFile(hFile, str, (DWORD)len, &lpNumberOfBytesWritten, NULL) == 0) goto onError;
+	if (lpNumberOfBytesWritten != (DWORD)len) goto onError;
+	CloseHandle(hFile);
+	hFile = INVALID_HANDLE_VALUE;
+	
+	if (MoveFileEx(tmp, dst, MOVEFILE_REPLACE_EXISTING) == 0) goto onError;
+	
+	res = 1;
+onError:
+	if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+	if (tmp != NULL) {
+		if (res != 1) DeleteFile(tmp);
+		free(tmp);
+	}
+	return res;
+}
+
+
+/**
+ * Write a null-terminated UTF-8 string to the given file. Existing files will be replaced
+ * atomically.
  * 
  * @param[in] dst - output file path
  * @param[in] str - null-terminated input string
@@ -120,7 +253,7 @@ int writeStringToFile(const TCHAR * dst, const char * str) {
 
 
 /**
- * Write a UTF-8 string to the given file. Existing files will be overwritten.
+ * Write a UTF-8 string to the given file. Existing files will be replaced atomically.
  * 
  * @param[in] dst - output file path
  * @param[in] str - input string
@@ -128,12 +261,53 @@ int writeStringToFile(const TCHAR * dst, const char * str) {
  * @return 1 on success, else 0
  */
 int writeStringNToFile(const TCHAR * dst, const char * str, const size_t len) {
+	return replaceFile(dst, str, len, NULL);
+}
+
+
+/**
+ * Write a UTF-8 string to the given file which is only accessible by the current user. Existing
+ * files will be replaced atomically.
+ * 
+ * @param[in] dst - output file path
+ * @param[in] str - input string
+ * @param[in] len - length of the input string in bytes
+ * @return 1 on success, else 0
+ */
+int writePrivateStringNToFile(const TCHAR * dst, const char * str, const size_t len) {
+	if (dst == NULL || str == NULL) return 0;
+	SECURITY_ATTRIBUTES sa;
+	int res;
+	
+	/* protected DACL which grants full access to the owner only */
+	sa.nLength = sizeof(sa);
+	sa.lpSecurityDescriptor = NULL;
+	sa.bInheritHandle = FALSE;
+	if (ConvertStringSecurityDescriptorToSecurityDescriptor(_T("D:P(A;;FA;;;OW)"), SDDL_REVISION_1, &(sa.lpSecurityDescriptor), NULL) == 0) return 0;
+	
+	/* the security descriptor only applies to newly created files like the temporary one */
+	res = replaceFile(dst, str, len, &sa);
+	LocalFree(sa.lpSecurityDescriptor);
+	return res;
+}
+
+
+/**
+ * Appends a UTF-8 string to the given file. The file is created if it does not exist. The string
+ * is written with a single call to allow concurrent writers to append whole lines.
+ * 
+ * @param[in] dst - output file path
+ * @param[in] str - input string
+ * @param[in] len - length of the input string in bytes
+ * @return 1 on success, else 0
+ */
+int appendStringNToFile(const TCHAR * dst, const char * str, const size_t len) {
 	if (dst == NULL || str == NULL) return 0;
 	HANDLE hFile = INVALID_HANDLE_VALUE;
 	DWORD lpNumberOfBytesWritten;
 	int res = 0;
 	
-	hFile = CreateFile(dst, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	hFile = CreateFile(dst, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
 	if (hFile == INVALID_HANDLE_VALUE) goto onError;
 	
 	if (WriteFile(hFile, str, (DWORD)len, &lpNumberOfBytesWritten, NULL) == 0) goto onError;
@@ -463,6 +637,7 @@ static int resolve(tTr64RequestCtx * ctx) {
 	res = (tIpAddress *)malloc(sizeof(tIpAddress));
 	if (res == NULL) goto onError;
 	res->entry = NULL;
+	res->refCount = 1;
 	
 	if (GetAddrInfo(nativeHost, nativePort, &hints, &(res->list)) != 0) goto onError;
 	
@@ -482,9 +657,56 @@ onError:
 
 
 /**
- * Performs a HTTP request for the parameters in the given context. The internal buffer is used to
- * provide data which shall be sent to the host (with HTTP header). The result is stored in the
- * same buffer (with HTTP header). The internal socket will be left open.
+ * Checks whether the idle connection of the given context may be re-used. The connection is stale
+ * if it was idle for too long or if the peer closed it meanwhile. An idle connection is not
+ * readable unless it was closed by the peer.
+ * 
+ * @param[in] ctx - context to use
+ * @return 1 if stale, else 0
+ */
+static int isStale(const tTr64RequestCtx * ctx) {
+	fd_set fds;
+	struct timeval timeout = {0, 0};
+	if (UINT_OVERFLOW_OP(GetTickCount(), -, ctx->net->idleTime) > (DWORD)IDLE_TIMEOUT) return 1;
+	FD_ZERO(&fds);
+	FD_SET(ctx->net->socket, &fds);
+	return (select(0, &fds, NULL, NULL, &timeout) != 0) ? 1 : 0;
+}
+
+
+/**
+ * Sends the request data starting at the given offset. A request given as fragments is sent from
+ * the referenced data at once via WSASend() (scatter-gather). Otherwise, it is sent from the
+ * context buffer.
+ * 
+ * @param[in,out] ctx - context to use
+ * @param[in] offset - number of request bytes sent so far
+ * @return number of bytes sent or SOCKET_ERROR (see WSAGetLastError())
+ */
+static int sendRequest(tTr64RequestCtx * ctx, const size_t offset) {
+	const tTr64Fragments * list = &(ctx->fragments);
+	WSABUF buf[SEND_FRAGMENTS];
+	DWORD count = 0, sent = 0;
+	size_t i = 0, skip = offset;
+	if (list->length < 1) return send(ctx->net->socket, ctx->buffer + offset, (int)(ctx->length - offset), 0);
+	/* skip the fragments already sent */
+	for (; i < list->length && skip >= list->item[i].length; i++) skip -= list->item[i].length;
+	for (; i < list->length && count < SEND_FRAGMENTS; i++, count++) {
+		buf[count].buf = (CHAR *)(list->item[i].start + skip);
+		buf[count].len = (ULONG)(list->item[i].length - skip);
+		skip = 0;
+	}
+	if (WSASend(ctx->net->socket, buf, count, &sent, 0, NULL, NULL) != 0) return SOCKET_ERROR;
+	return (int)sent;
+}
+
+
+/**
+ * Performs a HTTP request for the parameters in the given context. The request fragments or, if
+ * none are given, the internal buffer provide the data which shall be sent to the host (with HTTP
+ * header). The result is stored in the internal buffer (with HTTP header). The body of a successful
+ * response is passed to the receive callback of the context as it arrives instead if set. The
+ * internal socket will be left open.
  * The function sets ctx->auth to the needed authentication response if the request failed due to a
  * 401 status code. Re-sending the request with the proper authentication response will clear the
  * ctx->auth field to avoid an infinite loop if the credentials are wrong.
@@ -495,11 +717,14 @@ onError:
  * a second request with the authentication response provided by ctx->auth.
  */
 static int request(tTr64RequestCtx * ctx) {
-	if (ctx == NULL || ctx->length < 1) return 0;
+	if (ctx == NULL || (ctx->length < 1 && ctx->fragments.length < 1)) return 0;
 	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_REQUEST));
 	const ADDRINFOT * addr = NULL;
-	int sRes, res = 0, auth = 0;
+	const size_t requestLength = ctx->length;
+	const size_t sendLength = (ctx->fragments.length > 0) ? ctx->fragments.size : ctx->length;
+	int sRes, res = 0, auth = 0, reused = 0, isGet = 0;
 	tTr64Response response = {0};
+	tPHttpState httpState;
 	DWORD startTime, durationStart;
 	
 	ctx->status = 400;
@@ -507,14 +732,18 @@ static int request(tTr64RequestCtx * ctx) {
 	durationStart = GetTickCount();
 	
 	if (ctx->auth != NULL) {
-		auth = 1; /* performing authentication of the previous request */
+		/* performing authentication of the previous request (a preemptive one may get a new challenge) */
+		auth = (ctx->preAuth == 0) ? 1 : 0;
 		free(ctx->auth);
 		ctx->auth = NULL;
 	}
+	ctx->preAuth = 0;
 	
 	ctx->content = NULL;
+	memset(&(ctx->etag), 0, sizeof(ctx->etag));
+	memset(&(ctx->modified), 0, sizeof(ctx->modified));
 	
-	if (ctx->net->socket != INVALID_SOCKET && ctx->net->list != ctx->address->list) {
+	if (ctx->net->socket != INVALID_SOCKET && (ctx->net->list != ctx->address->list || isStale(ctx) == 1)) {
 		shutdown(ctx->net->socket, SD_BOTH);
 		closesocket(ctx->net->socket);
 		ctx->net->socket = INVALID_SOCKET;
@@ -531,6 +760,7 @@ static int request(tTr64RequestCtx * ctx) {
 		/* restart iteration over resolved addresses */
 		ctx->address->entry = ctx->address->list;
 	}
+	reused = (ctx->net->socket != INVALID_SOCKET) ? 1 : 0;
 	
 onTryNext:
 	/* try to connect to one of the given addresses */
@@ -602,8 +832,8 @@ onTryNext:
 	
 	/* send HTTP request */
 	sRes = 0;
-	for (size_t i = 0; i < ctx->length; i += (size_t)sRes) {
-		sRes = send(ctx->net->socket, ctx->buffer + i, (int)(ctx->length - i), 0);
+	for (size_t i = 0; i < sendLength; i += (size_t)sRes) {
+		sRes = sendRequest(ctx, i);
 		if (sRes < 0) {
 			switch (WSAGetLastError()) {
 			case WSAEINPROGRESS:
@@ -618,6 +848,7 @@ onTryNext:
 				goto onError;
 				break;
 			default:
+				if (reused != 0) goto onRetry;
 				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_HTTP_SEND_REQ));
 				if (ctx->verbose > 1) printLastWsaError(ferr);
 				goto onError;
@@ -627,15 +858,17 @@ onTryNext:
 	}
 	if (signalReceived != 0) goto onError;
 	
-	/* receive HTTP response */
+	/* receive HTTP response (only idempotent requests are repeated once sent completely) */
+	isGet = (ctx->fragments.length < 1 && requestLength >= 4 && memcmp(ctx->buffer, "GET ", 4) == 0) ? 1 : 0;
 	sRes = 0;
 	startTime = GetTickCount();
+	p_httpInit(&httpState);
 	for (ctx->length = 0; ctx->length < ctx->capacity; ) {
 		/*
 		 * Receiving the last byte of the HTTP response may take up to 400ms if the peer did not set the push bit.
 		 * This is due to Windows' TCP Acknowledgment Delay algorithm (see http://www.icpdas.com/root/support/faq/card/software/FAQ_Disable_TCP_ACK_Delay_en.pdf).
 		 */
-		if (response.content.start != NULL && response.content.length > 0) {
+		if (response.content.start != NULL && response.content.length > 0 && (ctx->receive == NULL || response.status != 200)) {
 			sRes = recv(ctx->net->socket, ctx->buffer + ctx->length, (int)(response.content.start + response.content.length - ctx->buffer - ctx->length), 0);
 		} else {
 			sRes = recv(ctx->net->socket, ctx->buffer + ctx->length, (int)(ctx->capacity - ctx->length), 0);
@@ -651,6 +884,7 @@ onTryNext:
 				goto onReceiveTimeout;
 				break;
 			default:
+				if (reused != 0 && ctx->length == 0 && isGet != 0) goto onRetry;
 				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_HTTP_RECV_RESP));
 				if (ctx->verbose > 1) printLastWsaError(ferr);
 				goto onError;
@@ -659,29 +893,20 @@ onTryNext:
 			break; /* timeout -> assume successful completion */
 		} else if (sRes == 0) {
 			/* peer closed the connection */
+			if (reused != 0 && ctx->length == 0 && isGet != 0) goto onRetry;
 			break;
 		}
 		if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_SOCK_RECV), (unsigned)sRes);
 		if ((size_t)(ctx->length + sRes) > MAX_RESPONSE_SIZE) goto onError; /* received response exceeds our defined limits */
 		ctx->length += (size_t)sRes;
-		/* increase input buffer if needed */
-		if (ctx->length >= ctx->capacity) {
-			const size_t newCapacity = ctx->capacity << 1;
-			if (newCapacity == 0) goto onError; /* overflow */
-			if (arrayFieldResize(ctx, buffer, newCapacity) != 1) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-				goto onError;
-			}
-		}
-		/* check if we have already received the whole response */
-		memset(&response, 0, sizeof(response));
-		switch (p_http(ctx->buffer, ctx->length, NULL, httpResponseVisitor, &response)) {
+		/* check if we have already received the whole response (only the new data is parsed) */
+		switch (p_httpResume(ctx->buffer, ctx->length, &httpState, NULL, httpResponseVisitor, &response)) {
 		case PHRT_SUCCESS:
 			ctx->status = response.status;
 			if (response.status == 401 && auth == 0) {
 				httpAuthentication(ctx, &response);
 				goto onError;
-			} else if (response.status != 200) {
+			} else if (response.status != 200 && response.status != 304) {
 				if (ctx->verbose > 1) {
 					const tHttpStatusMsg * item = (const tHttpStatusMsg *)bs_staticArray(&(response.status), httpStatMsg, cmpHttpStatusMsg);
 					if (item != NULL) {
@@ -691,19 +916,31 @@ onTryNext:
 					}
 				}
 				goto onError;
+			} else if (ctx->receive != NULL && response.status == 200) {
+				/* pass the rest of the streamed body */
+				if (response.content.start != NULL && response.content.start != ctx->buffer && response.content.length > 0) {
+					if (ctx->receive(ctx, response.content.start, response.content.length, ctx->receiveParam) != 1) goto onError;
+				}
 			} else if (response.content.start != NULL && response.content.start != ctx->buffer && response.content.length > 0) {
 				ctx->content = (char *)response.content.start;
 				/* limit to actual content length */
 				ctx->length = (size_t)(response.content.start + response.content.length - ctx->buffer);
 			}
+			ctx->etag = response.etag;
+			ctx->modified = response.modified;
 			goto onSuccess;
 			break;
 		case PHRT_UNEXPECTED_END:
 			/* incomplete response */
-			if (response.content.start != NULL && response.content.length > 0 && (response.content.start + response.content.length) > (ctx->buffer + ctx->capacity)) {
+			if (ctx->receive != NULL && response.status == 200) {
+				/* pass the body received so far instead of buffering the whole response */
+				const size_t length = p_httpDrain(ctx->buffer, ctx->length, &httpState, httpReceiveVisitor, ctx);
+				if (length == (size_t)-1) goto onError;
+				ctx->length = length;
+			} else if (response.content.start != NULL && response.content.length > 0 && (response.content.start + response.content.length) > (ctx->buffer + ctx->capacity)) {
 				const size_t newCapacity = (size_t)(response.content.start + response.content.length - ctx->buffer);
 				if (newCapacity > MAX_RESPONSE_SIZE) goto onError; /* received response exceeds our defined limits */
-				if (arrayFieldResize(ctx, buffer, newCapacity) != 1) {
+				if (resizeResponseBuffer(ctx, &response, newCapacity) != 1) {
 					if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
 					goto onError;
 				}
@@ -713,6 +950,15 @@ onTryNext:
 			goto onError;
 			break;
 		}
+		/* increase input buffer if needed (a streamed body has already been passed on) */
+		if (ctx->length >= ctx->capacity) {
+			const size_t newCapacity = ctx->capacity << 1;
+			if (newCapacity == 0) goto onError; /* overflow */
+			if (resizeResponseBuffer(ctx, &response, newCapacity) != 1) {
+				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+				goto onError;
+			}
+		}
 		/* check configured timeout */
 onReceiveTimeout:
 		{
@@ -726,11 +972,26 @@ onReceiveTimeout:
 			if (signalReceived != 0) goto onError;
 		}
 	}
+	goto onSuccess;
+onRetry:
+	/* the re-used connection was closed by the peer; the request is still unchanged */
+	shutdown(ctx->net->socket, SD_BOTH);
+	closesocket(ctx->net->socket);
+	ctx->net->socket = INVALID_SOCKET;
+	ctx->length = requestLength;
+	ctx->address->entry = ctx->address->list;
+	reused = 0;
+	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_SOCK_RETRY));
+	goto onTryNext;
 onSuccess:
+	ctx->net->idleTime = GetTickCount();
 	res = 1;
 onError:
 	ctx->duration = (size_t)(UINT_OVERFLOW_OP(GetTickCount(), -, durationStart));
 	if (ctx->address != NULL) ctx->address->entry = NULL;
+	/* the referenced request data may be released from now on */
+	ctx->fragments.length = 0;
+	ctx->fragments.size = 0;
 	if (res == 0) {
 		/* reset socket on error */
 		if (ctx->net->socket != INVALID_SOCKET) {
@@ -743,6 +1004,162 @@ onError:
 }
 
 
+/**
+ * Performs the HTTP requests prepared in the buffers of the given contexts. Contexts with an empty
+ * buffer are skipped. The passed visitor is called for each completed request with 1 on success,
+ * else 0. It returns 0 to abort all pending requests, 1 to leave the context idle or 2 if the next
+ * request was prepared in the context buffer. The semantic of each request is the same as for
+ * request().
+ * 
+ * @param[in,out] ctxs - contexts to use
+ * @param[in] count - number of contexts in ctxs
+ * @param[in] visitor - callback function called for each completed request
+ * @param[in,out] param - user defined callback function parameter
+ * @return 1 on success, 0 if aborted or on error
+ * @remarks This backend performs the requests sequentially.
+ */
+int requestParallel(tTr64RequestCtx ** ctxs, const size_t count, int (* visitor)(tTr64RequestCtx *, const int, void *), void * param) {
+	if (ctxs == NULL || count < 1 || visitor == NULL) return 0;
+	if (ctxs[0]->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_REQUESTPARALLEL));
+	for (size_t i = 0; i < count; i++) {
+		tTr64RequestCtx * ctx = ctxs[i];
+		if (ctx->length < 1 && ctx->fragments.length < 1) continue;
+		for (;;) {
+			const int res = ctx->request(ctx);
+			if (signalReceived != 0) return 0;
+			const int next = visitor(ctx, res, param);
+			if (next == 0) return 0;
+			if (next != 2) break;
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * Performs the HTTP requests prepared back to back in the buffer or fragments of the given context
+ * over a single connection without waiting for each response (HTTP/1.1 pipelining). The responses
+ * are passed in order to the given visitor. It returns 0 to stop or 1 to continue with the next
+ * response. Requests which were sent completely when the pipeline breaks off are passed to the
+ * visitor as failed with status 0. The others are not passed to the visitor. The caller needs to
+ * send them again, one by one.
+ * 
+ * @param[in,out] ctx - context to use
+ * @param[in] count - number of requests in the context buffer or fragments
+ * @param[in] end - end offset of each request within the context buffer or fragments (count elements)
+ * @param[in] visitor - callback function called for each received response
+ * @param[in,out] param - user defined callback function parameter
+ * @return 1 if all responses were passed to the visitor, else 0
+ * @remarks This backend does not support pipelining. All requests are left to the caller.
+ */
+int requestPipelined(tTr64RequestCtx * ctx, const size_t count, const size_t * end, int (* visitor)(tTr64RequestCtx *, const int, void *), void * param) {
+	PCF_UNUSED(param)
+	if (ctx == NULL || (ctx->length < 1 && ctx->fragments.length < 1) || count < 1 || end == NULL || visitor == NULL) return 0;
+	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_REQUESTPIPELINED));
+	return 0;
+}
+
+
+/**
+ * Creates a new request engine. Requests are added via submitTr64Request() and processed by
+ * pollTr64Engine().
+ * 
+ * @param[in] verbose - verbosity level
+ * @return Handle on success, else NULL.
+ * @remarks This backend performs the requests sequentially.
+ */
+tTr64Engine * newTr64Engine(const int verbose) {
+	tTr64Engine * res = (tTr64Engine *)calloc(1, sizeof(tTr64Engine));
+	if (res == NULL) {
+		if (verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		return NULL;
+	}
+	res->verbose = verbose;
+	return res;
+}
+
+
+/**
+ * Submits the request prepared in the buffer of the given context to the engine. The passed
+ * visitor is called from pollTr64Engine() once the request completed with 1 on success, else 0. It
+ * returns 0 to abort pollTr64Engine(), 1 to leave the context idle or 2 if the next request was
+ * prepared in the context buffer. The semantic of each request is the same as for request().
+ * The context may not be submitted again or freed while the request is pending.
+ * 
+ * @param[in,out] engine - engine to use
+ * @param[in,out] ctx - context to use
+ * @param[in] visitor - callback function called for the completed request
+ * @param[in,out] param - user defined callback function parameter
+ * @return 1 on success, 0 if the request could not be started
+ */
+int submitTr64Request(tTr64Engine * engine, tTr64RequestCtx * ctx, int (* visitor)(tTr64RequestCtx *, const int, void *), void * param) {
+	if (engine == NULL || ctx == NULL || visitor == NULL || (ctx->length < 1 && ctx->fragments.length < 1) || ctx->net->engine != NULL) return 0;
+	if (engine->length >= engine->capacity) {
+		if (arrayFieldResize(engine, ctx, PCF_MAX(INIT_ARRAY_SIZE, engine->capacity * 2)) != 1) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+			return 0;
+		}
+	}
+	ctx->net->engine = engine;
+	ctx->net->visitor = visitor;
+	ctx->net->param = param;
+	engine->ctx[engine->length] = ctx;
+	engine->length++;
+	return 1;
+}
+
+
+/**
+ * Performs the requests which were submitted to the engine before this call. Completed requests
+ * are passed to their visitor.
+ * 
+ * @param[in,out] engine - engine to use
+ * @param[in] timeout - maximum time to wait in milliseconds (unused)
+ * @param[out] pending - optional pointer to the number of pending requests
+ * @return 1 on success, 0 if aborted or on error
+ * @remarks This backend performs the requests sequentially.
+ */
+int pollTr64Engine(tTr64Engine * engine, const size_t timeout, size_t * pending) {
+	int res = 0;
+	PCF_UNUSED(timeout)
+	if (engine == NULL) return 0;
+	for (size_t count = engine->length; count > 0 && engine->length > 0; count--) {
+		tTr64RequestCtx * ctx = engine->ctx[0];
+		engine->length--;
+		memmove(engine->ctx, engine->ctx + 1, engine->length * sizeof(*(engine->ctx)));
+		ctx->net->engine = NULL;
+		for (;;) {
+			const int result = ctx->request(ctx);
+			if (signalReceived != 0) goto onError;
+			const int next = ctx->net->visitor(ctx, result, ctx->net->param);
+			if (next == 0) goto onError;
+			if (next != 2) break;
+			if (submitTr64Request(engine, ctx, ctx->net->visitor, ctx->net->param) == 1) break;
+		}
+	}
+	res = 1;
+onError:
+	if (pending != NULL) *pending = engine->length;
+	return res;
+}
+
+
+/**
+ * Frees the given request engine. All pending requests are aborted. The engine is invalid after
+ * this call.
+ * 
+ * @param[in,out] engine - engine to free
+ */
+void freeTr64Engine(tTr64Engine * engine) {
+	if (engine == NULL) return;
+	for (size_t i = 0; i < engine->length; i++) {
+		engine->ctx[i]->net->engine = NULL;
+	}
+	if (engine->ctx != NULL) free(engine->ctx);
+	free(engine);
+}
+
+
 /**
  * Close outstanding connections for a fresh start.
  * 
@@ -845,6 +1262,7 @@ tTr64RequestCtx * newTr64Request(const char * url, const char * user, const char
 		if (verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
 		goto onError;
 	}
+	memset(res->net, 0, sizeof(*(res->net)));
 	res->net->list = NULL;
 	res->net->socket = INVALID_SOCKET;
 	res->request = request;
@@ -864,6 +1282,64 @@ onError:
 }
 
 
+/**
+ * Creates a new HTTP request context for the same host as the given one. The resolved addresses
+ * are shared with the given context but the new context uses its own connection and buffer.
+ * 
+ * @param[in] ctx - context to clone
+ * @return Handle on success, else NULL.
+ */
+tTr64RequestCtx * cloneTr64Request(const tTr64RequestCtx * ctx) {
+	if (ctx == NULL) return NULL;
+	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_ENTER_CLONETR64REQUEST));
+	
+	tTr64RequestCtx * res = (tTr64RequestCtx *)malloc(sizeof(tTr64RequestCtx));
+	if (res == NULL) goto onOutOfMemory;
+	memset(res, 0, sizeof(*res));
+	
+#define CLONE_STR(field) \
+	if (ctx->field != NULL) { \
+		res->field = strdup(ctx->field); \
+		if (res->field == NULL) goto onOutOfMemory; \
+	}
+	CLONE_STR(protocol)
+	CLONE_STR(user)
+	CLONE_STR(pass)
+	CLONE_STR(host)
+	CLONE_STR(port)
+	CLONE_STR(path)
+#undef CLONE_STR
+	
+	res->format = ctx->format;
+	res->timeout = ctx->timeout;
+	
+	res->discover = ctx->discover;
+	res->resolve = ctx->resolve;
+	res->net = (tNetHandle *)malloc(sizeof(tNetHandle));
+	if (res->net == NULL) goto onOutOfMemory;
+	memset(res->net, 0, sizeof(*(res->net)));
+	res->net->list = NULL;
+	res->net->socket = INVALID_SOCKET;
+	res->request = ctx->request;
+	res->reset = ctx->reset;
+	res->printAddress = ctx->printAddress;
+	res->verbose = ctx->verbose;
+	
+	if (ctx->address != NULL) {
+		res->address = ctx->address;
+		res->address->refCount++;
+	}
+	
+	if (arrayFieldInit(res, buffer, BUFFER_SIZE) != 1) goto onOutOfMemory;
+	
+	return res;
+onOutOfMemory:
+	if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+	freeTr64Request(res);
+	return NULL;
+}
+
+
 /**
  * Frees the given HTTP request context. The context is invalid after this call.
  * 
@@ -880,9 +1356,16 @@ void freeTr64Request(tTr64RequestCtx * ctx) {
 	if (ctx->path != NULL) free(ctx->path);
 	if (ctx->method != NULL) free(ctx->method);
 	if (ctx->auth != NULL) free(ctx->auth);
+	if (ctx->realm != NULL) free(ctx->realm);
+	if (ctx->nonce != NULL) free(ctx->nonce);
+	if (ctx->opaque != NULL) free(ctx->opaque);
 	if (ctx->address != NULL) {
-		if (ctx->address->list != NULL) FreeAddrInfo(ctx->address->list);
-		free(ctx->address);
+		if (ctx->address->refCount > 1) {
+			ctx->address->refCount--;
+		} else {
+			if (ctx->address->list != NULL) FreeAddrInfo(ctx->address->list);
+			free(ctx->address);
+		}
 	}
 	if (ctx->net != NULL) {
 		if (ctx->net->socket != INVALID_SOCKET) {
@@ -891,6 +1374,7 @@ void freeTr64Request(tTr64RequestCtx * ctx) {
 		}
 		free(ctx->net);
 	}
+	if (ctx->fragments.item != NULL) free(ctx->fragments.item);
 	if (ctx->buffer != NULL) free(ctx->buffer);
 	free(ctx);
 }
@@ -2,7 +2,7 @@
  * @file tr64c.c
  * @author Daniel Starke
  * @date 2018-06-21
- * @version 2018-08-17
+ * @version 2026-10-16
  * @todo Implement transaction session support.
  * 
  * DISCLAIMER
@@ -23,6 +23,7 @@
 #include "getopt.h"
 #include "hmd5.h"
 #include "mingw-unicode.h"
+#include "utf8.h"
 
 
 #if defined(PCF_IS_WIN)
@@ -56,6 +57,7 @@ const void * fmsg[MSG_COUNT] = {
 	/* MSGT_ERR_OPT_NO_ARG             */ _T("Error: Option argument is missing for '%s'.\n"),
 	/* MSGT_ERR_OPT_BAD_FORMAT         */ _T("Error: Invalid format value. (%s)\n"),
 	/* MSGT_ERR_OPT_BAD_TIMEOUT        */ _T("Error: Invalid timeout value. (%s)"),
+	/* MSGT_ERR_OPT_BAD_JOBS           */ _T("Error: Invalid number of parallel connections. (%s)\n"),
 	/* MSGT_ERR_OPT_NO_SERVICE         */ _T("Error: Missing service name.\n"),
 	/* MSGT_ERR_OPT_NO_ACTION          */ _T("Error: Missing action name.\n"),
 	/* MSGT_ERR_OPT_NO_ACTION_ARG      */ _T("Error: Missing action argument variable.\n"),
@@ -94,10 +96,15 @@ const void * fmsg[MSG_COUNT] = {
 	/* MSGT_ERR_SOCK_SEND_SSDP_REQ     */ _T("Error: Failed to send SSDP discovery request.\n"),
 	/* MSGT_ERR_SOCK_LEAVE_MC_GROUP    */ _T("Error: Failed to leave the SSDP multicast group.\n"),
 	/* MSGT_ERR_SOCK_CONNECT           */ _T("Error: Failed to connect to the given host.\n"),
+	/* MSGT_ERR_SOCK_CONNECT_TOUT      */ _T("Error: Connection to the given host timed out.\n"),
 	/* MSGT_ERR_SOCK_SEND_TOUT         */ _T("Error: Request to server timed out.\n"),
 	/* MSGT_ERR_SOCK_RECV_TOUT         */ _T("Error: Response from server timed out.\n"),
+	/* MSGT_ERR_ENGINE_NEW             */ _T("Error: Failed to create request engine.\n"),
+	/* MSGT_ERR_ENGINE_EVENT           */ _T("Error: Failed to register socket events.\n"),
+	/* MSGT_ERR_ENGINE_WAIT            */ _T("Error: Failed to wait for socket events.\n"),
 	/* MSGT_ERR_HTTP_SEND_REQ          */ _T("Error: Failed to send request to server.\n"),
 	/* MSGT_ERR_HTTP_RECV_RESP         */ _T("Error: Failed to get response from server.\n"),
+	/* MSGT_ERR_HTTP_PIPELINE_RESP     */ _T("Error: Connection was closed before the response to a sent request. The request is not repeated.\n"),
 	/* MSGT_ERR_HTTP_STATUS            */ _T("Error: Received HTTP response with status code %u.\n"),
 	/* MSGT_ERR_HTTP_STATUS_STR        */ _T("Error: Received HTTP response with status code %u - %s.\n"),
 	/* MSGT_ERR_HTTP_FMT_AUTH          */ _T("Error: Failed to format HTTP authentication response.\n"),
@@ -113,25 +120,38 @@ const void * fmsg[MSG_COUNT] = {
 	/* MSGT_ERR_QUERY_RESP_ARG_BAD_ESC */ _T("Error: Invalid escape sequence in argument value of query response.\n"),
 	/* MSGT_ERR_QUERY_PRINT            */ _T("Error: Failed to write formatted query response.\n"),
 	/* MSGT_ERR_BAD_CMD                */ _T("Error: Invalid command.\n"),
+	/* MSGT_ERR_BATCH_OPEN             */ _T("Error: Failed to open batch file.\n"),
+	/* MSGT_ERR_DEVICES_OPEN           */ _T("Error: Failed to open device list file.\n"),
+	/* MSGT_ERR_DEVICES_FMT            */ _T("Error: Invalid device list entry. Expected <URL> [<user> [<password>]].\n"),
 	/* MSGT_WARN_CACHE_READ            */ _T("Warning: Failed to read cache file content.\n"),
 	/* MSGT_WARN_CACHE_FMT             */ _T("Warning: The cache file format is invalid.\n"),
 	/* MSGT_WARN_CACHE_UNESC           */ _T("Warning: Failed to unescape field from cache file.\n"),
 	/* MSGT_WARN_CACHE_NO_MEM          */ _T("Warning: Failed to allocate memory to output cache file.\n"),
 	/* MSGT_WARN_CACHE_WRITE           */ _T("Warning: Failed to output cache file.\n"),
+	/* MSGT_WARN_CACHE_INDEX           */ _T("Warning: Failed to update the cache directory index.\n"),
+	/* MSGT_WARN_SESSION_FMT           */ _T("Warning: The authentication session file format is invalid.\n"),
+	/* MSGT_WARN_SESSION_NO_MEM        */ _T("Warning: Failed to allocate memory to output authentication session file.\n"),
+	/* MSGT_WARN_SESSION_WRITE         */ _T("Warning: Failed to output authentication session file.\n"),
 	/* MSGT_WARN_OPT_LOW_TIMEOUT       */ _T("Warning: Timeout value is less than recommended (>=1000ms).\n"),
 	/* MSGT_WARN_LIST_NO_MEM           */ _T("Warning: Failed to allocate memory for list output.\n"),
 	/* MSGT_WARN_CMD_BAD_ESC           */ _T("Warning: Invalid escape sequence in command-line at column %u.\n"),
 	/* MSGT_INFO_SIGTERM               */ _T("Info: Received signal. Finishing current operation.\n"),
 	/* MSGU_INFO_DEV_DESC_REQ          */    "Info: Requesting /%s from device.\n",
 	/* MSGT_INFO_DEV_DESC_DUR          */ _T("Info: Finished device description request in %u ms.\n"),
+	/* MSGT_INFO_DEV_DESC_SAME         */ _T("Info: The device description is unchanged.\n"),
+	/* MSGT_INFO_DEV_DESC_SHARED       */ _T("Info: Using the parsed descriptions of a device with identical device description.\n"),
 	/* MSGU_INFO_SRVC_DESC_REQ         */    "Info: Requesting %s from device.\n",
 	/* MSGT_INFO_SRVC_DESC_DUR         */ _T("Info: Finished service description request in %u ms.\n"),
+	/* MSGU_INFO_SRVC_DESC_SAME        */    "Info: The service description %s is unchanged.\n",
 	/* MSGT_INFO_SOCK_BOUND_SSDP       */ _T("Info: Bound to SSDP multicast address "),
 	/* MSGU_INFO_SOCK_JOINED_MC_GROUP  */    "Info: Joined SSDP multicast group for address %s on interface %s (%s).\n",
 	/* MSGT_INFO_SSDP_SENT             */ _T("Info: Sent %u bytes as multicast SSDP request.\n"),
 	/* MSGT_INFO_SSDP_RECV             */ _T("Info: Received %u bytes SSDP response.\n"),
 	/* MSGT_DBG_SOCK_RECV              */ _T("Debug: Received %u bytes from server.\n"),
+	/* MSGT_DBG_SOCK_RETRY             */ _T("Debug: Re-used connection was closed by the server. Retrying with a new connection.\n"),
+	/* MSGT_DBG_SOCK_PIPELINE          */ _T("Debug: Connection was closed by the server within the pipeline. Sending the unsent requests one by one.\n"),
 	/* MSGT_DBG_BAD_TOKEN              */ _T("Debug: Unexpected token at line %u column %u.\n"),
+	/* MSGT_DBG_BAD_TOKEN_AT           */ _T("Debug: Unexpected token at byte %u of the content.\n"),
 	/* MSGU_DBG_SELECTED_QUERY         */  "Debug: Selected query action is %s::%s::%s.\n",
 	/* MSGT_DBG_PARSE_QUERY_RESP       */ _T("Debug: Parsing query response.\n"),
 	/* MSGT_DBG_OUT_QUERY_RESP         */ _T("Debug: Output query response.\n"),
@@ -139,7 +159,10 @@ const void * fmsg[MSG_COUNT] = {
 	/* MSGT_DBG_ENTER_REQUEST          */ _T("Debug: Enter request().\n"),
 	/* MSGT_DBG_ENTER_RESET            */ _T("Debug: Enter reset().\n"),
 	/* MSGT_DBG_ENTER_PRINTADDRESS     */ _T("Debug: Enter printAddress().\n"),
+	/* MSGT_DBG_ENTER_REQUESTPARALLEL  */ _T("Debug: Enter requestParallel().\n"),
+	/* MSGT_DBG_ENTER_REQUESTPIPELINED */ _T("Debug: Enter requestPipelined().\n"),
 	/* MSGT_DBG_ENTER_NEWTR64REQUEST   */ _T("Debug: Enter newTr64Request().\n"),
+	/* MSGT_DBG_ENTER_CLONETR64REQUEST */ _T("Debug: Enter cloneTr64Request().\n"),
 	/* MSGT_DBG_ENTER_FREETR64REQUEST  */ _T("Debug: Enter freeTr64Request().\n")
 };
 
@@ -196,6 +219,37 @@ const tHttpStatusMsg httpStatMsg[] = {
 };
 
 
+/** TR-064 argument types sorted case-insensitive by name. */
+static const tTrArgTypeName argTypes[] = {
+	{"bin.base64",  TAT_BIN_BASE64},
+	{"bin.hex",     TAT_BIN_HEX},
+	{"boolean",     TAT_BOOLEAN},
+	{"char",        TAT_CHAR},
+	{"date",        TAT_DATE},
+	{"dateTime",    TAT_DATE_TIME},
+	{"dateTime.tz", TAT_DATE_TIME_TZ},
+	{"fixed.14.4",  TAT_FIXED_14_4},
+	{"float",       TAT_FLOAT},
+	{"i1",          TAT_I1},
+	{"i2",          TAT_I2},
+	{"i4",          TAT_I4},
+	{"i8",          TAT_I8},
+	{"int",         TAT_INT},
+	{"number",      TAT_NUMBER},
+	{"r4",          TAT_R4},
+	{"r8",          TAT_R8},
+	{"string",      TAT_STRING},
+	{"time",        TAT_TIME},
+	{"time.tz",     TAT_TIME_TZ},
+	{"ui1",         TAT_UI1},
+	{"ui2",         TAT_UI2},
+	{"ui4",         TAT_UI4},
+	{"ui8",         TAT_UI8},
+	{"uri",         TAT_URI},
+	{"uuid",        TAT_UUID}
+};
+
+
 /**
  * Main entry point.
  */
@@ -207,18 +261,24 @@ int _tmain(int argc, TCHAR ** argv) {
 		handleQuery,
 		handleScan,
 		handleList,
-		handleInteractive
+		handleInteractive,
+		handleBatch,
+		handlePoll
 	};
 	struct option longOptions[] = {
 		{_T("utf8"),        no_argument,       NULL,    GETOPT_UTF8},
 		{_T("version"),     no_argument,       NULL, GETOPT_VERSION},
+		{_T("batch"),       required_argument, NULL,        _T('b')},
 		{_T("cache"),       required_argument, NULL,        _T('c')},
+		{_T("devices"),     required_argument, NULL,        _T('d')},
 		{_T("format"),      required_argument, NULL,        _T('f')},
 		{_T("help"),        no_argument,       NULL,        _T('h')},
 		{_T("interactive"), no_argument,       NULL,        _T('i')},
+		{_T("jobs"),        required_argument, NULL,        _T('j')},
 		{_T("list"),        no_argument,       NULL,        _T('l')},
 		{_T("host"),        required_argument, NULL,        _T('o')},
 		{_T("password"),    required_argument, NULL,        _T('p')},
+		{_T("revalidate"),  no_argument,       NULL,        _T('r')},
 		{_T("scan"),        no_argument,       NULL,        _T('s')},
 		{_T("timeout"),     required_argument, NULL,        _T('t')},
 		{_T("user"),        required_argument, NULL,        _T('u')},
@@ -247,9 +307,10 @@ int _tmain(int argc, TCHAR ** argv) {
 
 	opt.verbose++;
 	opt.timeout = DEFAULT_TIMEOUT;
+	opt.jobs = DEFAULT_JOBS;
 	opt.format = F_TEXT;
 	while (1) {
-		res = getopt_long(argc, argv, _T(":c:f:hil:o:p:st:u:v"), longOptions, NULL);
+		res = getopt_long(argc, argv, _T(":b:c:d:f:hij:l:o:p:rst:u:v"), longOptions, NULL);
 
 		if (res == -1) break;
 		switch (res) {
@@ -264,9 +325,16 @@ int _tmain(int argc, TCHAR ** argv) {
 			_putts(_T2(PROGRAM_VERSION_STR));
 			goto onSuccess;
 			break;
+		case _T('b'):
+			opt.batch = optarg;
+			opt.mode = M_BATCH;
+			break;
 		case _T('c'):
 			opt.cache = optarg;
 			break;
+		case _T('d'):
+			opt.devices = optarg;
+			break;
 		case _T('f'):
 			for (TCHAR * ch = optarg; *ch != 0; ch++) *ch = _totupper(*ch);
 			if (_tcscmp(optarg, _T("TEXT")) == 0) {
@@ -289,6 +357,16 @@ int _tmain(int argc, TCHAR ** argv) {
 		case _T('i'):
 			opt.mode = M_INTERACTIVE;
 			break;
+		case _T('j'):
+			{
+				const long jobs = _tcstol(optarg, &strNum, 10);
+				if (jobs < 1 || jobs > MAX_JOBS || strNum == NULL || *strNum != 0) {
+					_ftprintf(ferr, MSGT(MSGT_ERR_OPT_BAD_JOBS), optarg);
+					goto onError;
+				}
+				opt.jobs = (size_t)jobs;
+			}
+			break;
 		case _T('l'):
 			opt.mode = M_LIST;
 			break;
@@ -302,6 +380,9 @@ int _tmain(int argc, TCHAR ** argv) {
 			/* clear password in command-line */
 			for (TCHAR * ptr = optarg; *ptr != 0; ptr++) *ptr = _T('*');
 			break;
+		case _T('r'):
+			opt.revalidate = 1;
+			break;
 		case _T('s'):
 			opt.mode = M_SCAN;
 			break;
@@ -340,6 +421,9 @@ int _tmain(int argc, TCHAR ** argv) {
 		}
 	}
 	
+	/* the device list selects the poll mode; the batch file provides its queries in this case */
+	if (opt.devices != NULL) opt.mode = M_POLL;
+	
 	if (optind >= argc && opt.mode == M_QUERY) {
 		_ftprintf(ferr, MSGT(MSGT_ERR_OPT_NO_ACTION_ARG));
 		goto onError;
@@ -356,6 +440,16 @@ int _tmain(int argc, TCHAR ** argv) {
 		if (parseActionPath(&opt, 0) != 1) goto onOutOfMemory;
 	}
 	
+	/* a cache directory holds one cache file per device URL */
+	if (opt.cache != NULL && isDir(opt.cache) == 1) {
+		opt.cacheDir = opt.cache;
+		opt.cache = NULL;
+		if (opt.url != NULL && opt.mode != M_POLL) {
+			opt.cache = getCacheEntryPath(opt.cacheDir, opt.url);
+			if (opt.cache == NULL) goto onOutOfMemory;
+		}
+	}
+	
 	/* initialize backend API */
 	if (initBackend() != 1) {
 		if (opt.verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_BACKEND_INIT));
@@ -381,6 +475,7 @@ onOutOfMemory:
 	}
 onError:
 	/* cleanup */
+	if (opt.cacheDir != NULL && opt.cache != NULL) free(opt.cache);
 	if (opt.url != NULL) free(opt.url);
 	if (opt.user != NULL) free(opt.user);
 	if (opt.pass != NULL) free(opt.pass);
@@ -405,8 +500,28 @@ void printHelp(void) {
 	_tprintf(
 	_T("tr64c [options] [[<device>/]<service/action> [<variable=value> ...]]\n")
 	_T("\n")
+	_T("-b, --batch <file>\n")
+	_T("      Execute the queries given line by line in this file. Use - for standard\n")
+	_T("      input. Each result is output as JSON record in a single line. Queries\n")
+	_T("      from a file are sent up to 8 at once over a single connection (HTTP/1.1\n")
+	_T("      pipelining).\n")
 	_T("-c, --cache <file>\n")
-	_T("      Cache action descriptions of the device in this file.\n")
+	_T("      Cache action descriptions of the device in this file. A memory mapped\n")
+	_T("      binary format is used unless the file name ends with .xml. The HTTP\n")
+	_T("      authentication session is kept next to it in <file>.auth to authorize\n")
+	_T("      the first request of the next call without an extra round trip.\n")
+	_T("      A single query only fetches the service descriptions it needs. Others\n")
+	_T("      are added to the cache file once they are used.\n")
+	_T("      If <file> is an existing directory, one binary cache file per device URL\n")
+	_T("      is kept in it and listed in its index file. This also applies to\n")
+	_T("      --devices. Cache files are replaced atomically to allow concurrent calls\n")
+	_T("      to share the same cache.\n")
+	_T("-d, --devices <file>\n")
+	_T("      Query all devices listed line by line in this file concurrently. Each line\n")
+	_T("      has the format <URL> [<user> [<password>]]. The queries are given as\n")
+	_T("      command-line arguments or via --batch. The output format is the same as\n")
+	_T("      for --batch with the device URL added to each record.\n")
+	_T("      Identical descriptions are parsed only once and shared between devices.\n")
 	_T("-f, --format <string>\n")
 	_T("      Defines the output format. Possible values are:\n")
 	_T("      TEXT - plain text (default)\n")
@@ -417,6 +532,9 @@ void printHelp(void) {
 	_T("      Print short usage instruction.\n")
 	_T("-i, --interactive\n")
 	_T("      Run in interactive mode.\n")
+	_T("-j, --jobs <number>\n")
+	_T("      Number of parallel connections used to fetch the service descriptions or\n")
+	_T("      number of concurrently processed devices for --devices. The default is 4.\n")
 	_T("-l, --list\n")
 	_T("      List services and actions available on the device.\n")
 	_T("-o, --host <URL>\n")
@@ -427,6 +545,9 @@ void printHelp(void) {
 	_T("      which the local discovery shall be performed on.\n")
 	_T("-p, --password <string>\n")
 	_T("      Use this password to authenticate to the device.\n")
+	_T("-r, --revalidate\n")
+	_T("      Checks whether the cached descriptions are still up to date. Only the\n")
+	_T("      service descriptions which changed are fetched again.\n")
 	_T("-s, --scan\n")
 	_T("      Perform a local device discovery scan.\n")
 	_T("-u, --user <string>\n")
@@ -501,6 +622,27 @@ int arrayResize(void ** array, size_t * capacity, const size_t itemSize, const s
 }
 
 
+/**
+ * Resizes a given array allocated from the passed arena. The previous memory is not released
+ * until the arena is reset.
+ * 
+ * @param[in,out] arena - allocate from this arena
+ * @param[in] array - pointer to an array
+ * @param[in] capacity - pointer to the capacity variable of the array
+ * @param[in] itemSize - array item size in bytes
+ * @param[in] size - new array size in number of items
+ * @return 1 on success, else 0
+ * @remarks The passed arguments are not checked.
+ */
+int arrayResizeArena(tArena * arena, void ** array, size_t * capacity, const size_t itemSize, const size_t size) {
+	void * mem = ar_realloc(arena, *array, itemSize * (*capacity), itemSize * size);
+	if (mem == NULL) return 0;
+	*array = mem;
+	*capacity = size;
+	return 1;
+}
+
+
 /**
  * Duplicates the given string by taking at most the number of characters given. The result is
  * guaranteed to be null-terminated.
@@ -831,6 +973,97 @@ onError:
 }
 
 
+/**
+ * Writes the given unescaped byte to out with the passed output escaping applied. At most 6 bytes
+ * are written.
+ * 
+ * @param[out] out - write to this buffer
+ * @param[in] c - byte to write
+ * @param[in] esc - output escaping
+ * @return pointer behind the written bytes
+ * @see escapeCsv()
+ * @see escapeJson()
+ * @see p_escapeXml()
+ */
+static char * putEscapedByte(char * out, const unsigned char c, const tOutEscape esc) {
+	static const char hex[] = "0123456789ABCDEF";
+#define CASE_APPEND(a, b) case a: memcpy(out, b, sizeof(b) - 1); return out + (sizeof(b) - 1);
+	switch (esc) {
+	case OE_CSV:
+		if (c == '"') *out++ = '"';
+		break;
+	case OE_JSON:
+		switch (c) {
+		CASE_APPEND('"',  "\\\"")
+		CASE_APPEND('\\', "\\\\")
+		CASE_APPEND('/',  "\\/" )
+		CASE_APPEND('\b', "\\b" )
+		CASE_APPEND('\f', "\\f" )
+		CASE_APPEND('\n', "\\n" )
+		CASE_APPEND('\r', "\\r" )
+		CASE_APPEND('\t', "\\t" )
+		default:
+			if (c < 0x20) {
+				memcpy(out, "\\u00", 4);
+				out[4] = hex[c >> 4];
+				out[5] = hex[c & 0x0F];
+				return out + 6;
+			}
+			break;
+		}
+		break;
+	case OE_XML:
+		switch (c) {
+		CASE_APPEND('"',  "&quot;")
+		CASE_APPEND('\'', "&apos;")
+		CASE_APPEND('<',  "&lt;"  )
+		CASE_APPEND('>',  "&gt;"  )
+		CASE_APPEND('&',  "&amp;" )
+		default: break;
+		}
+		break;
+	default:
+		break;
+	}
+#undef CASE_APPEND
+	*out++ = (char)c;
+	return out;
+}
+
+
+/**
+ * Writes the given unescaped string to out with the passed output escaping applied. Runs of
+ * characters which need no escaping are copied at once. At most 6 bytes are written per input byte.
+ * 
+ * @param[out] out - write to this buffer
+ * @param[in] in - string to write
+ * @param[in] len - length of in in bytes
+ * @param[in] esc - output escaping
+ * @return pointer behind the written bytes
+ * @see putEscapedByte()
+ */
+static char * putEscapedRun(char * out, const char * in, const size_t len, const tOutEscape esc) {
+	tPEscapeSet set;
+	switch (esc) {
+	case OE_CSV:  set = PES_CSV; break;
+	case OE_JSON: set = PES_JSON; break;
+	case OE_XML:  set = PES_XML; break;
+	default:
+		memcpy(out, in, len);
+		return out + len;
+	}
+	for (size_t i = 0; i < len; i++) {
+		const size_t run = p_findEscape(in + i, len - i, set);
+		memcpy(out, in + i, run);
+		out += run;
+		i += run;
+		if (i >= len) break;
+		out = putEscapedByte(out, (unsigned char)(in[i]), esc);
+	}
+	return out;
+}
+
+
 /**
  * Escapes the given string to encode as CSV field.
  * 
@@ -841,24 +1074,26 @@ onError:
  */
 static char * escapeCsv(const char * str, const size_t length) {
 	if (str == NULL) return NULL;
-	/* calculate the result string size in bytes */
-	size_t resSize = 1;
-	size_t i = 0;
-	for (const char * in = str; *in != 0 && i < length; in++, i++, resSize++) {
-		if (*in == '"') resSize++;
-	}
-	if ((i + 1) == resSize) return (char *)str;
-	/* create the result string */
-	char * res = (char *)malloc(sizeof(char) * resSize);
+	const size_t len = p_strnlen(str, length);
+	size_t i = p_findEscape(str, len, PES_CSV);
+	if (i >= len) return (char *)str;
+	/* create the result string with enough space for the worst case */
+	char * res = (char *)malloc(sizeof(char) * ((len * 2) + 1));
 	if (res == NULL) return NULL;
-	i = 0;
-	char * out = res;
-	for (const char * in = str; *in != 0 && i < length; in++, i++) {
-		if (*in == '"') *out++ = '"';
-		*out++ = *in;
+	memcpy(res, str, i);
+	char * out = res + i;
+	while (i < len) {
+		/* repeat the quote and copy the following run of plain characters at once */
+		*out++ = '"';
+		const size_t run = p_findEscape(str + i + 1, len - i - 1, PES_CSV) + 1;
+		memcpy(out, str + i, run);
+		out += run;
+		i += run;
 	}
 	*out = 0;
-	return res;
+	/* shrink to the actual size */
+	char * shrunk = (char *)realloc(res, (size_t)(out - res) + 1);
+	return (shrunk != NULL) ? shrunk : res;
 }
 
 
@@ -872,64 +1107,19 @@ static char * escapeCsv(const char * str, const size_t length) {
  * @see https://tools.ietf.org/html/rfc8259#section-7
  */
 static char * escapeJson(const char * str, const size_t length) {
-	static const char hex[] = "0123456789ABCDEF";
 	if (str == NULL) return NULL;
-	/* calculate the result string size in bytes */
-	size_t resSize = 1;
-	size_t i = 0;
-	for (const char * in = str; *in != 0 && i < length; in++, i++) {
-		switch (*in) {
-		case '"':
-		case '\\':
-		case '/':
-		case '\b':
-		case '\f':
-		case '\n':
-		case '\r':
-		case '\t':
-			resSize += 2;
-			break;
-		default:
-			if (*in < 0x20) {
-				resSize += 6;
-			} else {
-				resSize++;
-			}
-			break;
-		}
-	}
-	if ((i + 1) == resSize) return (char *)str;
-	/* create the result string */
-	char * res = (char *)malloc(sizeof(char) * resSize);
+	const size_t len = p_strnlen(str, length);
+	size_t i = p_findEscape(str, len, PES_JSON);
+	if (i >= len) return (char *)str;
+	/* create the result string with enough space for the worst case */
+	char * res = (char *)malloc(sizeof(char) * ((len * 6) + 1));
 	if (res == NULL) return NULL;
-	i = 0;
-	char * out = res;
-	for (const char * in = str; *in != 0 && i < length; in++, i++) {
-		switch (*in) {
-		case '"':  *out++ = '\\'; *out++ = '"';  break;
-		case '\\': *out++ = '\\'; *out++ = '\\'; break;
-		case '/':  *out++ = '\\'; *out++ = '/';  break;
-		case '\b': *out++ = '\\'; *out++ = 'b';  break;
-		case '\f': *out++ = '\\'; *out++ = 'f';  break;
-		case '\n': *out++ = '\\'; *out++ = 'n';  break;
-		case '\r': *out++ = '\\'; *out++ = 'r';  break;
-		case '\t': *out++ = '\\'; *out++ = 't';  break;
-		default:
-			if (*in < 0x20) {
-				*out++ = '\\';
-				*out++ = 'u';
-				*out++ = '0';
-				*out++ = '0';
-				*out++ = hex[(*in >> 4) & 0x0F];
-				*out++ = hex[*in & 0x0F];
-			} else {
-				*out++ = *in;
-			}
-			break;
-		}
-	}
+	memcpy(res, str, i);
+	char * out = putEscapedRun(res + i, str + i, len - i, OE_JSON);
 	*out = 0;
-	return res;
+	/* shrink to the actual size */
+	char * shrunk = (char *)realloc(res, (size_t)(out - res) + 1);
+	return (shrunk != NULL) ? shrunk : res;
 }
 
 
@@ -939,29 +1129,125 @@ static char * escapeJson(const char * str, const size_t length) {
  * @param[in] type - TR-064 argument type
  * @return mapped JSON type
  */
-static tJsonType mapToJsonType(const char * type) {
-	if (type == NULL) return JT_NULL;
-	if (stricmp(type, "boolean") == 0) return JT_BOOLEAN;
-	if (tolower(*type) == 'u') type++;
-	if (tolower(*type) != 'i') return JT_STRING;
-	char * endPtr = NULL;
-	unsigned long bits = strtoul(type + 1, &endPtr, 10);
-	if (endPtr != NULL && *endPtr == 0) {
-		switch (bits) {
-		case 1:
-		case 2:
-		case 4:
-		case 8:
-			return JT_NUMBER;
-			break;
-		default:
-			break;
-		}
+static tJsonType mapToJsonType(const tTrArgType type) {
+	switch (type) {
+	case TAT_BOOLEAN:
+		return JT_BOOLEAN;
+	case TAT_I1:
+	case TAT_I2:
+	case TAT_I4:
+	case TAT_I8:
+	case TAT_UI1:
+	case TAT_UI2:
+	case TAT_UI4:
+	case TAT_UI8:
+		return JT_NUMBER;
+	default:
+		break;
 	}
 	return JT_STRING;
 }
 
 
+/**
+ * Compares the given argument type name with the passed item case-insensitive. Used for binary
+ * search in argTypes.
+ * 
+ * @param[in] type - left-hand statement of comparison
+ * @param[in] item - right-hand statement of comparison
+ * @return <0 if smaller, 0 if equal and >0 if larger
+ */
+static int cmpTrArgTypeName(const char * type, const tTrArgTypeName * item) {
+	return stricmp(type, item->name);
+}
+
+
+/**
+ * Decodes the given TR-064 argument type name.
+ * 
+ * @param[in] type - TR-064 argument type name
+ * @return decoded argument type or TAT_UNKNOWN
+ */
+static tTrArgType getArgType(const char * type) {
+	if (type == NULL) return TAT_UNKNOWN;
+	const tTrArgTypeName * item = (const tTrArgTypeName *)bs_staticArray(type, argTypes, cmpTrArgTypeName);
+	return (item != NULL) ? item->type : TAT_UNKNOWN;
+}
+
+
+/**
+ * Decodes the given TR-064 argument direction.
+ * 
+ * @param[in] dir - argument direction string
+ * @param[in] len - length of dir in bytes
+ * @return decoded argument direction or TAD_NONE if invalid
+ */
+static tTrArgDir getArgDir(const char * dir, const size_t len) {
+	if (len == 2 && memcmp(dir, "in", 2) == 0) return TAD_IN;
+	if (len == 3 && memcmp(dir, "out", 3) == 0) return TAD_OUT;
+	return TAD_NONE;
+}
+
+
+/**
+ * Returns the name of the given TR-064 argument direction.
+ * 
+ * @param[in] dir - argument direction
+ * @return argument direction string
+ */
+static const char * getArgDirName(const tTrArgDir dir) {
+	switch (dir) {
+	case TAD_IN: return "in";
+	case TAD_OUT: return "out";
+	default: break;
+	}
+	return "";
+}
+
+
+/**
+ * Returns the interned copy of the given string. The string is added to the string table if not
+ * found. Equal strings share the same pointer afterwards.
+ * 
+ * @param[in,out] arena - allocate the hash table and string from this arena
+ * @param[in,out] table - string table
+ * @param[in] str - string to intern
+ * @param[in] len - length of str in bytes
+ * @return interned string or NULL on allocation error
+ */
+static char * internString(tArena * arena, tTrStringTable * table, const char * str, const size_t len) {
+	uint32_t hash = 2166136261U; /* FNV-1a */
+	size_t mask, i;
+	char * res;
+	for (size_t n = 0; n < len; n++) hash = (hash ^ (uint8_t)(str[n])) * 16777619U;
+	/* keep the load factor below 3/4 */
+	if ((table->length + 1) * 4 > table->capacity * 3) {
+		const size_t capacity = PCF_MAX(64, table->capacity * 2);
+		char ** item = (char **)ar_calloc(arena, capacity, sizeof(char *));
+		if (item == NULL) return NULL;
+		for (size_t n = 0; n < table->capacity; n++) {
+			const char * old = table->item[n];
+			uint32_t oldHash = 2166136261U;
+			if (old == NULL) continue;
+			for (; *old != 0; old++) oldHash = (oldHash ^ (uint8_t)(*old)) * 16777619U;
+			for (i = oldHash & (capacity - 1); item[i] != NULL; i = (i + 1) & (capacity - 1));
+			item[i] = table->item[n];
+		}
+		table->item = item;
+		table->capacity = capacity;
+	}
+	mask = table->capacity - 1;
+	for (i = hash & mask; table->item[i] != NULL; i = (i + 1) & mask) {
+		if (strncmp(table->item[i], str, len) == 0 && table->item[i][len] == 0) return table->item[i];
+	}
+	res = ar_strndup(arena, str, len);
+	if (res == NULL) return NULL;
+	table->item[i] = res;
+	table->length++;
+	return res;
+}
+
+
 /**
  * Helper callback function to parse a URL into tokens.
  * 
@@ -1015,10 +1301,16 @@ int httpResponseVisitor(const tPHttpTokenType type, const tPToken * tokens, void
 	if (resp == NULL) return 0;
 	if (type == PHTT_EXPECTED) {
 		resp->content = *tokens;
-	} else if (type == PHTT_BODY && resp->content.start != NULL) {
+	} else if (type == PHTT_BODY && (resp->content.start != NULL || resp->chunked != 0)) {
 		resp->content = *tokens;
 	} else if (type == PHTT_STATUS) {
 		resp->status = (size_t)strtoul(tokens[1].start, NULL, 10);
+	} else if (type == PHTT_PARAMETER && p_cmpTokenI(tokens, "Transfer-Encoding") == 0) {
+		resp->chunked = p_isHttpChunked(tokens + 1);
+	} else if (type == PHTT_PARAMETER && p_cmpTokenI(tokens, "ETag") == 0) {
+		resp->etag = tokens[1];
+	} else if (type == PHTT_PARAMETER && p_cmpTokenI(tokens, "Last-Modified") == 0) {
+		resp->modified = tokens[1];
 	} else if (type == PHTT_PARAMETER && p_cmpTokenI(tokens, "WWW-Authenticate") == 0) {
 		/* parse authentication parameters */
 		typedef enum {
@@ -1243,6 +1535,47 @@ onAlgorithmParam:
 }
 
 
+/**
+ * Helper callback function for p_httpDrain() which passes the received part of the body to the
+ * receive callback of the request context.
+ * 
+ * @param[in] type - token type
+ * @param[in] tokens - tokens passed (1 for body)
+ * @param[in,out] param - user defined callback data (expects tTr64RequestCtx)
+ * @return 1 to continue, 0 to abort
+ */
+int httpReceiveVisitor(const tPHttpTokenType type, const tPToken * tokens, void * param) {
+	tTr64RequestCtx * ctx = (tTr64RequestCtx *)param;
+	if (ctx == NULL || ctx->receive == NULL || type != PHTT_BODY) return 0;
+	return (ctx->receive(ctx, tokens->start, tokens->length, ctx->receiveParam) == 1) ? 1 : 0;
+}
+
+
+/**
+ * Resizes the buffer of the given context while keeping the tokens of the passed response valid
+ * which point into that buffer.
+ * 
+ * @param[in,out] ctx - context to use
+ * @param[in,out] resp - response with tokens pointing into the context buffer
+ * @param[in] size - new buffer size in bytes
+ * @return 1 on success, else 0
+ */
+int resizeResponseBuffer(tTr64RequestCtx * ctx, tTr64Response * resp, const size_t size) {
+	if (ctx == NULL || resp == NULL) return 0;
+	tPToken * tokens[] = {&(resp->content), &(resp->etag), &(resp->modified), &(resp->auth.realm), &(resp->auth.nonce), &(resp->auth.opaque)};
+	size_t offsets[sizeof(tokens) / sizeof(*tokens)];
+	const size_t count = sizeof(tokens) / sizeof(*tokens);
+	for (size_t i = 0; i < count; i++) {
+		offsets[i] = (tokens[i]->start != NULL) ? (size_t)(tokens[i]->start - ctx->buffer) : (size_t)-1;
+	}
+	if (arrayFieldResize(ctx, buffer, size) != 1) return 0;
+	for (size_t i = 0; i < count; i++) {
+		if (offsets[i] != (size_t)-1) tokens[i]->start = ctx->buffer + offsets[i];
+	}
+	return 1;
+}
+
+
 /**
  * Converts the given MD5 to a hex string.
  * 
@@ -1261,7 +1594,53 @@ void md5ToHex(char * str, const uint8_t * md5) {
 
 
 /**
- * Helper function to build a HTTP digest authentication request from the given server response.
+ * Helper function to replace the string in the given field if it differs from the passed token.
+ * 
+ * @param[in,out] field - pointer to the allocated string field
+ * @param[in] token - new value or token with NULL start to clear the field
+ * @return 1 if the value was changed, 0 if unchanged or -1 on allocation error
+ */
+static int updateAuthField(char ** field, const tPToken * token) {
+	if (token->start == NULL) {
+		if (*field == NULL) return 0;
+		free(*field);
+		*field = NULL;
+		return 1;
+	}
+	if (*field != NULL && strlen(*field) == token->length && strncmp(*field, token->start, token->length) == 0) return 0;
+	char * value = strndupInternal(token->start, token->length);
+	if (value == NULL) return -1;
+	if (*field != NULL) free(*field);
+	*field = value;
+	return 1;
+}
+
+
+/**
+ * Helper function to calculate the HTTP digest authentication HA1 value from the user name, realm
+ * and password of the given context.
+ * 
+ * @param[in,out] ctx - context to use
+ */
+static void updateAuthHa1(tTr64RequestCtx * ctx) {
+	static const char sep[1] = {':'};
+	tHMd5Ctx a1;
+	uint8_t a1Data[16];
+	h_initMd5(&a1);
+	h_updateMd5(&a1, (const uint8_t *)(ctx->user), strlen(ctx->user));
+	h_updateMd5(&a1, (const uint8_t *)(sep), 1);
+	h_updateMd5(&a1, (const uint8_t *)(ctx->realm), strlen(ctx->realm));
+	h_updateMd5(&a1, (const uint8_t *)(sep), 1);
+	h_updateMd5(&a1, (const uint8_t *)(ctx->pass), strlen(ctx->pass));
+	h_finalMd5(&a1, a1Data);
+	md5ToHex(ctx->ha1, a1Data);
+}
+
+
+/**
+ * Helper function to store the HTTP digest authentication challenge of the given server response
+ * and build the authentication request for the current method and path from it. The challenge is
+ * kept in the context to authorize further requests preemptively (see httpAuthorization()).
  * 
  * @param[in,out] ctx - context to use
  * @param[in] resp - previous HTTP request resp
@@ -1271,59 +1650,75 @@ void md5ToHex(char * str, const uint8_t * md5) {
  */
 int httpAuthentication(tTr64RequestCtx * ctx, const tTr64Response * resp) {
 	if (ctx == NULL || resp == NULL || ctx->method == NULL || ctx->path == NULL || ctx->user == NULL || ctx->pass == NULL) return 0;
+	int changed;
+	if ((resp->auth.flags & HAF_NEED) != HAF_NEED) return 0; /* missing fields */
+	/* copy parameters as our input will be overwritten on output */
+	changed = updateAuthField(&(ctx->realm), &(resp->auth.realm));
+	if (changed < 0) goto onOutOfMemory;
+	/* HA1 only depends on the realm for the given credentials */
+	if (changed > 0 || ctx->ha1[0] == 0) updateAuthHa1(ctx);
+	changed = updateAuthField(&(ctx->nonce), &(resp->auth.nonce));
+	if (changed < 0) goto onOutOfMemory;
+	if (changed > 0) ctx->nc = 0; /* new nonce -> restart nonce count */
+	if ((resp->auth.flags & HAF_OPAQUE) != 0) {
+		changed = updateAuthField(&(ctx->opaque), &(resp->auth.opaque));
+	} else {
+		const tPToken none = {NULL, 0};
+		changed = updateAuthField(&(ctx->opaque), &none);
+	}
+	if (changed < 0) goto onOutOfMemory;
+	ctx->authFlags = resp->auth.flags;
+	if (httpAuthorization(ctx) != 1) return 0;
+	ctx->preAuth = 0;
+	return 1;
+onOutOfMemory:
+	if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+	return 0;
+}
+
+
+/**
+ * Helper function to build a HTTP digest authentication request for the current method and path
+ * from the last server challenge stored in the context. The nonce count is incremented with each
+ * call. Nothing is done if no challenge was received yet.
+ * 
+ * @param[in,out] ctx - context to use
+ * @return 1 on success, else 0
+ * @remarks No support for auth-int and MD5-sess.
+ * @see https://tools.ietf.org/html/rfc2617
+ */
+int httpAuthorization(tTr64RequestCtx * ctx) {
+	if (ctx == NULL || ctx->method == NULL || ctx->path == NULL || ctx->user == NULL || ctx->realm == NULL || ctx->nonce == NULL) return 0;
 	static const char * authRfc2617 = "Authorization: Digest username=\"%s\",realm=\"%s\",nonce=\"%s\",uri=\"%s\",qop=\"auth\",nc=%s,cnonce=\"%s\",response=\"%s\"\r\n";
 	static const char * authRfc2617Opaque = "Authorization: Digest username=\"%s\",realm=\"%s\",nonce=\"%s\",uri=\"%s\",qop=\"auth\",nc=%s,cnonce=\"%s\",response=\"%s\",opaque=\"%s\"\r\n";
 	static const char * authRfc2069 = "Authorization: Digest username=\"%s\",realm=\"%s\",nonce=\"%s\",uri=\"%s\",qop=\"\",response=\"%s\"\r\n";
 	static const char auth[] = "auth"; /* only "" and "auth" is supported (i.e. no auth-int) */
-	tHMd5Ctx a1, a2, k;
-	uint8_t a1Data[16], a2Data[16], kData[16];
-	char a1Str[33], a2Str[33], kStr[33];
+	tHMd5Ctx a2, k;
+	uint8_t a2Data[16], kData[16];
+	char a2Str[33], kStr[33];
 	char nc[9];
 	char cnonce[9];
 	char sep[1] = {':'};
-	const char * realm = NULL;
-	const char * nonce = NULL;
-	const char * opaque = NULL;
-	int ok, res = 0;
-	if ((resp->auth.flags & HAF_NEED) != HAF_NEED) return 0; /* missing fields */
+	int ok;
 	/* calculate digest */
-	h_initMd5(&a1);
-	h_updateMd5(&a1, (const uint8_t *)(ctx->user), strlen(ctx->user));
-	h_updateMd5(&a1, (const uint8_t *)(sep), 1);
-	h_updateMd5(&a1, (const uint8_t *)(resp->auth.realm.start), resp->auth.realm.length);
-	h_updateMd5(&a1, (const uint8_t *)(sep), 1);
-	h_updateMd5(&a1, (const uint8_t *)(ctx->pass), strlen(ctx->pass));
-	h_finalMd5(&a1, a1Data);
-	md5ToHex(a1Str, a1Data);
 	h_initMd5(&a2);
 	h_updateMd5(&a2, (const uint8_t *)(ctx->method), strlen(ctx->method));
 	h_updateMd5(&a2, (const uint8_t *)(sep), 1);
 	h_updateMd5(&a2, (const uint8_t *)(ctx->path), strlen(ctx->path));
 	h_finalMd5(&a2, a2Data);
 	md5ToHex(a2Str, a2Data);
-	/* copy parameters for output as our input will be overwritten on output */
-	realm = strndupInternal(resp->auth.realm.start, resp->auth.realm.length);
-	if (realm == NULL) {
-		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-		goto onError;
-	}
-	nonce = strndupInternal(resp->auth.nonce.start, resp->auth.nonce.length);
-	if (nonce == NULL) {
-		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-		goto onError;
-	}
-	if ((resp->auth.flags & HAF_RFC2617) == HAF_RFC2617) {
+	if ((ctx->authFlags & HAF_RFC2617) == HAF_RFC2617) {
 		/* use RFC 2617 auth */
 		if (ctx->cnonce == 0) ctx->cnonce = (size_t)((rand() << 16) ^ rand());
 		ctx->nc++;
 		snprintf(cnonce, sizeof(cnonce), "%08X", (unsigned)(ctx->cnonce & 0xFFFFFFFF));
-		snprintf(nc, sizeof(nc), "%08u", (unsigned)(ctx->nc % 100000000));
+		snprintf(nc, sizeof(nc), "%08x", (unsigned)(ctx->nc & 0xFFFFFFFF));
 		h_initMd5(&k);
-		h_updateMd5(&k, (const uint8_t *)(a1Str), 32);
+		h_updateMd5(&k, (const uint8_t *)(ctx->ha1), 32);
 		h_updateMd5(&k, (const uint8_t *)(sep), 1);
-		h_updateMd5(&k, (const uint8_t *)(resp->auth.nonce.start), resp->auth.nonce.length);
+		h_updateMd5(&k, (const uint8_t *)(ctx->nonce), strlen(ctx->nonce));
 		h_updateMd5(&k, (const uint8_t *)(sep), 1);
-		if ((resp->auth.flags & HAF_AUTH) != 0) {
+		if ((ctx->authFlags & HAF_AUTH) != 0) {
 			h_updateMd5(&k, (const uint8_t *)(nc), sizeof(nc) - 1);
 			h_updateMd5(&k, (const uint8_t *)(sep), 1);
 			h_updateMd5(&k, (const uint8_t *)(cnonce), sizeof(cnonce) - 1);
@@ -1335,49 +1730,37 @@ int httpAuthentication(tTr64RequestCtx * ctx, const tTr64Response * resp) {
 		h_finalMd5(&k, kData);
 		md5ToHex(kStr, kData);
 		/* build response string */
-		if ((resp->auth.flags & HAF_OPAQUE) != 0) {
-			/* copy parameter for output as our input will be overwritten on output */
-			opaque = strndupInternal(resp->auth.opaque.start, resp->auth.opaque.length);
-			if (opaque == NULL) {
-				if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-				goto onError;
-			}
-			ctx->length = 0;
-			ok = formatToCtxBuffer(ctx, authRfc2617Opaque, ctx->user, realm, nonce, ctx->path, nc, cnonce, kStr, opaque);
+		ctx->length = 0;
+		if (ctx->opaque != NULL) {
+			ok = formatToCtxBuffer(ctx, authRfc2617Opaque, ctx->user, ctx->realm, ctx->nonce, ctx->path, nc, cnonce, kStr, ctx->opaque);
 		} else {
-			ctx->length = 0;
-			ok = formatToCtxBuffer(ctx, authRfc2617, ctx->user, realm, nonce, ctx->path, nc, cnonce, kStr);
+			ok = formatToCtxBuffer(ctx, authRfc2617, ctx->user, ctx->realm, ctx->nonce, ctx->path, nc, cnonce, kStr);
 		}
 	} else {
 		/* fall back to RFC 2069 */
 		h_initMd5(&k);
-		h_updateMd5(&k, (const uint8_t *)(a1Str), 32);
+		h_updateMd5(&k, (const uint8_t *)(ctx->ha1), 32);
 		h_updateMd5(&k, (const uint8_t *)(sep), 1);
-		h_updateMd5(&k, (const uint8_t *)(resp->auth.nonce.start), resp->auth.nonce.length);
+		h_updateMd5(&k, (const uint8_t *)(ctx->nonce), strlen(ctx->nonce));
 		h_updateMd5(&k, (const uint8_t *)(sep), 1);
 		h_updateMd5(&k, (const uint8_t *)(a2Str), 32);
 		h_finalMd5(&k, kData);
 		md5ToHex(kStr, kData);
 		/* build response string */
 		ctx->length = 0;
-		ok = formatToCtxBuffer(ctx, authRfc2069, ctx->user, realm, nonce, ctx->path, kStr);
+		ok = formatToCtxBuffer(ctx, authRfc2069, ctx->user, ctx->realm, ctx->nonce, ctx->path, kStr);
 	}
 	if (ok != 1) {
 		if (ctx->verbose > 1)  _ftprintf(ferr, MSGT(MSGT_ERR_HTTP_FMT_AUTH));
-		goto onError;
+		return 0;
 	}
 	if (ctx->auth != NULL) free(ctx->auth);
 	ctx->auth = strndupInternal(ctx->buffer, ctx->length);
 	if (ctx->auth == NULL) {
 		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-		goto onError;
+		return 0;
 	}
-	res = 1;
-onError:
-	if (realm != NULL) free((void *)realm);
-	if (nonce != NULL) free((void *)nonce);
-	if (opaque != NULL) free((void *)opaque);
-	return res;
+	return 1;
 }
 
 
@@ -1479,6 +1862,69 @@ int formatToQryBuffer(tTrQueryHandler * qry, const char * fmt, ...) {
 }
 
 
+/**
+ * Reserves space for the given number of bytes and a null-terminator behind the used space of the
+ * passed buffer. The function automatically increases the buffer if insufficient.
+ * 
+ * @param[in,out] buffer - reserve space in the pointed buffer
+ * @param[in,out] capacity - capacity of the buffer
+ * @param[in] length - length of the buffer
+ * @param[in] len - number of bytes to reserve
+ * @return 1 on success, else 0
+ */
+static int reserveBuffer(char ** buffer, size_t * capacity, const size_t length, const size_t len) {
+	if (*buffer == NULL || (*capacity - length) <= len) {
+		const size_t minCapacity = length + len + 1;
+		size_t newCapacity = PCF_MAX(BUFFER_SIZE, *capacity * 2);
+		for (; newCapacity < minCapacity; newCapacity *= 2);
+		if (arrayResize((void **)buffer, capacity, sizeof(**buffer), newCapacity) != 1) return 0;
+	}
+	return 1;
+}
+
+
+/**
+ * Appends the given string to the passed buffer. The function automatically increases the buffer
+ * if insufficient. The result is always null-terminated.
+ * 
+ * @param[in,out] buffer - add to the pointed buffer
+ * @param[in,out] capacity - capacity of the buffer
+ * @param[in,out] length - length of the buffer
+ * @param[in] str - string to append
+ * @param[in] len - number of bytes to append from str
+ * @return 1 on success, else 0
+ */
+static int appendToBuffer(char ** buffer, size_t * capacity, size_t * length, const char * str, const size_t len) {
+	if (buffer == NULL || capacity == NULL || length == NULL || (str == NULL && len > 0)) return 0;
+	if (reserveBuffer(buffer, capacity, *length, len) != 1) return 0;
+	if (len > 0) memcpy(*buffer + *length, str, len);
+	*length += len;
+	(*buffer)[*length] = 0;
+	return 1;
+}
+
+
+/**
+ * Appends the given string as fragment to the passed fragment list. The string is referenced, not
+ * copied. Empty strings are skipped.
+ * 
+ * @param[in,out] list - add to this fragment list
+ * @param[in] str - string to append
+ * @param[in] len - number of bytes to append from str
+ * @return 1 on success, else 0
+ */
+static int appendFragment(tTr64Fragments * list, const char * str, const size_t len) {
+	if (list == NULL || (str == NULL && len > 0)) return 0;
+	if (len < 1) return 1;
+	if (list->length >= list->capacity && arrayFieldResize(list, item, PCF_MAX(INIT_ARRAY_SIZE, list->capacity * 2)) != 1) return 0;
+	list->item[list->length].start = str;
+	list->item[list->length].length = len;
+	list->length++;
+	list->size += len;
+	return 1;
+}
+
+
 #ifdef UNICODE
 static struct {
 	char * buffer;
@@ -1550,25 +1996,63 @@ static int xmlToFullName(const tPSaxTokenType type, tPToken * out, const tPToken
 
 
 /**
- * Callback to parse the XML cache file format.
+ * Copies the given XML token to the passed reusable buffer. The output token points to the copy.
  * 
- * @param[in] type - token type
- * @param[in] tokens - tokens passed (1 for contents and cdata; 2 for xml, instructions and tags, 3 for attributes)
- * @param[in] level - token level (i.e. number of parents)
- * @param[in,out] param - user defined callback data (expects tPTrObjectCacheCtx)
- * @return 1 to continue, 0 on error
- * @see newTrObject()
+ * @param[in,out] copy - buffer for the copy
+ * @param[out] out - receives the copied token
+ * @param[in] token - token to copy
+ * @return 1 on success, else 0
  */
-static int xmlCacheFileVisitor(const tPSaxTokenType type, const tPToken * tokens, const size_t level, void * param) {
-	PCF_UNUSED(level);
-	tPTrObjectCacheCtx * ctx = (tPTrObjectCacheCtx *)param;
-	tPToken fullName;
-	if (tokens == NULL || ctx == NULL) return 0;
-	if (xmlToFullName(type, &fullName, tokens) != 1) return 0;
-#define ENTER_NODE(item, root, newState) \
+static int copyXmlToken(tTrTokenCopy * copy, tPToken * out, const tPToken * token) {
+	if (copy->buffer == NULL || token->length > copy->capacity) {
+		const size_t newCapacity = PCF_MAX(token->length, 32);
+		char * newBuffer = (char *)realloc(copy->buffer, newCapacity);
+		if (newBuffer == NULL) return 0;
+		copy->buffer = newBuffer;
+		copy->capacity = newCapacity;
+	}
+	if (token->length > 0) memcpy(copy->buffer, token->start, token->length);
+	out->start = copy->buffer;
+	out->length = token->length;
+	return 1;
+}
+
+
+/**
+ * Releases the given XML token copies.
+ * 
+ * @param[in,out] copy - token copies to release
+ * @param[in] count - number of elements in copy
+ */
+static void freeXmlTokenCopies(tTrTokenCopy * copy, const size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		if (copy[i].buffer != NULL) free(copy[i].buffer);
+		copy[i].buffer = NULL;
+		copy[i].capacity = 0;
+	}
+}
+
+
+/**
+ * Callback to parse the XML cache file format.
+ * 
+ * @param[in] type - token type
+ * @param[in] tokens - tokens passed (1 for contents and cdata; 2 for xml, instructions and tags, 3 for attributes)
+ * @param[in] level - token level (i.e. number of parents)
+ * @param[in,out] param - user defined callback data (expects tPTrObjectCacheCtx)
+ * @return 1 to continue, 0 on error
+ * @see newTrObject()
+ */
+static int xmlCacheFileVisitor(const tPSaxTokenType type, const tPToken * tokens, const size_t level, void * param) {
+	PCF_UNUSED(level);
+	tPTrObjectCacheCtx * ctx = (tPTrObjectCacheCtx *)param;
+	tPToken fullName;
+	if (tokens == NULL || ctx == NULL) return 0;
+	if (xmlToFullName(type, &fullName, tokens) != 1) return 0;
+#define ENTER_NODE(item, root, newState) \
 	if (p_cmpToken(&fullName, #item) != 0) return 0; /* invalid tag */ \
 	if (ctx->root->length >= ctx->root->capacity) { \
-		if (arrayFieldResize(ctx->root, item, PCF_MAX(INIT_ARRAY_SIZE, ctx->root->capacity * 2)) != 1) return 0; \
+		if (arrayFieldResizeArena(&(ctx->object->arena), ctx->root, item, PCF_MAX(INIT_ARRAY_SIZE, ctx->root->capacity * 2)) != 1) return 0; \
 	} \
 	ctx->item = ctx->root->item + ctx->root->length; \
 	memset(ctx->item, 0, sizeof(*(ctx->item))); \
@@ -1576,7 +2060,12 @@ static int xmlCacheFileVisitor(const tPSaxTokenType type, const tPToken * tokens
 	ctx->state = PCS_WITHIN_##newState;
 #define ADD_FIELD(item, field) \
 	if (p_cmpToken(&fullName, #field) == 0) { \
-		ctx->item->field = strndupInternal(tokens[2].start, tokens[2].length); \
+		ctx->item->field = ar_strndup(&(ctx->object->arena), tokens[2].start, tokens[2].length); \
+		if (ctx->item->field == NULL) return 0; \
+	}
+#define INTERN_FIELD(item, field) \
+	if (p_cmpToken(&fullName, #field) == 0) { \
+		ctx->item->field = internString(&(ctx->object->arena), &(ctx->object->strings), tokens[2].start, tokens[2].length); \
 		if (ctx->item->field == NULL) return 0; \
 	}
 #define LEAVE_NODE(item, newState) \
@@ -1602,14 +2091,22 @@ static int xmlCacheFileVisitor(const tPSaxTokenType type, const tPToken * tokens
 	case PCS_WITHIN_OBJECT:
 		switch (type) {
 		case PSTT_START_TAG:
+			if (ctx->version == 0) return 0; /* unknown format version */
 			ENTER_NODE(device, object, DEVICE)
 			break;
 		case PSTT_ATTRIBUTE:
 			ADD_FIELD(object, name) else
-			ADD_FIELD(object, url)
+			ADD_FIELD(object, url) else
+			ADD_FIELD(object, hash) else
+			ADD_FIELD(object, etag) else
+			ADD_FIELD(object, modified) else
+			if (p_cmpToken(&fullName, "version") == 0) {
+				ctx->version = (p_cmpToken(tokens + 2, XML_CACHE_VERSION) == 0) ? 1 : 0;
+			}
 			break;
 		case PSTT_END_TAG:
 			if (p_cmpToken(&fullName, "object") != 0) return 0;
+			if (ctx->version == 0) return 0; /* unknown format version */
 			ctx->state = PCS_END;
 			CHECK_FIELD(object, name)
 			CHECK_FIELD(object, url)
@@ -1643,7 +2140,15 @@ static int xmlCacheFileVisitor(const tPSaxTokenType type, const tPToken * tokens
 			ADD_FIELD(service, name) else
 			ADD_FIELD(service, type) else
 			ADD_FIELD(service, path)  else
-			ADD_FIELD(service, control)
+			ADD_FIELD(service, control) else
+			ADD_FIELD(service, hash) else
+			ADD_FIELD(service, etag) else
+			ADD_FIELD(service, modified) else
+			if (p_cmpToken(&fullName, "pending") == 0) {
+				ctx->service->pending = (tokens[2].length == 1 && *(tokens[2].start) == '1') ? 1 : 0;
+			} else if (p_cmpToken(&fullName, "stale") == 0) {
+				ctx->service->stale = (tokens[2].length == 1 && *(tokens[2].start) == '1') ? 1 : 0;
+			}
 			break;
 		case PSTT_END_TAG:
 			LEAVE_NODE(service, DEVICE)
@@ -1675,17 +2180,20 @@ static int xmlCacheFileVisitor(const tPSaxTokenType type, const tPToken * tokens
 	case PCS_WITHIN_ARG:
 		switch (type) {
 		case PSTT_ATTRIBUTE:
-			ADD_FIELD(arg, name) else
-			ADD_FIELD(arg, var) else
-			ADD_FIELD(arg, type) else
-			ADD_FIELD(arg, dir)
+			INTERN_FIELD(arg, name) else
+			INTERN_FIELD(arg, var) else
+			INTERN_FIELD(arg, type) else
+			if (p_cmpToken(&fullName, "dir") == 0) {
+				ctx->arg->dir = getArgDir(tokens[2].start, tokens[2].length);
+			}
 			break;
 		case PSTT_END_TAG:
 			LEAVE_NODE(arg, ACTION)
 			CHECK_FIELD(arg, name)
 			CHECK_FIELD(arg, var)
 			CHECK_FIELD(arg, type)
-			CHECK_FIELD(arg, dir)
+			if (ctx->arg->dir == TAD_NONE) return 0;
+			ctx->arg->dataType = getArgType(ctx->arg->type);
 			break;
 		default:
 			return 0; /* invalid token */
@@ -1697,6 +2205,7 @@ static int xmlCacheFileVisitor(const tPSaxTokenType type, const tPToken * tokens
 	
 #undef ENTER_NODE
 #undef ADD_FIELD
+#undef INTERN_FIELD
 #undef LEAVE_NODE
 #undef CHECK_FIELD
 	
@@ -1707,34 +2216,36 @@ static int xmlCacheFileVisitor(const tPSaxTokenType type, const tPToken * tokens
 /**
  * Parses the type name from a deviceType node content.
  * 
+ * @param[in,out] arena - allocate the result from this arena
  * @param[in] str - deviceType node content
  * @param[in] len - str length in bytes
  * @return parsed and allocated string or NULL on error
  */
-static char * parseDeviceName(const char * str, const size_t len) {
+static char * parseDeviceName(tArena * arena, const char * str, const size_t len) {
 	static const char devicePrefix[] = "urn:dslforum-org:device:";
 	const char * ptr = devicePrefix;
 	size_t i;
 	for (i = 0; i < len && i < sizeof(devicePrefix) && *ptr == *str; i++, ptr++, str++);
 	if ((i + 1) != sizeof(devicePrefix)) return NULL;
-	return strndupInternal(str, len - i);
+	return ar_strndup(arena, str, len - i);
 }
 
 
 /**
  * Parses the type name from a serviceType node content.
  * 
+ * @param[in,out] arena - allocate the result from this arena
  * @param[in] str - serviceType node content
  * @param[in] len - str length in bytes
  * @return parsed and allocated string or NULL on error
  */
-static char * parseServiceName(const char * str, const size_t len) {
+static char * parseServiceName(tArena * arena, const char * str, const size_t len) {
 	static const char servicePrefix[] = "urn:dslforum-org:service:";
 	const char * ptr = servicePrefix;
 	size_t i;
 	for (i = 0; i < len && i < sizeof(servicePrefix) && *ptr == *str; i++, ptr++, str++);
 	if ((i + 1) != sizeof(servicePrefix)) return NULL;
-	return strndupInternal(str, len - i);
+	return ar_strndup(arena, str, len - i);
 }
 
 
@@ -1814,7 +2325,7 @@ static int xmlDeviceDescVisitor(const tPSaxTokenType type, const tPToken * token
 #define ENTER_NODE(item, root) \
 	if (ctx->root == NULL) return 0; \
 	if (ctx->root->length >= ctx->root->capacity) { \
-		if (arrayFieldResize(ctx->root, item, PCF_MAX(INIT_ARRAY_SIZE, ctx->root->capacity * 2)) != 1) { \
+		if (arrayFieldResizeArena(ctx->arena, ctx->root, item, PCF_MAX(INIT_ARRAY_SIZE, ctx->root->capacity * 2)) != 1) { \
 			ctx->lastError = MSGT_ERR_NO_MEM; \
 			return 0; \
 		} \
@@ -1828,7 +2339,10 @@ static int xmlDeviceDescVisitor(const tPSaxTokenType type, const tPToken * token
 		if (level != 0) return 0; /* invalid token */
 		break;
 	case PSTT_START_TAG:
-		ctx->xmlPath[level] = fullName;
+		if (copyXmlToken(ctx->xmlPathCopy + level, ctx->xmlPath + level, &fullName) != 1) {
+			ctx->lastError = MSGT_ERR_NO_MEM;
+			return 0;
+		}
 		memset(&(ctx->content), 0, sizeof(ctx->content));
 		if (p_cmpToken(&fullName, "device") == 0) {
 			if (ctx->device != NULL) {
@@ -1843,13 +2357,17 @@ static int xmlDeviceDescVisitor(const tPSaxTokenType type, const tPToken * token
 				if (ctx->service->path == NULL) return 0;
 			}
 			ENTER_NODE(service, device)
+			ctx->service->pending = 1;
 		}
 		break;
 	case PSTT_ATTRIBUTE:
 		/* ignored */
 		break;
 	case PSTT_CONTENT:
-		ctx->content = *tokens;
+		if (copyXmlToken(&(ctx->contentCopy), &(ctx->content), tokens) != 1) {
+			ctx->lastError = MSGT_ERR_NO_MEM;
+			return 0;
+		}
 		break;
 	case PSTT_END_TAG:
 		if (p_cmpTokens(ctx->xmlPath + level, &fullName) != 0) {
@@ -1902,15 +2420,15 @@ static int xmlDeviceDescVisitor(const tPSaxTokenType type, const tPToken * token
 					}
 					if (pass != 0) {
 						if (ctx->device != NULL && field == &(ctx->device->name)) {
-							ctx->device->name = parseDeviceName(ctx->content.start, ctx->content.length);
+							ctx->device->name = parseDeviceName(ctx->arena, ctx->content.start, ctx->content.length);
 							if (ctx->device->name == NULL) {
 								ctx->lastError = MSGT_ERR_NO_MEM;
 								return 0;
 							}
 						} else {
-							*field = strndupInternal(ctx->content.start, ctx->content.length);
+							*field = ar_strndup(ctx->arena, ctx->content.start, ctx->content.length);
 							if (ctx->service != NULL && field == &(ctx->service->type)) {
-								ctx->service->name = parseServiceName(ctx->content.start, ctx->content.length);
+								ctx->service->name = parseServiceName(ctx->arena, ctx->content.start, ctx->content.length);
 								if (ctx->service->name == NULL) {
 									ctx->lastError = MSGT_ERR_NO_MEM;
 									return 0;
@@ -1965,7 +2483,10 @@ static int xmlServiceDescVisitor(const tPSaxTokenType type, const tPToken * toke
 		if (level != 0) return 0; /* invalid token */
 		break;
 	case PSTT_START_TAG:
-		ctx->xmlPath[level] = fullName;
+		if (copyXmlToken(ctx->xmlPathCopy + level, ctx->xmlPath + level, &fullName) != 1) {
+			ctx->lastError = MSGT_ERR_NO_MEM;
+			return 0;
+		}
 		memset(&(ctx->content), 0, sizeof(ctx->content));
 		if (p_cmpToken(&fullName, "action") == 0) {
 			if (ctx->action != NULL) {
@@ -1976,7 +2497,7 @@ static int xmlServiceDescVisitor(const tPSaxTokenType type, const tPToken * toke
 			if (ctx->arg != NULL) {
 				if (ctx->arg->name == NULL) return 0;
 				if (ctx->arg->var == NULL) return 0;
-				if (ctx->arg->dir == NULL) return 0;
+				if (ctx->arg->dir == TAD_NONE) return 0;
 			}
 			ENTER_NODE(arg, action)
 		} else if (p_cmpToken(&fullName, "stateVariable") == 0) {
@@ -1987,7 +2508,10 @@ static int xmlServiceDescVisitor(const tPSaxTokenType type, const tPToken * toke
 		/* ignored */
 		break;
 	case PSTT_CONTENT:
-		ctx->content = *tokens;
+		if (copyXmlToken(&(ctx->contentCopy), &(ctx->content), tokens) != 1) {
+			ctx->lastError = MSGT_ERR_NO_MEM;
+			return 0;
+		}
 		break;
 	case PSTT_END_TAG:
 		if (p_cmpTokens(ctx->xmlPath + level, &fullName) != 0) {
@@ -1998,7 +2522,7 @@ static int xmlServiceDescVisitor(const tPSaxTokenType type, const tPToken * toke
 				if (ctx->arg != NULL) {
 					if (ctx->arg->name == NULL) return 0;
 					if (ctx->arg->var == NULL) return 0;
-					if (ctx->arg->dir == NULL) return 0;
+					if (ctx->arg->dir == TAD_NONE) return 0;
 				} else {
 					return 0;
 				}
@@ -2010,45 +2534,63 @@ static int xmlServiceDescVisitor(const tPSaxTokenType type, const tPToken * toke
 					return 0;
 				}
 			} else if (ctx->content.start != NULL) {
-				/* add field */
+				/* add field (argument strings are interned) */
 				char ** field = NULL;
+				int intern = 0;
 				if (p_cmpToken(&fullName, "name") == 0) {
 					if (level == actionPath.depth && cmpXmlPath(ctx->xmlPath, level, actionPath.path) == 1) {
 						field = &(ctx->action->name);
 					} else if (level == argPath.depth && cmpXmlPath(ctx->xmlPath, level, argPath.path) == 1) {
 						field = &(ctx->arg->name);
+						intern = 1;
 					} else if (level == statePath.depth && cmpXmlPath(ctx->xmlPath, level, statePath.path) == 1) {
-						ctx->stateVarName = ctx->content;
+						if (copyXmlToken(&(ctx->stateVarNameCopy), &(ctx->stateVarName), &(ctx->content)) != 1) {
+							ctx->lastError = MSGT_ERR_NO_MEM;
+							return 0;
+						}
 					}
 				} else if (p_cmpToken(&fullName, "relatedStateVariable") == 0) {
 					if (level == argPath.depth && cmpXmlPath(ctx->xmlPath, level, argPath.path) == 1) {
 						field = &(ctx->arg->var);
+						intern = 1;
 					}
 				} else if (p_cmpToken(&fullName, "direction") == 0) {
 					if (level == argPath.depth && cmpXmlPath(ctx->xmlPath, level, argPath.path) == 1) {
-						field = &(ctx->arg->dir);
+						ctx->arg->dir = getArgDir(ctx->content.start, ctx->content.length);
+						if (ctx->arg->dir == TAD_NONE) return 0; /* invalid direction */
 					}
 				} else if (ctx->service != NULL && ctx->stateVarName.start != NULL && p_cmpToken(&fullName, "dataType") == 0) {
 					if (level == statePath.depth && cmpXmlPath(ctx->xmlPath, level, statePath.path) == 1) {
 						/* set dataType for relatedStateVariable */
+						char * typeName = NULL;
+						tTrArgType dataType = TAT_UNKNOWN;
 						for (size_t ac = 0; ac < ctx->service->length; ac++) {
 							tTrAction * action = ctx->service->action + ac;
 							for (size_t ar = 0; ar < action->length; ar++) {
 								tTrArgument * arg = action->arg + ar;
 								if (arg->var == NULL || arg->type != NULL) continue;
 								if (p_cmpToken(&(ctx->stateVarName), arg->var) == 0) {
-									arg->type = strndupInternal(ctx->content.start, ctx->content.length);
-									if (arg->type == NULL) {
-										ctx->lastError = MSGT_ERR_NO_MEM;
-										return 0;
+									if (typeName == NULL) {
+										typeName = internString(ctx->arena, ctx->strings, ctx->content.start, ctx->content.length);
+										if (typeName == NULL) {
+											ctx->lastError = MSGT_ERR_NO_MEM;
+											return 0;
+										}
+										dataType = getArgType(typeName);
 									}
+									arg->type = typeName;
+									arg->dataType = dataType;
 								}
 							}
 						}
 					}
 				}
 				if (field != NULL) {
-					*field = strndupInternal(ctx->content.start, ctx->content.length);
+					if (intern != 0) {
+						*field = internString(ctx->arena, ctx->strings, ctx->content.start, ctx->content.length);
+					} else {
+						*field = ar_strndup(ctx->arena, ctx->content.start, ctx->content.length);
+					}
 					if (*field == NULL) {
 						ctx->lastError = MSGT_ERR_NO_MEM;
 						return 0;
@@ -2067,361 +2609,1816 @@ static int xmlServiceDescVisitor(const tPSaxTokenType type, const tPToken * toke
 }
 
 
+/** HTTP request format string for device and service descriptions (path, host, port). */
+static const char * descRequest =
+	"GET /%s HTTP/1.1\r\n"
+	"Host: %s:%s\r\n"
+	"\r\n"
+;
+
+
+/** HTTP request format string for conditional description requests (path, host, port, field, value). */
+static const char * condDescRequest =
+	"GET /%s HTTP/1.1\r\n"
+	"Host: %s:%s\r\n"
+	"%s: %s\r\n"
+	"\r\n"
+;
+
+
 /**
- * Creates a new TR-064 object according to the given parameters. The caller needs to resolve the
- * host address in ctx.
+ * Formats the request for a device or service description in the context buffer. The request is
+ * conditional if a validator of the previous response is given.
  * 
  * @param[in,out] ctx - context to use
- * @param[in] opt - options to use
- * @return Object on success, else NULL.
+ * @param[in] path - description path without leading slash
+ * @param[in] etag - ETag of the previous response or NULL
+ * @param[in] modified - Last-Modified date of the previous response or NULL
+ * @return 1 on success, else 0
  */
-tTrObject * newTrObject(tTr64RequestCtx * ctx, const tOptions * opt) {
-	if (ctx == NULL || opt == NULL) return NULL;
-	static const char * request =
-		"GET /%s HTTP/1.1\r\n"
-		"Host: %s:%s\r\n"
-		"\r\n"
-	;
-	char * xml = NULL;
-	const char * xmlErrPos;
-	char * escName = NULL;
-	char * escUrl = NULL;
-	size_t xmlLen = 0;
-	int ok;
-	tTrObject * obj = NULL;
-	tTrObject * res = NULL;
-	
-	obj = (tTrObject *)calloc(1, sizeof(tTrObject));
-	if (obj == NULL) return NULL;
-	
-	/* read from cache */
-	if (isFile(opt->cache) == 1) {
-		xml = readFileToString(opt->cache, &xmlLen);
-		if (xml == NULL || xmlLen < 1) {
-			if (xml != NULL) free(xml);
-			if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_READ));
-			goto onCacheFileError;
-		}
-		/* parse XML and fill in TR-064 object elements */
-		tPTrObjectCacheCtx xmlCtx = {
-			/* .object  = */ obj,
-			/* .device  = */ NULL,
-			/* .service = */ NULL,
-			/* .action  = */ NULL,
-			/* .arg     = */ NULL,
-			/* .state   = */ PCS_START
-		};
-		xmlErrPos = NULL;
-		if (p_sax(xml, xmlLen, &xmlErrPos, xmlCacheFileVisitor, &xmlCtx) != PSRT_SUCCESS) {
-			if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_FMT));
-			if (ctx->verbose > 3) {
-				tParserPos pos;
-				if (p_getPos(xml, xmlLen, xmlErrPos, 1, &pos) == 1) {
-					_ftprintf(ferr, MSGT(MSGT_DBG_BAD_TOKEN), (unsigned)pos.line, (unsigned)pos.column);
-				}
-			}
-			free(xml);
-			/* re-initialize object to discard fragments from cache file */
-			freeTrObject(obj);
-			obj = (tTrObject *)calloc(1, sizeof(tTrObject));
-			if (obj == NULL) goto onError;
-			goto onCacheFileError;
-		}
-		free(xml);
-		/* unescape object name */
-		if (p_unescapeXmlVar(&(obj->name), NULL, 0) != 1) {
-			if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_UNESC));
-			goto onUnescapeOutOfMemoryError;
-		}
-		/* unescape object URL */
-		if (p_unescapeXmlVar(&(obj->url), NULL, 0) != 1) {
-			if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_UNESC));
-			goto onUnescapeOutOfMemoryError;
-		}
-		/* check if cached URL matches requested one */
-		if (strcmp(obj->url, opt->url) == 0) {
-			return obj;
-		}
-onUnescapeOutOfMemoryError:
-		/* re-initialize object to discard fragments from cache file */
-		freeTrObject(obj);
-		obj = (tTrObject *)calloc(1, sizeof(tTrObject));
-		if (obj == NULL) goto onError;
-	}
-	
-onCacheFileError:
-	xml = NULL;
-	
-	/* read from device */
-	/* read device description */
-	ctx->length = 0;
-	if (formatToCtxBuffer(ctx, request, ctx->path, ctx->host, ctx->port) != 1) {
-		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_FMT_DEV_DESC));
-		goto onError;
-	}
-	if (ctx->verbose > 3) {
-		fuprintf(ferr, MSGU(MSGU_INFO_DEV_DESC_REQ), ctx->path);
-	}
-	if (ctx->request(ctx) != 1) {
-		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_GET_DEV_DESC), (unsigned)(ctx->status));
-		goto onError;
-	}
-	if (ctx->verbose > 2) _ftprintf(ferr, MSGT(MSGT_INFO_DEV_DESC_DUR), (unsigned)(ctx->duration));
-	/* parse device descriptions in used callback (see xmlDeviceDescVisitor()) */
-	{
-		obj->url = strdup(opt->url);
-		if (obj->url == NULL) {
-			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-			goto onError;
-		}
-		tPTrObjectDeviceCtx devCtx = {
-			/* .xmlPath    = */ {{0}},
-			/* .object     = */ obj,
-			/* .device     = */ NULL,
-			/* .service    = */ NULL,
-			/* .content    = */ {0},
-			/* .lastError  = */ MSGT_SUCCESS
-		};
-		const size_t contentLength = (ctx->buffer + ctx->length) - ctx->content;
-		xmlErrPos = NULL;
-		if (p_sax(ctx->content, contentLength, &xmlErrPos, xmlDeviceDescVisitor, &devCtx) != PSRT_SUCCESS) {
-			if (devCtx.lastError != MSGT_SUCCESS) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(devCtx.lastError));
-			} else {
-				if (ctx->verbose > 0) {
-					fuprintf(ferr, MSGU(MSGU_ERR_DEV_DESC_FMT), ctx->path);
-				}
-				if (ctx->verbose > 3) {
-					tParserPos pos;
-					if (p_getPos(ctx->content, contentLength, xmlErrPos, 1, &pos) == 1) {
-						_ftprintf(ferr, MSGT(MSGT_DBG_BAD_TOKEN), (unsigned)pos.line, (unsigned)pos.column);
-					}
-				}
-			}
-			goto onError;
-		}
-	}
-	/* read and parse service descriptions */
-	for (size_t d = 0; d < obj->length; d++) {
-		tTrDevice * device = obj->device + d;
-		if (device->service == NULL) continue;
-		for (size_t s = 0; s < device->length; s++) {
-			tTrService * service = device->service + s;
-			/* read service description */
-			/* skip leading slash (/) in service->path as it is already included in request */
-			ctx->length = 0;
-			if (formatToCtxBuffer(ctx, request, service->path + 1, ctx->host, ctx->port) != 1) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_FMT_SRVC_DESC));
-				goto onError;
-			}
-			if (ctx->verbose > 2) {
-				fuprintf(ferr, MSGU(MSGU_INFO_SRVC_DESC_REQ), service->path);
-			}
-			if (ctx->request(ctx) != 1) {
-				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_GET_SRVC_DESC), (unsigned)(ctx->status));
-				goto onError;
-			}
-			if (ctx->verbose > 2) _ftprintf(ferr, MSGT(MSGT_INFO_SRVC_DESC_DUR), (unsigned)(ctx->duration));
-			/* parse service description in used callback (see xmlServiceDescVisitor()) */
-			{
-				tPTrObjectServiceCtx serviceCtx = {
-					/* .xmlPath      = */ {{0}},
-					/* .service      = */ service,
-					/* .action       = */ NULL,
-					/* .arg          = */ NULL,
-					/* .content      = */ {0},
-					/* .stateVarName = */ {0},
-					/* .lastError    = */ MSGT_SUCCESS
-				};
-				const size_t contentLength = (ctx->buffer + ctx->length) - ctx->content;
-				xmlErrPos = NULL;
-				if (p_sax(ctx->content, contentLength, &xmlErrPos, xmlServiceDescVisitor, &serviceCtx) != PSRT_SUCCESS) {
-					if (serviceCtx.lastError != MSGT_SUCCESS) {
-						if (ctx->verbose > 0) _ftprintf(ferr, MSGT(serviceCtx.lastError));
-					} else {
-						if (ctx->verbose > 0) {
-							fuprintf(ferr, MSGU(MSGU_ERR_DEV_SRVC_FMT), service->path);
-						}
-						if (ctx->verbose > 3) {
-							tParserPos pos;
-							if (p_getPos(ctx->content, contentLength, xmlErrPos, 1, &pos) == 1) {
-								_ftprintf(ferr, MSGT(MSGT_DBG_BAD_TOKEN), (unsigned)pos.line, (unsigned)pos.column);
-							}
-						}
-					}
-					goto onError;
-				}
-				/* check if we got a type for each argument variable */
-				if (service->action != NULL) {
-					for (size_t ac = 0; ac < service->length; ac++) {
-						const tTrAction * action = service->action + ac;
-						if (action->arg == NULL) continue;
-						for (size_t ar = 0; ar < action->length; ar++) {
-							const tTrArgument * arg = action->arg + ar;
-							if (arg->type == NULL) {
-								if (ctx->verbose > 0) fuprintf(ferr, MSGU(MSGU_ERR_NO_TYPE_FOR_ARG), arg->var);
-								goto onError;
-							}
-						}
-					}
-				}
-			}
-		}
-	}
-	
-	/* store new cache file (format output errors are ignored until the end) */
+static int formatDescRequest(tTr64RequestCtx * ctx, const char * path, const char * etag, const char * modified) {
 	ctx->length = 0;
-	if (opt->cache == NULL) goto onSuccess;
-	ok = formatToCtxBuffer(ctx, "%s", "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-	escName = p_escapeXml(obj->name, (size_t)-1);
-	if (escName == NULL) goto onFormatOutOfMemoryError;
-	escUrl = p_escapeXml(obj->url, (size_t)-1);
-	if (escUrl == NULL) goto onFormatOutOfMemoryError;
-	ok &= formatToCtxBuffer(ctx, "<object name=\"%s\" url=\"%s\">\n", escName, escUrl);
-	if (obj->device != NULL) {
-		for (size_t d = 0; d < obj->length; d++) {
-			const tTrDevice * device = obj->device + d;
-			ok &= formatToCtxBuffer(ctx, " <device name=\"%s\">\n", device->name);
-			if (device->service != NULL) {
-				for (size_t s = 0; s < device->length; s++) {
-					const tTrService * service = device->service + s;
-					ok &= formatToCtxBuffer(ctx, "  <service name=\"%s\" type=\"%s\" path=\"%s\" control=\"%s\">\n", service->name, service->type, service->path, service->control);
-					if (service->action != NULL) {
-						for (size_t ac = 0; ac < service->length; ac++) {
-							const tTrAction * action = service->action + ac;
-							ok &= formatToCtxBuffer(ctx, "   <action name=\"%s\">\n", action->name);
-							if (action->arg != NULL) {
-								for (size_t ar = 0; ar < action->length; ar++) {
-									const tTrArgument * arg = action->arg + ar;
-									ok &= formatToCtxBuffer(ctx, "    <arg name=\"%s\" var=\"%s\" type=\"%s\" dir=\"%s\"/>\n", arg->name, arg->var, arg->type, arg->dir);
-								}
-							}
-							ok &= formatToCtxBuffer(ctx, "   </action>\n");
-						}
-					}
-					ok &= formatToCtxBuffer(ctx, "  </service>\n");
-				}
-			}
-			ok &= formatToCtxBuffer(ctx, " </device>\n");
-		}
-	}
-	ok &= formatToCtxBuffer(ctx, "</object>\n");
-	if (ok != 1) {
-onFormatOutOfMemoryError:
-		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_NO_MEM));
-	} else if (writeStringNToFile(opt->cache, ctx->buffer, ctx->length) != 1) {
-		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_WRITE));
+	if (etag != NULL && *etag != 0) {
+		return formatToCtxBuffer(ctx, condDescRequest, path, ctx->host, ctx->port, "If-None-Match", etag);
+	} else if (modified != NULL && *modified != 0) {
+		return formatToCtxBuffer(ctx, condDescRequest, path, ctx->host, ctx->port, "If-Modified-Since", modified);
 	}
-	if (escName != NULL && escName != obj->name) free(escName);
-	if (escUrl != NULL && escUrl != obj->url) free(escUrl);
-	
-onSuccess:
-	res = obj;
-onError:
-	if (res == NULL && obj != NULL) freeTrObject(obj);
-	return res;
+	return formatToCtxBuffer(ctx, descRequest, path, ctx->host, ctx->port);
 }
 
 
 /**
- * Sets the value for the given argument to the passed string. A new string will be allocated from
- * it and assigned. Any previously assigned value will be freed beforehand. Use null for str to
- * clear the argument value.
+ * Calculates the MD5 of the content received within the given context.
  * 
- * @param[in] arg - argument to set value for
- * @param[in] str - string to set as value
- * @return 1 on success, else 0
+ * @param[in] ctx - context with the received content
+ * @param[out] str - pointer to 33 byte output string
  */
-int setArgValue(tTrArgument * arg, const char * str) {
-	if (arg == NULL) return 0;
-	if (arg->value != NULL) free(arg->value);
-	if (str != NULL) {
-		arg->value = strdup(str);
-		if (arg->value == NULL) return 0;
-	} else {
-		arg->value = NULL;
+static void hashContent(const tTr64RequestCtx * ctx, char * str) {
+	tHMd5Ctx md5;
+	uint8_t md5Data[16];
+	h_initMd5(&md5);
+	if (ctx->content != NULL) {
+		h_updateMd5(&md5, (const uint8_t *)(ctx->content), (size_t)((ctx->buffer + ctx->length) - ctx->content));
 	}
-	return 1;
+	h_finalMd5(&md5, md5Data);
+	md5ToHex(str, md5Data);
 }
 
 
 /**
- * Sets the value for the given argument to the passed string. A new string will be allocated from
- * it and assigned. Any previously assigned value will be freed beforehand. Use null for str to
- * clear the argument value.
+ * Sets the fingerprint of a description from the response received within the given context. The
+ * fingerprint consists of the content MD5 and the ETag and Last-Modified fields if given.
  * 
- * @param[in] arg - argument to set value for
- * @param[in] str - string to set as value
- * @param[in] len - string length in bytes
+ * @param[in,out] arena - allocate the strings from this arena
+ * @param[in] ctx - context with the received description
+ * @param[in] md5 - content MD5 as hex string (see hashContent())
+ * @param[out] hash - receives the MD5
+ * @param[out] etag - receives the ETag or NULL
+ * @param[out] modified - receives the Last-Modified date or NULL
  * @return 1 on success, else 0
  */
-int setArgValueN(tTrArgument * arg, const char * str, const size_t len) {
-	if (arg == NULL) return 0;
-	if (arg->value != NULL) free(arg->value);
-	if (str != NULL) {
-		arg->value = strndupInternal(str, len);
-		if (arg->value == NULL) return 0;
-	} else {
-		arg->value = NULL;
+static int setDescFingerprint(tArena * arena, const tTr64RequestCtx * ctx, const char * md5, char ** hash, char ** etag, char ** modified) {
+	*hash = ar_strdup(arena, md5);
+	*etag = (ctx->etag.start != NULL) ? ar_strndup(arena, ctx->etag.start, ctx->etag.length) : NULL;
+	*modified = (ctx->modified.start != NULL) ? ar_strndup(arena, ctx->modified.start, ctx->modified.length) : NULL;
+	if (*hash == NULL || (ctx->etag.start != NULL && *etag == NULL) || (ctx->modified.start != NULL && *modified == NULL)) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		return 0;
 	}
 	return 1;
 }
 
 
 /**
- * Deletes the allocated TR-064 object.
+ * Releases the token copies of the given device description visitor context.
  * 
- * @param[in] obj - object to delete
+ * @param[in,out] devCtx - device description visitor context
  */
-void freeTrObject(tTrObject * obj) {
-	if (obj == NULL) return;
-	if (obj->name != NULL) free(obj->name);
-	if (obj->url != NULL) free(obj->url);
-	if (obj->device != NULL) {
-		for (size_t d = 0; d < obj->length; d++) {
-			tTrDevice * device = obj->device + d;
-			if (device->name != NULL) free(device->name);
-			if (device->service == NULL) continue;
-			for (size_t s = 0; s < device->length; s++) {
-				tTrService * service = device->service + s;
-				if (service->name != NULL) free(service->name);
-				if (service->type != NULL) free(service->type);
-				if (service->path != NULL) free(service->path);
-				if (service->control != NULL) free(service->control);
-				if (service->action == NULL) continue;
-				for (size_t ac = 0; ac < service->length; ac++) {
-					tTrAction * action = service->action + ac;
-					if (action->name != NULL) free(action->name);
-					if (action->arg == NULL) continue;
-					for (size_t ar = 0; ar < action->length; ar++) {
-						tTrArgument * arg = action->arg + ar;
-						if (arg->name != NULL) free(arg->name);
-						if (arg->var != NULL) free(arg->var);
-						if (arg->value != NULL) free(arg->value);
-						if (arg->type != NULL) free(arg->type);
-						if (arg->dir != NULL) free(arg->dir);
-					}
-					free(action->arg);
+static void freeDeviceDescCtx(tPTrObjectDeviceCtx * devCtx) {
+	freeXmlTokenCopies(devCtx->xmlPathCopy, MAX_XML_DEPTH);
+	freeXmlTokenCopies(&(devCtx->contentCopy), 1);
+}
+
+
+/**
+ * Releases the token copies of the given service description visitor context.
+ * 
+ * @param[in,out] serviceCtx - service description visitor context
+ */
+static void freeServiceDescCtx(tPTrObjectServiceCtx * serviceCtx) {
+	freeXmlTokenCopies(serviceCtx->xmlPathCopy, MAX_XML_DEPTH);
+	freeXmlTokenCopies(&(serviceCtx->contentCopy), 1);
+	freeXmlTokenCopies(&(serviceCtx->stateVarNameCopy), 1);
+}
+
+
+/**
+ * Parses the device description received within the given context and adds the found devices and
+ * services to the passed object.
+ * 
+ * @param[in] ctx - context with the received device description
+ * @param[in,out] obj - add devices to this object
+ * @return 1 on success, else 0
+ */
+static int parseDeviceDesc(tTr64RequestCtx * ctx, tTrObject * obj) {
+	const char * xmlErrPos = NULL;
+	int res = 0;
+	/* parse device descriptions in used callback (see xmlDeviceDescVisitor()) */
+	tPTrObjectDeviceCtx devCtx = {
+		/* .xmlPath     = */ {{0}},
+		/* .arena       = */ &(obj->arena),
+		/* .object      = */ obj,
+		/* .device      = */ NULL,
+		/* .service     = */ NULL,
+		/* .content     = */ {0},
+		/* .lastError   = */ MSGT_SUCCESS,
+		/* .xmlPathCopy = */ {{0}},
+		/* .contentCopy = */ {0}
+	};
+	const size_t contentLength = (ctx->buffer + ctx->length) - ctx->content;
+	if (p_sax(ctx->content, contentLength, &xmlErrPos, xmlDeviceDescVisitor, &devCtx) != PSRT_SUCCESS) {
+		if (devCtx.lastError != MSGT_SUCCESS) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(devCtx.lastError));
+		} else {
+			if (ctx->verbose > 0) {
+				fuprintf(ferr, MSGU(MSGU_ERR_DEV_DESC_FMT), ctx->path);
+			}
+			if (ctx->verbose > 3) {
+				tParserPos pos;
+				if (p_getPos(ctx->content, contentLength, xmlErrPos, 1, &pos) == 1) {
+					_ftprintf(ferr, MSGT(MSGT_DBG_BAD_TOKEN), (unsigned)pos.line, (unsigned)pos.column);
 				}
-				free(service->action);
 			}
-			free(device->service);
 		}
-		free(obj->device);
+		goto onError;
 	}
-	free(obj);
+	res = 1;
+onError:
+	freeDeviceDescCtx(&devCtx);
+	return res;
 }
 
 
 /**
- * Callback to parse the query response XML/SOAP format. The argument value is set unescaped.
+ * Checks whether the given parsed service has a type for each argument variable. The service is no
+ * longer pending afterwards.
  * 
- * @param[in] type - token type
- * @param[in] tokens - tokens passed (1 for xml, tags, instructions, contents and cdata; 2 for attributes)
- * @param[in] level - token level (i.e. number of parents)
- * @param[in,out] param - user defined callback data (expects tPTrQueryRespCtx)
- * @return 1 to continue, 0 on error
- * @see trQuery()
+ * @param[in] ctx - context with the verbosity level
+ * @param[in,out] service - parsed service
+ * @return 1 on success, else 0
+ */
+static int checkServiceDesc(const tTr64RequestCtx * ctx, tTrService * service) {
+	if (service->action != NULL) {
+		for (size_t ac = 0; ac < service->length; ac++) {
+			const tTrAction * action = service->action + ac;
+			if (action->arg == NULL) continue;
+			for (size_t ar = 0; ar < action->length; ar++) {
+				const tTrArgument * arg = action->arg + ar;
+				if (arg->type == NULL) {
+					if (ctx->verbose > 0) fuprintf(ferr, MSGU(MSGU_ERR_NO_TYPE_FOR_ARG), arg->var);
+					return 0;
+				}
+			}
+		}
+	}
+	service->pending = 0;
+	return 1;
+}
+
+
+/**
+ * Parses the service description received within the given context and adds the found actions to
+ * the passed service.
+ * 
+ * @param[in] ctx - context with the received service description
+ * @param[in,out] arena - allocate the actions from this arena
+ * @param[in,out] strings - intern the argument strings in this string table (allocated from arena)
+ * @param[in,out] service - add actions to this service
+ * @return 1 on success, else 0
+ */
+static int parseServiceDesc(tTr64RequestCtx * ctx, tArena * arena, tTrStringTable * strings, tTrService * service) {
+	const char * xmlErrPos = NULL;
+	int res = 0;
+	/* parse service description in used callback (see xmlServiceDescVisitor()) */
+	tPTrObjectServiceCtx serviceCtx = {
+		/* .xmlPath          = */ {{0}},
+		/* .arena            = */ arena,
+		/* .strings          = */ strings,
+		/* .service          = */ service,
+		/* .action           = */ NULL,
+		/* .arg              = */ NULL,
+		/* .content          = */ {0},
+		/* .stateVarName     = */ {0},
+		/* .lastError        = */ MSGT_SUCCESS,
+		/* .xmlPathCopy      = */ {{0}},
+		/* .contentCopy      = */ {0},
+		/* .stateVarNameCopy = */ {0}
+	};
+	const size_t contentLength = (ctx->buffer + ctx->length) - ctx->content;
+	if (p_sax(ctx->content, contentLength, &xmlErrPos, xmlServiceDescVisitor, &serviceCtx) != PSRT_SUCCESS) {
+		if (serviceCtx.lastError != MSGT_SUCCESS) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(serviceCtx.lastError));
+		} else {
+			if (ctx->verbose > 0) {
+				fuprintf(ferr, MSGU(MSGU_ERR_DEV_SRVC_FMT), service->path);
+			}
+			if (ctx->verbose > 3) {
+				tParserPos pos;
+				if (p_getPos(ctx->content, contentLength, xmlErrPos, 1, &pos) == 1) {
+					_ftprintf(ferr, MSGT(MSGT_DBG_BAD_TOKEN), (unsigned)pos.line, (unsigned)pos.column);
+				}
+			}
+		}
+		goto onError;
+	}
+	res = checkServiceDesc(ctx, service);
+onError:
+	freeServiceDescCtx(&serviceCtx);
+	return res;
+}
+
+
+/**
+ * Callback function for the request context which parses and hashes the received part of a
+ * description (see startDescStream()). The description is limited to MAX_DESC_SIZE bytes.
+ * 
+ * @param[in,out] ctx - context of the pending request
+ * @param[in] data - received part of the content
+ * @param[in] length - length of data in bytes
+ * @param[in,out] param - description stream (tTrDescStream)
+ * @return 1 to continue, 0 to abort
+ */
+static int receiveDescStream(tTr64RequestCtx * ctx, const char * data, const size_t length, void * param) {
+	tTrDescStream * stream = (tTrDescStream *)param;
+	PCF_UNUSED(ctx);
+	if (stream == NULL || length < 1) return 0;
+	if (length > (MAX_DESC_SIZE - stream->received)) return 0; /* received content exceeds our defined limits */
+	stream->received += length;
+	h_updateMd5(&(stream->md5), (const uint8_t *)data, length);
+	stream->result = p_saxResume(data, length, &(stream->sax), &(stream->errorOffset), stream->visitor, &(stream->parse));
+	return (stream->result == PSRT_UNEXPECTED_END || stream->result == PSRT_SUCCESS) ? 1 : 0;
+}
+
+
+/**
+ * Lets the next request of the given context parse and hash the description while it is received.
+ * The body of the response is not buffered in this case. This keeps the memory usage constant and
+ * overlaps parsing with the network transfer. The visitor context in stream->parse needs to be set
+ * by the caller.
+ * 
+ * @param[in,out] ctx - context of the description request
+ * @param[in,out] stream - description stream
+ * @param[in] visitor - XML token visitor for stream->parse
+ */
+static void startDescStream(tTr64RequestCtx * ctx, tTrDescStream * stream, const PSaxTokenVisitor visitor) {
+	p_saxInit(&(stream->sax));
+	h_initMd5(&(stream->md5));
+	stream->visitor = visitor;
+	stream->result = PSRT_UNEXPECTED_END;
+	stream->errorOffset = 0;
+	stream->received = 0;
+	ctx->receive = receiveDescStream;
+	ctx->receiveParam = stream;
+}
+
+
+/**
+ * Completes the description stream of the given context and releases the parser state. The
+ * visitor context in stream->parse remains unchanged.
+ * 
+ * @param[in,out] ctx - context of the description request
+ * @param[in,out] stream - description stream (see startDescStream())
+ * @param[in] received - 1 if the request succeeded, else 0
+ * @param[out] hash - receives the content MD5 as 33 byte hex string
+ * @return 1 on success, 0 if the description could not be parsed, -1 if it was not received
+ */
+static int finishDescStream(tTr64RequestCtx * ctx, tTrDescStream * stream, const int received, char * hash) {
+	uint8_t md5Data[16];
+	ctx->receive = NULL;
+	ctx->receiveParam = NULL;
+	if (received == 1 && stream->result == PSRT_UNEXPECTED_END) {
+		/* end of content */
+		stream->result = p_saxResume(NULL, 0, &(stream->sax), &(stream->errorOffset), stream->visitor, &(stream->parse));
+	}
+	p_saxFree(&(stream->sax));
+	h_finalMd5(&(stream->md5), md5Data);
+	md5ToHex(hash, md5Data);
+	if (stream->result == PSRT_SUCCESS) return (received == 1) ? 1 : -1;
+	return (received == 1 || stream->result != PSRT_UNEXPECTED_END) ? 0 : -1;
+}
+
+
+/**
+ * Prints the error of a description which could not be parsed while it was received.
+ * 
+ * @param[in] ctx - context of the description request
+ * @param[in] stream - failed description stream (see finishDescStream())
+ * @param[in] lastError - error of the visitor context in stream->parse
+ * @param[in] format - message for an invalid description format (MSGU_ with path argument)
+ * @param[in] path - description path
+ */
+static void printDescStreamError(const tTr64RequestCtx * ctx, const tTrDescStream * stream, const tMessage lastError, const tMessage format, const char * path) {
+	if (lastError != MSGT_SUCCESS || stream->result == PSRT_NO_MEMORY) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT((lastError != MSGT_SUCCESS) ? lastError : MSGT_ERR_NO_MEM));
+		return;
+	}
+	if (ctx->verbose > 0) fuprintf(ferr, MSGU(format), path);
+	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_BAD_TOKEN_AT), (unsigned)(stream->errorOffset));
+}
+
+
+/**
+ * Prepares the request for the next pending or stale service description which has not been
+ * requested yet in the buffer of the context with the given index. Only services matching the
+ * filter of the fetch context are requested. Stale services are requested conditionally if
+ * possible.
+ * 
+ * @param[in,out] fetch - fetch context
+ * @param[in] index - context index
+ * @return 2 if a request was prepared, 1 if all services have been requested, 0 on error
+ */
+static int requestNextServiceDesc(tTrObjectFetchCtx * fetch, const size_t index) {
+	tTr64RequestCtx * ctx = fetch->ctxs[index];
+	const tTrObject * obj = fetch->object;
+	ctx->receive = NULL;
+	ctx->receiveParam = NULL;
+	ctx->length = 0;
+	fetch->pending[index] = NULL;
+	const tOptions * filter = fetch->filter;
+	for (; fetch->device < obj->length; fetch->device++, fetch->service = 0) {
+		const tTrDevice * device = obj->device + fetch->device;
+		if (device->service == NULL) continue;
+		if (filter != NULL && filter->device != NULL && strncmp(device->name, filter->device, strlen(filter->device)) != 0) continue;
+		for (; fetch->service < device->length; fetch->service++) {
+			tTrService * service = device->service + fetch->service;
+			int ok;
+			if (service->pending == 0 && service->stale == 0) continue;
+			if (filter != NULL && filter->service != NULL && strncmp(service->name, filter->service, strlen(filter->service)) != 0) continue;
+			fetch->service++;
+			/* skip leading slash (/) in service->path as it is already included in request */
+			if (service->stale != 0) {
+				ok = formatDescRequest(ctx, service->path + 1, service->etag, service->modified);
+			} else {
+				ok = formatToCtxBuffer(ctx, fetch->request, service->path + 1, ctx->host, ctx->port);
+			}
+			if (ok != 1) {
+				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_FMT_SRVC_DESC));
+				return 0;
+			}
+			if (ctx->verbose > 2) {
+				fuprintf(ferr, MSGU(MSGU_INFO_SRVC_DESC_REQ), service->path);
+			}
+			if (service->stale == 0 && fetch->registry == NULL) {
+				/* parse service description while it is received (see xmlServiceDescVisitor()) */
+				tTrDescStream * stream = fetch->stream + index;
+				memset(&(stream->parse), 0, sizeof(stream->parse));
+				stream->parse.service.arena = &(fetch->object->arena);
+				stream->parse.service.strings = &(fetch->object->strings);
+				stream->parse.service.service = service;
+				stream->parse.service.lastError = MSGT_SUCCESS;
+				startDescStream(ctx, stream, xmlServiceDescVisitor);
+			}
+			fetch->pending[index] = service;
+			return 2;
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * Applies the service description received within the given context to the passed service. A stale
+ * service keeps its actions if its description did not change.
+ * 
+ * @param[in] ctx - context with the received service description
+ * @param[in,out] obj - object which owns the service
+ * @param[in,out] service - update this service
+ * @return 1 on success, else 0
+ */
+static int updateServiceDesc(tTr64RequestCtx * ctx, tTrObject * obj, tTrService * service) {
+	char hash[33];
+	if (service->stale != 0 && ctx->status == 304) goto onUnchanged;
+	hashContent(ctx, hash);
+	if (service->stale != 0) {
+		if (service->hash != NULL && strcmp(service->hash, hash) == 0) {
+			if (setDescFingerprint(&(obj->arena), ctx, hash, &(service->hash), &(service->etag), &(service->modified)) != 1) return 0;
+			goto onUnchanged;
+		}
+		/* discard the outdated actions */
+		service->action = NULL;
+		service->capacity = 0;
+		service->length = 0;
+	}
+	if (parseServiceDesc(ctx, &(obj->arena), &(obj->strings), service) != 1) return 0;
+	if (setDescFingerprint(&(obj->arena), ctx, hash, &(service->hash), &(service->etag), &(service->modified)) != 1) return 0;
+	service->stale = 0;
+	return 1;
+onUnchanged:
+	if (ctx->verbose > 2) fuprintf(ferr, MSGU(MSGU_INFO_SRVC_DESC_SAME), service->path);
+	service->stale = 0;
+	return 1;
+}
+
+
+/**
+ * Copies the given shared actions to the passed service. Only the action array is allocated from
+ * the arena. The arguments and strings are shared.
+ * 
+ * @param[in,out] arena - allocate the action array from this arena
+ * @param[in,out] service - set the actions of this service
+ * @param[in] action - shared action array
+ * @param[in] length - number of elements in action
+ * @return 1 on success, else 0
+ */
+static int copySharedActions(tArena * arena, tTrService * service, const tTrAction * action, const size_t length) {
+	service->action = NULL;
+	service->capacity = 0;
+	service->length = 0;
+	if (length < 1) return 1;
+	service->action = (tTrAction *)ar_alloc(arena, sizeof(tTrAction) * length);
+	if (service->action == NULL) return 0;
+	memcpy(service->action, action, sizeof(tTrAction) * length);
+	/* request templates depend on the service and are built per copy */
+	for (size_t ac = 0; ac < length; ac++) service->action[ac].request = NULL;
+	service->capacity = length;
+	service->length = length;
+	return 1;
+}
+
+
+/**
+ * Returns the service description entry with the given MD5 from the passed registry.
+ * 
+ * @param[in] registry - registry of the shared descriptions
+ * @param[in] hash - MD5 of the service description as hex string
+ * @return entry on success or NULL if not found
+ */
+static tTrServiceDescEntry * findSharedServiceDesc(const tTrDescRegistry * registry, const char * hash) {
+	for (size_t i = 0; i < registry->serviceLength; i++) {
+		if (strcmp(registry->service[i].hash, hash) == 0) return registry->service + i;
+	}
+	return NULL;
+}
+
+
+/**
+ * Applies the service description received within the given context to the passed service. The
+ * description is only parsed if the registry holds no description with the same MD5. The parsed
+ * actions are added to the registry and shared with all services with the same description.
+ * 
+ * @param[in] ctx - context with the received service description
+ * @param[in,out] registry - registry of the shared descriptions
+ * @param[in,out] obj - object which owns the service
+ * @param[in,out] service - update this service
+ * @return 1 on success, else 0
+ */
+static int shareServiceDesc(tTr64RequestCtx * ctx, tTrDescRegistry * registry, tTrObject * obj, tTrService * service) {
+	char hash[33];
+	tTrServiceDescEntry * entry;
+	hashContent(ctx, hash);
+	entry = findSharedServiceDesc(registry, hash);
+	if (entry == NULL) {
+		tTrService parsed = {0};
+		parsed.path = service->path; /* for error messages */
+		if (parseServiceDesc(ctx, &(registry->arena), &(registry->strings), &parsed) != 1) return 0;
+		if (registry->serviceLength >= registry->serviceCapacity) {
+			if (arrayResizeArena(&(registry->arena), (void **)(&(registry->service)), &(registry->serviceCapacity), sizeof(*(registry->service)), PCF_MAX(INIT_ARRAY_SIZE, registry->serviceCapacity * 2)) != 1) goto onOutOfMemory;
+		}
+		entry = registry->service + registry->serviceLength;
+		registry->serviceLength++;
+		memcpy(entry->hash, hash, sizeof(hash));
+		entry->action = parsed.action;
+		entry->length = parsed.length;
+	}
+	if (copySharedActions(&(obj->arena), service, entry->action, entry->length) != 1) goto onOutOfMemory;
+	if (setDescFingerprint(&(obj->arena), ctx, hash, &(service->hash), &(service->etag), &(service->modified)) != 1) return 0;
+	service->pending = 0;
+	service->stale = 0;
+	return 1;
+onOutOfMemory:
+	if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+	return 0;
+}
+
+
+/**
+ * Returns the device description entry with the given MD5 from the passed registry.
+ * 
+ * @param[in] registry - registry of the shared descriptions
+ * @param[in] hash - MD5 of the device description as hex string
+ * @return entry on success or NULL if not found
+ */
+static const tTrDeviceDescEntry * findSharedDeviceDesc(const tTrDescRegistry * registry, const char * hash) {
+	for (size_t i = 0; i < registry->deviceLength; i++) {
+		if (strcmp(registry->device[i].hash, hash) == 0) return registry->device + i;
+	}
+	return NULL;
+}
+
+
+/**
+ * Adds the devices and services of the given completely fetched object to the passed registry.
+ * Objects with services whose actions are not shared via the registry are not added.
+ * 
+ * @param[in,out] registry - registry of the shared descriptions
+ * @param[in] obj - object to add
+ * @return 1 on success, else 0
+ */
+static int registerSharedDeviceDesc(tTrDescRegistry * registry, const tTrObject * obj) {
+	tArena * arena = &(registry->arena);
+	tTrDeviceDescEntry * entry;
+	tTrDevice * device;
+	if (obj->hash == NULL || findSharedDeviceDesc(registry, obj->hash) != NULL) return 1;
+	for (size_t d = 0; d < obj->length; d++) {
+		const tTrDevice * srcDevice = obj->device + d;
+		for (size_t s = 0; s < srcDevice->length; s++) {
+			const tTrService * srcService = srcDevice->service + s;
+			if (srcService->hash == NULL || findSharedServiceDesc(registry, srcService->hash) == NULL) return 1;
+		}
+	}
+	device = (tTrDevice *)ar_calloc(arena, (obj->length > 0) ? obj->length : 1, sizeof(tTrDevice));
+	if (device == NULL) return 0;
+	for (size_t d = 0; d < obj->length; d++) {
+		const tTrDevice * srcDevice = obj->device + d;
+		tTrDevice * dstDevice = device + d;
+		dstDevice->name = ar_strdup(arena, srcDevice->name);
+		if (dstDevice->name == NULL) return 0;
+		if (srcDevice->length < 1) continue;
+		dstDevice->service = (tTrService *)ar_calloc(arena, srcDevice->length, sizeof(tTrService));
+		if (dstDevice->service == NULL) return 0;
+		dstDevice->capacity = srcDevice->length;
+		dstDevice->length = srcDevice->length;
+		for (size_t s = 0; s < srcDevice->length; s++) {
+			const tTrService * srcService = srcDevice->service + s;
+			tTrService * dstService = dstDevice->service + s;
+			const tTrServiceDescEntry * shared = findSharedServiceDesc(registry, srcService->hash);
+			dstService->name = ar_strdup(arena, srcService->name);
+			dstService->type = ar_strdup(arena, srcService->type);
+			dstService->path = ar_strdup(arena, srcService->path);
+			dstService->control = ar_strdup(arena, srcService->control);
+			if (dstService->name == NULL || dstService->type == NULL || dstService->path == NULL || dstService->control == NULL) return 0;
+			dstService->hash = (char *)(shared->hash);
+			dstService->action = shared->action;
+			dstService->capacity = shared->length;
+			dstService->length = shared->length;
+		}
+	}
+	if (registry->deviceLength >= registry->deviceCapacity) {
+		if (arrayResizeArena(arena, (void **)(&(registry->device)), &(registry->deviceCapacity), sizeof(*(registry->device)), PCF_MAX(INIT_ARRAY_SIZE, registry->deviceCapacity * 2)) != 1) return 0;
+	}
+	entry = registry->device + registry->deviceLength;
+	memcpy(entry->hash, obj->hash, sizeof(entry->hash));
+	entry->name = ar_strdup(arena, obj->name);
+	if (entry->name == NULL) return 0;
+	entry->device = device;
+	entry->length = obj->length;
+	registry->deviceLength++;
+	return 1;
+}
+
+
+/**
+ * Sets the devices and services of the given object to a copy of the passed shared device
+ * description entry. The strings and arguments are shared with the entry.
+ * 
+ * @param[in,out] obj - object without devices
+ * @param[in] entry - shared device description entry
+ * @return 1 on success, else 0
+ */
+static int copySharedDeviceDesc(tTrObject * obj, const tTrDeviceDescEntry * entry) {
+	tArena * arena = &(obj->arena);
+	obj->name = entry->name;
+	obj->device = (tTrDevice *)ar_calloc(arena, (entry->length > 0) ? entry->length : 1, sizeof(tTrDevice));
+	if (obj->device == NULL) return 0;
+	obj->capacity = entry->length;
+	obj->length = entry->length;
+	for (size_t d = 0; d < entry->length; d++) {
+		const tTrDevice * srcDevice = entry->device + d;
+		tTrDevice * dstDevice = obj->device + d;
+		dstDevice->name = srcDevice->name;
+		if (srcDevice->length < 1) continue;
+		dstDevice->service = (tTrService *)ar_alloc(arena, sizeof(tTrService) * srcDevice->length);
+		if (dstDevice->service == NULL) return 0;
+		memcpy(dstDevice->service, srcDevice->service, sizeof(tTrService) * srcDevice->length);
+		dstDevice->capacity = srcDevice->length;
+		dstDevice->length = srcDevice->length;
+		for (size_t s = 0; s < srcDevice->length; s++) {
+			tTrService * service = dstDevice->service + s;
+			if (copySharedActions(arena, service, service->action, service->length) != 1) return 0;
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * Completes the service description which was parsed while it was received within the given
+ * context (see requestNextServiceDesc()).
+ * 
+ * @param[in,out] ctx - context of the completed request
+ * @param[in,out] obj - object which owns the service
+ * @param[in,out] service - parsed service
+ * @param[in,out] stream - description stream of the context
+ * @param[in] result - 1 if the request succeeded, else 0
+ * @return 1 on success, 0 on parse error, -1 if the request failed
+ */
+static int finishServiceDescStream(tTr64RequestCtx * ctx, tTrObject * obj, tTrService * service, tTrDescStream * stream, const int result) {
+	char hash[33];
+	const int parsed = finishDescStream(ctx, stream, result, hash);
+	freeServiceDescCtx(&(stream->parse.service));
+	if (parsed < 0) return -1;
+	if (parsed != 1) {
+		printDescStreamError(ctx, stream, stream->parse.service.lastError, MSGU_ERR_DEV_SRVC_FMT, service->path);
+		return 0;
+	}
+	if (checkServiceDesc(ctx, service) != 1) return 0;
+	if (setDescFingerprint(&(obj->arena), ctx, hash, &(service->hash), &(service->etag), &(service->modified)) != 1) return 0;
+	return 1;
+}
+
+
+/**
+ * Callback function for requestParallel() which parses the received service description and
+ * requests the next one.
+ * 
+ * @param[in,out] ctx - context of the completed request
+ * @param[in] result - 1 if the request succeeded, else 0
+ * @param[in,out] param - fetch context (tTrObjectFetchCtx)
+ * @return 0 to abort, 1 if all services have been requested, 2 if the next request is pending
+ */
+static int fetchServiceDescVisitor(tTr64RequestCtx * ctx, const int result, void * param) {
+	tTrObjectFetchCtx * fetch = (tTrObjectFetchCtx *)param;
+	size_t index;
+	for (index = 0; index < fetch->count && fetch->ctxs[index] != ctx; index++);
+	if (index >= fetch->count) return 0;
+	if (fetch->pending[index] != NULL && ctx->receive != NULL) {
+		/* parsed while it was received */
+		switch (finishServiceDescStream(ctx, fetch->object, fetch->pending[index], fetch->stream + index, result)) {
+		case 1:
+			break;
+		case 0:
+			return 0;
+		default:
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_GET_SRVC_DESC), (unsigned)(ctx->status));
+			return 0;
+		}
+		if (ctx->verbose > 2) _ftprintf(ferr, MSGT(MSGT_INFO_SRVC_DESC_DUR), (unsigned)(ctx->duration));
+	} else if (fetch->pending[index] != NULL) {
+		if (result != 1) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_GET_SRVC_DESC), (unsigned)(ctx->status));
+			return 0;
+		}
+		if (ctx->verbose > 2) _ftprintf(ferr, MSGT(MSGT_INFO_SRVC_DESC_DUR), (unsigned)(ctx->duration));
+		if (fetch->registry != NULL && fetch->pending[index]->stale == 0) {
+			if (shareServiceDesc(ctx, fetch->registry, fetch->object, fetch->pending[index]) != 1) return 0;
+		} else if (updateServiceDesc(ctx, fetch->object, fetch->pending[index]) != 1) {
+			return 0;
+		}
+	}
+	return requestNextServiceDesc(fetch, index);
+}
+
+
+/**
+ * Unescapes the given XML string in place. This is possible as the unescaped string is never
+ * longer than the escaped one. The function sets errno to EINVAL upon wrong escape sequence.
+ * 
+ * @param[in,out] str - null-terminated string to unescape
+ * @return 1 on success, else 0
+ */
+static int unescapeXmlInPlace(char * str) {
+	if (str == NULL) return 0;
+	char * res = p_unescapeXml(str, (size_t)-1, NULL, 0);
+	if (res == NULL) return 0;
+	if (res != str) {
+		strcpy(str, res);
+		free(res);
+	}
+	return 1;
+}
+
+
+/**
+ * Checks whether the given cache file path selects the XML cache format (extension .xml).
+ * 
+ * @param[in] path - cache file path
+ * @return 1 for the XML format, 0 for the binary format
+ */
+static int isXmlCachePath(const TCHAR * path) {
+	const TCHAR * ext = _tcsrchr(path, _T('.'));
+	if (ext == NULL) return 0;
+	return (_totlower(ext[1]) == _T('x') && _totlower(ext[2]) == _T('m') && _totlower(ext[3]) == _T('l') && ext[4] == 0) ? 1 : 0;
+}
+
+
+/**
+ * Reads the TR-064 object from the given XML cache file. Files without the expected format version
+ * (XML_CACHE_VERSION) are rejected.
+ * 
+ * @param[in,out] obj - fill this empty object
+ * @param[in] path - cache file path
+ * @param[in] verbose - verbosity level
+ * @return 1 on success, else 0
+ */
+static int readXmlCache(tTrObject * obj, const TCHAR * path, const int verbose) {
+	const char * xmlErrPos = NULL;
+	size_t xmlLen = 0;
+	char * xml = readFileToString(path, &xmlLen);
+	tPTrObjectCacheCtx xmlCtx = {
+		/* .object  = */ obj,
+		/* .device  = */ NULL,
+		/* .service = */ NULL,
+		/* .action  = */ NULL,
+		/* .arg     = */ NULL,
+		/* .state   = */ PCS_START,
+		/* .version = */ 0
+	};
+	if (xml == NULL || xmlLen < 1) {
+		if (xml != NULL) free(xml);
+		if (verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_READ));
+		return 0;
+	}
+	/* parse XML and fill in TR-064 object elements */
+	if (p_sax(xml, xmlLen, &xmlErrPos, xmlCacheFileVisitor, &xmlCtx) != PSRT_SUCCESS) {
+		if (verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_FMT));
+		if (verbose > 3) {
+			tParserPos pos;
+			if (p_getPos(xml, xmlLen, xmlErrPos, 1, &pos) == 1) {
+				_ftprintf(ferr, MSGT(MSGT_DBG_BAD_TOKEN), (unsigned)pos.line, (unsigned)pos.column);
+			}
+		}
+		free(xml);
+		return 0;
+	}
+	free(xml);
+	/* unescape object name, URL and the optional description validators */
+#define UNESC_OPT(x) ((x) == NULL || unescapeXmlInPlace(x) == 1)
+	if (unescapeXmlInPlace(obj->name) != 1 || unescapeXmlInPlace(obj->url) != 1 || ( ! UNESC_OPT(obj->etag) ) || ( ! UNESC_OPT(obj->modified) )) {
+		goto onUnescapeError;
+	}
+	for (size_t d = 0; d < obj->length; d++) {
+		const tTrDevice * device = obj->device + d;
+		for (size_t s = 0; s < device->length; s++) {
+			tTrService * service = device->service + s;
+			if (( ! UNESC_OPT(service->etag) ) || ( ! UNESC_OPT(service->modified) )) goto onUnescapeError;
+		}
+	}
+#undef UNESC_OPT
+	return 1;
+onUnescapeError:
+	if (verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_UNESC));
+	return 0;
+}
+
+
+/**
+ * Formats the given optional XML attribute in the context buffer. Nothing is added if the value is
+ * NULL.
+ * 
+ * @param[in,out] ctx - request context
+ * @param[in] name - attribute name
+ * @param[in] value - attribute value to escape or NULL
+ * @return 1 on success, else 0
+ */
+static int formatCacheAttr(tTr64RequestCtx * ctx, const char * name, const char * value) {
+	int ok;
+	if (value == NULL) return 1;
+	char * escValue = p_escapeXml(value, (size_t)-1);
+	if (escValue == NULL) return 0;
+	ok = formatToCtxBuffer(ctx, " %s=\"%s\"", name, escValue);
+	if (escValue != value) free(escValue);
+	return ok;
+}
+
+
+/**
+ * Writes the given TR-064 object to the XML cache file. The request context buffer is used to
+ * format the output. Errors are reported as warnings.
+ * 
+ * @param[in,out] ctx - request context
+ * @param[in] obj - object to write
+ * @param[in] path - cache file path
+ */
+static void writeXmlCache(tTr64RequestCtx * ctx, const tTrObject * obj, const TCHAR * path) {
+	char * escName = NULL;
+	char * escUrl = NULL;
+	int ok;
+	
+	/* format output errors are ignored until the end */
+	ctx->length = 0;
+	ok = formatToCtxBuffer(ctx, "%s", "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	escName = p_escapeXml(obj->name, (size_t)-1);
+	if (escName == NULL) goto onFormatOutOfMemoryError;
+	escUrl = p_escapeXml(obj->url, (size_t)-1);
+	if (escUrl == NULL) goto onFormatOutOfMemoryError;
+	ok &= formatToCtxBuffer(ctx, "<object version=\"%s\" name=\"%s\" url=\"%s\"", XML_CACHE_VERSION, escName, escUrl);
+	ok &= formatCacheAttr(ctx, "hash", obj->hash);
+	ok &= formatCacheAttr(ctx, "etag", obj->etag);
+	ok &= formatCacheAttr(ctx, "modified", obj->modified);
+	ok &= formatToCtxBuffer(ctx, ">\n");
+	if (obj->device != NULL) {
+		for (size_t d = 0; d < obj->length; d++) {
+			const tTrDevice * device = obj->device + d;
+			ok &= formatToCtxBuffer(ctx, " <device name=\"%s\">\n", device->name);
+			if (device->service != NULL) {
+				for (size_t s = 0; s < device->length; s++) {
+					const tTrService * service = device->service + s;
+					ok &= formatToCtxBuffer(ctx, "  <service name=\"%s\" type=\"%s\" path=\"%s\" control=\"%s\"%s%s", service->name, service->type, service->path, service->control, (service->pending != 0) ? " pending=\"1\"" : "", (service->stale != 0) ? " stale=\"1\"" : "");
+					ok &= formatCacheAttr(ctx, "hash", service->hash);
+					ok &= formatCacheAttr(ctx, "etag", service->etag);
+					ok &= formatCacheAttr(ctx, "modified", service->modified);
+					ok &= formatToCtxBuffer(ctx, ">\n");
+					if (service->action != NULL) {
+						for (size_t ac = 0; ac < service->length; ac++) {
+							const tTrAction * action = service->action + ac;
+							ok &= formatToCtxBuffer(ctx, "   <action name=\"%s\">\n", action->name);
+							if (action->arg != NULL) {
+								for (size_t ar = 0; ar < action->length; ar++) {
+									const tTrArgument * arg = action->arg + ar;
+									ok &= formatToCtxBuffer(ctx, "    <arg name=\"%s\" var=\"%s\" type=\"%s\" dir=\"%s\"/>\n", arg->name, arg->var, arg->type, getArgDirName(arg->dir));
+								}
+							}
+							ok &= formatToCtxBuffer(ctx, "   </action>\n");
+						}
+					}
+					ok &= formatToCtxBuffer(ctx, "  </service>\n");
+				}
+			}
+			ok &= formatToCtxBuffer(ctx, " </device>\n");
+		}
+	}
+	ok &= formatToCtxBuffer(ctx, "</object>\n");
+	if (ok != 1) {
+onFormatOutOfMemoryError:
+		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_NO_MEM));
+	} else if (writeStringNToFile(path, ctx->buffer, ctx->length) != 1) {
+		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_WRITE));
+	}
+	if (escName != NULL && escName != obj->name) free(escName);
+	if (escUrl != NULL && escUrl != obj->url) free(escUrl);
+}
+
+
+/**
+ * Maps the given binary cache file and builds the TR-064 object from it. All strings of the
+ * object point directly into the mapped file and all element arrays share a single arena
+ * allocation. The mapping is released by freeTrObject().
+ * 
+ * @param[in,out] obj - fill this empty object
+ * @param[in] path - cache file path
+ * @param[in] verbose - verbosity level
+ * @return 1 on success, 0 on error, -1 if the file is not a binary cache file
+ */
+static int readBinaryCache(tTrObject * obj, const TCHAR * path, const int verbose) {
+	const tTrCacheHeader * head;
+	const tTrCacheDevice * cDevice;
+	const tTrCacheService * cService;
+	const tTrCacheAction * cAction;
+	const tTrCacheArgument * cArg;
+	const char * strings;
+	const char * data;
+	size_t size = 0;
+	uint64_t offset;
+	char * block = NULL;
+	tTrDevice * device;
+	tTrService * service;
+	tTrAction * action;
+	tTrArgument * arg;
+	
+	data = mapFile(path, &size);
+	if (data == NULL) return -1;
+	if (size < sizeof(*head) || memcmp(data, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+		unmapFile(data, size);
+		return -1;
+	}
+	head = (const tTrCacheHeader *)data;
+	if (head->version != CACHE_VERSION || head->byteOrder != CACHE_BYTE_ORDER || head->size != size) goto onFormatError;
+	
+	/* locate record arrays and string table (cannot overflow with 32-bit counts) */
+	offset = sizeof(*head);
+	cDevice = (const tTrCacheDevice *)(data + offset);
+	offset += (uint64_t)(head->devices) * sizeof(*cDevice);
+	cService = (const tTrCacheService *)(data + PCF_MIN(offset, (uint64_t)size));
+	offset += (uint64_t)(head->services) * sizeof(*cService);
+	cAction = (const tTrCacheAction *)(data + PCF_MIN(offset, (uint64_t)size));
+	offset += (uint64_t)(head->actions) * sizeof(*cAction);
+	cArg = (const tTrCacheArgument *)(data + PCF_MIN(offset, (uint64_t)size));
+	offset += (uint64_t)(head->args) * sizeof(*cArg);
+	strings = data + PCF_MIN(offset, (uint64_t)size);
+	offset += (uint64_t)(head->strings);
+	if (offset != (uint64_t)size || head->strings < 1 || data[size - 1] != 0) goto onFormatError;
+	
+	/* validate all references before use */
+#define CHECK_STR(x) if ((x) >= head->strings) goto onFormatError;
+#define CHECK_RANGE(first, count, total) if ((uint64_t)(first) + (uint64_t)(count) > (uint64_t)(total)) goto onFormatError;
+	CHECK_STR(head->name)
+	CHECK_STR(head->url)
+	CHECK_STR(head->hash)
+	CHECK_STR(head->etag)
+	CHECK_STR(head->modified)
+	for (uint32_t i = 0; i < head->devices; i++) {
+		CHECK_STR(cDevice[i].name)
+		CHECK_RANGE(cDevice[i].service, cDevice[i].serviceCount, head->services)
+	}
+	for (uint32_t i = 0; i < head->services; i++) {
+		CHECK_STR(cService[i].name)
+		CHECK_STR(cService[i].type)
+		CHECK_STR(cService[i].path)
+		CHECK_STR(cService[i].control)
+		CHECK_STR(cService[i].hash)
+		CHECK_STR(cService[i].etag)
+		CHECK_STR(cService[i].modified)
+		CHECK_RANGE(cService[i].action, cService[i].actionCount, head->actions)
+	}
+	for (uint32_t i = 0; i < head->actions; i++) {
+		CHECK_STR(cAction[i].name)
+		CHECK_RANGE(cAction[i].arg, cAction[i].argCount, head->args)
+	}
+	for (uint32_t i = 0; i < head->args; i++) {
+		CHECK_STR(cArg[i].name)
+		CHECK_STR(cArg[i].var)
+		CHECK_STR(cArg[i].type)
+		CHECK_STR(cArg[i].dir)
+	}
+#undef CHECK_STR
+#undef CHECK_RANGE
+	
+	/* create all element arrays within one allocation */
+	block = (char *)ar_calloc(&(obj->arena), 1, (sizeof(tTrDevice) * head->devices) + (sizeof(tTrService) * head->services) + (sizeof(tTrAction) * head->actions) + (sizeof(tTrArgument) * head->args));
+	if (block == NULL) {
+		if (verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_READ));
+		goto onError;
+	}
+	device = (tTrDevice *)block;
+	service = (tTrService *)(device + head->devices);
+	action = (tTrAction *)(service + head->services);
+	arg = (tTrArgument *)(action + head->actions);
+#define STR(x) ((char *)(strings + (x)))
+#define OPT_STR(x) ((*STR(x) != 0) ? STR(x) : NULL)
+	for (uint32_t i = 0; i < head->devices; i++) {
+		device[i].name = STR(cDevice[i].name);
+		device[i].service = service + cDevice[i].service;
+		device[i].capacity = cDevice[i].serviceCount;
+		device[i].length = cDevice[i].serviceCount;
+	}
+	for (uint32_t i = 0; i < head->services; i++) {
+		service[i].name = STR(cService[i].name);
+		service[i].type = STR(cService[i].type);
+		service[i].path = STR(cService[i].path);
+		service[i].control = STR(cService[i].control);
+		service[i].action = action + cService[i].action;
+		service[i].capacity = cService[i].actionCount;
+		service[i].length = cService[i].actionCount;
+		service[i].pending = ((cService[i].flags & CACHE_SERVICE_PENDING) != 0) ? 1 : 0;
+		service[i].stale = ((cService[i].flags & CACHE_SERVICE_STALE) != 0) ? 1 : 0;
+		service[i].hash = OPT_STR(cService[i].hash);
+		service[i].etag = OPT_STR(cService[i].etag);
+		service[i].modified = OPT_STR(cService[i].modified);
+	}
+	for (uint32_t i = 0; i < head->actions; i++) {
+		action[i].name = STR(cAction[i].name);
+		action[i].arg = arg + cAction[i].arg;
+		action[i].capacity = cAction[i].argCount;
+		action[i].length = cAction[i].argCount;
+	}
+	for (uint32_t i = 0; i < head->args; i++) {
+		arg[i].name = STR(cArg[i].name);
+		arg[i].var = STR(cArg[i].var);
+		arg[i].type = STR(cArg[i].type);
+		arg[i].dataType = getArgType(arg[i].type);
+		arg[i].dir = getArgDir(STR(cArg[i].dir), strlen(STR(cArg[i].dir)));
+		if (arg[i].dir == TAD_NONE) goto onFormatError;
+	}
+	obj->name = STR(head->name);
+	obj->url = STR(head->url);
+	obj->hash = OPT_STR(head->hash);
+	obj->etag = OPT_STR(head->etag);
+	obj->modified = OPT_STR(head->modified);
+#undef OPT_STR
+#undef STR
+	obj->device = device;
+	obj->capacity = head->devices;
+	obj->length = head->devices;
+	obj->cache = data;
+	obj->cacheSize = size;
+	return 1;
+onFormatError:
+	if (verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_FMT));
+onError:
+	unmapFile(data, size);
+	return 0;
+}
+
+
+/**
+ * Adds the given string to the string table of a binary cache file.
+ * 
+ * @param[in,out] table - string table
+ * @param[in,out] offset - current string table size
+ * @param[in] str - string to add (NULL is stored as empty string)
+ * @return offset of the added string within the string table
+ */
+static uint32_t addCacheString(char * table, uint32_t * offset, const char * str) {
+	const uint32_t res = *offset;
+	const size_t len = (str != NULL) ? strlen(str) : 0;
+	if (len > 0) memcpy(table + res, str, len);
+	table[res + len] = 0;
+	*offset = (uint32_t)(res + len + 1);
+	return res;
+}
+
+
+/**
+ * Writes the given TR-064 object to the binary cache file. Errors are reported as warnings.
+ * 
+ * @param[in] obj - object to write
+ * @param[in] path - cache file path
+ * @param[in] verbose - verbosity level
+ * @see readBinaryCache()
+ */
+static void writeBinaryCache(const tTrObject * obj, const TCHAR * path, const int verbose) {
+#define STR_SIZE(x) (((x) != NULL) ? strlen(x) : 0) + 1
+	uint64_t devices = 0, services = 0, actions = 0, args = 0;
+	uint64_t strings = STR_SIZE(obj->name) + STR_SIZE(obj->url) + STR_SIZE(obj->hash) + STR_SIZE(obj->etag) + STR_SIZE(obj->modified);
+	uint64_t size;
+	tTrCacheHeader * head;
+	tTrCacheDevice * cDevice;
+	tTrCacheService * cService;
+	tTrCacheAction * cAction;
+	tTrCacheArgument * cArg;
+	char * table;
+	char * data;
+	uint32_t str = 0;
+	uint32_t s1 = 0, ac1 = 0, ar1 = 0;
+	
+	/* calculate the file size */
+	devices = obj->length;
+	for (size_t d = 0; d < obj->length; d++) {
+		const tTrDevice * device = obj->device + d;
+		strings += STR_SIZE(device->name);
+		services += device->length;
+		for (size_t s = 0; s < device->length; s++) {
+			const tTrService * service = device->service + s;
+			strings += STR_SIZE(service->name) + STR_SIZE(service->type) + STR_SIZE(service->path) + STR_SIZE(service->control);
+			strings += STR_SIZE(service->hash) + STR_SIZE(service->etag) + STR_SIZE(service->modified);
+			actions += service->length;
+			for (size_t ac = 0; ac < service->length; ac++) {
+				const tTrAction * action = service->action + ac;
+				strings += STR_SIZE(action->name);
+				args += action->length;
+				for (size_t ar = 0; ar < action->length; ar++) {
+					const tTrArgument * arg = action->arg + ar;
+					strings += STR_SIZE(arg->name) + STR_SIZE(arg->var) + STR_SIZE(arg->type) + STR_SIZE(getArgDirName(arg->dir));
+				}
+			}
+		}
+	}
+#undef STR_SIZE
+	size = sizeof(*head) + (devices * sizeof(*cDevice)) + (services * sizeof(*cService)) + (actions * sizeof(*cAction)) + (args * sizeof(*cArg)) + strings;
+	if (size > 0xFFFFFFFE) {
+		if (verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_NO_MEM));
+		return;
+	}
+	data = (char *)calloc(1, (size_t)size);
+	if (data == NULL) {
+		if (verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_NO_MEM));
+		return;
+	}
+	
+	/* fill in header, records and string table */
+	head = (tTrCacheHeader *)data;
+	cDevice = (tTrCacheDevice *)(head + 1);
+	cService = (tTrCacheService *)(cDevice + devices);
+	cAction = (tTrCacheAction *)(cService + services);
+	cArg = (tTrCacheArgument *)(cAction + actions);
+	table = (char *)(cArg + args);
+	memcpy(head->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	head->version = CACHE_VERSION;
+	head->byteOrder = CACHE_BYTE_ORDER;
+	head->size = (uint32_t)size;
+	head->name = addCacheString(table, &str, obj->name);
+	head->url = addCacheString(table, &str, obj->url);
+	head->hash = addCacheString(table, &str, obj->hash);
+	head->etag = addCacheString(table, &str, obj->etag);
+	head->modified = addCacheString(table, &str, obj->modified);
+	head->devices = (uint32_t)devices;
+	head->services = (uint32_t)services;
+	head->actions = (uint32_t)actions;
+	head->args = (uint32_t)args;
+	head->strings = (uint32_t)strings;
+	for (size_t d = 0; d < obj->length; d++) {
+		const tTrDevice * device = obj->device + d;
+		cDevice->name = addCacheString(table, &str, device->name);
+		cDevice->service = s1;
+		cDevice->serviceCount = (uint32_t)(device->length);
+		cDevice++;
+		s1 = (uint32_t)(s1 + device->length);
+		for (size_t s = 0; s < device->length; s++) {
+			const tTrService * service = device->service + s;
+			cService->name = addCacheString(table, &str, service->name);
+			cService->type = addCacheString(table, &str, service->type);
+			cService->path = addCacheString(table, &str, service->path);
+			cService->control = addCacheString(table, &str, service->control);
+			cService->action = ac1;
+			cService->actionCount = (uint32_t)(service->length);
+			cService->hash = addCacheString(table, &str, service->hash);
+			cService->etag = addCacheString(table, &str, service->etag);
+			cService->modified = addCacheString(table, &str, service->modified);
+			cService->flags = (service->pending != 0) ? CACHE_SERVICE_PENDING : 0;
+			if (service->stale != 0) cService->flags |= CACHE_SERVICE_STALE;
+			cService++;
+			ac1 = (uint32_t)(ac1 + service->length);
+		}
+	}
+	/* actions and arguments are stored in the same order as the services */
+	for (size_t d = 0; d < obj->length; d++) {
+		const tTrDevice * device = obj->device + d;
+		for (size_t s = 0; s < device->length; s++) {
+			const tTrService * service = device->service + s;
+			for (size_t ac = 0; ac < service->length; ac++) {
+				const tTrAction * action = service->action + ac;
+				cAction->name = addCacheString(table, &str, action->name);
+				cAction->arg = ar1;
+				cAction->argCount = (uint32_t)(action->length);
+				cAction++;
+				ar1 = (uint32_t)(ar1 + action->length);
+				for (size_t ar = 0; ar < action->length; ar++) {
+					const tTrArgument * arg = action->arg + ar;
+					cArg->name = addCacheString(table, &str, arg->name);
+					cArg->var = addCacheString(table, &str, arg->var);
+					cArg->type = addCacheString(table, &str, arg->type);
+					cArg->dir = addCacheString(table, &str, getArgDirName(arg->dir));
+					cArg++;
+				}
+			}
+		}
+	}
+	
+	if (writeStringNToFile(path, data, (size_t)size) != 1) {
+		if (verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_WRITE));
+	}
+	free(data);
+}
+
+
+/**
+ * Returns the path of the given file within the passed cache directory.
+ * 
+ * @param[in] dir - cache directory path
+ * @param[in] name - ASCII file name
+ * @return newly allocated path or NULL on error
+ */
+static TCHAR * getCacheDirPath(const TCHAR * dir, const char * name) {
+	const size_t dirLen = _tcslen(dir);
+	TCHAR * res = (TCHAR *)malloc((dirLen + strlen(name) + 2) * sizeof(TCHAR));
+	TCHAR * ptr;
+	if (res == NULL) return NULL;
+	memcpy(res, dir, dirLen * sizeof(TCHAR));
+	ptr = res + dirLen;
+	if (dirLen > 0 && dir[dirLen - 1] != _T('/') && dir[dirLen - 1] != _T('\\')) *ptr++ = _T('/');
+	for (; *name != 0; name++) *ptr++ = (TCHAR)(*name);
+	*ptr = 0;
+	return res;
+}
+
+
+/**
+ * Returns the cache file name for the given device URL within a cache directory. The name is
+ * derived from the MD5 of the URL.
+ * 
+ * @param[in] url - device URL
+ * @param[out] name - receives the null-terminated file name
+ */
+static void getCacheEntryName(const char * url, char (* name)[32 + sizeof(CACHE_ENTRY_EXT)]) {
+	tHMd5Ctx md5;
+	uint8_t md5Data[16];
+	h_initMd5(&md5);
+	h_updateMd5(&md5, (const uint8_t *)url, strlen(url));
+	h_finalMd5(&md5, md5Data);
+	md5ToHex(*name, md5Data);
+	memcpy(*name + 32, CACHE_ENTRY_EXT, sizeof(CACHE_ENTRY_EXT));
+}
+
+
+/**
+ * Returns the path of the cache file for the given device URL within the passed cache directory.
+ * 
+ * @param[in] dir - cache directory path
+ * @param[in] url - device URL
+ * @return newly allocated path or NULL on error
+ */
+TCHAR * getCacheEntryPath(const TCHAR * dir, const char * url) {
+	char name[32 + sizeof(CACHE_ENTRY_EXT)];
+	getCacheEntryName(url, &name);
+	return getCacheDirPath(dir, name);
+}
+
+
+/**
+ * Adds the cache file of the given device URL to the index of the passed cache directory unless
+ * it is already listed. Each index line has the format <file name> <URL>. Lines are appended
+ * with a single write to allow concurrent processes to share the cache directory. Errors are
+ * reported as warnings.
+ * 
+ * @param[in] dir - cache directory path
+ * @param[in] url - device URL
+ * @param[in] verbose - verbosity level
+ */
+static void addCacheIndex(const TCHAR * dir, const char * url, const int verbose) {
+	char name[32 + sizeof(CACHE_ENTRY_EXT)];
+	const size_t nameLen = sizeof(name) - 1;
+	TCHAR * path = NULL;
+	char * data = NULL;
+	char * entry = NULL;
+	size_t entryLen;
+	int ok = 0;
+	
+	getCacheEntryName(url, &name);
+	path = getCacheDirPath(dir, CACHE_INDEX_FILE);
+	if (path == NULL) goto onError;
+	if (isFile(path) == 1) data = readFileToString(path, NULL);
+	for (const char * line = data; line != NULL && *line != 0; line = strchr(line, '\n')) {
+		if (*line == '\n') line++;
+		if (strncmp(line, name, nameLen) == 0 && line[nameLen] == ' ') {
+			ok = 1; /* already listed */
+			goto onError;
+		}
+	}
+	entryLen = nameLen + strlen(url) + 2;
+	entry = (char *)malloc(entryLen + 1);
+	if (entry == NULL) goto onError;
+	snprintf(entry, entryLen + 1, "%s %s\n", name, url);
+	ok = appendStringNToFile(path, entry, entryLen);
+onError:
+	if (ok != 1 && verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_INDEX));
+	if (entry != NULL) free(entry);
+	if (data != NULL) free(data);
+	if (path != NULL) free(path);
+}
+
+
+/**
+ * Returns the path of the authentication session file which belongs to the given cache file.
+ * 
+ * @param[in] cache - cache file path
+ * @return newly allocated path or NULL on error
+ */
+static TCHAR * getSessionPath(const TCHAR * cache) {
+	static const TCHAR ext[] = SESSION_EXT;
+	const size_t len = _tcslen(cache);
+	TCHAR * res = (TCHAR *)malloc((len * sizeof(TCHAR)) + sizeof(ext));
+	if (res == NULL) return NULL;
+	memcpy(res, cache, len * sizeof(TCHAR));
+	memcpy(res + len, ext, sizeof(ext));
+	return res;
+}
+
+
+/**
+ * Restores the HTTP digest authentication session of the given context from the session file
+ * next to the cache file. This allows to authorize the first request preemptively. The file is
+ * ignored if it was written for another URL or user. An expired nonce is replaced by the next
+ * challenge of the server.
+ * 
+ * @param[in,out] ctx - request context
+ * @param[in] cache - cache file path or NULL
+ * @param[in] url - device URL
+ */
+static void readAuthSession(tTr64RequestCtx * ctx, const TCHAR * cache, const char * url) {
+	TCHAR * path = NULL;
+	char * data = NULL;
+	char * line = NULL;
+	char * next = NULL;
+	const char * sessionUrl = NULL;
+	const char * user = NULL;
+	const char * realm = NULL;
+	const char * nonce = NULL;
+	const char * opaque = NULL;
+	const char * flags = NULL;
+	const char * nc = NULL;
+	
+	if (cache == NULL || url == NULL || ctx->user == NULL || ctx->pass == NULL) return;
+	path = getSessionPath(cache);
+	if (path == NULL || isFile(path) != 1) goto onError;
+	data = readFileToString(path, NULL);
+	if (data == NULL) goto onError;
+	
+	/* signature line followed by key=value lines */
+	for (line = data; line != NULL; line = next) {
+		char * sep;
+		next = strchr(line, '\n');
+		if (next != NULL) *next++ = 0;
+		sep = strchr(line, '\r');
+		if (sep != NULL) *sep = 0;
+		if (line == data) {
+			if (strcmp(line, SESSION_MAGIC) != 0) goto onFormatError;
+			continue;
+		}
+		if (*line == 0) continue;
+		sep = strchr(line, '=');
+		if (sep == NULL) goto onFormatError;
+		*sep++ = 0;
+		if (strcmp(line, "url") == 0) {
+			sessionUrl = sep;
+		} else if (strcmp(line, "user") == 0) {
+			user = sep;
+		} else if (strcmp(line, "realm") == 0) {
+			realm = sep;
+		} else if (strcmp(line, "nonce") == 0) {
+			nonce = sep;
+		} else if (strcmp(line, "opaque") == 0) {
+			opaque = sep;
+		} else if (strcmp(line, "flags") == 0) {
+			flags = sep;
+		} else if (strcmp(line, "nc") == 0) {
+			nc = sep;
+		}
+	}
+	if (sessionUrl == NULL || user == NULL || realm == NULL || nonce == NULL || flags == NULL || nc == NULL) goto onFormatError;
+	if (strcmp(sessionUrl, url) != 0 || strcmp(user, ctx->user) != 0) goto onError;
+	
+	ctx->authFlags = (tHttpAuthFlag)strtoul(flags, NULL, 10);
+	if ((ctx->authFlags & HAF_NEED) != HAF_NEED) goto onFormatError;
+	ctx->nc = (size_t)strtoul(nc, NULL, 10);
+	ctx->realm = strdup(realm);
+	ctx->nonce = strdup(nonce);
+	if (opaque != NULL) ctx->opaque = strdup(opaque);
+	if (ctx->realm == NULL || ctx->nonce == NULL || (opaque != NULL && ctx->opaque == NULL)) {
+		/* start without session */
+		if (ctx->realm != NULL) free(ctx->realm);
+		if (ctx->nonce != NULL) free(ctx->nonce);
+		if (ctx->opaque != NULL) free(ctx->opaque);
+		ctx->realm = NULL;
+		ctx->nonce = NULL;
+		ctx->opaque = NULL;
+		goto onError;
+	}
+	updateAuthHa1(ctx);
+	goto onError;
+onFormatError:
+	if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_SESSION_FMT));
+onError:
+	if (data != NULL) free(data);
+	if (path != NULL) free(path);
+}
+
+
+/**
+ * Stores the HTTP digest authentication session of the given context in the session file next to
+ * the cache file. The file is only accessible by the current user. The password or any value
+ * derived from it is not stored. Errors are reported as warnings.
+ * 
+ * @param[in,out] ctx - request context
+ * @param[in] cache - cache file path or NULL
+ * @param[in] url - device URL
+ */
+static void writeAuthSession(tTr64RequestCtx * ctx, const TCHAR * cache, const char * url) {
+	TCHAR * path = NULL;
+	int ok;
+	
+	if (cache == NULL || url == NULL || ctx->user == NULL || ctx->realm == NULL || ctx->nonce == NULL) return;
+	ctx->length = 0;
+	ok = formatToCtxBuffer(ctx, "%s\nurl=%s\nuser=%s\nrealm=%s\nnonce=%s\n", SESSION_MAGIC, url, ctx->user, ctx->realm, ctx->nonce);
+	if (ctx->opaque != NULL) ok &= formatToCtxBuffer(ctx, "opaque=%s\n", ctx->opaque);
+	ok &= formatToCtxBuffer(ctx, "flags=%u\nnc=%lu\n", (unsigned)(ctx->authFlags), (unsigned long)(ctx->nc));
+	if (ok == 1) path = getSessionPath(cache);
+	if (ok != 1 || path == NULL) {
+		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_SESSION_NO_MEM));
+	} else if (writePrivateStringNToFile(path, ctx->buffer, ctx->length) != 1) {
+		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_SESSION_WRITE));
+	}
+	if (path != NULL) free(path);
+}
+
+
+/**
+ * Copies all strings of the given object which point into the mapped binary cache file to the
+ * arena of the object and releases the mapping. This allows to replace the cache file.
+ * 
+ * @param[in,out] obj - object to detach
+ * @return 1 on success, else 0
+ */
+static int detachBinaryCache(tTrObject * obj) {
+#define DETACH(x) if ((x) != NULL) { (x) = ar_strdup(&(obj->arena), (x)); if ((x) == NULL) return 0; }
+#define DETACH_INTERN(x) if ((x) != NULL) { (x) = internString(&(obj->arena), &(obj->strings), (x), strlen(x)); if ((x) == NULL) return 0; }
+	if (obj->cache == NULL) return 1;
+	DETACH(obj->name)
+	DETACH(obj->url)
+	DETACH(obj->hash)
+	DETACH(obj->etag)
+	DETACH(obj->modified)
+	for (size_t d = 0; d < obj->length; d++) {
+		tTrDevice * device = obj->device + d;
+		DETACH(device->name)
+		for (size_t s = 0; s < device->length; s++) {
+			tTrService * service = device->service + s;
+			DETACH(service->name)
+			DETACH(service->type)
+			DETACH(service->path)
+			DETACH(service->control)
+			DETACH(service->hash)
+			DETACH(service->etag)
+			DETACH(service->modified)
+			for (size_t ac = 0; ac < service->length; ac++) {
+				tTrAction * action = service->action + ac;
+				DETACH(action->name)
+				for (size_t ar = 0; ar < action->length; ar++) {
+					tTrArgument * arg = action->arg + ar;
+					DETACH_INTERN(arg->name)
+					DETACH_INTERN(arg->var)
+					DETACH_INTERN(arg->type)
+				}
+			}
+		}
+	}
+#undef DETACH
+#undef DETACH_INTERN
+	/* the action index references the action names */
+	obj->index = NULL;
+	obj->indexLength = 0;
+	unmapFile(obj->cache, obj->cacheSize);
+	obj->cache = NULL;
+	obj->cacheSize = 0;
+	return 1;
+}
+
+
+/**
+ * Writes the given TR-064 object to its cache file in the format selected by the file extension.
+ * Errors are reported as warnings.
+ * 
+ * @param[in,out] ctx - request context
+ * @param[in,out] obj - object to write
+ */
+static void writeTrObjectCache(tTr64RequestCtx * ctx, tTrObject * obj) {
+	if (obj->cacheFile == NULL) return;
+	if (isXmlCachePath(obj->cacheFile) == 1) {
+		writeXmlCache(ctx, obj, obj->cacheFile);
+	} else if (detachBinaryCache(obj) != 1) {
+		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_WARN_CACHE_NO_MEM));
+	} else {
+		writeBinaryCache(obj, obj->cacheFile, ctx->verbose);
+	}
+}
+
+
+/**
+ * Fetches and parses all pending service descriptions of the given object which match the passed
+ * filter. Stale service descriptions are revalidated. The descriptions are fetched over up to the
+ * given number of parallel connections. New descriptions are parsed while they are received unless
+ * shared via a registry. Others are parsed as each response completes. The cache file of
+ * the object is updated if any service description was fetched.
+ * 
+ * @param[in,out] ctx - context to use (needs a resolved host address)
+ * @param[in,out] obj - object to complete
+ * @param[in] filter - only fetch services matching device and service of these options or NULL for all
+ * @param[in] jobs - maximum number of parallel connections
+ * @return 1 on success, else 0
+ */
+static int fetchServiceDescs(tTr64RequestCtx * ctx, tTrObject * obj, const tOptions * filter, const size_t jobs) {
+	size_t serviceCount = 0;
+	int res = 0;
+	tTrObjectFetchCtx fetchCtx = {
+		/* .request  = */ descRequest,
+		/* .object   = */ obj,
+		/* .registry = */ NULL,
+		/* .filter   = */ filter,
+		/* .ctxs     = */ NULL,
+		/* .pending  = */ NULL,
+		/* .stream   = */ NULL,
+		/* .count    = */ 0,
+		/* .device   = */ 0,
+		/* .service  = */ 0
+	};
+	
+	for (size_t d = 0; d < obj->length; d++) {
+		const tTrDevice * device = obj->device + d;
+		if (device->service == NULL) continue;
+		if (filter != NULL && filter->device != NULL && strncmp(device->name, filter->device, strlen(filter->device)) != 0) continue;
+		for (size_t s = 0; s < device->length; s++) {
+			const tTrService * service = device->service + s;
+			if (service->pending == 0 && service->stale == 0) continue;
+			if (filter != NULL && filter->service != NULL && strncmp(service->name, filter->service, strlen(filter->service)) != 0) continue;
+			serviceCount++;
+		}
+	}
+	if (serviceCount < 1) return 1;
+	
+	fetchCtx.count = PCF_MAX(PCF_MIN(jobs, serviceCount), 1);
+	fetchCtx.ctxs = (tTr64RequestCtx **)calloc(fetchCtx.count, sizeof(*(fetchCtx.ctxs)));
+	fetchCtx.pending = (tTrService **)calloc(fetchCtx.count, sizeof(*(fetchCtx.pending)));
+	fetchCtx.stream = (tTrDescStream *)calloc(fetchCtx.count, sizeof(*(fetchCtx.stream)));
+	if (fetchCtx.ctxs == NULL || fetchCtx.pending == NULL || fetchCtx.stream == NULL) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		goto onError;
+	}
+	fetchCtx.ctxs[0] = ctx;
+	for (size_t i = 1; i < fetchCtx.count; i++) {
+		fetchCtx.ctxs[i] = cloneTr64Request(ctx);
+		if (fetchCtx.ctxs[i] == NULL) goto onError;
+	}
+	for (size_t i = 0; i < fetchCtx.count; i++) {
+		if (requestNextServiceDesc(&fetchCtx, i) == 0) goto onError;
+	}
+	if (requestParallel(fetchCtx.ctxs, fetchCtx.count, fetchServiceDescVisitor, &fetchCtx) != 1) goto onError;
+	/* the action index needs to include the new actions */
+	obj->index = NULL;
+	obj->indexLength = 0;
+	
+	/* merge the fetched service descriptions into the cache file */
+	writeTrObjectCache(ctx, obj);
+	
+	res = 1;
+onError:
+	if (fetchCtx.ctxs != NULL) {
+		for (size_t i = 0; i < fetchCtx.count; i++) {
+			tTr64RequestCtx * fetchReq = fetchCtx.ctxs[i];
+			if (fetchReq == NULL) continue;
+			if (fetchReq->receive != NULL) {
+				/* release the parser state of an aborted description stream */
+				char hash[33];
+				finishDescStream(fetchReq, fetchCtx.stream + i, 0, hash);
+				freeServiceDescCtx(&(fetchCtx.stream[i].parse.service));
+			}
+			if (i > 0) freeTr64Request(fetchReq);
+		}
+		free(fetchCtx.ctxs);
+	}
+	if (fetchCtx.pending != NULL) free(fetchCtx.pending);
+	if (fetchCtx.stream != NULL) free(fetchCtx.stream);
+	return res;
+}
+
+
+/**
+ * Reads the TR-064 object from the given cache file in binary or XML format.
+ * 
+ * @param[in] path - cache file path or NULL
+ * @param[in] url - the cache file needs to be written for this device URL
+ * @param[in] verbose - verbosity level
+ * @return Object on success or NULL if the cache file is missing, invalid or for another URL.
+ */
+static tTrObject * readTrObjectCache(const TCHAR * path, const char * url, const int verbose) {
+	tTrObject * obj;
+	int ok;
+	if (path == NULL || isFile(path) != 1) return NULL;
+	obj = (tTrObject *)calloc(1, sizeof(tTrObject));
+	if (obj == NULL) return NULL;
+	ok = readBinaryCache(obj, path, verbose);
+	if (ok < 0) ok = readXmlCache(obj, path, verbose);
+	/* check if cached URL matches requested one */
+	if (ok == 1 && strcmp(obj->url, url) == 0) return obj;
+	/* discard fragments from cache file */
+	freeTrObject(obj);
+	return NULL;
+}
+
+
+/**
+ * Checks whether the device description of the given cached object changed. The object is kept as
+ * is if the device responds with 304 or the content MD5 matches. Otherwise, the new device
+ * description is parsed and each service with unchanged type, path and control URL keeps its
+ * actions but is marked stale. Stale service descriptions are revalidated on their next use (see
+ * fetchServiceDescs()). Only the changed ones are fetched again completely.
+ * 
+ * @param[in,out] ctx - context to use (needs a resolved host address)
+ * @param[in,out] obj - cached object to revalidate
+ * @return 1 on success, else 0
+ */
+static int revalidateTrObject(tTr64RequestCtx * ctx, tTrObject * obj) {
+	char hash[33];
+	tTrDevice * oldDevice = obj->device;
+	const size_t oldLength = obj->length;
+	if (formatDescRequest(ctx, ctx->path, obj->etag, obj->modified) != 1) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_FMT_DEV_DESC));
+		return 0;
+	}
+	if (ctx->verbose > 3) {
+		fuprintf(ferr, MSGU(MSGU_INFO_DEV_DESC_REQ), ctx->path);
+	}
+	if (ctx->request(ctx) != 1) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_GET_DEV_DESC), (unsigned)(ctx->status));
+		return 0;
+	}
+	if (ctx->verbose > 2) _ftprintf(ferr, MSGT(MSGT_INFO_DEV_DESC_DUR), (unsigned)(ctx->duration));
+	if (ctx->status == 304) goto onUnchanged;
+	hashContent(ctx, hash);
+	if (obj->hash != NULL && strcmp(obj->hash, hash) == 0) goto onUnchanged;
+	
+	/* parse the new device description; the previous devices stay valid within the arena */
+	obj->name = NULL;
+	obj->device = NULL;
+	obj->capacity = 0;
+	obj->length = 0;
+	obj->index = NULL;
+	obj->indexLength = 0;
+	if (parseDeviceDesc(ctx, obj) != 1) return 0;
+	if (setDescFingerprint(&(obj->arena), ctx, hash, &(obj->hash), &(obj->etag), &(obj->modified)) != 1) return 0;
+	/* keep the actions of the matching services until they were revalidated */
+	for (size_t d = 0; d < obj->length; d++) {
+		tTrDevice * device = obj->device + d;
+		for (size_t od = 0; od < oldLength; od++) {
+			const tTrDevice * old = oldDevice + od;
+			if (strcmp(device->name, old->name) != 0) continue;
+			for (size_t s = 0; s < device->length; s++) {
+				tTrService * service = device->service + s;
+				for (size_t os = 0; os < old->length; os++) {
+					const tTrService * oldService = old->service + os;
+					if (oldService->pending != 0) continue;
+					if (strcmp(service->type, oldService->type) != 0) continue;
+					if (strcmp(service->path, oldService->path) != 0) continue;
+					if (strcmp(service->control, oldService->control) != 0) continue;
+					service->action = oldService->action;
+					service->capacity = oldService->capacity;
+					service->length = oldService->length;
+					service->hash = oldService->hash;
+					service->etag = oldService->etag;
+					service->modified = oldService->modified;
+					service->pending = 0;
+					service->stale = 1;
+					break;
+				}
+			}
+			break;
+		}
+	}
+	writeTrObjectCache(ctx, obj);
+	return 1;
+onUnchanged:
+	if (ctx->verbose > 2) _ftprintf(ferr, MSGT(MSGT_INFO_DEV_DESC_SAME));
+	return 1;
+}
+
+
+/**
+ * Creates a new TR-064 object according to the given parameters. The caller needs to resolve the
+ * host address in ctx. The device description is parsed while it is received. The service
+ * descriptions are fetched over up to opt->jobs parallel connections and parsed the same way. In
+ * query mode only the device description is fetched here. The needed service descriptions are
+ * fetched on first use and merged into the cache file (see fetchServiceDescs()). A cached object is
+ * revalidated if requested by the options (see revalidateTrObject()).
+ * 
+ * @param[in,out] ctx - context to use
+ * @param[in] opt - options to use
+ * @return Object on success, else NULL.
+ */
+tTrObject * newTrObject(tTr64RequestCtx * ctx, const tOptions * opt) {
+	if (ctx == NULL || opt == NULL) return NULL;
+	char hash[33];
+	tTrDescStream stream;
+	int parsed;
+	tTrObject * obj = NULL;
+	tTrObject * res = NULL;
+	
+	/* read from cache (binary or XML format) */
+	obj = readTrObjectCache(opt->cache, opt->url, ctx->verbose);
+	if (obj != NULL) {
+		obj->cacheFile = opt->cache;
+		if (opt->revalidate != 0 && revalidateTrObject(ctx, obj) != 1) goto onError;
+		return obj;
+	}
+	
+	obj = (tTrObject *)calloc(1, sizeof(tTrObject));
+	if (obj == NULL) return NULL;
+	
+	/* read from device */
+	/* read device description */
+	ctx->length = 0;
+	if (formatToCtxBuffer(ctx, descRequest, ctx->path, ctx->host, ctx->port) != 1) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_FMT_DEV_DESC));
+		goto onError;
+	}
+	if (ctx->verbose > 3) {
+		fuprintf(ferr, MSGU(MSGU_INFO_DEV_DESC_REQ), ctx->path);
+	}
+	/* parse device description while it is received (see xmlDeviceDescVisitor()) */
+	memset(&(stream.parse), 0, sizeof(stream.parse));
+	stream.parse.device.arena = &(obj->arena);
+	stream.parse.device.object = obj;
+	stream.parse.device.lastError = MSGT_SUCCESS;
+	startDescStream(ctx, &stream, xmlDeviceDescVisitor);
+	parsed = finishDescStream(ctx, &stream, ctx->request(ctx), hash);
+	freeDeviceDescCtx(&(stream.parse.device));
+	if (parsed < 0) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_GET_DEV_DESC), (unsigned)(ctx->status));
+		goto onError;
+	}
+	if (ctx->verbose > 2) _ftprintf(ferr, MSGT(MSGT_INFO_DEV_DESC_DUR), (unsigned)(ctx->duration));
+	if (parsed != 1) {
+		printDescStreamError(ctx, &stream, stream.parse.device.lastError, MSGU_ERR_DEV_DESC_FMT, ctx->path);
+		goto onError;
+	}
+	obj->url = ar_strdup(&(obj->arena), opt->url);
+	if (obj->url == NULL) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		goto onError;
+	}
+	if (setDescFingerprint(&(obj->arena), ctx, hash, &(obj->hash), &(obj->etag), &(obj->modified)) != 1) goto onError;
+	
+	/* read and parse service descriptions (unless fetched on demand) */
+	if (opt->mode != M_QUERY && fetchServiceDescs(ctx, obj, NULL, opt->jobs) != 1) goto onError;
+	
+	/* store new cache file */
+	obj->cacheFile = opt->cache;
+	writeTrObjectCache(ctx, obj);
+	if (opt->cacheDir != NULL) addCacheIndex(opt->cacheDir, opt->url, ctx->verbose);
+	
+	res = obj;
+onError:
+	if (res == NULL && obj != NULL) freeTrObject(obj);
+	return res;
+}
+
+
+/**
+ * Sets the value for the given argument to the passed string. A new string will be allocated from
+ * the arena of the query values and assigned. Use null for str to clear the argument value.
+ * 
+ * @param[in,out] values - query values to set the argument value in
+ * @param[in] index - index of the argument within the action of values
+ * @param[in] str - string to set as value
+ * @return 1 on success, else 0
+ */
+int setArgValue(tTrQueryValues * values, const size_t index, const char * str) {
+	if (values == NULL || values->action == NULL || index >= values->action->length) return 0;
+	tTrArgValue * value = values->value + index;
+	if (str != NULL) {
+		value->token.start = ar_strdup(&(values->arena), str);
+		if (value->token.start == NULL) return 0;
+		value->token.length = strlen(str);
+		value->entities = (strchr(str, '&') != NULL) ? 1 : 0;
+	} else {
+		memset(value, 0, sizeof(*value));
+	}
+	return 1;
+}
+
+
+/**
+ * Sets the value for the given argument to the passed XML escaped string without copying it. The
+ * string needs to remain valid as long as the value is used. Use null for str to clear the
+ * argument value.
+ * 
+ * @param[in,out] values - query values to set the argument value in
+ * @param[in] index - index of the argument within the action of values
+ * @param[in] str - string to set as value
+ * @param[in] len - string length in bytes
+ * @return 1 on success, else 0
+ */
+int setArgValueRef(tTrQueryValues * values, const size_t index, const char * str, const size_t len) {
+	if (values == NULL || values->action == NULL || index >= values->action->length) return 0;
+	tTrArgValue * value = values->value + index;
+	if (str != NULL) {
+		value->token.start = str;
+		value->token.length = len;
+		value->entities = (memchr(str, '&', len) != NULL) ? 1 : 0;
+	} else {
+		memset(value, 0, sizeof(*value));
+	}
+	return 1;
+}
+
+
+/**
+ * Releases the argument values of the previous query and binds the query values to the action of
+ * the next query. All argument values are unset afterwards.
+ * 
+ * @param[in,out] values - query values to reset
+ * @param[in] action - action of the next query
+ * @return 1 on success, else 0
+ */
+static int resetArgValues(tTrQueryValues * values, const tTrAction * action) {
+	ar_reset(&(values->arena));
+	values->action = action;
+	values->value = (tTrArgValue *)ar_calloc(&(values->arena), (action->length > 0) ? action->length : 1, sizeof(tTrArgValue));
+	return (values->value != NULL) ? 1 : 0;
+}
+
+
+/**
+ * Deletes the allocated TR-064 object. All elements and strings are released at once with the
+ * arena of the object.
+ * 
+ * @param[in] obj - object to delete
+ */
+void freeTrObject(tTrObject * obj) {
+	if (obj == NULL) return;
+	ar_free(&(obj->arena));
+	if (obj->cache != NULL) unmapFile(obj->cache, obj->cacheSize);
+	free(obj);
+}
+
+
+/**
+ * Callback to parse the query response XML/SOAP format. The argument value references the escaped
+ * response content. It is unescaped on output.
+ * 
+ * @param[in] type - token type
+ * @param[in] tokens - tokens passed (1 for xml, tags, instructions, contents and cdata; 2 for attributes)
+ * @param[in] level - token level (i.e. number of parents)
+ * @param[in,out] param - user defined callback data (expects tPTrQueryRespCtx)
+ * @return 1 to continue, 0 on error
+ * @see trQuery()
  */
 static int xmlQueryRespVisitor(const tPSaxTokenType type, const tPToken * tokens, const size_t level, void * param) {
 	static const char * soapNs = "http://schemas.xmlsoap.org/soap/envelope/";
@@ -2515,25 +4512,13 @@ static int xmlQueryRespVisitor(const tPSaxTokenType type, const tPToken * tokens
 		} else if (level == 3 && ctx->depth == 4) {
 			/* TR-064 action response argument */
 			ctx->depth--;
-			/* find corresponding argument and set received value as newly allocated string */
+			/* find corresponding argument and reference the received value */
 			found = 0;
 			for (size_t ar = 0; ar < ctx->action->length; ar++) {
-				tTrArgument * arg = ctx->action->arg + ar;
-				if (strcmp(arg->dir, "out") != 0) continue;
+				const tTrArgument * arg = ctx->action->arg + ar;
+				if (arg->dir != TAD_OUT) continue;
 				if (p_cmpToken(tokens + 1, arg->name) != 0) continue;
-				if (setArgValueN(arg, ctx->content.start, ctx->content.length) != 1) {
-					ctx->lastError = MSGT_ERR_NO_MEM;
-					return 0; /* allocation error */
-				}
-				errno = 0;
-				if (arg->value != NULL && p_unescapeXmlVar(&(arg->value), NULL, 0) != 1) {
-					if (errno == EINVAL) {
-						ctx->lastError = MSGT_ERR_QUERY_RESP_ARG_BAD_ESC;
-					} else {
-						ctx->lastError = MSGT_ERR_NO_MEM;
-					}
-					return 0; /* allocation error */
-				}
+				setArgValueRef(ctx->values, ar, ctx->content.start, ctx->content.length);
 				found = 1;
 				break;
 			}
@@ -2551,6 +4536,127 @@ static int xmlQueryRespVisitor(const tPSaxTokenType type, const tPToken * tokens
 }
 
 
+/**
+ * Decodes the given XML entity to UTF-8.
+ * 
+ * @param[in] str - entity name between '&' and ';'
+ * @param[in] len - length of str in bytes
+ * @param[out] out - receives the decoded character (at least 4 bytes)
+ * @return number of bytes written to out or 0 if the entity is invalid
+ */
+static size_t decodeXmlEntity(const char * str, const size_t len, char * out) {
+	unsigned long cp = 0;
+	size_t i;
+	if (len < 2) return 0;
+	if (str[0] != '#') {
+		/* named entity */
+		if (len == 2 && str[1] == 't' && (str[0] == 'l' || str[0] == 'g')) {
+			*out = (str[0] == 'l') ? '<' : '>';
+		} else if (len == 3 && memcmp(str, "amp", 3) == 0) {
+			*out = '&';
+		} else if (len == 4 && memcmp(str, "apos", 4) == 0) {
+			*out = '\'';
+		} else if (len == 4 && memcmp(str, "quot", 4) == 0) {
+			*out = '"';
+		} else {
+			return 0;
+		}
+		return 1;
+	}
+	if (str[1] == 'x') {
+		/* Unicode code point in hex */
+		if (len < 3) return 0;
+		for (i = 2; i < len; i++) {
+			const int c = tolower((unsigned char)(str[i]));
+			if (c >= '0' && c <= '9') {
+				cp = (cp << 4) | (unsigned long)(c - '0');
+			} else if (c >= 'a' && c <= 'f') {
+				cp = (cp << 4) | (unsigned long)(c - 'a' + 10);
+			} else {
+				return 0;
+			}
+			if (cp > 0x10FFFF) cp = 0x110000; /* replaced below */
+		}
+	} else {
+		/* Unicode code point in decimal */
+		for (i = 1; i < len; i++) {
+			if (str[i] < '0' || str[i] > '9') return 0;
+			cp = (cp * 10) + (unsigned long)(str[i] - '0');
+			if (cp > 0x10FFFF) cp = 0x110000; /* replaced below */
+		}
+	}
+	if (cp == 0) return 0;
+	/* invalid Unicode code points are replaced */
+	return utf8_fromCodePoint(out, 4, (tUChar)cp, UTF8M_REPLACE);
+}
+
+
+/**
+ * Appends the given XML escaped argument value to the query buffer with the passed output
+ * escaping applied. The value is transcoded in a single pass without intermediate allocations.
+ * Unset values are ignored. The function sets errno to EINVAL upon wrong escape sequence and to
+ * ENOMEM on allocation error.
+ * 
+ * @param[in,out] qry - query handle
+ * @param[in] value - argument value to append
+ * @param[in] esc - output escaping
+ * @return 1 on success, else 0
+ */
+static int appendArgValue(tTrQueryHandler * qry, const tTrArgValue * value, const tOutEscape esc) {
+	const char * in = value->token.start;
+	const char * end = in + value->token.length;
+	char * out;
+	if (in == NULL) return 1;
+	if (value->entities == 0 && esc == OE_TEXT) {
+		if (appendToBuffer(&(qry->buffer), &(qry->capacity), &(qry->length), in, value->token.length) == 1) return 1;
+		errno = ENOMEM;
+		return 0;
+	}
+	/* each input byte results in at most 6 output bytes */
+	if (reserveBuffer(&(qry->buffer), &(qry->capacity), qry->length, value->token.length * 6) != 1) {
+		errno = ENOMEM;
+		return 0;
+	}
+	out = qry->buffer + qry->length;
+	if (value->entities == 0) {
+		out = putEscapedRun(out, in, value->token.length, esc);
+	} else {
+		while (in < end) {
+			const char * amp = (const char *)memchr(in, '&', (size_t)(end - in));
+			if (amp == NULL) amp = end;
+			out = putEscapedRun(out, in, (size_t)(amp - in), esc);
+			if (amp >= end) break;
+			char chr[4];
+			const char * sep = (const char *)memchr(amp + 1, ';', (size_t)(end - amp - 1));
+			const size_t n = (sep != NULL) ? decodeXmlEntity(amp + 1, (size_t)(sep - amp - 1), chr) : 0;
+			if (n == 0) {
+				qry->buffer[qry->length] = 0;
+				errno = EINVAL;
+				return 0;
+			}
+			out = putEscapedRun(out, chr, n, esc);
+			in = sep + 1;
+		}
+	}
+	qry->length = (size_t)(out - qry->buffer);
+	*out = 0;
+	return 1;
+}
+
+
+/**
+ * Outputs the error message for an argument value which could not be appended to the query buffer.
+ * 
+ * @param[in] qry - query handle
+ * @see appendArgValue()
+ */
+static void trQueryPrintValueError(const tTrQueryHandler * qry) {
+	if (qry->ctx->verbose > 0) {
+		_ftprintf(ferr, MSGT((errno == EINVAL) ? MSGT_ERR_QUERY_RESP_ARG_BAD_ESC : MSGT_ERR_NO_MEM));
+	}
+}
+
+
 /**
  * Outputs the query result in text format.
  * 
@@ -2566,9 +4672,11 @@ static int trQueryOutputText(FILE * fd, tTrQueryHandler * qry, const tTrAction *
 	qry->length = 0;
 	ok = formatToQryBuffer(qry, "%s\n", action->name);
 	for (size_t ar = 0; ar < action->length; ar++) {
-		tTrArgument * arg = action->arg + ar;
-		if (strcmp(arg->dir, "out") != 0) continue;
-		ok &= formatToQryBuffer(qry,"  %s: %s\n", arg->var, (arg->value != NULL) ? arg->value : "");
+		const tTrArgument * arg = action->arg + ar;
+		if (arg->dir != TAD_OUT) continue;
+		ok &= formatToQryBuffer(qry,"  %s: ", arg->var);
+		if (appendArgValue(qry, qry->values.value + ar, OE_TEXT) != 1) goto onValueError;
+		ok &= formatToQryBuffer(qry,"\n");
 	}
 	if (ok != 1) goto onOutOfMemory;
 	
@@ -2578,6 +4686,9 @@ static int trQueryOutputText(FILE * fd, tTrQueryHandler * qry, const tTrAction *
 	}
 	
 	return 1;
+onValueError:
+	trQueryPrintValueError(qry);
+	return 0;
 onOutOfMemory:
 	if (qry->ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
 	return 0;
@@ -2600,8 +4711,8 @@ static int trQueryOutputCsv(FILE * fd, tTrQueryHandler * qry, const tTrAction *
 	qry->length = 0;
 	/* build header */
 	for (size_t ar = 0; ar < action->length; ar++) {
-		tTrArgument * arg = action->arg + ar;
-		if (strcmp(arg->dir, "out") != 0 || arg->value == NULL) continue;
+		const tTrArgument * arg = action->arg + ar;
+		if (arg->dir != TAD_OUT || qry->values.value[ar].token.start == NULL) continue;
 		escStr = escapeCsv(arg->var, (size_t)-1);
 		if (escStr == NULL) goto onOutOfMemory;
 		ok &= formatToQryBuffer(qry, first ? "\"%s\"" : ",\"%s\"", escStr);
@@ -2614,16 +4725,16 @@ static int trQueryOutputCsv(FILE * fd, tTrQueryHandler * qry, const tTrAction *
 	/* build record */
 	first = 1;
 	for (size_t ar = 0; ar < action->length; ar++) {
-		tTrArgument * arg = action->arg + ar;
-		if (strcmp(arg->dir, "out") != 0) continue;
-		if (arg->value == NULL) {
+		const tTrArgument * arg = action->arg + ar;
+		const tTrArgValue * value = qry->values.value + ar;
+		if (arg->dir != TAD_OUT) continue;
+		if (value->token.start == NULL) {
 			if (first != 0) ok &= formatToQryBuffer(qry, ",");
 			continue;
 		}
-		escStr = escapeCsv(arg->value, (size_t)-1);
-		if (escStr == NULL) goto onOutOfMemory;
-		ok &= formatToQryBuffer(qry, first ? "\"%s\"" : ",\"%s\"", escStr);
-		if (escStr != arg->value) free(escStr);
+		ok &= formatToQryBuffer(qry, first ? "\"" : ",\"");
+		if (appendArgValue(qry, value, OE_CSV) != 1) goto onValueError;
+		ok &= formatToQryBuffer(qry, "\"");
 		first = 0;
 	}
 	ok &= formatToQryBuffer(qry, "\n");
@@ -2633,11 +4744,54 @@ static int trQueryOutputCsv(FILE * fd, tTrQueryHandler * qry, const tTrAction *
 		if (qry->ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_QUERY_PRINT));
 		return 0;
 	}
-	
-	return 1;
-onOutOfMemory:
-	if (qry->ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-	return 0;
+	
+	return 1;
+onValueError:
+	trQueryPrintValueError(qry);
+	return 0;
+onOutOfMemory:
+	if (qry->ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+	return 0;
+}
+
+
+/**
+ * Formats the value of the given argument as JSON value to the query buffer. The function sets
+ * errno as described for appendArgValue() on error.
+ * 
+ * @param[in,out] qry - query handle
+ * @param[in] arg - output the value of this argument
+ * @param[in] value - argument value
+ * @return 1 on success, else 0
+ */
+static int formatJsonValue(tTrQueryHandler * qry, const tTrArgument * arg, const tTrArgValue * value) {
+	int ok = 1;
+	
+	errno = ENOMEM;
+	if (value->token.start == NULL) return formatToQryBuffer(qry, "null");
+	switch (mapToJsonType(arg->dataType)) {
+	case JT_NULL:
+		ok = formatToQryBuffer(qry, "null");
+		break;
+	case JT_NUMBER:
+		ok = appendArgValue(qry, value, OE_TEXT);
+		break;
+	case JT_BOOLEAN:
+		if (value->token.length == 1 && *(value->token.start) == '0') {
+			ok = formatToQryBuffer(qry, "false");
+			break;
+		} else if (value->token.length == 1 && *(value->token.start) == '1') {
+			ok = formatToQryBuffer(qry, "true");
+			break;
+		}
+		/* fall-through */
+	case JT_STRING:
+		ok = formatToQryBuffer(qry, "\"");
+		ok &= appendArgValue(qry, value, OE_JSON);
+		ok &= formatToQryBuffer(qry, "\"");
+		break;
+	}
+	return ok;
 }
 
 
@@ -2660,42 +4814,15 @@ static int trQueryOutputJson(FILE * fd, tTrQueryHandler * qry, const tTrAction *
 	ok = formatToQryBuffer(qry, "{\"%s\":{\n", escStr);
 	if (escStr != action->name) free(escStr);
 	for (size_t ar = 0; ar < action->length; ar++) {
-		tTrArgument * arg = action->arg + ar;
-		if (strcmp(arg->dir, "out") != 0) continue;
+		const tTrArgument * arg = action->arg + ar;
+		if (arg->dir != TAD_OUT) continue;
 		/* key */
 		escStr = escapeJson(arg->var, (size_t)-1);
 		if (escStr == NULL) goto onOutOfMemory;
 		ok &= formatToQryBuffer(qry, first ? "  \"%s\":" : ",\n  \"%s\":", escStr);
 		if (escStr != arg->var) free(escStr);
 		/* value */
-		if (arg->value == NULL) {
-			ok &= formatToQryBuffer(qry, "null");
-			first = 0;
-			continue;
-		}
-		switch (mapToJsonType(arg->type)) {
-		case JT_NULL:
-			ok &= formatToQryBuffer(qry, "null");
-			break;
-		case JT_NUMBER:
-			ok &= formatToQryBuffer(qry, "%s", arg->value);
-			break;
-		case JT_BOOLEAN:
-			if (strcmp(arg->value, "0") == 0) {
-				ok &= formatToQryBuffer(qry, "false");
-				break;
-			} else if (strcmp(arg->value, "1") == 0) {
-				ok &= formatToQryBuffer(qry, "true");
-				break;
-			}
-			/* fall-through */
-		case JT_STRING:
-			escStr = escapeJson(arg->value, (size_t)-1);
-			if (escStr == NULL) goto onOutOfMemory;
-			ok &= formatToQryBuffer(qry, "\"%s\"", escStr);
-			if (escStr != arg->value) free(escStr);
-			break;
-		}
+		if (formatJsonValue(qry, arg, qry->values.value + ar) != 1) goto onValueError;
 		first = 0;
 	}
 	ok &= formatToQryBuffer(qry, "\n}}\n");
@@ -2707,6 +4834,9 @@ static int trQueryOutputJson(FILE * fd, tTrQueryHandler * qry, const tTrAction *
 	}
 	
 	return 1;
+onValueError:
+	trQueryPrintValueError(qry);
+	return 0;
 onOutOfMemory:
 	if (qry->ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
 	return 0;
@@ -2724,22 +4854,16 @@ onOutOfMemory:
 static int trQueryOutputXml(FILE * fd, tTrQueryHandler * qry, const tTrAction * action) {
 	if (fd == NULL || qry == NULL || action == NULL) return 0;
 	int ok;
-	char * escStr;
 	
 	qry->length = 0;
 	ok = formatToQryBuffer(qry, "<%s>\n", action->name);
 	for (size_t ar = 0; ar < action->length; ar++) {
-		tTrArgument * arg = action->arg + ar;
-		if (strcmp(arg->dir, "out") != 0) continue;
+		const tTrArgument * arg = action->arg + ar;
+		if (arg->dir != TAD_OUT) continue;
 		/* start tag */
 		ok &= formatToQryBuffer(qry, "  <%s>", arg->var);
 		/* value */
-		if (arg->value != NULL) {
-			escStr = p_escapeXml(arg->value, (size_t)-1);
-			if (escStr == NULL) goto onOutOfMemory;
-			ok &= formatToQryBuffer(qry, "%s", escStr);
-			if (escStr != arg->value) free(escStr);
-		}
+		if (appendArgValue(qry, qry->values.value + ar, OE_XML) != 1) goto onValueError;
 		/* end tag */
 		ok &= formatToQryBuffer(qry, "</%s>\n", arg->var);
 	}
@@ -2752,6 +4876,9 @@ static int trQueryOutputXml(FILE * fd, tTrQueryHandler * qry, const tTrAction *
 	}
 		
 	return 1;
+onValueError:
+	trQueryPrintValueError(qry);
+	return 0;
 onOutOfMemory:
 	if (qry->ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
 	return 0;
@@ -2759,27 +4886,177 @@ onOutOfMemory:
 
 
 /**
- * Queries a TR-064 SOAP request according to opt and prints the result to fout.
+ * Outputs the query result as single line JSON record for the batch mode. The record includes the
+ * query line, HTTP status and request duration in milliseconds. The device URL is added in poll
+ * mode. A failed query is output with a null result if no action is given.
  * 
+ * @param[in,out] fd - output to this file descriptor
  * @param[in,out] qry - query handle
- * @param[in] opt - query options
- * @param[in] argIndex - first valid argument index
+ * @param[in] action - action to output or NULL if the query failed
  * @return 1 on success, else 0
+ * @see https://jsonlines.org/
  */
-static int trQuery(tTrQueryHandler * qry, const tOptions * opt, int argIndex) {
-	static const char * req =
-		"POST %s HTTP/1.1\r\n"
-		"Host: %s:%s\r\n"
-		"Connection: keep-alive\r\n"
-		"Accept: */*\r\n"
-		"User-Agent: tr64c %s\r\n"
-		"%s" /* authorization field goes in here */
-		"SOAPAction: %s#%s\r\n"
-		"Content-Type: text/xml; charset=utf-8\r\n"
-		"Content-Length: %u\r\n"
-		"\r\n"
-		"%.*s"
-	;
+static int trQueryOutputBatch(FILE * fd, tTrQueryHandler * qry, const tTrAction * action) {
+	if (fd == NULL || qry == NULL) return 0;
+	const tTr64RequestCtx * ctx = qry->ctx;
+	int ok, first = 1;
+	char * escStr;
+	
+	qry->length = 0;
+	if (qry->device != NULL) {
+		ok = formatToQryBuffer(qry, "{\"device\":\"%s\",\"query\":\"%s\"", qry->device, (qry->name != NULL) ? qry->name : "");
+	} else {
+		ok = formatToQryBuffer(qry, "{\"query\":\"%s\"", (qry->name != NULL) ? qry->name : "");
+	}
+	if (ctx->status != 0) {
+		ok &= formatToQryBuffer(qry, ",\"status\":%u", (unsigned)(ctx->status));
+	} else {
+		ok &= formatToQryBuffer(qry, ",\"status\":null");
+	}
+	if (ctx->duration != (size_t)-1) {
+		ok &= formatToQryBuffer(qry, ",\"duration\":%u", (unsigned)(ctx->duration));
+	} else {
+		ok &= formatToQryBuffer(qry, ",\"duration\":null");
+	}
+	if (action != NULL) {
+		const size_t resultPos = qry->length;
+		escStr = escapeJson(action->name, (size_t)-1);
+		if (escStr == NULL) goto onOutOfMemory;
+		ok &= formatToQryBuffer(qry, ",\"result\":{\"%s\":{", escStr);
+		if (escStr != action->name) free(escStr);
+		for (size_t ar = 0; ar < action->length; ar++) {
+			const tTrArgument * arg = action->arg + ar;
+			if (arg->dir != TAD_OUT) continue;
+			escStr = escapeJson(arg->var, (size_t)-1);
+			if (escStr == NULL) goto onOutOfMemory;
+			ok &= formatToQryBuffer(qry, first ? "\"%s\":" : ",\"%s\":", escStr);
+			if (escStr != arg->var) free(escStr);
+			if (formatJsonValue(qry, arg, qry->values.value + ar) != 1) {
+				if (errno != EINVAL) goto onOutOfMemory;
+				/* output a null result like for a failed query */
+				trQueryPrintValueError(qry);
+				qry->length = resultPos;
+				break;
+			}
+			first = 0;
+		}
+		if (qry->length != resultPos) {
+			ok &= formatToQryBuffer(qry, "}}}\n");
+		} else {
+			ok &= formatToQryBuffer(qry, ",\"result\":null}\n");
+		}
+	} else {
+		ok &= formatToQryBuffer(qry, ",\"result\":null}\n");
+	}
+	if (ok != 1) goto onOutOfMemory;
+	
+	if (fputUtf8N(fd, qry->buffer, qry->length) < 1) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_QUERY_PRINT));
+		return 0;
+	}
+	
+	return 1;
+onOutOfMemory:
+	if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+	return 0;
+}
+
+
+/**
+ * Compares two action references by their action name.
+ * 
+ * @param[in] lhs - left-hand action reference
+ * @param[in] rhs - right-hand action reference
+ * @return <0 if lhs < rhs, 0 if lhs == rhs, >0 if lhs > rhs
+ */
+static int cmpTrActionRef(const void * lhs, const void * rhs) {
+	return strcmp(((const tTrActionRef *)lhs)->name, ((const tTrActionRef *)rhs)->name);
+}
+
+
+/**
+ * Builds the action lookup index of the given object. The index holds all actions sorted by name
+ * to find all actions with a given name prefix in O(log n).
+ * 
+ * @param[in,out] obj - object to build the index for
+ * @return 1 on success, else 0
+ */
+static int buildActionIndex(tTrObject * obj) {
+	size_t count = 0;
+	tTrActionRef * ref;
+	for (size_t d = 0; d < obj->length; d++) {
+		const tTrDevice * dev = obj->device + d;
+		if (dev->service == NULL) continue;
+		for (size_t s = 0; s < dev->length; s++) {
+			if (dev->service[s].action != NULL) count += dev->service[s].length;
+		}
+	}
+	obj->index = (tTrActionRef *)ar_alloc(&(obj->arena), PCF_MAX(count, 1) * sizeof(tTrActionRef));
+	if (obj->index == NULL) return 0;
+	ref = obj->index;
+	for (size_t d = 0; d < obj->length; d++) {
+		const tTrDevice * dev = obj->device + d;
+		if (dev->service == NULL) continue;
+		for (size_t s = 0; s < dev->length; s++) {
+			const tTrService * srvc = dev->service + s;
+			if (srvc->action == NULL) continue;
+			for (size_t ac = 0; ac < srvc->length; ac++, ref++) {
+				ref->name = srvc->action[ac].name;
+				ref->device = dev;
+				ref->service = srvc;
+				ref->action = srvc->action + ac;
+			}
+		}
+	}
+	obj->indexLength = count;
+	qsort(obj->index, count, sizeof(tTrActionRef), cmpTrActionRef);
+	return 1;
+}
+
+
+/**
+ * Concatenates the passed strings into a single string allocated from the given arena.
+ * 
+ * @param[in,out] arena - allocate from this arena
+ * @param[out] len - receives the length of the result in bytes
+ * @param[in] ... - null-terminated strings; the list ends with NULL
+ * @return concatenated string or NULL on error
+ */
+static const char * concatToArena(tArena * arena, size_t * len, ...) {
+	va_list ap;
+	size_t total = 0;
+	const char * str;
+	char * res;
+	char * ptr;
+	va_start(ap, len);
+	while ((str = va_arg(ap, const char *)) != NULL) total += strlen(str);
+	va_end(ap);
+	res = (char *)ar_alloc(arena, total + 1);
+	if (res == NULL) return NULL;
+	ptr = res;
+	va_start(ap, len);
+	while ((str = va_arg(ap, const char *)) != NULL) {
+		const size_t strLen = strlen(str);
+		memcpy(ptr, str, strLen);
+		ptr += strLen;
+	}
+	va_end(ap);
+	*ptr = 0;
+	*len = total;
+	return res;
+}
+
+
+/**
+ * Builds the request template of the given action. The template is allocated from the arena of
+ * the object and kept until the object is freed.
+ * 
+ * @param[in,out] obj - object of the action
+ * @param[in] service - service of the action
+ * @param[in,out] action - build the template for this action
+ * @return 1 on success, else 0
+ */
+static int buildRequestTemplate(tTrObject * obj, const tTrService * service, tTrAction * action) {
 	static const char * head =
 		"<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
 		"<s:Envelope s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\" xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">\n"
@@ -2789,41 +5066,94 @@ static int trQuery(tTrQueryHandler * qry, const tOptions * opt, int argIndex) {
 		"</s:Body>\n"
 		"</s:Envelope>"
 	;
-	if (qry == NULL || opt == NULL) return 0;
+	tArena * arena = &(obj->arena);
+	tTrRequestTemplate * tmpl = (tTrRequestTemplate *)ar_calloc(arena, 1, sizeof(tTrRequestTemplate));
+	if (tmpl == NULL) return 0;
+	tmpl->request = concatToArena(arena, &(tmpl->requestLen), "POST ", service->control, " HTTP/1.1\r\nHost: ", NULL);
+	tmpl->soap = concatToArena(arena, &(tmpl->soapLen), "SOAPAction: ", service->type, "#", action->name, "\r\nContent-Type: text/xml; charset=utf-8\r\nContent-Length: ", NULL);
+	tmpl->bodyHead = concatToArena(arena, &(tmpl->bodyHeadLen), head, "<u:", action->name, " xmlns:u=\"", service->type, "\">\n", NULL);
+	tmpl->bodyTail = concatToArena(arena, &(tmpl->bodyTailLen), "</u:", action->name, ">\n", tail, NULL);
+	if (tmpl->request == NULL || tmpl->soap == NULL || tmpl->bodyHead == NULL || tmpl->bodyTail == NULL) return 0;
+	for (size_t ar = 0; ar < action->length; ar++) {
+		if (action->arg[ar].dir == TAD_IN) tmpl->argCount++;
+	}
+	if (tmpl->argCount > 0) {
+		tTrRequestArg * item;
+		tmpl->arg = (tTrRequestArg *)ar_alloc(arena, sizeof(tTrRequestArg) * tmpl->argCount);
+		if (tmpl->arg == NULL) return 0;
+		item = tmpl->arg;
+		for (size_t ar = 0; ar < action->length; ar++) {
+			tTrArgument * arg = action->arg + ar;
+			if (arg->dir != TAD_IN) continue;
+			item->arg = arg;
+			item->open = concatToArena(arena, &(item->openLen), "<", arg->name, ">", NULL);
+			item->close = concatToArena(arena, &(item->closeLen), "</", arg->name, ">\n", NULL);
+			if (item->open == NULL || item->close == NULL) return 0;
+			item++;
+		}
+	}
+	action->request = tmpl;
+	return 1;
+}
+
+
+/**
+ * Selects the TR-064 action according to opt and sets its input argument values in the query values.
+ * 
+ * @param[in,out] qry - query handle
+ * @param[in] opt - query options
+ * @param[in] argIndex - first valid argument index
+ * @param[out] pService - selected service
+ * @param[out] pAction - selected action
+ * @return 1 on success, else 0
+ */
+static int trQueryPrepare(tTrQueryHandler * qry, const tOptions * opt, int argIndex, const tTrService ** pService, tTrAction ** pAction) {
 	tTr64RequestCtx * ctx = qry->ctx;
 	tTrObject * obj = qry->obj;
 	const tTrDevice * device = NULL;
 	const tTrService * service = NULL;
 	tTrAction * action = NULL;
+	const tTrRequestTemplate * tmpl;
 	const size_t deviceLen  = (opt->device != NULL)  ? strlen(opt->device)  : 0;
 	const size_t serviceLen = (opt->service != NULL) ? strlen(opt->service) : 0;
-	const size_t actionLen  = (opt->action != NULL)  ? strlen(opt->action)  : 0;
+	const char * actionName = (opt->action != NULL) ? opt->action : "";
+	const size_t actionLen  = strlen(actionName);
+	size_t first, last;
 	int res = 0;
-	int fmt;
 	
 	/* select the matching action description */
 	if (obj->device == NULL) {
 		if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_DEV_IN_DESC));
 		goto onError;
 	}
-	for (size_t d = 0; d < obj->length; d++) {
-		const tTrDevice * dev = obj->device + d;
-		if (dev->service == NULL || (opt->device != NULL && strncmp(dev->name, opt->device, deviceLen) != 0)) continue;
-		for (size_t s = 0; s < dev->length; s++) {
-			const tTrService * srvc = dev->service + s;
-			if (srvc->action == NULL || (opt->service != NULL && strncmp(srvc->name, opt->service, serviceLen) != 0)) continue;
-			for (size_t ac = 0; ac < srvc->length; ac++) {
-				tTrAction * act = srvc->action + ac;
-				if (act == NULL || (opt->action != NULL && strncmp(act->name, opt->action, actionLen) != 0)) continue;
-				if (action == NULL) {
-					device = dev;
-					service = srvc;
-					action = act;
-				} else {
-					if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_OPT_ACTION_AMB));
-					goto onError;
-				}
-			}
+	/* fetch pending service descriptions which may contain the action */
+	if (fetchServiceDescs(ctx, obj, opt, PCF_MAX(opt->jobs, 1)) != 1) goto onError;
+	if (obj->index == NULL && buildActionIndex(obj) != 1) {
+		if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		goto onError;
+	}
+	/* all actions starting with the given name form a range beginning at its lower bound */
+	first = 0;
+	last = obj->indexLength;
+	while (first < last) {
+		const size_t mid = first + ((last - first) >> 1);
+		if (strcmp(obj->index[mid].name, actionName) < 0) {
+			first = mid + 1;
+		} else {
+			last = mid;
+		}
+	}
+	for (size_t i = first; i < obj->indexLength && strncmp(obj->index[i].name, actionName, actionLen) == 0; i++) {
+		const tTrActionRef * ref = obj->index + i;
+		if (opt->device != NULL && strncmp(ref->device->name, opt->device, deviceLen) != 0) continue;
+		if (opt->service != NULL && strncmp(ref->service->name, opt->service, serviceLen) != 0) continue;
+		if (action == NULL) {
+			device = ref->device;
+			service = ref->service;
+			action = ref->action;
+		} else {
+			if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_OPT_ACTION_AMB));
+			goto onError;
 		}
 	}
 	if (service == NULL || action == NULL) {
@@ -2833,13 +5163,21 @@ static int trQuery(tTrQueryHandler * qry, const tOptions * opt, int argIndex) {
 	if (opt->verbose > 3) {
 		fuprintf(ferr, MSGU(MSGU_DBG_SELECTED_QUERY), device->name, service->name, action->name);
 	}
+	if (resetArgValues(&(qry->values), action) != 1) {
+		if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		goto onError;
+	}
+	if (action->request == NULL && buildRequestTemplate(obj, service, action) != 1) {
+		if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		goto onError;
+	}
+	tmpl = action->request;
 	
-	/* check input parameters and build request SOAP action */
-	qry->length = 0;
-	fmt = formatToQryBuffer(qry, "%s<u:%s xmlns:u=\"%s\">\n", head, action->name, service->type);
-	for (size_t ar = 0; ar < action->length; ar++) {
-		tTrArgument * arg = action->arg + ar;
-		if (strcmp(arg->dir, "in") != 0) continue;
+	/* check input parameters */
+	for (size_t ar = 0; ar < tmpl->argCount; ar++) {
+		const tTrRequestArg * item = tmpl->arg + ar;
+		const tTrArgument * arg = item->arg;
+		const size_t index = (size_t)(arg - action->arg);
 		int ok = 0;
 		for (int i = argIndex; i < opt->argCount; i++) {
 			char * sep = strchr(opt->args[i], '=');
@@ -2852,20 +5190,16 @@ static int trQuery(tTrQueryHandler * qry, const tOptions * opt, int argIndex) {
 					goto onError;
 				}
 				ok = 1;
-				/* replace value in argument */
-				if (arg->value != NULL) free(arg->value);
-				arg->value = strdup(sep + 1);
-				if (arg->value == NULL) {
-					if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-					goto onError;
-				}
-				/* XML escape value */
-				if (p_escapeXmlVar(&(arg->value)) != 1) {
-					if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-					goto onError;
+				/* replace value in argument (XML escaped) */
+				{
+					char * escValue = p_escapeXml(sep + 1, (size_t)-1);
+					const int set = (escValue != NULL) ? setArgValue(&(qry->values), index, escValue) : 0;
+					if (escValue != NULL && escValue != sep + 1) free(escValue);
+					if (set != 1) {
+						if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+						goto onError;
+					}
 				}
-				/* format argument */
-				fmt &= formatToQryBuffer(qry, "<%s>%s</%s>\n", arg->name, arg->value, arg->name);
 			}
 			*sep = '=';
 		}
@@ -2874,69 +5208,148 @@ static int trQuery(tTrQueryHandler * qry, const tOptions * opt, int argIndex) {
 			goto onError;
 		}
 	}
-	fmt &= formatToQryBuffer(qry, "</u:%s>\n%s", action->name, tail);
 	
-	if (fmt != 1) {
-		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_FMT_QUERY));
-		goto onError;
-	}
+	*pService = service;
+	*pAction = action;
+	res = 1;
+onError:
+	return res;
+}
+
+
+/**
+ * Appends the HTTP request for the given action to the request fragments of the query handle
+ * context. The request is spliced together from the request template of the action and the input
+ * argument values set by trQueryPrepare() without copying them. Only the authorization field and
+ * the content length are kept in the query buffer. It is authorized preemptively if an
+ * authentication challenge was received before.
+ * 
+ * @param[in,out] qry - query handle
+ * @param[in] service - service of the action
+ * @param[in] action - action to request
+ * @return 1 on success, else 0
+ * @remarks The referenced data needs to remain unchanged until the request completed.
+ */
+static int trQueryFormat(tTrQueryHandler * qry, const tTrService * service, const tTrAction * action) {
+	static const char fields[] =
+		"\r\n"
+		"Connection: keep-alive\r\n"
+		"Accept: */*\r\n"
+		"User-Agent: tr64c " PROGRAM_VERSION_STR "\r\n"
+	;
+	static const char end[] = "\r\n\r\n";
+	tTr64RequestCtx * ctx = qry->ctx;
+	tTr64Fragments * list = &(ctx->fragments);
+	const tTrRequestTemplate * tmpl = action->request;
+	const size_t first = list->length;
+	const size_t firstSize = list->size;
+	char num[24];
+	size_t numPos = sizeof(num);
+	size_t value, authLen;
+	int res = 0;
+	int fmt;
 	
-onAuthentication:
-	/* build HTTP request */
-	ctx->length = 0;
-	fmt = formatToCtxBuffer(
-		ctx,
-		req,
-		service->control,
-		ctx->host,
-		ctx->port,
-		PROGRAM_VERSION_STR,
-		(ctx->auth != NULL) ? ctx->auth : "",
-		service->type,
-		action->name,
-		(unsigned)(qry->length),
-		(unsigned)(qry->length),
-		qry->buffer
-	);
-	if (fmt != 1) {
+	if (tmpl == NULL || qry->values.action != action) {
 		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_FMT_QUERY));
 		goto onError;
 	}
 	
-	/* set method */
-	if (ctx->method != NULL) free(ctx->method);
-	ctx->method = strdup("POST");
-	if (ctx->method == NULL) {
-		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-		goto onError;
+	/* content length */
+	value = tmpl->bodyHeadLen + tmpl->bodyTailLen;
+	for (size_t ar = 0; ar < tmpl->argCount; ar++) {
+		const tTrRequestArg * item = tmpl->arg + ar;
+		value += item->openLen + qry->values.value[item->arg - action->arg].token.length + item->closeLen;
 	}
+	do {
+		num[--numPos] = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value > 0);
 	
-	/* set path */
-	if (ctx->path != NULL) free(ctx->path);
-	ctx->path = strdup(service->control);
-	if (ctx->path == NULL) {
-		if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
-		goto onError;
+	/* set method (kept from the previous request if unchanged) */
+	if (ctx->method == NULL || strcmp(ctx->method, "POST") != 0) {
+		if (ctx->method != NULL) free(ctx->method);
+		ctx->method = strdup("POST");
+		if (ctx->method == NULL) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+			goto onError;
+		}
 	}
 	
-	/* send HTTP request to server and receive response */
-	if (ctx->request(ctx) != 1) {
-		if (ctx->status == 401 && ctx->auth != NULL) {
-			/* retry with proper authentication */
-			goto onAuthentication;
-		} else {
-			if (ctx->verbose > 0) {
-				const tHttpStatusMsg * item = (const tHttpStatusMsg *)bs_staticArray(&(ctx->status), httpStatMsg, cmpHttpStatusMsg);
-				if (item != NULL) {
-					_ftprintf(ferr, MSGT(MSGT_ERR_GET_QUERY_RESP_STR), (unsigned)(ctx->status), item->string);
-				} else  {
-					_ftprintf(ferr, MSGT(MSGT_ERR_GET_QUERY_RESP), (unsigned)(ctx->status));
-				}
-			}
+	/* set path (kept from the previous request if unchanged) */
+	if (ctx->path == NULL || strcmp(ctx->path, service->control) != 0) {
+		if (ctx->path != NULL) free(ctx->path);
+		ctx->path = strdup(service->control);
+		if (ctx->path == NULL) {
+			if (ctx->verbose > 1) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
 			goto onError;
 		}
 	}
 	
+	/* authorize preemptively with the nonce of the last challenge */
+	if (ctx->auth == NULL && ctx->nonce != NULL) {
+		if (httpAuthorization(ctx) != 1) goto onError;
+		ctx->preAuth = 1;
+	}
+	
+	/* keep the variable header parts in the query buffer (ctx->auth is released once sent) */
+	authLen = (ctx->auth != NULL) ? strlen(ctx->auth) : 0;
+	qry->length = 0;
+	fmt = appendToBuffer(&(qry->buffer), &(qry->capacity), &(qry->length), ctx->auth, authLen);
+	fmt &= appendToBuffer(&(qry->buffer), &(qry->capacity), &(qry->length), num + numPos, sizeof(num) - numPos);
+	
+	/* build HTTP request */
+	fmt &= appendFragment(list, tmpl->request, tmpl->requestLen);
+	fmt &= appendFragment(list, ctx->host, strlen(ctx->host));
+	fmt &= appendFragment(list, ":", 1);
+	fmt &= appendFragment(list, ctx->port, strlen(ctx->port));
+	fmt &= appendFragment(list, fields, sizeof(fields) - 1);
+	if (fmt == 1) {
+		/* authorization field goes in here */
+		fmt &= appendFragment(list, qry->buffer, authLen);
+		fmt &= appendFragment(list, tmpl->soap, tmpl->soapLen);
+		fmt &= appendFragment(list, qry->buffer + authLen, qry->length - authLen);
+	}
+	fmt &= appendFragment(list, end, sizeof(end) - 1);
+	
+	/* build request SOAP action */
+	fmt &= appendFragment(list, tmpl->bodyHead, tmpl->bodyHeadLen);
+	for (size_t ar = 0; ar < tmpl->argCount; ar++) {
+		const tTrRequestArg * item = tmpl->arg + ar;
+		const tPToken * token = &(qry->values.value[item->arg - action->arg].token);
+		fmt &= appendFragment(list, item->open, item->openLen);
+		fmt &= appendFragment(list, token->start, token->length);
+		fmt &= appendFragment(list, item->close, item->closeLen);
+	}
+	fmt &= appendFragment(list, tmpl->bodyTail, tmpl->bodyTailLen);
+	if (fmt != 1) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_FMT_QUERY));
+		goto onError;
+	}
+	
+	res = 1;
+onError:
+	if (res != 1) {
+		/* drop the fragments of the incomplete request */
+		list->length = first;
+		list->size = firstSize;
+	}
+	return res;
+}
+
+
+/**
+ * Parses the TR-064 SOAP response received within the context of the query handle and sets the
+ * output argument values in the query values of the handle accordingly.
+ * 
+ * @param[in,out] qry - query handle
+ * @param[in] service - service of the action
+ * @param[in] action - requested action
+ * @return 1 on success, else 0
+ */
+static int trQueryParse(tTrQueryHandler * qry, const tTrService * service, const tTrAction * action) {
+	tTr64RequestCtx * ctx = qry->ctx;
+	int res = 0;
+	
 	/* parse response */
 	{
 		if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_PARSE_QUERY_RESP));
@@ -2944,6 +5357,7 @@ onAuthentication:
 			/* .xmlPath      = */ {{0}},
 			/* .soapNs       = */ {0},
 			/* .userNs       = */ {0},
+			/* .values       = */ &(qry->values),
 			/* .service      = */ service,
 			/* .action       = */ action,
 			/* .content      = */ {0},
@@ -2968,6 +5382,58 @@ onAuthentication:
 		}
 	}
 	
+	
+	res = 1;
+onError:
+	return res;
+}
+
+
+/**
+ * Outputs the error message for a failed query request according to the HTTP status.
+ * 
+ * @param[in] ctx - context of the failed request
+ */
+static void trQueryPrintError(const tTr64RequestCtx * ctx) {
+	if (ctx->verbose > 0) {
+		const tHttpStatusMsg * item = (const tHttpStatusMsg *)bs_staticArray(&(ctx->status), httpStatMsg, cmpHttpStatusMsg);
+		if (item != NULL) {
+			_ftprintf(ferr, MSGT(MSGT_ERR_GET_QUERY_RESP_STR), (unsigned)(ctx->status), item->string);
+		} else  {
+			_ftprintf(ferr, MSGT(MSGT_ERR_GET_QUERY_RESP), (unsigned)(ctx->status));
+		}
+	}
+}
+
+
+/**
+ * Sends the TR-064 SOAP request prepared by trQueryPrepare() and prints the result to fout.
+ * 
+ * @param[in,out] qry - query handle
+ * @param[in] service - service of the action
+ * @param[in] action - action to request
+ * @return 1 on success, else 0
+ */
+static int trQueryRequest(tTrQueryHandler * qry, const tTrService * service, const tTrAction * action) {
+	tTr64RequestCtx * ctx = qry->ctx;
+	int res = 0;
+	
+onAuthentication:
+	if (trQueryFormat(qry, service, action) != 1) goto onError;
+	
+	/* send HTTP request to server and receive response */
+	if (ctx->request(ctx) != 1) {
+		if (ctx->status == 401 && ctx->auth != NULL) {
+			/* retry with proper authentication */
+			goto onAuthentication;
+		} else {
+			trQueryPrintError(ctx);
+			goto onError;
+		}
+	}
+	
+	if (trQueryParse(qry, service, action) != 1) goto onError;
+	
 	/* output result (possible errors are printed by the called function) */
 	if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_OUT_QUERY_RESP));
 	if (qry->output(fout, qry, action) != 1) goto onError;
@@ -2978,6 +5444,24 @@ onError:
 }
 
 
+/**
+ * Queries a TR-064 SOAP request according to opt and prints the result to fout.
+ * 
+ * @param[in,out] qry - query handle
+ * @param[in] opt - query options
+ * @param[in] argIndex - first valid argument index
+ * @return 1 on success, else 0
+ */
+static int trQuery(tTrQueryHandler * qry, const tOptions * opt, int argIndex) {
+	if (qry == NULL || opt == NULL) return 0;
+	const tTrService * service = NULL;
+	tTrAction * action = NULL;
+	
+	if (trQueryPrepare(qry, opt, argIndex, &service, &action) != 1) return 0;
+	return trQueryRequest(qry, service, action);
+}
+
+
 /**
  * Creates a new TR-064 query handler.
  * Use ctx->resolve() before calling qry->query().
@@ -3005,6 +5489,9 @@ tTrQueryHandler * newTrQueryHandler(tTr64RequestCtx * ctx, tTrObject * obj, cons
 	qry->obj = obj;
 	qry->query = trQuery;
 	qry->output = writer[opt->format];
+	qry->name = NULL;
+	qry->device = NULL;
+	memset(&(qry->values), 0, sizeof(qry->values));
 	if (arrayFieldInit(qry, buffer, BUFFER_SIZE) != 1) {
 		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
 		goto onError;
@@ -3025,6 +5512,7 @@ onError:
 void freeTrQueryHandler(tTrQueryHandler * qry) {
 	if (qry == NULL) return;
 	if (qry->buffer != NULL) free(qry->buffer);
+	ar_free(&(qry->values.arena));
 	free(qry);
 }
 
@@ -3221,8 +5709,8 @@ static int iParseCmdLineToOpts(char * line, tOptions * opt) {
 		}
 		ptr++;
 	}
-	if (out != line && *out != 0) {
-		/* end of last field */
+	if (out != line && (start != NULL || *out != 0)) {
+		/* end of last field (the line may end without line-feed) */
 		opt->argCount++;
 		*out++ = 0; /* null-terminate previous field */
 	}
@@ -3290,6 +5778,7 @@ int handleQuery(tOptions * opt) {
 	
 	ctx = newTr64Request(opt->url, opt->user, opt->pass, opt->format, opt->timeout, opt->verbose);
 	if (ctx == NULL) goto onError;
+	readAuthSession(ctx, opt->cache, opt->url);
 	if (ctx->resolve(ctx) != 1) goto onError;
 	obj = newTrObject(ctx, opt);
 	if (obj == NULL) goto onError;
@@ -3301,7 +5790,10 @@ int handleQuery(tOptions * opt) {
 onError:
 	if (qry != NULL) freeTrQueryHandler(qry);
 	if (obj != NULL) freeTrObject(obj);
-	if (ctx != NULL) freeTr64Request(ctx);
+	if (ctx != NULL) {
+		writeAuthSession(ctx, opt->cache, opt->url);
+		freeTr64Request(ctx);
+	}
 	return res;
 }
 
@@ -3402,7 +5894,7 @@ static int trListOutputText(tTr64RequestCtx * ctx, const tTrObject * obj) {
 				if (action->arg == NULL) continue;
 				for (size_t ar = 0; ar < action->length; ar++) {
 					const tTrArgument * arg = action->arg + ar;
-					ok &= formatToCtxBuffer(ctx, "        [%s] %s : %s\n", arg->dir, arg->var, arg->type);
+					ok &= formatToCtxBuffer(ctx, "        [%s] %s : %s\n", getArgDirName(arg->dir), arg->var, arg->type);
 				}
 			}
 		}
@@ -3468,7 +5960,7 @@ static int trListOutputCsv(tTr64RequestCtx * ctx, const tTrObject * obj) {
 				for (size_t ar = 0; ar < action->length; ar++) {
 					const tTrArgument * arg = action->arg + ar;
 					ESC(Var, arg->var)
-					ESC(Dir, arg->dir)
+					ESC(Dir, getArgDirName(arg->dir))
 					ESC(Type, arg->type)
 					ok &= formatToCtxBuffer(ctx, "\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\"\n", escObject, escDevice, escService, escAction, escVar, escDir, escType);
 				}
@@ -3545,7 +6037,7 @@ static int trListOutputJson(tTr64RequestCtx * ctx, const tTrObject * obj) {
 							for (size_t ar = 0; ar < action->length; ar++) {
 								const tTrArgument * arg = action->arg + ar;
 								ESC(Var, arg->var)
-								ESC(Dir, arg->dir)
+								ESC(Dir, getArgDirName(arg->dir))
 								ESC(Type, arg->type)
 								ok &= formatToCtxBuffer(ctx, "        {\"Var\":\"%s\", \"Dir\":\"%s\", \"Type\":\"%s\"}%s\n", escVar, escDir, escType, ((ar + 1) < action->length) ? "," : "");
 							}
@@ -3629,7 +6121,7 @@ static int trListOutputXml(tTr64RequestCtx * ctx, const tTrObject * obj) {
 							for (size_t ar = 0; ar < action->length; ar++) {
 								const tTrArgument * arg = action->arg + ar;
 								ESC(Var, arg->var)
-								ESC(Dir, arg->dir)
+								ESC(Dir, getArgDirName(arg->dir))
 								ESC(Type, arg->type)
 								ok &= formatToCtxBuffer(ctx, "        <Var name=\"%s\" dir=\"%s\" type=\"%s\"/>\n", escVar, escDir, escType);
 							}
@@ -3686,6 +6178,7 @@ int handleList(tOptions * opt) {
 	if (ctx->resolve(ctx) != 1) goto onError;
 	obj = newTrObject(ctx, opt);
 	if (obj == NULL) goto onError;
+	if (fetchServiceDescs(ctx, obj, NULL, opt->jobs) != 1) goto onError;
 	
 	ctx->length = 0;
 	if (obj->device == NULL) {
@@ -3723,6 +6216,7 @@ int handleInteractive(tOptions * opt) {
 	
 	ctx = newTr64Request(opt->url, opt->user, opt->pass, opt->format, opt->timeout, opt->verbose);
 	if (ctx == NULL) goto onError;
+	readAuthSession(ctx, opt->cache, opt->url);
 	if (ctx->resolve(ctx) != 1) goto onError;
 	obj = newTrObject(ctx, opt);
 	if (obj == NULL) goto onError;
@@ -3747,6 +6241,8 @@ int handleInteractive(tOptions * opt) {
 		} else if (feof(fin) || strncmp(opt->args[0], "EXIT", strlen(opt->args[0])) == 0) {
 			break;
 		} else if (strncmp(opt->args[0], "LIST", strlen(opt->args[0])) == 0) {
+			if (fetchServiceDescs(ctx, obj, NULL, opt->jobs) != 1) continue;
+			ctx->length = 0;
 			listOutput[opt->format](ctx, obj);
 		} else if (strncmp(opt->args[0], "QUERY", strlen(opt->args[0])) == 0) {
 			if (opt->argCount < 2) {
@@ -3771,6 +6267,664 @@ onError:
 	freeGetLine(line);
 	if (qry != NULL) freeTrQueryHandler(qry);
 	if (obj != NULL) freeTrObject(obj);
-	if (ctx != NULL) freeTr64Request(ctx);
+	if (ctx != NULL) {
+		writeAuthSession(ctx, opt->cache, opt->url);
+		freeTr64Request(ctx);
+	}
+	return res;
+}
+
+
+/**
+ * Callback function for requestPipelined() which parses and outputs the response of the next batch
+ * query.
+ * 
+ * @param[in,out] ctx - context of the received response
+ * @param[in] result - 1 if the request succeeded, else 0
+ * @param[in,out] param - batch context (tTrBatchCtx)
+ * @return 0 to stop, 1 to continue with the next response
+ */
+static int batchQueryVisitor(tTr64RequestCtx * ctx, const int result, void * param) {
+	tTrBatchCtx * batch = (tTrBatchCtx *)param;
+	tTrBatchQuery * item = batch->query + batch->next;
+	int ok = 0;
+	if (result != 1 && ctx->status == 401 && ctx->auth != NULL) {
+		/* send this and the following queries one by one with the new challenge */
+		free(ctx->auth);
+		ctx->auth = NULL;
+		return 0;
+	}
+	batch->next++;
+	if (result != 1) {
+		/* status 0: the request was sent but the pipeline broke off (reported by requestPipelined()) */
+		if (ctx->status != 0) trQueryPrintError(ctx);
+	} else if (trQueryParse(item->qry, item->service, item->action) == 1) {
+		if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_OUT_QUERY_RESP));
+		ok = item->qry->output(fout, item->qry, item->action);
+	}
+	if (ok != 1 && trQueryOutputBatch(fout, item->qry, NULL) != 1) {
+		batch->error = 1;
+		return 0;
+	}
+	return 1;
+}
+
+
+/**
+ * Sends the prepared batch queries and outputs their results in order. Multiple queries are sent
+ * at once over a single connection (HTTP/1.1 pipelining). If the pipeline breaks off, the queries
+ * which were not sent completely are sent one by one. The others are output as failed as they may
+ * have been performed already.
+ * 
+ * @param[in,out] ctx - context to use
+ * @param[in,out] batch - batch context
+ * @return 1 on success, else 0
+ */
+static int trBatchQueries(tTr64RequestCtx * ctx, tTrBatchCtx * batch) {
+	batch->next = 0;
+	if (batch->count > 1) {
+		/* queue the request fragments back to back */
+		size_t queued = 0;
+		for (; queued < batch->count; queued++) {
+			const tTrBatchQuery * item = batch->query + queued;
+			if (trQueryFormat(item->qry, item->service, item->action) != 1) break;
+			batch->end[queued] = ctx->fragments.size;
+			if (ctx->auth != NULL) {
+				/* each request is authorized with its own nonce count */
+				free(ctx->auth);
+				ctx->auth = NULL;
+			}
+		}
+		if (queued == batch->count) requestPipelined(ctx, batch->count, batch->end, batchQueryVisitor, batch);
+		/* drop the queued fragments if not sent */
+		ctx->fragments.length = 0;
+		ctx->fragments.size = 0;
+		if (batch->error != 0) return 0;
+	}
+	for (; batch->next < batch->count && signalReceived == 0; batch->next++) {
+		tTrBatchQuery * item = batch->query + batch->next;
+		ctx->status = 0;
+		ctx->duration = (size_t)-1;
+		if (trQueryRequest(item->qry, item->service, item->action) != 1) {
+			if (trQueryOutputBatch(fout, item->qry, NULL) != 1) return 0;
+		}
+	}
+	batch->count = 0;
+	fflush(fout);
+	return 1;
+}
+
+
+/**
+ * Process the TR-064 queries from the given batch file. The device description is only retrieved
+ * once and the connection is kept open between the queries. Each query line has the format
+ * [device/]service/action [<variable=value> ...]. Empty lines and lines starting with # are ignored.
+ * Consecutive queries from a batch file are sent together (see trBatchQueries()). Queries from the
+ * standard input are sent as soon as their line was read.
+ * 
+ * @param[in,out] opt - given options
+ * @return 1 on success, else 0
+ */
+int handleBatch(tOptions * opt) {
+	if (opt->mode != M_BATCH) return 0;
+	tTr64RequestCtx * ctx = NULL;
+	tTrObject * obj = NULL;
+	tTrBatchCtx batch[1] = {0};
+	tReadLineBuf line[1] = {0};
+	FILE * fd = NULL;
+	int narrow = 1;
+	int len, res = 0;
+	
+	if (opt->batch == NULL || _tcscmp(opt->batch, _T("-")) == 0) {
+		fd = fin;
+		batch->depth = 1;
+#ifdef UNICODE
+		narrow = opt->narrow;
+#endif /* UNICODE */
+	} else {
+		fd = _tfopen(opt->batch, _T("r"));
+		if (fd == NULL) {
+			if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_BATCH_OPEN));
+			goto onError;
+		}
+		batch->depth = PIPELINE_DEPTH;
+	}
+	
+	ctx = newTr64Request(opt->url, opt->user, opt->pass, opt->format, opt->timeout, opt->verbose);
+	if (ctx == NULL) goto onError;
+	readAuthSession(ctx, opt->cache, opt->url);
+	if (ctx->resolve(ctx) != 1) goto onError;
+	obj = newTrObject(ctx, opt);
+	if (obj == NULL) goto onError;
+	batch->query = (tTrBatchQuery *)calloc(batch->depth, sizeof(tTrBatchQuery));
+	batch->end = (size_t *)calloc(batch->depth, sizeof(size_t));
+	if (batch->query == NULL || batch->end == NULL) {
+		if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		goto onError;
+	}
+	for (size_t i = 0; i < batch->depth; i++) {
+		tTrBatchQuery * item = batch->query + i;
+		item->qry = newTrQueryHandler(ctx, obj, opt);
+		if (item->qry == NULL) goto onError;
+		item->qry->output = trQueryOutputBatch;
+	}
+	
+	while (signalReceived == 0) {
+		len = getLineUtf8(line, fd, narrow);
+		if (len < 0) goto onError;
+		if (len == 0) break; /* end of file */
+		/* remove line ending */
+		for (char * ch = line->str; *ch != 0; ch++) {
+			if (*ch == '\r' || *ch == '\n') {
+				*ch = 0;
+				break;
+			}
+		}
+		{
+			const char * ch = line->str;
+			while (isblank(*ch) != 0) ch++;
+			if (*ch == 0 || *ch == '#') continue;
+		}
+		tTrBatchQuery * item = batch->query + batch->count;
+		/* keep the escaped query line for the output as the command-line parser modifies it */
+		if (item->name != NULL) free(item->name);
+		item->name = escapeJson(line->str, (size_t)-1);
+		if (item->name == line->str) item->name = strdup(line->str);
+		if (item->name == NULL) {
+			if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+			goto onError;
+		}
+		item->qry->name = item->name;
+		ctx->status = 0;
+		ctx->duration = (size_t)-1;
+		/* prepare query (possible errors are printed by the called functions) */
+		if (iParseCmdLineToOpts(line->str, opt) != 1 || opt->argCount <= 0 || parseActionPath(opt, 0) != 1 || opt->action == NULL) {
+			if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_BAD_CMD));
+		} else if (trQueryPrepare(item->qry, opt, 1, &(item->service), &(item->action)) == 1) {
+			batch->count++;
+			if (batch->count >= batch->depth && trBatchQueries(ctx, batch) != 1) goto onError;
+			continue;
+		}
+		/* output the failed query after the prepared ones */
+		{
+			const size_t status = ctx->status;
+			const size_t duration = ctx->duration;
+			if (trBatchQueries(ctx, batch) != 1) goto onError;
+			ctx->status = status;
+			ctx->duration = duration;
+		}
+		if (trQueryOutputBatch(fout, item->qry, NULL) != 1) goto onError;
+		fflush(fout);
+	}
+	if (trBatchQueries(ctx, batch) != 1) goto onError;
+	
+	res = 1;
+onError:
+	freeGetLine(line);
+	if (fd != NULL && fd != fin) fclose(fd);
+	if (batch->query != NULL) {
+		for (size_t i = 0; i < batch->depth; i++) {
+			tTrBatchQuery * item = batch->query + i;
+			if (item->qry != NULL) freeTrQueryHandler(item->qry);
+			if (item->name != NULL) free(item->name);
+		}
+		free(batch->query);
+	}
+	if (batch->end != NULL) free(batch->end);
+	if (obj != NULL) freeTrObject(obj);
+	if (ctx != NULL) {
+		writeAuthSession(ctx, opt->cache, opt->url);
+		freeTr64Request(ctx);
+	}
+	return res;
+}
+
+
+/**
+ * Frees the given lines read by readPollLines().
+ * 
+ * @param[in,out] lines - lines to free
+ * @param[in] count - number of lines
+ */
+static void freePollLines(tTrPollLine * lines, const size_t count) {
+	if (lines == NULL) return;
+	for (size_t i = 0; i < count; i++) {
+		tOptions * opt = &(lines[i].opt);
+		if (opt->args != NULL) {
+			for (int j = 0; j < opt->argCount; j++) {
+				if (opt->args[j] != NULL) free(opt->args[j]);
+			}
+			free(opt->args);
+		}
+		if (opt->device != NULL) free(opt->device);
+		if (opt->service != NULL) free(opt->service);
+		if (opt->action != NULL) free(opt->action);
+		if (lines[i].name != NULL) free(lines[i].name);
+	}
+	free(lines);
+}
+
+
+/**
+ * Reads all lines from the given file and splits each into its arguments like the interactive
+ * mode does. Empty lines and lines starting with # are ignored.
+ * 
+ * @param[in] path - read from this file or standard input if "-"
+ * @param[in] opt - global options
+ * @param[in] openError - message to output if the file could not be opened
+ * @param[out] lines - allocated lines (see freePollLines())
+ * @param[out] count - number of lines
+ * @return 1 on success, else 0
+ */
+static int readPollLines(const TCHAR * path, const tOptions * opt, const tMessage openError, tTrPollLine ** lines, size_t * count) {
+	tReadLineBuf line[1] = {0};
+	tTrPollLine * res = NULL;
+	size_t capacity = 0, length = 0;
+	FILE * fd = NULL;
+	int narrow = 1;
+	int len, ok = 0;
+	
+	if (_tcscmp(path, _T("-")) == 0) {
+		fd = fin;
+#ifdef UNICODE
+		narrow = opt->narrow;
+#endif /* UNICODE */
+	} else {
+		fd = _tfopen(path, _T("r"));
+		if (fd == NULL) {
+			if (opt->verbose > 0) _ftprintf(ferr, MSGT(openError));
+			goto onError;
+		}
+	}
+	
+	while (signalReceived == 0) {
+		len = getLineUtf8(line, fd, narrow);
+		if (len < 0) goto onError;
+		if (len == 0) break; /* end of file */
+		/* remove line ending */
+		for (char * ch = line->str; *ch != 0; ch++) {
+			if (*ch == '\r' || *ch == '\n') {
+				*ch = 0;
+				break;
+			}
+		}
+		{
+			const char * ch = line->str;
+			while (isblank(*ch) != 0) ch++;
+			if (*ch == 0 || *ch == '#') continue;
+		}
+		if (length >= capacity) {
+			const size_t newCapacity = PCF_MAX(INIT_ARRAY_SIZE, capacity * 2);
+			tTrPollLine * newRes = (tTrPollLine *)realloc(res, sizeof(*res) * newCapacity);
+			if (newRes == NULL) goto onOutOfMemory;
+			res = newRes;
+			capacity = newCapacity;
+		}
+		tTrPollLine * item = res + length;
+		memset(item, 0, sizeof(*item));
+		item->opt.verbose = opt->verbose;
+		length++;
+		/* keep the escaped line as the command-line parser modifies it */
+		item->name = escapeJson(line->str, (size_t)-1);
+		if (item->name == line->str) item->name = strdup(line->str);
+		if (item->name == NULL) goto onOutOfMemory;
+		if (iParseCmdLineToOpts(line->str, &(item->opt)) != 1) {
+			/* keep invalid lines without arguments to report them in order */
+			if (item->opt.args != NULL) {
+				for (int i = 0; i < item->opt.argCount; i++) {
+					if (item->opt.args[i] != NULL) free(item->opt.args[i]);
+				}
+				free(item->opt.args);
+				item->opt.args = NULL;
+			}
+			item->opt.argCount = 0;
+		}
+	}
+	
+	ok = 1;
+	goto onError;
+onOutOfMemory:
+	if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+onError:
+	freeGetLine(line);
+	if (fd != NULL && fd != fin) fclose(fd);
+	if (ok != 1) {
+		freePollLines(res, length);
+		return 0;
+	}
+	*lines = res;
+	*count = length;
+	return 1;
+}
+
+
+/**
+ * Outputs a failed result for all remaining queries of the given device and finishes it. Devices
+ * without query handler (e.g. due to an invalid URL) are output without status and duration.
+ * 
+ * @param[in,out] dev - device context
+ * @return 1 on success, else 0
+ */
+static int failPollDevice(tTrPollDevice * dev) {
+	for (; dev->query < dev->poll->queryCount; dev->query++) {
+		const char * name = dev->poll->query[dev->query].name;
+		if (dev->qry == NULL) {
+			/* same record as output by trQueryOutputBatch() for a failed query */
+			if (fuprintf(fout, "{\"device\":\"%s\",\"query\":\"%s\",\"status\":null,\"duration\":null,\"result\":null}\n", dev->device, (name != NULL) ? name : "") < 1) {
+				if (dev->poll->opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_QUERY_PRINT));
+				return 0;
+			}
+			continue;
+		}
+		dev->qry->name = name;
+		if (trQueryOutputBatch(fout, dev->qry, NULL) != 1) return 0;
+	}
+	dev->state = PS_DONE;
+	return 1;
+}
+
+
+/**
+ * Prepares the request for the next query of the given device in its context buffer. Queries
+ * which can not be prepared are output as failed.
+ * 
+ * @param[in,out] dev - device context
+ * @return 2 if a request was prepared, 1 if all queries have been performed, 0 on error
+ */
+static int startPollQuery(tTrPollDevice * dev) {
+	tTr64RequestCtx * ctx = dev->ctx;
+	for (; dev->query < dev->poll->queryCount; dev->query++) {
+		const tTrPollLine * query = dev->poll->query + dev->query;
+		dev->qry->name = query->name;
+		ctx->status = 0;
+		ctx->duration = (size_t)-1;
+		if (query->opt.action != NULL && trQueryPrepare(dev->qry, &(query->opt), 1, &(dev->service), &(dev->action)) == 1) {
+			if (trQueryFormat(dev->qry, dev->service, dev->action) == 1) return 2;
+		} else if (query->opt.action == NULL) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_BAD_CMD));
+		}
+		if (trQueryOutputBatch(fout, dev->qry, NULL) != 1) return 0;
+	}
+	dev->state = PS_DONE;
+	return 1;
+}
+
+
+/**
+ * Callback function for the request engine which processes the completed request of a device in
+ * poll mode. The device description is requested first, followed by the service descriptions and
+ * the queries.
+ * 
+ * @param[in,out] ctx - context of the completed request
+ * @param[in] result - 1 if the request succeeded, else 0
+ * @param[in,out] param - device context (tTrPollDevice)
+ * @return 0 to abort, 1 if the device is finished, 2 if the next request is pending
+ */
+static int pollDeviceVisitor(tTr64RequestCtx * ctx, const int result, void * param) {
+	tTrPollDevice * dev = (tTrPollDevice *)param;
+	const tTrDeviceDescEntry * shared;
+	char hash[33];
+	int next;
+	switch (dev->state) {
+	case PS_DEVICE_DESC:
+		if (result != 1) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_GET_DEV_DESC), (unsigned)(ctx->status));
+			return failPollDevice(dev);
+		}
+		if (ctx->verbose > 2) _ftprintf(ferr, MSGT(MSGT_INFO_DEV_DESC_DUR), (unsigned)(ctx->duration));
+		hashContent(ctx, hash);
+		if (setDescFingerprint(&(dev->obj->arena), ctx, hash, &(dev->obj->hash), &(dev->obj->etag), &(dev->obj->modified)) != 1) return failPollDevice(dev);
+		/* devices with identical device description share the parsed descriptions */
+		shared = findSharedDeviceDesc(&(dev->poll->registry), hash);
+		if (shared != NULL) {
+			if (ctx->verbose > 2) _ftprintf(ferr, MSGT(MSGT_INFO_DEV_DESC_SHARED));
+			if (copySharedDeviceDesc(dev->obj, shared) != 1) {
+				if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+				return failPollDevice(dev);
+			}
+			next = 1;
+			break;
+		}
+		if (parseDeviceDesc(ctx, dev->obj) != 1) return failPollDevice(dev);
+		dev->state = PS_SERVICE_DESC;
+		next = requestNextServiceDesc(&(dev->fetch), 0);
+		break;
+	case PS_SERVICE_DESC:
+		next = fetchServiceDescVisitor(ctx, result, &(dev->fetch));
+		break;
+	case PS_QUERY:
+		if (result != 1) {
+			if (ctx->status == 401 && ctx->auth != NULL) {
+				/* retry with proper authentication */
+				if (trQueryFormat(dev->qry, dev->service, dev->action) == 1) return 2;
+			} else {
+				trQueryPrintError(ctx);
+			}
+			if (trQueryOutputBatch(fout, dev->qry, NULL) != 1) return 0;
+		} else if (trQueryParse(dev->qry, dev->service, dev->action) == 1) {
+			if (ctx->verbose > 3) _ftprintf(ferr, MSGT(MSGT_DBG_OUT_QUERY_RESP));
+			if (dev->qry->output(fout, dev->qry, dev->action) != 1) return 0;
+		} else {
+			if (trQueryOutputBatch(fout, dev->qry, NULL) != 1) return 0;
+		}
+		dev->query++;
+		return startPollQuery(dev);
+	default:
+		return 1;
+	}
+	if (next == 0) return failPollDevice(dev);
+	if (next == 2) return 2;
+	/* all service descriptions have been received */
+	if (registerSharedDeviceDesc(&(dev->poll->registry), dev->obj) != 1) {
+		if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+		return failPollDevice(dev);
+	}
+	if (dev->cache != NULL) {
+		dev->obj->cacheFile = dev->cache;
+		writeTrObjectCache(ctx, dev->obj);
+		addCacheIndex(dev->poll->opt->cacheDir, dev->obj->url, ctx->verbose);
+	}
+	dev->state = PS_QUERY;
+	dev->query = 0;
+	return startPollQuery(dev);
+}
+
+
+/**
+ * Frees the resources of the given device context. The authentication session is stored first.
+ * 
+ * @param[in,out] dev - device context
+ */
+static void freePollDevice(tTrPollDevice * dev) {
+	if (dev->ctx != NULL) writeAuthSession(dev->ctx, dev->cache, dev->target->opt.args[0]);
+	if (dev->qry != NULL) freeTrQueryHandler(dev->qry);
+	if (dev->obj != NULL) freeTrObject(dev->obj);
+	if (dev->cache != NULL) free(dev->cache);
+	if (dev->ctx != NULL) freeTr64Request(dev->ctx);
+	if (dev->device != NULL && dev->device != dev->target->opt.args[0]) free(dev->device);
+	dev->qry = NULL;
+	dev->obj = NULL;
+	dev->cache = NULL;
+	dev->ctx = NULL;
+	dev->device = NULL;
+}
+
+
+/**
+ * Starts processing the given device by submitting its device description request to the engine.
+ * Devices found in the cache directory continue with their missing service descriptions or their
+ * first query instead.
+ * 
+ * @param[in,out] dev - device context
+ * @return 1 on success, else 0
+ */
+static int startPollDevice(tTrPollDevice * dev) {
+	const tOptions * opt = dev->poll->opt;
+	const tOptions * target = &(dev->target->opt);
+	const char * url = target->args[0];
+	tTr64RequestCtx * ctx;
+	
+	dev->state = PS_DONE;
+	dev->device = escapeJson(url, (size_t)-1);
+	if (dev->device == NULL) goto onOutOfMemory;
+	dev->ctx = newTr64Request(url, (target->argCount > 1) ? target->args[1] : opt->user, (target->argCount > 2) ? target->args[2] : opt->pass, opt->format, opt->timeout, opt->verbose);
+	if (dev->ctx == NULL) return failPollDevice(dev); /* errors are output by the called function */
+	ctx = dev->ctx;
+	if (opt->cacheDir != NULL) {
+		dev->cache = getCacheEntryPath(opt->cacheDir, url);
+		if (dev->cache == NULL) goto onOutOfMemory;
+		dev->obj = readTrObjectCache(dev->cache, url, opt->verbose);
+		readAuthSession(ctx, dev->cache, url);
+	}
+	if (dev->obj == NULL) {
+		dev->obj = (tTrObject *)calloc(1, sizeof(tTrObject));
+		if (dev->obj == NULL) goto onOutOfMemory;
+		dev->obj->url = ar_strdup(&(dev->obj->arena), url);
+		if (dev->obj->url == NULL) goto onOutOfMemory;
+	}
+	dev->qry = newTrQueryHandler(ctx, dev->obj, opt);
+	if (dev->qry == NULL) return 0;
+	dev->qry->output = trQueryOutputBatch;
+	dev->qry->device = dev->device;
+	/* service descriptions are fetched sequentially over the device connection */
+	dev->fetch.request = descRequest;
+	dev->fetch.object = dev->obj;
+	dev->fetch.registry = &(dev->poll->registry);
+	dev->fetch.ctxs = &(dev->ctx);
+	dev->fetch.pending = &(dev->pending);
+	dev->fetch.count = 1;
+	dev->query = 0;
+	dev->state = PS_DEVICE_DESC;
+	
+	if (ctx->resolve(ctx) != 1) return failPollDevice(dev);
+	if (dev->obj->name != NULL) {
+		/* the device description was read from the cache directory */
+		int next;
+		dev->state = PS_SERVICE_DESC;
+		next = requestNextServiceDesc(&(dev->fetch), 0);
+		if (next == 0) return failPollDevice(dev);
+		if (next != 2) {
+			dev->state = PS_QUERY;
+			next = startPollQuery(dev);
+			if (next != 2) return next;
+		}
+	} else {
+		ctx->length = 0;
+		if (formatToCtxBuffer(ctx, descRequest, ctx->path, ctx->host, ctx->port) != 1) {
+			if (ctx->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_FMT_DEV_DESC));
+			return failPollDevice(dev);
+		}
+		if (ctx->verbose > 3) {
+			fuprintf(ferr, MSGU(MSGU_INFO_DEV_DESC_REQ), ctx->path);
+		}
+	}
+	while (submitTr64Request(dev->poll->engine, ctx, pollDeviceVisitor, dev) != 1) {
+		const int next = pollDeviceVisitor(ctx, 0, dev);
+		if (next == 0) return 0;
+		if (next != 2) break;
+	}
+	return 1;
+onOutOfMemory:
+	if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+	return 0;
+}
+
+
+/**
+ * Queries all devices from the given device list concurrently. Up to opt->jobs devices are
+ * processed at the same time on a single thread. Each result is output as soon as it completes.
+ * 
+ * @param[in,out] opt - given options
+ * @return 1 on success, else 0
+ */
+int handlePoll(tOptions * opt) {
+	if (opt->mode != M_POLL) return 0;
+	tTrPollCtx poll = {0};
+	tTrPollLine * target = NULL;
+	tTrPollDevice * device = NULL;
+	size_t targetCount = 0;
+	size_t first = 0, next = 0, active = 0;
+	int res = 0;
+	
+	poll.opt = opt;
+	
+	/* read device list */
+	if (readPollLines(opt->devices, opt, MSGT_ERR_DEVICES_OPEN, &target, &targetCount) != 1) goto onError;
+	for (size_t i = 0; i < targetCount; i++) {
+		if (target[i].opt.argCount < 1 || target[i].opt.argCount > 3) {
+			if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_DEVICES_FMT));
+			goto onError;
+		}
+	}
+	
+	/* read queries */
+	if (opt->batch != NULL) {
+		if (readPollLines(opt->batch, opt, MSGT_ERR_BATCH_OPEN, &(poll.query), &(poll.queryCount)) != 1) goto onError;
+	} else {
+		if (opt->action == NULL) {
+			if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_OPT_NO_ACTION));
+			goto onError;
+		}
+		/* copy the query from the command-line */
+		poll.query = (tTrPollLine *)calloc(1, sizeof(tTrPollLine));
+		if (poll.query == NULL) goto onOutOfMemory;
+		poll.queryCount = 1;
+		poll.query->opt.verbose = opt->verbose;
+		poll.query->opt.args = (char **)calloc((size_t)(opt->argCount), sizeof(char *));
+		if (poll.query->opt.args == NULL) goto onOutOfMemory;
+		for (int i = 0; i < opt->argCount; i++, poll.query->opt.argCount++) {
+			poll.query->opt.args[i] = strdup(opt->args[i]);
+			if (poll.query->opt.args[i] == NULL) goto onOutOfMemory;
+		}
+		poll.query->name = escapeJson(opt->args[0], (size_t)-1);
+		if (poll.query->name == opt->args[0]) poll.query->name = strdup(opt->args[0]);
+		if (poll.query->name == NULL) goto onOutOfMemory;
+	}
+	for (size_t i = 0; i < poll.queryCount; i++) {
+		tOptions * query = &(poll.query[i].opt);
+		if (query->argCount > 0 && parseActionPath(query, 0) != 1) goto onOutOfMemory;
+	}
+	
+	device = (tTrPollDevice *)calloc(PCF_MAX(targetCount, 1), sizeof(tTrPollDevice));
+	if (device == NULL) goto onOutOfMemory;
+	poll.engine = newTr64Engine(opt->verbose);
+	if (poll.engine == NULL) goto onError;
+	
+	while (signalReceived == 0) {
+		/* start further devices up to the concurrency limit */
+		for (; active < opt->jobs && next < targetCount; next++, active++) {
+			device[next].poll = &poll;
+			device[next].target = target + next;
+			if (startPollDevice(device + next) != 1) goto onError;
+		}
+		if (pollTr64Engine(poll.engine, (size_t)-1, NULL) != 1) goto onError;
+		fflush(fout);
+		/* release finished devices */
+		active = 0;
+		for (size_t i = first; i < next; i++) {
+			if (device[i].state == PS_DONE) {
+				freePollDevice(device + i);
+				if (i == first) first++;
+			} else {
+				active++;
+			}
+		}
+		if (active == 0 && next >= targetCount) break;
+	}
+	
+	res = 1;
+	goto onError;
+onOutOfMemory:
+	if (opt->verbose > 0) _ftprintf(ferr, MSGT(MSGT_ERR_NO_MEM));
+onError:
+	if (poll.engine != NULL) freeTr64Engine(poll.engine);
+	if (device != NULL) {
+		for (size_t i = 0; i < next; i++) freePollDevice(device + i);
+		free(device);
+	}
+	/* the devices reference the shared descriptions */
+	ar_free(&(poll.registry.arena));
+	freePollLines(poll.query, poll.queryCount);
+	freePollLines(target, targetCount);
 	return res;
 }
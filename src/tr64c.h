@@ -2,7 +2,7 @@
  * @file tr64c.h
  * @author Daniel Starke
  * @date 2018-06-21
- * @version 2018-08-16
+ * @version 2026-10-16
  * @todo WinHTTP backend: https://social.msdn.microsoft.com/Forums/en-US/e141be2b-f621-4419-a6fb-8d86134f1f43/httpsendrequest-amp-internetreadfile-in-c?forum=vclanguage
  * 
  * DISCLAIMER
@@ -27,8 +27,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "bsearch.h"
 #include "cvutf8.h"
+#include "hmd5.h"
 #include "parser.h"
 #include "target.h"
 #include "tchar.h"
@@ -39,10 +41,30 @@
 #define MAX_RESPONSE_SIZE 0x100000
 
 
+/** Maximal size of a streamed description in bytes. Only the parser state is kept in memory. */
+#define MAX_DESC_SIZE 0x1000000
+
+
 /** Defines the default timeout for network operations in milliseconds. */
 #define DEFAULT_TIMEOUT 1000
 
 
+/** Defines the time in milliseconds after which an idle keep-alive connection is closed instead of re-used. */
+#define IDLE_TIMEOUT 5000
+
+
+/** Defines the maximum number of batch queries sent at once over a single connection. */
+#define PIPELINE_DEPTH 8
+
+
+/** Defines the default number of parallel connections to fetch service descriptions or poll devices. */
+#define DEFAULT_JOBS 4
+
+
+/** Defines the maximal number of parallel connections to fetch service descriptions or poll devices. */
+#define MAX_JOBS 256
+
+
 /** Defines the default protocol for TR-064. */
 #define DEFAULT_PROTOCOL "http"
 
@@ -63,6 +85,46 @@
 #define INIT_ARRAY_SIZE 8
 
 
+/** Binary cache file signature (including null-terminator). */
+#define CACHE_MAGIC "TR64C-C"
+
+
+/** Binary cache file format version. Increase this on incompatible changes. */
+#define CACHE_VERSION 3
+
+
+/** XML cache file format version. Increase this on incompatible changes. */
+#define XML_CACHE_VERSION "2"
+
+
+/** Binary cache service record flag for services whose description has not been fetched yet. */
+#define CACHE_SERVICE_PENDING 0x00000001
+
+
+/** Binary cache service record flag for services whose description needs to be revalidated. */
+#define CACHE_SERVICE_STALE 0x00000002
+
+
+/** Binary cache file byte order mark. Files with a different byte order are rejected. */
+#define CACHE_BYTE_ORDER 0x01020304
+
+
+/** File name extension of the cache files within a cache directory. */
+#define CACHE_ENTRY_EXT ".bin"
+
+
+/** Index file name within a cache directory. Each line maps a cache file name to its device URL. */
+#define CACHE_INDEX_FILE "index"
+
+
+/** Authentication session file signature line. */
+#define SESSION_MAGIC "TR64C-S 1"
+
+
+/** File name extension of the authentication session file which is stored next to the cache file. */
+#define SESSION_EXT _T(".auth")
+
+
 /** Maximal depth of a XML node path in number of nodes. */
 #define MAX_XML_DEPTH 16
 
@@ -105,7 +167,9 @@ typedef enum {
 	M_QUERY = 0,
 	M_SCAN,
 	M_LIST,
-	M_INTERACTIVE
+	M_INTERACTIVE,
+	M_BATCH,
+	M_POLL
 } tMode;
 
 
@@ -115,6 +179,7 @@ typedef enum {
 	MSGT_ERR_OPT_NO_ARG,
 	MSGT_ERR_OPT_BAD_FORMAT,
 	MSGT_ERR_OPT_BAD_TIMEOUT,
+	MSGT_ERR_OPT_BAD_JOBS,
 	MSGT_ERR_OPT_NO_SERVICE,
 	MSGT_ERR_OPT_NO_ACTION,
 	MSGT_ERR_OPT_NO_ACTION_ARG,
@@ -153,10 +218,15 @@ typedef enum {
 	MSGT_ERR_SOCK_SEND_SSDP_REQ,
 	MSGT_ERR_SOCK_LEAVE_MC_GROUP,
 	MSGT_ERR_SOCK_CONNECT,
+	MSGT_ERR_SOCK_CONNECT_TOUT,
 	MSGT_ERR_SOCK_SEND_TOUT,
 	MSGT_ERR_SOCK_RECV_TOUT,
+	MSGT_ERR_ENGINE_NEW,
+	MSGT_ERR_ENGINE_EVENT,
+	MSGT_ERR_ENGINE_WAIT,
 	MSGT_ERR_HTTP_SEND_REQ,
 	MSGT_ERR_HTTP_RECV_RESP,
+	MSGT_ERR_HTTP_PIPELINE_RESP,
 	MSGT_ERR_HTTP_STATUS,
 	MSGT_ERR_HTTP_STATUS_STR,
 	MSGT_ERR_HTTP_FMT_AUTH,
@@ -172,25 +242,38 @@ typedef enum {
 	MSGT_ERR_QUERY_RESP_ARG_BAD_ESC,
 	MSGT_ERR_QUERY_PRINT,
 	MSGT_ERR_BAD_CMD,
+	MSGT_ERR_BATCH_OPEN,
+	MSGT_ERR_DEVICES_OPEN,
+	MSGT_ERR_DEVICES_FMT,
 	MSGT_WARN_CACHE_READ,
 	MSGT_WARN_CACHE_FMT,
 	MSGT_WARN_CACHE_UNESC,
 	MSGT_WARN_CACHE_NO_MEM,
 	MSGT_WARN_CACHE_WRITE,
+	MSGT_WARN_CACHE_INDEX,
+	MSGT_WARN_SESSION_FMT,
+	MSGT_WARN_SESSION_NO_MEM,
+	MSGT_WARN_SESSION_WRITE,
 	MSGT_WARN_OPT_LOW_TIMEOUT,
 	MSGT_WARN_LIST_NO_MEM,
 	MSGT_WARN_CMD_BAD_ESC,
 	MSGT_INFO_SIGTERM,
 	MSGU_INFO_DEV_DESC_REQ,
 	MSGT_INFO_DEV_DESC_DUR,
+	MSGT_INFO_DEV_DESC_SAME,
+	MSGT_INFO_DEV_DESC_SHARED,
 	MSGU_INFO_SRVC_DESC_REQ,
 	MSGT_INFO_SRVC_DESC_DUR,
+	MSGU_INFO_SRVC_DESC_SAME,
 	MSGT_INFO_SOCK_BOUND_SSDP,
 	MSGU_INFO_SOCK_JOINED_MC_GROUP,
 	MSGT_INFO_SSDP_SENT,
 	MSGT_INFO_SSDP_RECV,
 	MSGT_DBG_SOCK_RECV,
+	MSGT_DBG_SOCK_RETRY,
+	MSGT_DBG_SOCK_PIPELINE,
 	MSGT_DBG_BAD_TOKEN,
+	MSGT_DBG_BAD_TOKEN_AT,
 	MSGU_DBG_SELECTED_QUERY,
 	MSGT_DBG_PARSE_QUERY_RESP,
 	MSGT_DBG_OUT_QUERY_RESP,
@@ -198,7 +281,10 @@ typedef enum {
 	MSGT_DBG_ENTER_REQUEST,
 	MSGT_DBG_ENTER_RESET,
 	MSGT_DBG_ENTER_PRINTADDRESS,
+	MSGT_DBG_ENTER_REQUESTPARALLEL,
+	MSGT_DBG_ENTER_REQUESTPIPELINED,
 	MSGT_DBG_ENTER_NEWTR64REQUEST,
+	MSGT_DBG_ENTER_CLONETR64REQUEST,
 	MSGT_DBG_ENTER_FREETR64REQUEST,
 	MSG_COUNT
 } tMessage;
@@ -222,6 +308,52 @@ typedef enum {
 	JT_STRING
 } tJsonType;
 
+
+typedef enum {
+	OE_TEXT,
+	OE_CSV,
+	OE_JSON,
+	OE_XML
+} tOutEscape;
+
+
+typedef enum {
+	TAD_NONE,
+	TAD_IN,
+	TAD_OUT
+} tTrArgDir;
+
+
+typedef enum {
+	TAT_UNKNOWN, /* handled as string */
+	TAT_BIN_BASE64,
+	TAT_BIN_HEX,
+	TAT_BOOLEAN,
+	TAT_CHAR,
+	TAT_DATE,
+	TAT_DATE_TIME,
+	TAT_DATE_TIME_TZ,
+	TAT_FIXED_14_4,
+	TAT_FLOAT,
+	TAT_I1,
+	TAT_I2,
+	TAT_I4,
+	TAT_I8,
+	TAT_INT,
+	TAT_NUMBER,
+	TAT_R4,
+	TAT_R8,
+	TAT_STRING,
+	TAT_TIME,
+	TAT_TIME_TZ,
+	TAT_UI1,
+	TAT_UI2,
+	TAT_UI4,
+	TAT_UI8,
+	TAT_URI,
+	TAT_UUID
+} tTrArgType;
+
 typedef enum {
 	HAF_NONE      = 0x0000,
 	HAF_CRED      = 0x0001,
@@ -246,11 +378,20 @@ typedef struct {
 } tHttpStatusMsg;
 
 
+typedef struct {
+	const char * name;
+	tTrArgType type;
+} tTrArgTypeName;
+
+
 typedef struct {
 	char * url;
 	char * user;
 	char * pass;
 	TCHAR * cache;
+	TCHAR * cacheDir;
+	TCHAR * batch;
+	TCHAR * devices;
 	char * device;
 	char * service;
 	char * action;
@@ -260,6 +401,8 @@ typedef struct {
 	int narrow;
 #endif /* UNICODE */
 	size_t timeout;
+	size_t jobs;
+	int revalidate;
 	int verbose;
 	tFormat format;
 	tMode mode;
@@ -278,11 +421,15 @@ typedef struct {
 
 typedef struct sIpAddress tIpAddress; /* internal, back-end specific */
 typedef struct sNetHandle tNetHandle; /* internal, back-end specific */
+typedef struct sEngine tTr64Engine; /* internal, back-end specific */
 
 
 typedef struct {
 	tPToken content;
 	size_t status;
+	int chunked; /* set if the body is chunked encoded */
+	tPToken etag; /* ETag field value */
+	tPToken modified; /* Last-Modified field value */
 	struct {
 		tPToken realm;
 		tPToken nonce;
@@ -292,6 +439,18 @@ typedef struct {
 } tTr64Response;
 
 
+/**
+ * HTTP request given as list of fragments which are sent without concatenating them first. The
+ * referenced data needs to remain valid until the request completed.
+ */
+typedef struct {
+	tPToken * item; /**< request fragments in sending order */
+	size_t capacity; /**< total capacity of item in number of elements */
+	size_t length; /**< number of elements in item */
+	size_t size; /**< request size in bytes (sum of all fragment lengths) */
+} tTr64Fragments;
+
+
 typedef struct tTr64RequestCtx {
 	char * protocol; /**< allocated protocol string (e.g. HTTP) */
 	char * user; /**< allocated user name */
@@ -304,9 +463,17 @@ typedef struct tTr64RequestCtx {
 	size_t timeout; /**< network timeout in milliseconds */
 	size_t duration; /**< measured time span the requested option took in milliseconds */
 	size_t status; /**< HTTP response status */
+	tPToken etag; /**< ETag field of the last response within buffer or empty */
+	tPToken modified; /**< Last-Modified field of the last response within buffer or empty */
 	size_t cnonce; /**< HTTP authentication client nonce (internal) */
 	size_t nc; /**< HTTP authentication nonce count (internal) */
 	char * auth; /**< HTTP authentication response (internal) */
+	char * realm; /**< HTTP authentication realm of the last challenge (internal) */
+	char * nonce; /**< HTTP authentication nonce of the last challenge (internal) */
+	char * opaque; /**< HTTP authentication opaque value of the last challenge or NULL (internal) */
+	tHttpAuthFlag authFlags; /**< HTTP authentication flags of the last challenge (internal) */
+	int preAuth; /**< set if auth was built preemptively from the last challenge (internal) */
+	char ha1[33]; /**< HTTP authentication digest of user, realm and password (internal) */
 	int discoveryCount; /**< SSDP response count */
 	int (* discover)(struct tTr64RequestCtx *, const char *, int (*)(const char *, const size_t, void *), void *); /**< perform a simple service discovery */
 	tIpAddress * address; /**< resolved host IP/port addresses */
@@ -316,6 +483,9 @@ typedef struct tTr64RequestCtx {
 	int (* request)(struct tTr64RequestCtx *); /**< HTTP request handler (also used for HTTPS if supported) */
 	int (* reset)(struct tTr64RequestCtx *); /**< resets all network handles */
 	char * content; /**< pointer to the HTTP payload in buffer */
+	int (* receive)(struct tTr64RequestCtx *, const char *, const size_t, void *); /**< receives the body of a successful response in parts instead of buffer if set (0 to abort) */
+	void * receiveParam; /**< user defined parameter passed to receive */
+	tTr64Fragments fragments; /**< request to send instead of buffer if not empty (cleared once completed) */
 	char * buffer; /**< for input and output */
 	size_t capacity; /**< total capacity of buffer */
 	size_t length; /**< currently used space of buffer */
@@ -324,19 +494,58 @@ typedef struct tTr64RequestCtx {
 
 
 typedef struct {
-	char * name; /**< argument name */
-	char * var; /**< variable name */
-	char * value; /**< argument value used for queries */
-	char * type; /**< argument type */
-	char * dir; /**< argument direction (in/out) */
+	char * name; /**< argument name (interned) */
+	char * var; /**< variable name (interned) */
+	char * type; /**< argument type name (interned) */
+	tTrArgType dataType; /**< argument type decoded from type */
+	tTrArgDir dir; /**< argument direction */
 } tTrArgument;
 
 
+/**
+ * Hash set of interned strings. Equal strings are stored only once and share the same pointer.
+ * The hash table and strings are allocated from the arena of the owner.
+ */
+typedef struct {
+	char ** item; /**< hash table with open addressing (NULL for unused slots) */
+	size_t capacity; /**< total capacity of item in number of elements (power of two) */
+	size_t length; /**< number of used slots in item */
+} tTrStringTable;
+
+
+typedef struct {
+	tTrArgument * arg; /**< input argument */
+	const char * open; /**< opening element tag */
+	size_t openLen; /**< length of open in bytes */
+	const char * close; /**< closing element tag including line-feed */
+	size_t closeLen; /**< length of close in bytes */
+} tTrRequestArg;
+
+
+/**
+ * Pre-serialized request fragments of a single action. The request is built by splicing these
+ * with the host, authorization field, content length and argument values.
+ */
+typedef struct {
+	const char * request; /**< request line up to the host value */
+	size_t requestLen; /**< length of request in bytes */
+	const char * soap; /**< SOAPAction and Content-Type fields up to the content length value */
+	size_t soapLen; /**< length of soap in bytes */
+	const char * bodyHead; /**< SOAP envelope up to the first argument */
+	size_t bodyHeadLen; /**< length of bodyHead in bytes */
+	const char * bodyTail; /**< SOAP envelope after the last argument */
+	size_t bodyTailLen; /**< length of bodyTail in bytes */
+	tTrRequestArg * arg; /**< input argument array */
+	size_t argCount; /**< number of elements in arg */
+} tTrRequestTemplate;
+
+
 typedef struct {
 	char * name; /**< action name */
 	tTrArgument * arg; /**< argument array */
 	size_t capacity; /**< total capacity of arg in number of elements */
 	size_t length; /**< number of elements in arg */
+	tTrRequestTemplate * request; /**< lazily built request template or NULL */
 } tTrAction;
 
 
@@ -348,6 +557,11 @@ typedef struct {
 	tTrAction * action; /**< actions array */
 	size_t capacity; /**< total capacity of action in number of elements */
 	size_t length; /**< number of elements in action */
+	int pending; /**< set if the service description has not been fetched yet */
+	int stale; /**< set if the service description needs to be revalidated before use */
+	char * hash; /**< MD5 of the service description as hex string or NULL */
+	char * etag; /**< ETag of the service description or NULL */
+	char * modified; /**< Last-Modified date of the service description or NULL */
 } tTrService;
 
 
@@ -359,15 +573,115 @@ typedef struct {
 } tTrDevice;
 
 
+typedef struct {
+	const char * name; /**< action name (sort key) */
+	const tTrDevice * device; /**< device of the action */
+	const tTrService * service; /**< service of the action */
+	tTrAction * action; /**< referenced action */
+} tTrActionRef;
+
+
+/**
+ * XML escaped argument value. Output argument values point into the received response and are
+ * only valid until the next request of the context.
+ */
+typedef struct {
+	tPToken token; /**< value (start is NULL if not set) */
+	int entities; /**< 1 if token contains XML entities, else 0 */
+} tTrArgValue;
+
+
+/**
+ * Argument values of a single query. These are kept apart from the description to leave the
+ * description read-only during queries. This allows sharing it between multiple queries.
+ */
+typedef struct {
+	const tTrAction * action; /**< action the values belong to or NULL */
+	tTrArgValue * value; /**< argument values in the order of action->arg */
+	tArena arena; /**< allocator for value and the input argument strings (reset per query) */
+} tTrQueryValues;
+
+
 typedef struct {
 	char * name; /**< root device name */
 	char * url; /**< URL to the object */
+	char * hash; /**< MD5 of the device description as hex string or NULL */
+	char * etag; /**< ETag of the device description or NULL */
+	char * modified; /**< Last-Modified date of the device description or NULL */
 	tTrDevice * device; /**< device array */
 	size_t capacity; /**< total capacity of device in number of elements */
 	size_t length; /**< number of elements in device */
+	const char * cache; /**< mapped binary cache file the strings point into or NULL */
+	size_t cacheSize; /**< size of the mapped binary cache file in bytes */
+	const TCHAR * cacheFile; /**< cache file to merge fetched service descriptions into or NULL */
+	tArena arena; /**< allocator for all element arrays and strings */
+	tTrStringTable strings; /**< interned argument strings allocated from arena */
+	tTrActionRef * index; /**< all actions sorted by name for query lookup or NULL if not built */
+	size_t indexLength; /**< number of elements in index */
 } tTrObject;
 
 
+/**
+ * Binary cache file header. All offsets and sizes are given in bytes. The header is followed by
+ * the device, service, action and argument record arrays and the string table in this order.
+ * String fields are offsets to null-terminated strings within the string table. Child record
+ * ranges are given as first index and count within the corresponding record array. Missing
+ * optional strings are stored as empty strings.
+ */
+typedef struct {
+	char magic[8]; /**< CACHE_MAGIC */
+	uint32_t version; /**< CACHE_VERSION */
+	uint32_t byteOrder; /**< CACHE_BYTE_ORDER */
+	uint32_t size; /**< total file size */
+	uint32_t name; /**< root device name */
+	uint32_t url; /**< URL to the object */
+	uint32_t hash; /**< MD5 of the device description */
+	uint32_t etag; /**< ETag of the device description */
+	uint32_t modified; /**< Last-Modified date of the device description */
+	uint32_t devices; /**< number of device records */
+	uint32_t services; /**< number of service records */
+	uint32_t actions; /**< number of action records */
+	uint32_t args; /**< number of argument records */
+	uint32_t strings; /**< string table size */
+} tTrCacheHeader;
+
+
+typedef struct {
+	uint32_t name;
+	uint32_t service;
+	uint32_t serviceCount;
+} tTrCacheDevice;
+
+
+typedef struct {
+	uint32_t name;
+	uint32_t type;
+	uint32_t path;
+	uint32_t control;
+	uint32_t action;
+	uint32_t actionCount;
+	uint32_t flags;
+	uint32_t hash;
+	uint32_t etag;
+	uint32_t modified;
+} tTrCacheService;
+
+
+typedef struct {
+	uint32_t name;
+	uint32_t arg;
+	uint32_t argCount;
+} tTrCacheAction;
+
+
+typedef struct {
+	uint32_t name;
+	uint32_t var;
+	uint32_t type;
+	uint32_t dir;
+} tTrCacheArgument;
+
+
 typedef struct {
 	tTrObject * object;
 	tTrDevice * device;
@@ -375,53 +689,200 @@ typedef struct {
 	tTrAction * action;
 	tTrArgument * arg;
 	tPCacheState state;
+	int version; /**< set if the cache file has the expected format version (XML_CACHE_VERSION) */
 } tPTrObjectCacheCtx;
 
 
+/**
+ * Copy of an XML token which is needed after the token callback returned. The tokens of a document
+ * which is parsed while being received are only valid during the callback (see p_saxResume()).
+ */
 typedef struct {
-	tPToken xmlPath[MAX_XML_DEPTH];
+	char * buffer; /**< allocated token copy */
+	size_t capacity; /**< total capacity of buffer in bytes */
+} tTrTokenCopy;
+
+
+typedef struct {
+	tPToken xmlPath[MAX_XML_DEPTH]; /* points into xmlPathCopy */
+	tArena * arena;
 	tTrObject * object;
 	tTrDevice * device;
 	tTrService * service;
-	tPToken content;
+	tPToken content; /* points into contentCopy */
 	tMessage lastError; /* only MSGT_ values without arguments are allowed */
+	tTrTokenCopy xmlPathCopy[MAX_XML_DEPTH];
+	tTrTokenCopy contentCopy;
 } tPTrObjectDeviceCtx;
 
 
 typedef struct {
-	tPToken xmlPath[MAX_XML_DEPTH];
+	tPToken xmlPath[MAX_XML_DEPTH]; /* points into xmlPathCopy */
+	tArena * arena;
+	tTrStringTable * strings;
 	tTrService * service;
 	tTrAction * action;
 	tTrArgument * arg;
-	tPToken content;
-	tPToken stateVarName;
+	tPToken content; /* points into contentCopy */
+	tPToken stateVarName; /* points into stateVarNameCopy */
 	tMessage lastError; /* only MSGT_ values without arguments are allowed */
+	tTrTokenCopy xmlPathCopy[MAX_XML_DEPTH];
+	tTrTokenCopy contentCopy;
+	tTrTokenCopy stateVarNameCopy;
 } tPTrObjectServiceCtx;
 
 
+/**
+ * Description which is parsed and hashed while it is received (see startDescStream()).
+ */
+typedef struct {
+	tPSaxState sax; /**< resumable XML parser state */
+	tHMd5Ctx md5; /**< MD5 of the content received so far */
+	PSaxTokenVisitor visitor; /**< XML token visitor of the description */
+	union {
+		tPTrObjectDeviceCtx device; /**< device description visitor context */
+		tPTrObjectServiceCtx service; /**< service description visitor context */
+	} parse; /**< XML token visitor context */
+	tPSaxReturnType result; /**< parser result of the content received so far */
+	size_t errorOffset; /**< content offset of the parser error */
+	size_t received; /**< number of content bytes received so far (limited to MAX_DESC_SIZE) */
+} tTrDescStream;
+
+
 typedef struct {
 	tPToken xmlPath[MAX_XML_DEPTH];
 	tPToken soapNs;
 	tPToken userNs;
+	tTrQueryValues * values;
 	const tTrService * service;
-	tTrAction * action;
+	const tTrAction * action;
 	tPToken content;
 	size_t depth;
 	tMessage lastError; /* only MSGT_ values without arguments are allowed */
 } tPTrQueryRespCtx;
 
 
+typedef struct {
+	char hash[33]; /**< MD5 of the service description as hex string */
+	tTrAction * action; /**< shared actions parsed from the service description */
+	size_t length; /**< number of elements in action */
+} tTrServiceDescEntry;
+
+
+typedef struct {
+	char hash[33]; /**< MD5 of the device description as hex string */
+	char * name; /**< root device name */
+	tTrDevice * device; /**< shared device array referencing the actions of tTrServiceDescEntry */
+	size_t length; /**< number of elements in device */
+} tTrDeviceDescEntry;
+
+
+/**
+ * Registry of parsed descriptions which are shared by all devices with byte-identical
+ * descriptions. Entries are immutable once added. Each device works on its own copy of the action
+ * array as the request templates depend on the service. Argument and string data is shared.
+ */
+typedef struct {
+	tArena arena; /**< allocator for all entries and shared descriptions */
+	tTrStringTable strings; /**< interned argument strings allocated from arena */
+	tTrDeviceDescEntry * device; /**< device description entries */
+	size_t deviceCapacity; /**< total capacity of device in number of elements */
+	size_t deviceLength; /**< number of elements in device */
+	tTrServiceDescEntry * service; /**< service description entries */
+	size_t serviceCapacity; /**< total capacity of service in number of elements */
+	size_t serviceLength; /**< number of elements in service */
+} tTrDescRegistry;
+
+
+typedef struct {
+	const char * request; /**< HTTP request format string */
+	tTrObject * object; /**< add service descriptions to this object */
+	tTrDescRegistry * registry; /**< share parsed service descriptions via this registry or NULL */
+	const tOptions * filter; /**< only request services matching device and service of these options or NULL for all */
+	tTr64RequestCtx ** ctxs; /**< parallel request contexts */
+	tTrService ** pending; /**< requested service per context */
+	tTrDescStream * stream; /**< service description parsed while being received per context */
+	size_t count; /**< number of elements in ctxs, pending and stream */
+	size_t device; /**< device index of the next service to request */
+	size_t service; /**< service index of the next service to request */
+} tTrObjectFetchCtx;
+
+
 typedef struct tTrQueryHandler {
 	tTr64RequestCtx * ctx;
 	tTrObject * obj;
+	tTrQueryValues values; /**< argument values of the current query */
 	int (* query)(struct tTrQueryHandler *, const tOptions *, int);
 	int (* output)(FILE *, struct tTrQueryHandler *, const tTrAction *);
+	const char * name; /**< query line for the batch output (JSON escaped) */
+	const char * device; /**< device URL for the batch output (JSON escaped) or NULL */
 	char * buffer; /**< for requests */
 	size_t capacity; /**< total capacity of buffer */
 	size_t length; /**< currently used space of buffer */
 } tTrQueryHandler;
 
 
+typedef struct {
+	tTrQueryHandler * qry; /**< query handler with the prepared request body and argument values */
+	const tTrService * service; /**< service of the prepared action */
+	tTrAction * action; /**< prepared action */
+	char * name; /**< query line (JSON escaped) */
+} tTrBatchQuery;
+
+
+/**
+ * Batch queries which are sent together over a single connection.
+ */
+typedef struct {
+	tTrBatchQuery * query; /**< queries in the order of the batch file */
+	size_t depth; /**< maximum number of queries sent together (number of elements in query) */
+	size_t count; /**< number of queries prepared */
+	size_t * end; /**< end offset of each queued request within the request fragments (depth elements) */
+	size_t next; /**< index of the next query to output */
+	int error; /**< set if the output failed */
+} tTrBatchCtx;
+
+
+typedef enum {
+	PS_DEVICE_DESC = 0,
+	PS_SERVICE_DESC,
+	PS_QUERY,
+	PS_DONE
+} tTrPollState;
+
+
+typedef struct {
+	tOptions opt; /**< arguments of the line */
+	char * name; /**< line content (JSON escaped) */
+} tTrPollLine;
+
+
+typedef struct {
+	const tOptions * opt; /**< global options */
+	tTr64Engine * engine; /**< engine processing all device requests */
+	tTrPollLine * query; /**< queries to perform on each device */
+	size_t queryCount; /**< number of elements in query */
+	tTrDescRegistry registry; /**< descriptions shared between devices */
+} tTrPollCtx;
+
+
+typedef struct {
+	tTrPollCtx * poll; /**< shared poll context */
+	const tTrPollLine * target; /**< device URL, user and password */
+	char * device; /**< device URL (JSON escaped) */
+	tTr64RequestCtx * ctx; /**< request context of the device */
+	tTrObject * obj; /**< device description */
+	TCHAR * cache; /**< cache file of the device within the cache directory or NULL */
+	tTrQueryHandler * qry; /**< query handler of the device */
+	tTrObjectFetchCtx fetch; /**< service description fetch context */
+	tTrService * pending; /**< requested service description */
+	const tTrService * service; /**< service of the current query */
+	tTrAction * action; /**< action of the current query */
+	size_t query; /**< index of the current query */
+	tTrPollState state; /**< processing state */
+} tTrPollDevice;
+
+
 extern volatile int signalReceived;
 extern FILE * fin;
 extern FILE * fout;
@@ -444,6 +905,8 @@ int arrayInit(void ** array, size_t * capacity, size_t * length, const size_t it
 #define arrayFieldInit(obj, field, size) arrayInit((void **)(&((obj)->field)), &((obj)->capacity), &((obj)->length), sizeof(*((obj)->field)), size)
 int arrayResize(void ** array, size_t * capacity, const size_t itemSize, const size_t size);
 #define arrayFieldResize(obj, field, size) arrayResize((void **)(&((obj)->field)), &((obj)->capacity), sizeof(*((obj)->field)), size)
+int arrayResizeArena(tArena * arena, void ** array, size_t * capacity, const size_t itemSize, const size_t size);
+#define arrayFieldResizeArena(arena, obj, field, size) arrayResizeArena((arena), (void **)(&((obj)->field)), &((obj)->capacity), sizeof(*((obj)->field)), size)
 char * strndupInternal(const char * str, const size_t n);
 int strnicmpInternal(const char * lhs, const char * rhs, const size_t n);
 int cmpHttpStatusMsg(const tHttpStatusMsg * item, const size_t * value);
@@ -452,13 +915,17 @@ int fputUtf8N(FILE * fd, const char * str, const size_t len);
 int parseActionPath(tOptions * opt, int argIndex);
 int urlVisitor(const tPUrlTokenType type, const tPToken * token, void * param);
 int httpResponseVisitor(const tPHttpTokenType type, const tPToken * tokens, void * param);
+int httpReceiveVisitor(const tPHttpTokenType type, const tPToken * tokens, void * param);
+int resizeResponseBuffer(tTr64RequestCtx * ctx, tTr64Response * resp, const size_t size);
 int httpAuthentication(tTr64RequestCtx * ctx, const tTr64Response * resp);
+int httpAuthorization(tTr64RequestCtx * ctx);
 int formatToBuffer(char ** buffer, size_t * capacity, size_t * length, const char * fmt, ...);
 int formatToCtxBuffer(tTr64RequestCtx * ctx, const char * fmt, ...);
 int formatToQryBuffer(tTrQueryHandler * ctx, const char * fmt, ...);
+TCHAR * getCacheEntryPath(const TCHAR * dir, const char * url);
 tTrObject * newTrObject(tTr64RequestCtx * ctx, const tOptions * opt);
-int setArgValue(tTrArgument * arg, const char * str);
-int setArgValueN(tTrArgument * arg, const char * str, const size_t len);
+int setArgValue(tTrQueryValues * values, const size_t index, const char * str);
+int setArgValueRef(tTrQueryValues * values, const size_t index, const char * str, const size_t len);
 void freeTrObject(tTrObject * obj);
 tTrQueryHandler * newTrQueryHandler(tTr64RequestCtx * ctx, tTrObject * obj, const tOptions * opt);
 void freeTrQueryHandler(tTrQueryHandler * qry);
@@ -469,16 +936,30 @@ int handleQuery(tOptions * opt);
 int handleScan(tOptions * opt);
 int handleList(tOptions * opt);
 int handleInteractive(tOptions * opt);
+int handleBatch(tOptions * opt);
+int handlePoll(tOptions * opt);
 
 
 /* I/O operations */
 int isFile(const TCHAR * src);
+int isDir(const TCHAR * src);
 char * readFileToString(const TCHAR * src, size_t * len);
+const char * mapFile(const TCHAR * src, size_t * len);
+void unmapFile(const char * ptr, const size_t len);
 int writeStringToFile(const TCHAR * dst, const char * str);
 int writeStringNToFile(const TCHAR * dst, const char * str, const size_t len);
+int writePrivateStringNToFile(const TCHAR * dst, const char * str, const size_t len);
+int appendStringNToFile(const TCHAR * dst, const char * str, const size_t len);
 int initBackend(void);
 void deinitBackend(void);
 tTr64RequestCtx * newTr64Request(const char * url, const char * user, const char * pass, const tFormat format, const size_t timeout, const int verbose);
+tTr64RequestCtx * cloneTr64Request(const tTr64RequestCtx * ctx);
+int requestParallel(tTr64RequestCtx ** ctxs, const size_t count, int (* visitor)(tTr64RequestCtx *, const int, void *), void * param);
+int requestPipelined(tTr64RequestCtx * ctx, const size_t count, const size_t * end, int (* visitor)(tTr64RequestCtx *, const int, void *), void * param);
+tTr64Engine * newTr64Engine(const int verbose);
+int submitTr64Request(tTr64Engine * engine, tTr64RequestCtx * ctx, int (* visitor)(tTr64RequestCtx *, const int, void *), void * param);
+int pollTr64Engine(tTr64Engine * engine, const size_t timeout, size_t * pending);
+void freeTr64Engine(tTr64Engine * engine);
 void freeTr64Request(tTr64RequestCtx * ctx);
 
 